@@ -27,6 +27,12 @@
 #include "gpio.h"
 #include "testmode.h"
 #include "program.h"
+#include "response_cache.h"
+#include "event_loop.h"
+#include "remote_station.h"
+#include "http_pool.h"
+#include "state_snapshot.h"
+#include "event_stream.h"
 #include "ArduinoJson.hpp"
 #include "psram_utils.h"
 #include "sunrise.h"
@@ -59,6 +65,9 @@
 #if defined(ESP8266)
 #include <lwip/dns.h>
 #endif
+#if defined(OSPI)
+#include <pthread.h>
+#endif
 #include "sensor_ble.h"
 #include "sensor_zigbee.h"
 #if defined(ESP32C5) && defined(OS_ENABLE_ZIGBEE)
@@ -270,6 +279,9 @@ const char iopt_json_names[] PROGMEM =
 	"fpd0\0" // IOPT_FLOW_PULSE_DIV_0
 	"fpd1\0" // IOPT_FLOW_PULSE_DIV_1
 	"wims\0" // IOPT_WIFI_MODEM_SLEEP: 0=off/full power, 1=modem sleep
+	"fbg0\0" // IOPT_FLOW_BUDGET_0
+	"fbg1\0" // IOPT_FLOW_BUDGET_1
+	"ibgt\0" // IOPT_CURRENT_BUDGET
 	;
 
 /** Option prompts (stored in PROGMEM to reduce RAM usage) */
@@ -358,7 +370,10 @@ const char iopt_prompts[] PROGMEM =
 	"Invert grp sch.?"
 	"Flow div low:   "
 	"Flow div high:  "
-	"WiFi modem sleep";
+	"WiFi modem sleep"
+	"Flow budget low:"
+	"Flow budget hi: "
+	"Current budget: ";
 
 // string options do not have prompts
 
@@ -446,7 +461,10 @@ const unsigned char iopt_max[] PROGMEM = {
 	1,               // IOPT_INVERT_GROUP_SCHEDULING
 	255,             // IOPT_FLOW_PULSE_DIV_0
 	255,             // IOPT_FLOW_PULSE_DIV_1
-	1                // IOPT_WIFI_MODEM_SLEEP
+	1,               // IOPT_WIFI_MODEM_SLEEP
+	255,             // IOPT_FLOW_BUDGET_0
+	255,             // IOPT_FLOW_BUDGET_1
+	255              // IOPT_CURRENT_BUDGET
 };
 
 /** Integer option values (stored in RAM) */
@@ -539,6 +557,9 @@ unsigned char OpenSprinkler::iopts[] = {
 	1,  // flow pulse divisor low byte (default divisor=1)
 	0,  // flow pulse divisor high byte
 	0,  // IOPT_WIFI_MODEM_SLEEP: 0=off/full power (default), 1=modem sleep
+	0,  // flow budget low byte (0 = no flow budget)
+	0,  // flow budget high byte
+	0,  // current budget (0 = no current budget)
 };
 
 /** String option values (stored in RAM) */
@@ -588,9 +609,7 @@ static const char months_str[] PROGMEM =
 
 #if !defined(ARDUINO)
 static inline uint32_t now() {
-    time_t rawtime;
-    time(&rawtime);
-	return (uint32_t)rawtime;
+	return (uint32_t)sim_clock_now();
 }
 #endif
 /** Calculate local time (UTC time plus time zone offset) */
@@ -1228,6 +1247,7 @@ void OpenSprinkler::reboot_dev(uint8_t cause) {
 #elif defined(OSPI) // RPI/LINUX network init functions
 
 #include "etherport.h"
+#include "web_thread.h"
 #include <sys/reboot.h>
 #include <stdlib.h>
 #include <sys/ioctl.h>
@@ -1237,6 +1257,7 @@ void OpenSprinkler::reboot_dev(uint8_t cause) {
 #include "sunrise.h"
 
 extern int override_http_port;
+extern int override_event_port;
 
 /** Initialize network with the given mac address and http port */
 unsigned char OpenSprinkler::start_network() {
@@ -1250,16 +1271,33 @@ unsigned char OpenSprinkler::start_network() {
 #else
 	port = 80;
 #endif
+#endif
+#if defined(OS_HTTP_THREAD)
+	// otf is served from the web thread, which must not use it while replaced.
+	// It also gets a buffer of its own: ether_buffer is per thread here.
+	bool web_thread_was_running = web_thread_running();
+	web_thread_stop();
+	static char otf_buffer[ETHER_BUFFER_SIZE];
+	char *hd_buffer = otf_buffer;
+#else
+	char *hd_buffer = ether_buffer;
 #endif
 	if(otc.en>0 && otc.token.length()>=DEFAULT_OTC_TOKEN_LENGTH) {
 		// Use TLS (wss) when the OTC port is 443; plain ws otherwise (e.g. port 80).
-		otf = new OTF::OpenThingsFramework(port, otc.server.c_str(), otc.port, otc.token.c_str(), otc.port == 443, ether_buffer, ETHER_BUFFER_SIZE);
+		otf = new OTF::OpenThingsFramework(port, otc.server.c_str(), otc.port, otc.token.c_str(), otc.port == 443, hd_buffer, ETHER_BUFFER_SIZE);
 		DEBUG_PRINT(F("Started OTF with remote connection. Local port is: "));
 	} else {
-		otf = new OTF::OpenThingsFramework(port, ether_buffer, ETHER_BUFFER_SIZE);
+		otf = new OTF::OpenThingsFramework(port, hd_buffer, ETHER_BUFFER_SIZE);
 		DEBUG_PRINT(F("Started OTF with just local connection. Local port is: "));
 	}
 	DEBUG_PRINTLN(port);
+	int listen_fd = event_loop_find_listen_fd((uint16_t)port);
+	if (listen_fd < 0) DEBUG_PRINTLN(F("event loop: web server socket not found"));
+	event_loop_set_listen(listen_fd);
+#if defined(OS_HTTP_THREAD)
+	if (web_thread_was_running) web_thread_start();
+#endif
+	event_stream_start(override_event_port >= 0 ? (uint16_t)override_event_port : (uint16_t)(port + 1));
 
 	return 1;
 }
@@ -2061,7 +2099,28 @@ void OpenSprinkler::latch_apply_all_station_bits() {
 /** Apply all station bits
  * !!! This will activate/deactivate valves !!!
  */
+// Station outputs as last pushed to the driver hardware. Only boards whose
+// byte differs from this image are rewritten. Everything is rewritten after
+// expander detection and every OUTPUT_REFRESH_MS, so a driver chip reset by a
+// brown-out is restored as it was when each call rewrote all boards.
+#define OUTPUT_REFRESH_MS  60000UL
+static unsigned char applied_bits[MAX_NUM_BOARDS];
+static bool applied_valid = false;
+static ulong applied_refresh = 0;
+
+static bool output_refresh_due() {
+	ulong t = millis();
+	if (!applied_valid || (long)(t - applied_refresh) >= 0) {
+		applied_valid = true;
+		applied_refresh = t + OUTPUT_REFRESH_MS;
+		return true;
+	}
+	return false;
+}
+
 void OpenSprinkler::apply_all_station_bits(void (*post_activation_callback)()) {
+	bool full_refresh = output_refresh_due();
+	state_snapshot_touch();
 
 #if defined(ESP8266) || defined(ESP32)
 	if(hw_type==HW_TYPE_LATCH) {
@@ -2081,7 +2140,9 @@ void OpenSprinkler::apply_all_station_bits(void (*post_activation_callback)()) {
 		}
 
 		// Handle driver board (on main controller)
-		if(drio->type==IOEXP_TYPE_9555) {
+		if(!full_refresh && station_bits[0]==applied_bits[0]) {
+			// unchanged, skip the register read-modify-write
+		} else if(drio->type==IOEXP_TYPE_9555) {
 			/* revision >= 1 uses PCA9555 with active high logic */
 			uint16_t reg = drio->i2c_read(NXP_OUTPUT_REG);  // read current output reg value
 			reg = (reg&0xFF00) | station_bits[0]; // output channels are the low 8-bit
@@ -2093,6 +2154,7 @@ void OpenSprinkler::apply_all_station_bits(void (*post_activation_callback)()) {
 
 		// Handle expansion boards
 		for(int i=0;i<MAX_EXT_BOARDS/2;i++) {
+			if(!full_refresh && station_bits[i*2+1]==applied_bits[i*2+1] && station_bits[i*2+2]==applied_bits[i*2+2]) continue;
 			uint16_t data = station_bits[i*2+2];
 			data = (data<<8) + station_bits[i*2+1];
 			if(expanders[i]->type==IOEXP_TYPE_9555) {
@@ -2101,47 +2163,64 @@ void OpenSprinkler::apply_all_station_bits(void (*post_activation_callback)()) {
 				expanders[i]->i2c_write(NXP_OUTPUT_REG, ~data);
 			}
 		}
+		memcpy(applied_bits, station_bits, MAX_NUM_BOARDS);
 	}
 
 #else
-	digitalWrite(PIN_SR_LATCH, LOW);
-	unsigned char bid, s, sbits;
-
-	// Shift out all station bit values
-	// from the highest bit to the lowest
+	unsigned char bid;
+	// Shift register image, highest board first. The chain has to be shifted
+	// as a whole, so it is either skipped entirely or sent in full.
+	unsigned char sr_image[MAX_NUM_BOARDS];
 	for(bid=0;bid<=MAX_EXT_BOARDS;bid++) {
 		if (status.enabled) // TODO: checking enabled bit here is inconsistent with Arduino implementation
-			sbits = station_bits[MAX_EXT_BOARDS-bid];
+			sr_image[bid] = station_bits[MAX_EXT_BOARDS-bid];
 		else
-			sbits = 0;
+			sr_image[bid] = 0;
+	}
+	bool sr_changed = full_refresh || memcmp(sr_image, applied_bits, MAX_NUM_BOARDS);
+	#if defined(ARDUINO)
+	if(engage_booster) sr_changed = true;
+	#endif
+
+	if(sr_changed) {
+		digitalWrite(PIN_SR_LATCH, LOW);
 
-		for(s=0;s<8;s++) {
-			digitalWrite(PIN_SR_CLOCK, LOW);
+		// Shift out all station bit values
+		// from the highest bit to the lowest
 	#if defined(OSPI) // if OSPI, use dynamically assigned pin_sr_data
-			digitalWrite(pin_sr_data, (sbits & ((unsigned char)1<<(7-s))) ? HIGH : LOW );
+		gpio_shift_out(PIN_SR_CLOCK, pin_sr_data, sr_image, MAX_NUM_BOARDS);
 	#else
-			digitalWrite(PIN_SR_DATA, (sbits & ((unsigned char)1<<(7-s))) ? HIGH : LOW );
-	#endif
-			digitalWrite(PIN_SR_CLOCK, HIGH);
+		for(bid=0;bid<=MAX_EXT_BOARDS;bid++) {
+			unsigned char sbits = sr_image[bid];
+			for(unsigned char s=0;s<8;s++) {
+				digitalWrite(PIN_SR_CLOCK, LOW);
+				digitalWrite(PIN_SR_DATA, (sbits & ((unsigned char)1<<(7-s))) ? HIGH : LOW );
+				digitalWrite(PIN_SR_CLOCK, HIGH);
+			}
 		}
-	}
+	#endif
 
 	#if defined(ARDUINO)
-	if((hw_type==HW_TYPE_DC) && engage_booster) {
-		// for DC controller: boost voltage
-		digitalWrite(PIN_BOOST_EN, LOW);  // disable output path
-		digitalWrite(PIN_BOOST, HIGH);    // enable boost converter
-		delay((int)iopts[IOPT_BOOST_TIME]<<2);  // wait for booster to charge
-		digitalWrite(PIN_BOOST, LOW);  // disable boost converter
-
-		digitalWrite(PIN_BOOST_EN, HIGH);  // enable output path
-		digitalWrite(PIN_SR_LATCH, HIGH);
-		engage_booster = 0;
-	} else {
+		if((hw_type==HW_TYPE_DC) && engage_booster) {
+			// for DC controller: boost voltage
+			digitalWrite(PIN_BOOST_EN, LOW);  // disable output path
+			digitalWrite(PIN_BOOST, HIGH);    // enable boost converter
+			delay((int)iopts[IOPT_BOOST_TIME]<<2);  // wait for booster to charge
+			digitalWrite(PIN_BOOST, LOW);  // disable boost converter
+
+			digitalWrite(PIN_BOOST_EN, HIGH);  // enable output path
+			digitalWrite(PIN_SR_LATCH, HIGH);
+			engage_booster = 0;
+		} else {
+			digitalWrite(PIN_SR_LATCH, HIGH);
+		}
+	#else
 		digitalWrite(PIN_SR_LATCH, HIGH);
+	#endif
+		memcpy(applied_bits, sr_image, MAX_NUM_BOARDS);
 	}
-	#else
-	digitalWrite(PIN_SR_LATCH, HIGH);
+
+	#if !defined(ARDUINO)
 	// Automated tests simulation logging for GPIO zones
 	{
 		static bool last_zone_states[MAX_NUM_STATIONS] = {false};
@@ -2517,6 +2596,7 @@ void OpenSprinkler::get_station_name(unsigned char sid, char tmp[]) {
 
 /** Set station name */
 void OpenSprinkler::set_station_name(unsigned char sid, char tmp[]) {
+	cache_invalidate(CACHE_DOM_STATIONS);
 	tmp[STATION_NAME_SIZE]=0;
 	char n0[STATION_NAME_SIZE+1];
 	get_station_name(sid, n0);
@@ -2544,6 +2624,10 @@ uint16_t OpenSprinkler::get_flow_pulse_divisor() {
 	return div ? div : 1;
 }
 
+uint16_t OpenSprinkler::get_flow_budget() {
+	return (uint16_t)(((uint16_t)iopts[IOPT_FLOW_BUDGET_1] << 8) | iopts[IOPT_FLOW_BUDGET_0]);
+}
+
 float OpenSprinkler::get_flow_volume_per_pulse() {
 	return (float)get_flow_pulse_rate_100() / (100.0f * (float)get_flow_pulse_divisor());
 }
@@ -2553,6 +2637,7 @@ uint16_t OpenSprinkler::get_flow_alert_setpoint(unsigned char sid) {
 }
 
 void OpenSprinkler::set_flow_alert_setpoint(unsigned char sid, uint16_t value) {
+	if (value != attrib_fas[sid]) cache_invalidate(CACHE_DOM_STATIONS);
 	attrib_fas[sid] = value;
 }
 
@@ -2562,6 +2647,7 @@ uint16_t OpenSprinkler::get_flow_avg_value(unsigned char sid) {
 
 void OpenSprinkler::set_flow_avg_value(unsigned char sid, uint16_t value) {
 	if (value != attrib_favg[sid]) {
+		cache_invalidate(CACHE_DOM_STATIONS);
 		attrib_favg[sid] = value;
 		file_write_block(STATIONS3_FILENAME, &value, (uint16_t)sid * sizeof(uint16_t), sizeof(uint16_t));
 	}
@@ -2598,6 +2684,10 @@ int16_t OpenSprinkler::get_imin() {
 	return iopts[IOPT_I_MIN_THRESHOLD]*10;
 }
 
+int16_t OpenSprinkler::get_current_budget() {
+	return iopts[IOPT_CURRENT_BUDGET]*10;
+}
+
 int16_t OpenSprinkler::get_imax() {
 	unsigned char i = iopts[IOPT_I_MAX_LIMIT];
 	if(hw_type == HW_TYPE_DC) {
@@ -2635,6 +2725,7 @@ void OpenSprinkler::set_station_gid(unsigned char sid, unsigned char gid) {
 
 /** Save all station attribs to file (backward compatibility) */
 void OpenSprinkler::attribs_save() {
+	cache_invalidate(CACHE_DOM_STATIONS);
 	// re-package attribute bits and save
 	unsigned char bid, s, sid=0;
 	StationAttrib at, at0;
@@ -2707,13 +2798,71 @@ void OpenSprinkler::attribs_load() {
 	}
 }
 
+// In-RAM copy of the password hash, so verifying a request does not touch
+// flash. Loaded on first use and dropped whenever SOPT_PASSWORD is saved.
+#define PW_CACHE_SIZE     65    // fits a 64-char hex hash plus terminator
+#define PW_CACHE_EMPTY    0
+#define PW_CACHE_VALID    1
+#define PW_CACHE_TOO_LONG 2     // stored value does not fit, compare against the file
+static char pw_cache[PW_CACHE_SIZE];
+static unsigned char pw_cache_state = PW_CACHE_EMPTY;
+
+#if defined(OS_HTTP_THREAD)
+#include <pthread.h>
+// requests verify passwords on the web threads too, some without the state lock
+static pthread_mutex_t pw_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+struct PwCacheLock {
+	bool held;
+	PwCacheLock(bool on = true) : held(on) { if (held) pthread_mutex_lock(&pw_cache_mutex); }
+	~PwCacheLock() { if (held) pthread_mutex_unlock(&pw_cache_mutex); }
+};
+#else
+struct PwCacheLock {
+	PwCacheLock(bool on = true) { (void)on; }
+};
+#endif
+
+static void pw_cache_load() {
+	char pwtmp[MAX_SOPTS_SIZE + 1];
+	os.sopt_load(SOPT_PASSWORD, pwtmp, MAX_SOPTS_SIZE);
+	size_t len = strlen(pwtmp);
+	memset(pw_cache, 0, sizeof(pw_cache));
+	if (len < PW_CACHE_SIZE) {
+		memcpy(pw_cache, pwtmp, len);
+		pw_cache_state = PW_CACHE_VALID;
+	} else {
+		pw_cache_state = PW_CACHE_TOO_LONG;
+	}
+	memset(pwtmp, 0, sizeof(pwtmp));
+}
+
+/** Compare against the cached hash in constant time (independent of where the first mismatch is) */
+static unsigned char pw_cache_equal(const char *pw) {
+	unsigned char diff = 0, ended = 0;
+	for (size_t i = 0; i < PW_CACHE_SIZE; i++) {
+		unsigned char c = ended ? 0 : (unsigned char)pw[i];
+		ended |= (c == 0);
+		diff |= c ^ (unsigned char)pw_cache[i];
+	}
+	if (!ended) diff |= 1;  // input longer than any cached hash
+	return diff == 0;
+}
+
 /** verify if a string matches password */
 unsigned char OpenSprinkler::password_verify(const char *pw) {
-	unsigned char ok = (file_cmp_block(SOPTS_FILENAME, pw, SOPT_PASSWORD*MAX_SOPTS_SIZE)==0) ? 1 : 0;
+	if (!pw) return 0;
+	unsigned char ok;
+	{
+		PwCacheLock lock;
+		if (pw_cache_state == PW_CACHE_EMPTY) pw_cache_load();
+		if (pw_cache_state == PW_CACHE_VALID) {
+			ok = pw_cache_equal(pw);
+		} else {
+			ok = (file_cmp_block(SOPTS_FILENAME, pw, SOPT_PASSWORD*MAX_SOPTS_SIZE)==0) ? 1 : 0;
+		}
+	}
 	if (!ok) {
-		char pwtmp[MAX_SOPTS_SIZE + 1];
-		sopt_load(SOPT_PASSWORD, pwtmp, MAX_SOPTS_SIZE);
-		DEBUG_PRINTF("[PW] verify failed, slot0='%.*s'\n", 32, pwtmp);
+		DEBUG_PRINTLN(F("[PW] verify failed"));
 	}
 	return ok;
 }
@@ -2899,7 +3048,6 @@ static uint16_t clamp_http_timeout(uint16_t timeout) {
 
 #if defined(ESP32)
 static SemaphoreHandle_t s_http_request_mutex = nullptr;
-static WiFiClientSecure* s_http_tls_client = nullptr;
 
 static constexpr uint32_t HTTP_DNS_CACHE_TTL_MS = 5UL * 60UL * 1000UL;
 
@@ -2929,16 +3077,6 @@ static SemaphoreHandle_t get_http_request_mutex() {
 	return s_http_request_mutex;
 }
 
-static WiFiClientSecure* get_shared_tls_client() {
-	if (!s_http_tls_client) {
-		s_http_tls_client = new WiFiClientSecure();
-		if (s_http_tls_client) {
-			s_http_tls_client->setInsecure();
-		}
-	}
-	return s_http_tls_client;
-}
-
 static bool resolve_host_with_cache(const char* host, IPAddress& out_ip) {
 	if (!host || !host[0]) return false;
 
@@ -3006,9 +3144,187 @@ struct AsyncHttpRequestParams {
 	bool usessl;
 	uint16_t timeout;
 	bool expect_response;
+	uint8_t prio;       // HTTP_PRIO_*
+	uint32_t seq;       // submit order, FIFO within a priority
+	ulong deadline;     // millis() after which a still queued request is dropped
+	uint32_t station;   // HTTP station the command switches, 0: not a station command
+	bool turnoff;       // station off command: never expires or is refused
+	char* response;     // OSPi: reply captured by a worker, handed to the callback on the main loop
 };
 
-static AsyncHttpRequestParams* s_http_async_pending = nullptr;
+#if defined(ESP8266)
+#define HTTP_ASYNC_SLOTS    4
+#else
+#define HTTP_ASYNC_SLOTS    16
+#endif
+
+// How long a request may wait in the queue. A station command that could not
+// go out within this window is stale and must not toggle a valve late.
+// Off commands are exempt: a late off still closes the valve.
+static const ulong http_async_max_wait[] = {15000UL, 60000UL, 120000UL};
+
+static AsyncHttpRequestParams* s_http_async_queue[HTTP_ASYNC_SLOTS];
+static uint32_t s_http_async_seq = 0;
+
+#if defined(OSPI)
+#define HTTP_ASYNC_WORKERS  3
+// requests the workers are sending, so a host never sees two at once
+static AsyncHttpRequestParams* s_http_async_running[HTTP_ASYNC_WORKERS];
+#endif
+
+static void free_async_request(AsyncHttpRequestParams* req) {
+	if (!req) return;
+	if (req->request) free(req->request);
+	if (req->response) free(req->response);
+	free(req);
+}
+
+static bool async_same_host(const AsyncHttpRequestParams* a, const AsyncHttpRequestParams* b) {
+	return a->port == b->port && strcmp(a->server, b->server) == 0;
+}
+
+// Requests to one host run in submit order, one at a time, so an on and the
+// off that follows it reach the device in that order
+static bool async_host_ready(const AsyncHttpRequestParams* req) {
+	for (int i = 0; i < HTTP_ASYNC_SLOTS; i++) {
+		AsyncHttpRequestParams* q = s_http_async_queue[i];
+		if (q && q != req && async_same_host(q, req) && (int32_t)(q->seq - req->seq) < 0) return false;
+	}
+#if defined(OSPI)
+	for (int i = 0; i < HTTP_ASYNC_WORKERS; i++) {
+		if (s_http_async_running[i] && async_same_host(s_http_async_running[i], req)) return false;
+	}
+#endif
+	return true;
+}
+
+// Index of the next request to run: highest priority first, then oldest,
+// among the requests whose host is free. Expired entries are dropped first.
+static int async_queue_next() {
+	int best = -1;
+	ulong now = millis();
+	for (int i = 0; i < HTTP_ASYNC_SLOTS; i++) {
+		AsyncHttpRequestParams* req = s_http_async_queue[i];
+		if (req && !req->turnoff && (long)(now - req->deadline) > 0) {
+			DEBUG_PRINT(F("async http expired: "));
+			DEBUG_PRINTLN(req->server);
+			free_async_request(req);
+			s_http_async_queue[i] = nullptr;
+		}
+	}
+	for (int i = 0; i < HTTP_ASYNC_SLOTS; i++) {
+		AsyncHttpRequestParams* req = s_http_async_queue[i];
+		if (!req || !async_host_ready(req)) continue;
+		if (best < 0 || req->prio < s_http_async_queue[best]->prio ||
+			(req->prio == s_http_async_queue[best]->prio && (int32_t)(req->seq - s_http_async_queue[best]->seq) < 0)) {
+			best = i;
+		}
+	}
+	return best;
+}
+
+// Free slot for a new request of the given priority. When full, the newest
+// request of the lowest priority below it is evicted. An off command may
+// evict any request except another off command.
+static int async_queue_slot(uint8_t prio, bool turnoff) {
+	int victim = -1;
+	for (int i = 0; i < HTTP_ASYNC_SLOTS; i++) {
+		AsyncHttpRequestParams* req = s_http_async_queue[i];
+		if (!req) return i;
+		if (req->turnoff || (req->prio <= prio && !turnoff)) continue;
+		if (victim < 0 || req->prio > s_http_async_queue[victim]->prio ||
+			(req->prio == s_http_async_queue[victim]->prio && (int32_t)(req->seq - s_http_async_queue[victim]->seq) > 0)) {
+			victim = i;
+		}
+	}
+	if (victim >= 0) {
+		DEBUG_PRINT(F("async http evicted: "));
+		DEBUG_PRINTLN(s_http_async_queue[victim]->server);
+		free_async_request(s_http_async_queue[victim]);
+		s_http_async_queue[victim] = nullptr;
+	}
+	return victim;
+}
+
+// A newer command for a station replaces its queued one in place, keeping
+// the queue position. Returns false if none was queued.
+static bool async_queue_coalesce(AsyncHttpRequestParams* req) {
+	if (!req->station) return false;
+	for (int i = 0; i < HTTP_ASYNC_SLOTS; i++) {
+		AsyncHttpRequestParams* q = s_http_async_queue[i];
+		if (!q || q->station != req->station || !async_same_host(q, req)) continue;
+		req->seq = q->seq;
+		if (q->prio < req->prio) req->prio = q->prio;
+		free_async_request(q);
+		s_http_async_queue[i] = req;
+		return true;
+	}
+	return false;
+}
+
+#if defined(OSPI)
+// Requests run on a small pool of worker threads so a slow or unreachable
+// host no longer stalls the main loop. Callbacks touch firmware state, so
+// workers only capture the reply; the main loop invokes the callbacks.
+// send_http_request() reads each reply into a buffer of its own here, so the
+// workers share no response buffer with each other or the main loop.
+static pthread_mutex_t s_http_async_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_http_async_cond = PTHREAD_COND_INITIALIZER;   // a request may be ready
+static pthread_cond_t s_http_async_room = PTHREAD_COND_INITIALIZER;   // a queue slot was freed
+static AsyncHttpRequestParams* s_http_async_done[HTTP_ASYNC_SLOTS + HTTP_ASYNC_WORKERS];
+static bool s_http_async_started = false;
+static thread_local AsyncHttpRequestParams* tl_http_async_req = nullptr;
+
+static void async_capture_response(char* buf) {
+	if (tl_http_async_req && buf) tl_http_async_req->response = strdup(buf);
+}
+
+static void* async_http_worker(void* arg) {
+	const int w = (int)(intptr_t)arg;
+	for (;;) {
+		pthread_mutex_lock(&s_http_async_lock);
+		int i;
+		while ((i = async_queue_next()) < 0) pthread_cond_wait(&s_http_async_cond, &s_http_async_lock);
+		AsyncHttpRequestParams* req = s_http_async_queue[i];
+		s_http_async_queue[i] = nullptr;
+		s_http_async_running[w] = req;
+		pthread_cond_broadcast(&s_http_async_room);
+		pthread_mutex_unlock(&s_http_async_lock);
+
+		tl_http_async_req = req;
+		OpenSprinkler::send_http_request(req->server, req->port, req->request, req->callback ? async_capture_response : NULL, req->usessl, req->timeout, req->expect_response);
+		tl_http_async_req = nullptr;
+
+		pthread_mutex_lock(&s_http_async_lock);
+		s_http_async_running[w] = nullptr;
+		pthread_cond_broadcast(&s_http_async_cond);  // the host is free for its next request
+		if (!req->callback) {
+			pthread_mutex_unlock(&s_http_async_lock);
+			free_async_request(req);
+			continue;
+		}
+		size_t n = 0;
+		while (n < sizeof(s_http_async_done)/sizeof(s_http_async_done[0]) && s_http_async_done[n]) n++;
+		if (n < sizeof(s_http_async_done)/sizeof(s_http_async_done[0])) {
+			s_http_async_done[n] = req;
+			req = nullptr;
+		}
+		pthread_mutex_unlock(&s_http_async_lock);
+		free_async_request(req);  // only if the done list was full
+		event_loop_wakeup();
+	}
+	return NULL;
+}
+
+static void start_async_http_workers() {
+	if (s_http_async_started) return;
+	s_http_async_started = true;
+	for (int i = 0; i < HTTP_ASYNC_WORKERS; i++) {
+		pthread_t th;
+		if (pthread_create(&th, NULL, async_http_worker, (void*)(intptr_t)i) == 0) pthread_detach(th);
+	}
+}
+#endif
 #endif
 
 } // namespace
@@ -3028,7 +3344,6 @@ bool OpenSprinkler::resolve_host(const char* host, IPAddress& ip) {
 
 int8_t OpenSprinkler::send_http_request(const char* server, uint16_t port, char* p, void(*callback)(char*), bool usessl, uint16_t timeout, bool expect_response, uint16_t resp_buf_size) {
 	uint16_t effective_timeout = clamp_http_timeout(timeout);
-	bool shared_client = false;
 
 	if(server == NULL || server[0]==0 || port==0 ) { // sanity checking
 		DEBUG_PRINTLN(F("server:port is invalid!"));
@@ -3040,6 +3355,21 @@ int8_t OpenSprinkler::send_http_request(const char* server, uint16_t port, char*
 		return HTTP_RQT_CONNECT_ERR;
 	}
 	#endif
+	if (!http_pool_host_ready(server, port, usessl)) {
+		// host failed recently, don't block the loop on another connect timeout
+		#if defined(ESP32)
+		unlock_http_request();
+		#endif
+		return HTTP_RQT_CONNECT_ERR;
+	}
+
+	// Requests expecting a reply go out as HTTP/1.1 over a pooled connection
+	// when the caller didn't ask for Connection: close
+	bool keep_alive = expect_response && http_request_keepalive(p);
+	HttpPoolClient *pooled = keep_alive ? http_pool_take(server, port, usessl) : NULL;
+	bool reused = (pooled != NULL);
+	HttpFrame fr;
+	memset(&fr, 0, sizeof(fr));
 #if defined(ARDUINO)
 	#if defined(ESP8266)
 	const size_t ssl_tmp_memory_needed = 11000;
@@ -3048,9 +3378,9 @@ int8_t OpenSprinkler::send_http_request(const char* server, uint16_t port, char*
 	const size_t ssl_tmp_memory_needed = 10000;
 	#endif
 
-	Client *client = NULL;
+	Client *client = pooled;
 	#if defined(ESP8266)
-		if(usessl) {
+		if(!client && usessl) {
 			if (!free_tmp_memory(ssl_tmp_memory_needed)) {
 				// Not enough contiguous heap for BearSSL. Keep the freed memory
 				// (do NOT restore now — restoring re-inits sensors/MQTT/InfluxDB and
@@ -3072,21 +3402,24 @@ int8_t OpenSprinkler::send_http_request(const char* server, uint16_t port, char*
 				} else {
 					_c->setInsecure();
 					_c->setBufferSizes(2048, 512);
+					// resume the host's last TLS session instead of a full handshake
+					_c->setSession(http_pool_tls_session(server, port));
 					client = _c;
 				}
 			}
-		} else {
+		} else if(!client) {
 			client = new WiFiClient();
 		}
 	#elif defined(ESP32)
-		if(usessl) {
-			client = get_shared_tls_client();
-			shared_client = (client != NULL);
-		} else {
+		if(!client && usessl) {
+			WiFiClientSecure *_c = new WiFiClientSecure();
+			if (_c) _c->setInsecure();
+			client = _c;
+		} else if(!client) {
 			client = new WiFiClient();
 		}
 	#else
-		client = new EthernetClient();
+		if(!client) client = new EthernetClient();
 	#endif
 
 	if (!client) {
@@ -3103,7 +3436,7 @@ int8_t OpenSprinkler::send_http_request(const char* server, uint16_t port, char*
 	#if defined(ESP32)
 	client->setTimeout(effective_timeout);
 	#endif
-	do {
+	if(!reused) do {
 		DEBUG_PRINT(server);
 		DEBUG_PRINT(F(":"));
 		DEBUG_PRINT(port);
@@ -3120,7 +3453,7 @@ int8_t OpenSprinkler::send_http_request(const char* server, uint16_t port, char*
 				conn_result = client->connect(server, port);
 			}
 		} else {
-			// Keep hostname for TLS/SNI. Reused TLS object enables session resumption opportunities.
+			// Keep hostname for TLS/SNI
 			conn_result = client->connect(server, port);
 		}
 		if(conn_result == 1) break;
@@ -3154,8 +3487,9 @@ int8_t OpenSprinkler::send_http_request(const char* server, uint16_t port, char*
 
 	if(tries==HTTP_CONNECT_NTRIES) {
 		DEBUG_PRINTLN(F("failed."));
+		http_pool_host_result(server, port, usessl, false);
 		client->stop();
-		if (!shared_client) delete client;
+		delete client;
 		#if defined(ESP8266)
 		if (memory_freed_by_ssl) restore_tmp_memory(ssl_tmp_memory_needed);
 		#elif defined(ESP32)
@@ -3167,36 +3501,49 @@ int8_t OpenSprinkler::send_http_request(const char* server, uint16_t port, char*
 		return HTTP_RQT_CONNECT_ERR;
 	}
 #else
-	EthernetClient *client = NULL;
+	EthernetClient *client = pooled;
 
-	if (usessl) {
-		client = new EthernetClientSsl();
-	} else {
-		client = new EthernetClient();
-	}
+	if (!client) {
+		if (usessl) {
+			client = new EthernetClientSsl();
+		} else {
+			client = new EthernetClient();
+		}
 
-	DEBUG_PRINT(server);
-	DEBUG_PRINT(F(":"));
-	DEBUG_PRINTLN(port);
-	if(!client->connect(server, port)) {
-		DEBUG_PRINT(F("failed."));
-		client->stop();
-		delete client;
-		#if defined(ESP32)
-		unlock_http_request();
-		#endif
-		return HTTP_RQT_CONNECT_ERR;
+		DEBUG_PRINT(server);
+		DEBUG_PRINT(F(":"));
+		DEBUG_PRINTLN(port);
+		if(!client->connect(server, port)) {
+			DEBUG_PRINT(F("failed."));
+			http_pool_host_result(server, port, usessl, false);
+			client->stop();
+			delete client;
+			return HTTP_RQT_CONNECT_ERR;
+		}
 	}
 
 #endif
+	if (!reused) http_pool_host_result(server, port, usessl, true);
 
 	uint16_t len = strlen(p);
 	if(len > ETHER_BUFFER_SIZE) len = ETHER_BUFFER_SIZE;
+	bool sent = false;
 	if(client->connected()) {
-		client->write((uint8_t *)p, len);
+		sent = (client->write((uint8_t *)p, len) == len);
 	} else {
 		DEBUG_PRINTLN(F("client no longer connected"));
 	}
+	if(reused && !sent) {
+		// the server dropped the idle connection before the request went out,
+		// so it is safe to send it again on a fresh one
+		DEBUG_PRINTLN(F("stale keep-alive connection, reconnecting"));
+		client->stop();
+		delete client;
+		#if defined(ESP32)
+		unlock_http_request();
+		#endif
+		return send_http_request(server, port, p, callback, usessl, timeout, expect_response, resp_buf_size);
+	}
 
 	if (!expect_response) {
 		// Command-only request (remote/HTTP/OTC stations): we don't read a
@@ -3210,7 +3557,7 @@ int8_t OpenSprinkler::send_http_request(const char* server, uint16_t port, char*
 #endif
 		client->flush();
 		client->stop();
-		if (!shared_client) delete client;
+		delete client;
 		#if defined(ESP8266)
 		if (memory_freed_by_ssl) restore_tmp_memory(ssl_tmp_memory_needed);
 		#elif defined(ESP32)
@@ -3238,7 +3585,7 @@ int8_t OpenSprinkler::send_http_request(const char* server, uint16_t port, char*
 	if (!http_buffer) {
 		DEBUG_PRINTLN(F("failed to allocate http request buffer"));
 		client->stop();
-		if (!shared_client) delete client;
+		delete client;
 		#if defined(ESP8266)
 		if (memory_freed_by_ssl) restore_tmp_memory(ssl_tmp_memory_needed);
 		#elif defined(ESP32)
@@ -3269,6 +3616,9 @@ int8_t OpenSprinkler::send_http_request(const char* server, uint16_t port, char*
 			if(pos+nbytes>(int)resp_cap) nbytes=(int)resp_cap-pos; // cannot read more than buffer size
 			client->read((uint8_t*)http_buffer+pos, nbytes);
 			pos+=nbytes;
+			// a framed response is done without waiting for the server to close
+			http_frame_parse(http_buffer, pos, &fr);
+			if(fr.complete || pos>=(int)resp_cap) break;
 		} else {
 			// Yield while waiting for data: allows higher-priority FreeRTOS tasks (WiFi/TCP)
 			// to run and prevents starving the task watchdog on single-core ESP32 devices.
@@ -3294,13 +3644,34 @@ int8_t OpenSprinkler::send_http_request(const char* server, uint16_t port, char*
 		}
 	}
 #else
-	len = client->read((uint8_t *)http_buffer+pos, resp_cap);
-	pos += len;
+	while(pos < (int)resp_cap) {
+		int n = client->read((uint8_t *)http_buffer+pos, resp_cap-pos);
+		if(n <= 0) break;
+		pos += n;
+		http_frame_parse(http_buffer, pos, &fr);
+		if(fr.complete || millis()>stoptime) break;
+	}
 
 #endif
 	http_buffer[pos]=0; // properly end buffer with 0
-	client->stop();
-	if (!shared_client) delete client;
+	if(reused && pos==0 && http_request_idempotent(p)) {
+		// the pooled connection died under the request; a GET can go out again
+		DEBUG_PRINTLN(F("stale keep-alive connection, retrying"));
+		client->stop();
+		delete client;
+#if defined(ESP32) || defined(OSPI)
+		free(http_buffer);
+#endif
+		#if defined(ESP32)
+		unlock_http_request();
+		#endif
+		http_pool_drop(server, port, usessl);  // the retry must open a fresh connection
+		return send_http_request(server, port, p, callback, usessl, timeout, expect_response, resp_buf_size);
+	}
+	// Other requests are not repeated: the peer may already have acted on
+	// them (/cm). The unframed reply keeps the connection out of the pool.
+	if(fr.complete && fr.chunked) pos = http_dechunk(http_buffer, pos, fr.body);
+	http_pool_put(server, port, usessl, client, keep_alive && fr.complete && fr.keep_alive);
 	#if defined(ESP8266)
 	if (memory_freed_by_ssl) restore_tmp_memory(ssl_tmp_memory_needed);
 	#elif defined(ESP32)
@@ -3325,7 +3696,7 @@ int8_t OpenSprinkler::send_http_request(const char* server, uint16_t port, char*
 	return HTTP_RQT_SUCCESS;
 }
 
-int8_t OpenSprinkler::send_http_request_async(const char* server, uint16_t port, const char* p, void(*callback)(char*), bool usessl, uint16_t timeout, bool expect_response) {
+int8_t OpenSprinkler::send_http_request_async(const char* server, uint16_t port, const char* p, void(*callback)(char*), bool usessl, uint16_t timeout, bool expect_response, uint8_t prio, uint32_t station, bool turnoff) {
 	if(server == NULL || server[0]==0 || port==0 || p == NULL) {
 		DEBUG_PRINTLN(F("server:port is invalid for async request"));
 		return HTTP_RQT_CONNECT_ERR;
@@ -3352,7 +3723,8 @@ int8_t OpenSprinkler::send_http_request_async(const char* server, uint16_t port,
 	req->timeout = effective_timeout;
 	req->expect_response = expect_response;
 
-	BaseType_t task_ok = PSRAM_TASK_CREATE(send_http_request_async_task, "http_async", 8192, req, 1, NULL);
+	// station commands get ahead of telemetry when tasks wait for the request mutex
+	BaseType_t task_ok = PSRAM_TASK_CREATE(send_http_request_async_task, "http_async", 8192, req, (prio == HTTP_PRIO_HIGH) ? 2 : 1, NULL);
 	if (task_ok != pdPASS) {
 		free(req->request);
 		free(req);
@@ -3360,10 +3732,7 @@ int8_t OpenSprinkler::send_http_request_async(const char* server, uint16_t port,
 	}
 	return HTTP_RQT_SUCCESS;
 	#else
-	if (s_http_async_pending) {
-		DEBUG_PRINTLN(F("async http queue busy"));
-		return HTTP_RQT_CONNECT_ERR;
-	}
+	if (prio > HTTP_PRIO_LOW) prio = HTTP_PRIO_LOW;
 
 	AsyncHttpRequestParams* req = (AsyncHttpRequestParams*)calloc(1, sizeof(AsyncHttpRequestParams));
 	if (!req) return HTTP_RQT_CONNECT_ERR;
@@ -3382,8 +3751,50 @@ int8_t OpenSprinkler::send_http_request_async(const char* server, uint16_t port,
 	req->usessl = usessl;
 	req->timeout = effective_timeout;
 	req->expect_response = expect_response;
+	req->prio = prio;
+	req->deadline = millis() + http_async_max_wait[prio];
+	req->station = station;
+	req->turnoff = turnoff;
 
-	s_http_async_pending = req;
+	#if defined(OSPI)
+	start_async_http_workers();
+	pthread_mutex_lock(&s_http_async_lock);
+	#endif
+	int slot = -1;
+	if (async_queue_coalesce(req)) {
+		slot = 0;  // took the place of the station's queued command
+	} else {
+		slot = async_queue_slot(prio, turnoff);
+		// the queue holds only off commands: wait until one has gone out
+		#if defined(OSPI)
+		while (slot < 0 && turnoff) {
+			pthread_cond_wait(&s_http_async_room, &s_http_async_lock);
+			slot = async_queue_slot(prio, turnoff);
+		}
+		#else
+		// no workers here: send the oldest queued request now to make room
+		for (int tries = 0; slot < 0 && turnoff && tries < HTTP_ASYNC_SLOTS; tries++) {
+			process_async_http_requests();
+			slot = async_queue_slot(prio, turnoff);
+		}
+		#endif
+		if (slot >= 0) {
+			req->seq = s_http_async_seq++;
+			s_http_async_queue[slot] = req;
+		}
+	}
+	#if defined(OSPI)
+	if (slot >= 0) pthread_cond_broadcast(&s_http_async_cond);
+	pthread_mutex_unlock(&s_http_async_lock);
+	#endif
+	if (slot < 0) {
+		DEBUG_PRINTLN(F("async http queue full"));
+		free_async_request(req);
+		return HTTP_RQT_CONNECT_ERR;
+	}
+	#if !defined(OSPI)
+	event_loop_wakeup();
+	#endif
 	return HTTP_RQT_SUCCESS;
 	#endif
 }
@@ -3391,15 +3802,34 @@ int8_t OpenSprinkler::send_http_request_async(const char* server, uint16_t port,
 void OpenSprinkler::process_async_http_requests() {
 	#if defined(ESP32)
 	return;
+	#elif defined(OSPI)
+	// run the callbacks of requests the workers have finished
+	for (;;) {
+		pthread_mutex_lock(&s_http_async_lock);
+		AsyncHttpRequestParams* req = s_http_async_done[0];
+		if (req) {
+			size_t n = sizeof(s_http_async_done)/sizeof(s_http_async_done[0]);
+			memmove(s_http_async_done, s_http_async_done + 1, (n - 1) * sizeof(s_http_async_done[0]));
+			s_http_async_done[n - 1] = nullptr;
+		}
+		pthread_mutex_unlock(&s_http_async_lock);
+		if (!req) break;
+		if (req->response && req->response[0]) req->callback(req->response);
+		free_async_request(req);
+	}
 	#else
-	if (!s_http_async_pending) return;
+	// one request per pass keeps the loop responsive between requests
+	int i = async_queue_next();
+	if (i < 0) return;
 
-	AsyncHttpRequestParams* req = s_http_async_pending;
-	s_http_async_pending = nullptr;
+	AsyncHttpRequestParams* req = s_http_async_queue[i];
+	s_http_async_queue[i] = nullptr;
 
 	send_http_request(req->server, req->port, req->request, req->callback, req->usessl, req->timeout, req->expect_response);
-	if (req->request) free(req->request);
-	free(req);
+	free_async_request(req);
+	for (i = 0; i < HTTP_ASYNC_SLOTS; i++) {
+		if (s_http_async_queue[i]) { event_loop_wakeup(); break; }
+	}
 	#endif
 }
 
@@ -3420,10 +3850,23 @@ int8_t OpenSprinkler::send_http_request(char* server_with_port, char* p, void(*c
 	return send_http_request(server, (port==NULL)?80:atoi(port), p, callback, usessl, timeout, expect_response);
 }
 
+/** Remote station timer
+ * if turning on the zone and duration is defined, give duration as the timer value
+ * otherwise:
+ *   if autorefresh is defined, we give a fixed duration each time, and auto refresh will renew it periodically
+ *   if no auto refresh, we will give the maximum allowed duration, and station will be turned off when off command is sent
+ */
+static uint16_t remote_station_timer(bool turnon, uint16_t dur) {
+	if(!turnon) return 0;
+	if(dur>0) return dur;
+	return OpenSprinkler::iopts[IOPT_SPE_AUTO_REFRESH]?4*MAX_NUM_STATIONS:64800;
+}
+
 /** Switch remote IP station
  * This function takes a remote station code,
  * parses it into remote IP, port, station index,
- * and makes a HTTP GET request.
+ * and queues the change on the channel to that controller.
+ * All changes for one controller within a loop go out as one request.
  * The remote controller is assumed to have the same
  * password as the main controller
  */
@@ -3434,45 +3877,14 @@ void OpenSprinkler::switch_remotestation(RemoteIPStationData *data, bool turnon,
 	uint32_t ip4 = hex2ulong(copy.ip, sizeof(copy.ip));
 	uint16_t port = (uint16_t)hex2ulong(copy.port, sizeof(copy.port));
 
-	unsigned char ip[4];
-	ip[0] = ip4>>24;
-	ip[1] = (ip4>>16)&0xff;
-	ip[2] = (ip4>>8)&0xff;
-	ip[3] = ip4&0xff;
-
-	char *p = tmp_buffer;
-    BufferFiller bf = BufferFiller(p, TMP_BUFFER_SIZE_L);
-	// if turning on the zone and duration is defined, give duration as the timer value
-	// otherwise:
-	//   if autorefresh is defined, we give a fixed duration each time, and auto refresh will renew it periodically
-	//   if no auto refresh, we will give the maximum allowed duration, and station will be turned off when off command is sent
-	uint16_t timer = 0;
-	if(turnon) {
-		if(dur>0) {
-			timer = dur;
-		} else {
-			timer = iopts[IOPT_SPE_AUTO_REFRESH]?4*MAX_NUM_STATIONS:64800;
-		}
-	}
-	bf.emit_p(PSTR("GET /cm?pw=$O&sid=$D&en=$D&t=$D"),
-						SOPT_PASSWORD,
-						(int)hex2ulong(copy.sid, sizeof(copy.sid)),
-						turnon, timer);
-	bf.emit_p(PSTR(" HTTP/1.0\r\nHOST: $D.$D.$D.$D\r\n"),
-						ip[0],ip[1],ip[2],ip[3]);
-
-	bf.emit_p(PSTR("User-Agent: $S\r\n\r\n"), user_agent_string);
-
-	char server[20];
-	snprintf(server, 20, "%d.%d.%d.%d", ip[0], ip[1], ip[2], ip[3]);
-	// Command-only request: don't wait for full response body.
-	send_http_request_async(server, port, p, NULL, false, 12000, false);
+	remote_station_queue_ip(ip4, port, (uint8_t)hex2ulong(copy.sid, sizeof(copy.sid)),
+	                        turnon, remote_station_timer(turnon, dur));
 }
 
 /** Switch remote OTC station
  * This function takes a remote station code,
  * parses it into OTC token and station index,
- * and makes a HTTPS GET request.
+ * and queues the change on the channel to that controller.
  * The remote controller is assumed to have the same
  * password as the main controller
  */
@@ -3480,31 +3892,9 @@ void OpenSprinkler::switch_remotestation(RemoteOTCStationData *data, bool turnon
 	RemoteOTCStationData copy;
 	memcpy((char*)&copy, (char*)data, sizeof(RemoteOTCStationData));
 	copy.token[sizeof(copy.token)-1] = 0; // ensure the string ends properly
-	char *p = tmp_buffer;
-	BufferFiller bf = BufferFiller(p, TMP_BUFFER_SIZE_L);
-	// if turning on the zone and duration is defined, give duration as the timer value
-	// otherwise:
-	//   if autorefresh is defined, we give a fixed duration each time, and auto refresh will renew it periodically
-	//   if no auto refresh, we will give the maximum allowed duration, and station will be turned off when off command is sent
-	uint16_t timer = 0;
-	if(turnon) {
-		if(dur>0) {
-			timer = dur;
-		} else {
-			timer = iopts[IOPT_SPE_AUTO_REFRESH]?4*MAX_NUM_STATIONS:64800;
-		}
-	}
-	bf.emit_p(PSTR("GET /forward/v1/$S/cm?pw=$O&sid=$D&en=$D&t=$D"),
-						copy.token,
-						SOPT_PASSWORD,
-						(int)hex2ulong(copy.sid, sizeof(copy.sid)),
-						turnon, timer);
-	bf.emit_p(PSTR(" HTTP/1.0\r\nHOST: $S\r\nConnection:close\r\n"), DEFAULT_OTC_SERVER_APP);
 
-	bf.emit_p(PSTR("User-Agent: $S\r\n\r\n"), user_agent_string);
-
-	// Command-only request: don't wait for full TLS response body.
-	send_http_request_async(DEFAULT_OTC_SERVER_APP, DEFAULT_OTC_PORT_APP, p, NULL, true, 12000, false);
+	remote_station_queue_otc((const char*)copy.token, (uint8_t)hex2ulong(copy.sid, sizeof(copy.sid)),
+	                         turnon, remote_station_timer(turnon, dur));
 }
 
 /** Switch http(s) station
@@ -3530,8 +3920,12 @@ void OpenSprinkler::switch_httpstation(HTTPStationData *data, bool turnon, bool
 	bf.emit_p(PSTR("GET /$S HTTP/1.0\r\nHOST: $S\r\n"), cmd, server);
 	bf.emit_p(PSTR("User-Agent: $S\r\n\r\n"), user_agent_string);
 
+	// the on and off commands together identify the station on that host
+	uint32_t station = cache_hash(cache_hash(CACHE_HASH_INIT, on_cmd), off_cmd);
+	if (!station) station = 1;
+
 	// Command-only request: don't wait for full response body.
-	send_http_request_async(server, atoi(port), p, NULL, usessl, 12000, false);
+	send_http_request_async(server, atoi(port), p, NULL, usessl, 12000, false, HTTP_PRIO_HIGH, station, !turnon);
 }
 
 /** Prepare factory reset */
@@ -4127,6 +4521,7 @@ void OpenSprinkler::populate_master() {
 
 /** Save integer options to file */
 void OpenSprinkler::iopts_save() {
+	cache_invalidate(CACHE_DOM_OPTIONS);
 	file_write_block(IOPTS_FILENAME, iopts, 0, NUM_IOPTS);
 	nboards = iopts[IOPT_EXT_BOARDS]+1;
 	nstations = nboards * 8;
@@ -4149,8 +4544,10 @@ String OpenSprinkler::sopt_load(unsigned char oid) {
 
 /** Save a string option to file */
 bool OpenSprinkler::sopt_save(unsigned char oid, const char *buf) {
+	PwCacheLock lock(oid == SOPT_PASSWORD);  // no verify sees a half-written hash
 	if (oid == SOPT_PASSWORD) {
 		DEBUG_PRINTF("[SOPT] write slot0 -> '%.*s'\n", 32, buf ? buf : "<null>");
+		pw_cache_state = PW_CACHE_EMPTY;  // reload on next verify
 	}
 	// smart save: if value hasn't changed, don't write
 	if(file_cmp_block(SOPTS_FILENAME, buf, (ulong)MAX_SOPTS_SIZE*oid)==0) return false;
@@ -4564,6 +4961,7 @@ void OpenSprinkler::lcd_print_option(int i) {
 		break;
 	case IOPT_I_MIN_THRESHOLD:
 	case IOPT_I_MAX_LIMIT:
+	case IOPT_CURRENT_BUDGET:
 		#if defined(ARDUINO)
 		lcd.print((int)iopts[i]*10);
 		lcd_print_pgm(PSTR(" mA"));
@@ -4960,6 +5358,7 @@ void OpenSprinkler::save_wifi_ip() {
 }
 
 void OpenSprinkler::detect_expanders() {
+	applied_valid = false; // new expander objects, rewrite all outputs on next apply
 	for(unsigned char i=0;i<(MAX_NUM_BOARDS)/2;i++) {
 		unsigned char address = EXP_I2CADDR_BASE+i;
 		unsigned char type = IOEXP::detectType(address);
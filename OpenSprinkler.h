@@ -463,6 +463,7 @@ static unsigned char iopts[]; // integer options (initialized — must NOT be in
 	static unsigned char is_sequential_station(unsigned char sid);
 	static uint16_t get_flow_pulse_rate_100();
 	static uint16_t get_flow_pulse_divisor();
+	static uint16_t get_flow_budget(); // supply flow budget in 0.1 flow units, 0 = none
 	static float get_flow_volume_per_pulse();
     uint16_t get_flow_alert_setpoint(unsigned char sid);
     void set_flow_alert_setpoint(unsigned char sid, uint16_t value);
@@ -475,6 +476,7 @@ static unsigned char iopts[]; // integer options (initialized — must NOT be in
 	static int16_t get_off_adj(unsigned char mas);
 	static int16_t get_imin();
 	static int16_t get_imax();
+	static int16_t get_current_budget(); // valve current budget in mA, 0 = none
 	static unsigned char is_running(unsigned char sid);
 	static unsigned char get_station_gid(unsigned char sid);
 	static void set_station_gid(unsigned char sid, unsigned char gid);
@@ -583,7 +585,7 @@ static unsigned char iopts[]; // integer options (initialized — must NOT be in
 	static int8_t send_http_request(uint32_t ip4, uint16_t port, char* p, void(*callback)(char*)=NULL, bool usessl=false, uint16_t timeout=5000, bool expect_response=true);
 	static int8_t send_http_request(const char* server, uint16_t port, char* p, void(*callback)(char*)=NULL, bool usessl=false, uint16_t timeout=5000, bool expect_response=true, uint16_t resp_buf_size=0);
 	static int8_t send_http_request(char* server_with_port, char* p, void(*callback)(char*)=NULL, bool usessl=false, uint16_t timeout=5000, bool expect_response=true);
-	static int8_t send_http_request_async(const char* server, uint16_t port, const char* p, void(*callback)(char*)=NULL, bool usessl=false, uint16_t timeout=12000, bool expect_response=true);
+	static int8_t send_http_request_async(const char* server, uint16_t port, const char* p, void(*callback)(char*)=NULL, bool usessl=false, uint16_t timeout=12000, bool expect_response=true, uint8_t prio=HTTP_PRIO_NORMAL, uint32_t station=0, bool turnoff=false); // station: key of the HTTP station a command switches, 0 if none
 	static void process_async_http_requests();
 	
 	#if defined(USE_OTF)
@@ -0,0 +1,343 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Background sampling of the analog sensor ADCs (ASB ADS1115, OSPi ADS1115/PCF8591)
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "adc_sampler.h"
+#include "sensors.h"
+#include "event_loop.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(ADS1115) && !defined(ARDUINO)
+#include "ospi-analog/driver_ads1115.h"
+#include "ospi-analog/driver_ads1115_interface.h"
+#endif
+#if defined(PCF8591) && !defined(ARDUINO)
+#include "ospi-analog/driver_pcf8591.h"
+#include "ospi-analog/driver_pcf8591_interface.h"
+#endif
+
+extern uint16_t get_asb_detected_boards();
+
+#define ADC_CHIPS        4     // chips per source, 4 inputs each
+#define ADC_RETRY_MS     10000 // back-off after a chip failed to answer
+#define ADC_IDLE_MS      900000 // drop channels nobody asked for in this time,
+                                // or in two read intervals of their sensor if longer
+
+struct AdcRing {
+  int16_t s[ADC_RING_SIZE];
+  uint8_t head;
+  uint8_t count;
+  ulong updated;
+  ulong read_at;     // last adc_sampler_get(), to retire deleted sensors
+  ulong idle_ms;     // retire after this long without a read
+};
+
+struct AdcSource {
+  uint16_t active;                  // channels somebody reads
+  float volts_per_count;
+  AdcRing *rings[ADC_CHANNELS];     // allocated on first read of a channel
+  int8_t pending[ADC_CHIPS];        // channel being converted, -1 if idle
+  uint8_t next[ADC_CHIPS];          // round robin position
+  ulong step_at[ADC_CHIPS];
+  ulong req_at[ADC_CHIPS];
+};
+
+static AdcSource adc_sources[ADC_SOURCES];
+static bool adc_inited = false;
+
+static void adc_init_state() {
+  if (adc_inited) return;
+  memset(adc_sources, 0, sizeof(adc_sources));
+  for (uint8_t s = 0; s < ADC_SOURCES; s++)
+    for (uint8_t c = 0; c < ADC_CHIPS; c++) adc_sources[s].pending[c] = -1;
+  adc_inited = true;
+}
+
+/*
+ * Chip backends: start a conversion on one input, then poll for the result
+ * (1 = sample in raw, 0 = still converting, 2 = nothing usable, -1 = fault).
+ */
+
+#if defined(ESP8266) || defined(ESP32)
+
+static ADS1115 *asb_adc[ADC_CHIPS];
+
+static void asb_drop(uint8_t chip) {
+  delete asb_adc[chip];
+  asb_adc[chip] = NULL;
+#if defined(ESP8266)
+  // I2C bus lockup recovery: reinitialize the software I2C
+  Wire.begin(SDA, SCL);
+  Wire.setClock(100000);
+  delay(5);
+#endif
+}
+
+static bool asb_start(uint8_t chip, uint8_t ch) {
+  uint16_t boards = get_asb_detected_boards();
+  if ((chip < 2 && !(boards & ASB_BOARD1)) || (chip >= 2 && !(boards & ASB_BOARD2))) return false;
+  if (!asb_adc[chip]) {
+    asb_adc[chip] = new ADS1115(ASB_BOARD_ADDR1a + chip);
+    if (!asb_adc[chip]->begin()) {
+      DEBUG_PRINTLN(F("no asb board?!?"));
+      asb_drop(chip);
+      return false;
+    }
+    asb_adc[chip]->setMode(1);  // single shot, the sampler rotates the mux
+    adc_sources[ADC_SRC_ASB].volts_per_count = asb_adc[chip]->toVoltage(1);
+  }
+  asb_adc[chip]->requestADC(ch);
+  return true;
+}
+
+static int asb_poll(uint8_t chip, int16_t *raw) {
+  if (!asb_adc[chip]) return -1;
+  if (asb_adc[chip]->isBusy()) return 0;
+  *raw = asb_adc[chip]->getValue();
+  if (*raw == ADS1X15_ERROR_I2C || *raw == ADS1X15_ERROR_TIMEOUT) {
+    asb_drop(chip);
+    return -1;
+  }
+  return 1;
+}
+
+#endif
+
+#if defined(ADS1115) && !defined(ARDUINO)
+
+#define ADS1115_REG_CONVERT  0x00
+#define ADS1115_REG_CONFIG   0x01
+#define ADS1115_CFG_START    0x8000  // OS bit: start a conversion / conversion done
+// single shot, +-6.144 V, 128 SPS, comparator off; the mux field selects AINx vs GND
+#define ADS1115_CFG_SINGLE(ch)  (ADS1115_CFG_START | ((4 + (ch)) << 12) | 0x0100 | (4 << 5) | 0x0003)
+
+static ads1115_handle_t ads_handle;
+
+static bool ospi_ads_start(uint8_t chip, uint8_t ch) {
+  if (!ads_handle.inited) {
+    DRIVER_ADS1115_LINK_INIT(&ads_handle, ads1115_handle_t);
+    DRIVER_ADS1115_LINK_IIC_INIT(&ads_handle, ads1115_interface_iic_init);
+    DRIVER_ADS1115_LINK_IIC_DEINIT(&ads_handle, ads1115_interface_iic_deinit);
+    DRIVER_ADS1115_LINK_IIC_READ(&ads_handle, ads1115_interface_iic_read);
+    DRIVER_ADS1115_LINK_IIC_WRITE(&ads_handle, ads1115_interface_iic_write);
+    DRIVER_ADS1115_LINK_DELAY_MS(&ads_handle, ads1115_interface_delay_ms);
+    DRIVER_ADS1115_LINK_DEBUG_PRINT(&ads_handle, ads1115_interface_debug_print);
+    if (ads1115_init(&ads_handle) != 0) return false;
+    adc_sources[ADC_SRC_OSPI_ADS1115].volts_per_count = 6.144f / 32768.0f;
+  }
+  if (ads1115_set_addr_pin(&ads_handle, (ads1115_address_t)(ADS1115_ADDR_GND + chip)) != 0) return false;
+  return ads1115_set_reg(&ads_handle, ADS1115_REG_CONFIG, (int16_t)ADS1115_CFG_SINGLE(ch)) == 0;
+}
+
+static int ospi_ads_poll(uint8_t chip, int16_t *raw) {
+  int16_t cfg;
+  if (ads1115_set_addr_pin(&ads_handle, (ads1115_address_t)(ADS1115_ADDR_GND + chip)) != 0) return -1;
+  if (ads1115_get_reg(&ads_handle, ADS1115_REG_CONFIG, &cfg) != 0) return -1;
+  if (!((uint16_t)cfg & ADS1115_CFG_START)) return 0;
+  return ads1115_get_reg(&ads_handle, ADS1115_REG_CONVERT, raw) == 0 ? 1 : -1;
+}
+
+#endif
+
+#if defined(PCF8591) && !defined(ARDUINO)
+
+static pcf8591_handle_t pcf_handle;
+
+static bool ospi_pcf_start(uint8_t ch) {
+  if (!pcf_handle.inited) {
+    DRIVER_PCF8591_LINK_INIT(&pcf_handle, pcf8591_handle_t);
+    DRIVER_PCF8591_LINK_IIC_INIT(&pcf_handle, pcf8591_interface_iic_init);
+    DRIVER_PCF8591_LINK_IIC_DEINIT(&pcf_handle, pcf8591_interface_iic_deinit);
+    DRIVER_PCF8591_LINK_IIC_READ_COMMAND(&pcf_handle, pcf8591_interface_iic_read_cmd);
+    DRIVER_PCF8591_LINK_IIC_WRITE_COMMAND(&pcf_handle, pcf8591_interface_iic_write_cmd);
+    DRIVER_PCF8591_LINK_DELAY_MS(&pcf_handle, pcf8591_interface_delay_ms);
+    DRIVER_PCF8591_LINK_DEBUG_PRINT(&pcf_handle, pcf8591_interface_debug_print);
+    if (pcf8591_set_addr_pin(&pcf_handle, PCF8591_ADDRESS_A000) != 0) return false;
+    if (pcf8591_init(&pcf_handle) != 0) return false;
+    if (pcf8591_set_mode(&pcf_handle, PCF8591_MODE_AIN0123_GND) != 0) return false;
+    if (pcf8591_set_auto_increment(&pcf_handle, PCF8591_BOOL_FALSE) != 0) return false;
+    if (pcf8591_set_reference_voltage(&pcf_handle, 3.3f) != 0) return false;
+    // Force enable Analog Output (AOUT) to ensure ASB sensor board remains powered
+    pcf_handle.conf |= 0x40;
+    adc_sources[ADC_SRC_OSPI_PCF8591].volts_per_count = 3.3f / 256.0f;
+  }
+  return pcf8591_set_channel(&pcf_handle, (pcf8591_channel_t)ch) == 0;
+}
+
+static int ospi_pcf_poll(int16_t *raw) {
+  float v;
+  if (pcf8591_read(&pcf_handle, raw, &v) != 0) return -1;
+  return *raw == 0 ? 2 : 1;  // zero readings are bus glitches, discard them
+}
+
+#endif
+
+static bool adc_start(uint8_t src, uint8_t chip, uint8_t ch) {
+  switch (src) {
+#if defined(ESP8266) || defined(ESP32)
+    case ADC_SRC_ASB: return asb_start(chip, ch);
+#endif
+#if defined(ADS1115) && !defined(ARDUINO)
+    case ADC_SRC_OSPI_ADS1115: return ospi_ads_start(chip, ch);
+#endif
+#if defined(PCF8591) && !defined(ARDUINO)
+    case ADC_SRC_OSPI_PCF8591: return chip == 0 && ospi_pcf_start(ch);
+#endif
+  }
+  (void)chip; (void)ch;
+  return false;
+}
+
+static int adc_poll(uint8_t src, uint8_t chip, int16_t *raw) {
+  switch (src) {
+#if defined(ESP8266) || defined(ESP32)
+    case ADC_SRC_ASB: return asb_poll(chip, raw);
+#endif
+#if defined(ADS1115) && !defined(ARDUINO)
+    case ADC_SRC_OSPI_ADS1115: return ospi_ads_poll(chip, raw);
+#endif
+#if defined(PCF8591) && !defined(ARDUINO)
+    case ADC_SRC_OSPI_PCF8591: return ospi_pcf_poll(raw);
+#endif
+  }
+  (void)chip; (void)raw;
+  return -1;
+}
+
+static void adc_push(AdcSource &S, uint8_t ch, int16_t raw) {
+  AdcRing *r = S.rings[ch];
+  if (!r) return;
+  r->s[r->head] = raw;
+  r->head = (r->head + 1) % ADC_RING_SIZE;
+  if (r->count < ADC_RING_SIZE) r->count++;
+  r->updated = millis();
+}
+
+void adc_sampler_loop() {
+  if (!adc_inited) return;
+  ulong now = millis();
+  bool sampling = false;
+  for (uint8_t src = 0; src < ADC_SOURCES; src++) {
+    AdcSource &S = adc_sources[src];
+    if (!S.active) continue;
+    for (uint8_t ch = 0; ch < ADC_CHANNELS; ch++) {
+      AdcRing *r = S.rings[ch];
+      if (r && now - r->read_at > r->idle_ms) {
+        free(r);
+        S.rings[ch] = NULL;
+        S.active &= ~(1 << ch);
+      }
+    }
+    if (!S.active) continue;
+    sampling = true;
+    for (uint8_t chip = 0; chip < ADC_CHIPS; chip++) {
+      uint8_t mask = (S.active >> (chip * 4)) & 0x0F;
+      if (!mask || (long)(now - S.step_at[chip]) < 0) continue;
+      S.step_at[chip] = now + ADC_STEP_MS;
+
+      if (S.pending[chip] >= 0) {
+        int16_t raw = 0;
+        int r = adc_poll(src, chip, &raw);
+        if (r == 0 && now - S.req_at[chip] < ADC_CONV_TIMEOUT_MS) continue;
+        if (r == 1) adc_push(S, chip * 4 + S.pending[chip], raw);
+        else if (r < 0) DEBUG_PRINTF("adc: source %d chip %d not answering\n", src, chip);
+        S.pending[chip] = -1;
+        if (r <= 0) {
+          S.step_at[chip] = now + ADC_RETRY_MS;
+          continue;
+        }
+      }
+
+      uint8_t ch = S.next[chip];
+      while (!(mask & (1 << ch))) ch = (ch + 1) & 3;
+      S.next[chip] = (ch + 1) & 3;
+      if (adc_start(src, chip, ch)) {
+        S.pending[chip] = ch;
+        S.req_at[chip] = now;
+      } else {
+        S.step_at[chip] = now + ADC_RETRY_MS;
+      }
+    }
+  }
+  if (sampling) event_loop_wake_within(ADC_STEP_MS);
+}
+
+bool adc_sampler_get(uint8_t src, uint8_t channel, AdcChannelStats *out, uint read_interval) {
+  if (src >= ADC_SOURCES || channel >= ADC_CHANNELS) return false;
+  adc_init_state();
+  AdcSource &S = adc_sources[src];
+  AdcRing *r = S.rings[channel];
+  // a sensor reading less often than ADC_IDLE_MS keeps its channel sampled
+  // between reads, so every read gets a full ring
+  ulong idle = ADC_IDLE_MS;
+  if (read_interval > idle / 2000) {
+    idle = read_interval < 0x7FFFFFFFUL / 2000 ? (ulong)read_interval * 2000 : 0x7FFFFFFFUL;
+  }
+  if (!r) {
+    r = (AdcRing*)calloc(1, sizeof(AdcRing));
+    if (!r) return false;
+    S.rings[channel] = r;
+    S.active |= (1 << channel);
+    r->read_at = millis();
+    r->idle_ms = idle;
+    return false;
+  }
+  r->read_at = millis();
+  r->idle_ms = idle;
+  if (!r->count) return false;
+
+  int32_t sum = 0;
+  int16_t mn = r->s[0], mx = r->s[0];
+  for (uint8_t i = 0; i < r->count; i++) {
+    int16_t v = r->s[i];
+    sum += v;
+    if (v < mn) mn = v;
+    if (v > mx) mx = v;
+  }
+  out->last = r->s[(r->head + ADC_RING_SIZE - 1) % ADC_RING_SIZE];
+  out->min = mn;
+  out->max = mx;
+  out->mean = (int16_t)(sum / r->count);
+  out->volts = out->mean * S.volts_per_count;
+  out->samples = r->count;
+  out->updated = r->updated;
+  return true;
+}
+
+void adc_sampler_free() {
+  if (!adc_inited) return;
+  for (uint8_t src = 0; src < ADC_SOURCES; src++) {
+    for (uint8_t ch = 0; ch < ADC_CHANNELS; ch++) free(adc_sources[src].rings[ch]);
+  }
+#if defined(ESP8266) || defined(ESP32)
+  for (uint8_t chip = 0; chip < ADC_CHIPS; chip++) {
+    delete asb_adc[chip];
+    asb_adc[chip] = NULL;
+  }
+#endif
+#if defined(PCF8591) && !defined(ARDUINO)
+  if (pcf_handle.inited) pcf8591_deinit(&pcf_handle);
+#endif
+  adc_inited = false;
+  adc_init_state();
+}
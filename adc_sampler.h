@@ -0,0 +1,67 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Background sampling of the analog sensor ADCs (ASB ADS1115, OSPi ADS1115/PCF8591)
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ADC_SAMPLER_H
+#define _ADC_SAMPLER_H
+
+#include <stdint.h>
+#include "defines.h"
+
+/** ADC families, each with up to ADC_CHANNELS inputs */
+#define ADC_SRC_ASB           0  // ESP analog sensor boards, 4x ADS1115 at 0x48..0x4B
+#define ADC_SRC_OSPI_ADS1115  1  // OSPi 1.6 onboard ADS1115, 4 chips
+#define ADC_SRC_OSPI_PCF8591  2  // OSPi onboard PCF8591
+#define ADC_SOURCES           3
+
+#define ADC_CHANNELS          16
+#define ADC_RING_SIZE         16    // oversampling window per channel
+#define ADC_STEP_MS           50    // one conversion step per chip per interval
+#define ADC_CONV_TIMEOUT_MS   100   // a conversion not ready after this is abandoned
+
+/** Filtered view of one channel's sample ring */
+struct AdcChannelStats {
+  int16_t last;       // newest raw sample
+  int16_t min;
+  int16_t max;
+  int16_t mean;
+  float volts;        // mean converted to volts
+  uint8_t samples;    // samples in the ring
+  ulong updated;      // millis() of the newest sample
+};
+
+/**
+ * @brief Latest filtered value of a channel, without waiting for the ADC.
+ * The first call for a channel adds it to the rotation and returns false;
+ * values are available once the sampler has converted it.
+ * @param read_interval seconds until the caller reads again; the channel
+ * stays in the rotation for at least twice that long
+ */
+bool adc_sampler_get(uint8_t src, uint8_t channel, AdcChannelStats *out, uint read_interval);
+
+/** Advance conversions on all chips; call from the main loop */
+void adc_sampler_loop();
+
+/** Drop all channels and driver instances (sensor config reload) */
+void adc_sampler_free();
+
+#endif // _ADC_SAMPLER_H
@@ -80,7 +80,7 @@
         
         g++ -o OpenSprinkler -DOSPI $USEGPIO $ADS1115 $PCF8591 -DSMTP_OPENSSL -DHAVE_TINY_WEBSOCKETS $DEBUG -std=c++17 -include string.h -include cstdint main.cpp \
                 OpenSprinkler.cpp program.cpp opensprinkler_server.cpp mcp_server.cpp utils.cpp weather.cpp gpio.cpp mqtt.cpp sunrise.cpp \
-            smtp.c RCSwitch.cpp psram_utils.cpp TimeLib.cpp debug_log.cpp sensor*.cpp special_station_handlers.cpp notifier.cpp naett.c \
+            smtp.c RCSwitch.cpp psram_utils.cpp request_arena.cpp response_cache.cpp flow_capture.cpp event_loop.cpp adc_sampler.cpp json_stream.cpp remote_station.cpp http_pool.cpp runtime_timeline.cpp capacity_sched.cpp config_journal.cpp web_thread.cpp response_pool.cpp state_snapshot.cpp event_stream.cpp TimeLib.cpp debug_log.cpp sensor*.cpp special_station_handlers.cpp notifier.cpp naett.c \
                 $ADS1115FILES $PCF8591FILES \
                 $ws_include \
                 $ws \
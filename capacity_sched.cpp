@@ -0,0 +1,60 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Flow and current budget profile for capacity-aware scheduling
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "capacity_sched.h"
+
+/** Make sure a step starts at t, return its index */
+size_t CapacityProfile::split(time_os_t t) {
+	size_t i = 0;
+	while (i < steps.size() && steps[i].t < t) i++;
+	if (i < steps.size() && steps[i].t == t) return i;
+	Step s = {t, 0, 0};
+	if (i > 0) {  // inherit the load of the step t falls into
+		s.flow = steps[i-1].flow;
+		s.ma = steps[i-1].ma;
+	}
+	steps.insert(steps.begin() + i, s);
+	return i;
+}
+
+void CapacityProfile::add(time_os_t st, time_os_t end, uint32_t flow, uint32_t ma) {
+	if (end <= st) return;
+	size_t b = split(st);
+	size_t e = split(end);
+	for (size_t i = b; i < e; i++) {
+		steps[i].flow += flow;
+		steps[i].ma += ma;
+	}
+}
+
+time_os_t CapacityProfile::earliest(time_os_t from, time_os_t dur, uint32_t flow, uint32_t ma) const {
+	time_os_t t = from;
+	size_t i = 0;
+	while (i + 1 < steps.size() && steps[i+1].t <= t) i++;
+	// walk the steps overlapping [t, t+dur), restart after any step that is too full
+	for (size_t j = i; j < steps.size() && steps[j].t < t + dur; j++) {
+		bool over = (flow_cap && steps[j].flow + flow > flow_cap) || (ma_cap && steps[j].ma + ma > ma_cap);
+		if (over && j + 1 < steps.size()) t = steps[j+1].t;  // the last step carries no load
+	}
+	return t;
+}
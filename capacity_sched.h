@@ -0,0 +1,68 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Flow and current budget profile for capacity-aware scheduling
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CAPACITY_SCHED_H
+#define _CAPACITY_SCHED_H
+
+#include <stdint.h>
+#include <vector>
+#include "types.h"
+
+/**
+ * @brief Load profile of the booked station runs over time
+ * The profile is a step function: the load booked from steps[i].t up to
+ * steps[i+1].t, and no load after the last step. A budget of 0 leaves that
+ * dimension unlimited. Demands are in the same units as the budgets.
+ */
+class CapacityProfile {
+public:
+	CapacityProfile(uint32_t flow_cap, uint32_t ma_cap) : flow_cap(flow_cap), ma_cap(ma_cap) {}
+
+	/** Clamp a learned demand to the budget, an unknown (0) demand takes the whole budget */
+	uint32_t flow_demand(uint32_t learned) const { return clamp(learned, flow_cap); }
+	uint32_t ma_demand(uint32_t learned) const { return clamp(learned, ma_cap); }
+
+	/** Book a run over [st, end) */
+	void add(time_os_t st, time_os_t end, uint32_t flow, uint32_t ma);
+
+	/** Earliest start >= from at which a run of dur seconds stays within the budgets */
+	time_os_t earliest(time_os_t from, time_os_t dur, uint32_t flow, uint32_t ma) const;
+
+private:
+	struct Step {
+		time_os_t t;
+		uint32_t flow;
+		uint32_t ma;
+	};
+	std::vector<Step> steps;
+	uint32_t flow_cap;
+	uint32_t ma_cap;
+
+	static uint32_t clamp(uint32_t learned, uint32_t cap) {
+		if (!cap) return 0;
+		return (learned == 0 || learned > cap) ? cap : learned;
+	}
+	size_t split(time_os_t t);
+};
+
+#endif // _CAPACITY_SCHED_H
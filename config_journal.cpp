@@ -0,0 +1,136 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Append-only change journal for the JSON configuration files
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "config_journal.h"
+#include "utils.h"
+#include "sensors_util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CJ_MAGIC  0xC5
+
+struct CjHeader {
+  uint8_t magic;
+  uint8_t op;
+  uint16_t len;
+  uint32_t nr;
+  uint32_t crc;
+};
+
+uint32_t cj_crc32(uint32_t crc, const void *data, size_t len) {
+  // nibble table, small enough for ESP8266 flash
+  static const uint32_t table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+  };
+  const uint8_t *p = (const uint8_t *)data;
+  crc = ~crc;
+  while (len--) {
+    crc ^= *p++;
+    crc = (crc >> 4) ^ table[crc & 0x0F];
+    crc = (crc >> 4) ^ table[crc & 0x0F];
+  }
+  return ~crc;
+}
+
+static uint32_t cj_record_crc(uint8_t op, uint32_t nr, const char *json, uint16_t len) {
+  uint32_t crc = cj_crc32(0, &op, 1);
+  crc = cj_crc32(crc, &nr, sizeof(nr));
+  return cj_crc32(crc, json, len);
+}
+
+void cj_filename(const char *snapshot, char *out, size_t size) {
+  snprintf(out, size, "%s.jnl", snapshot);
+}
+
+bool cj_append(const char *snapshot, uint8_t op, uint32_t nr, const char *json, uint16_t len) {
+  char fn[40];
+  cj_filename(snapshot, fn, sizeof(fn));
+  if (op != CJ_UPSERT) len = 0;
+
+  CjHeader h;
+  h.magic = CJ_MAGIC;
+  h.op = op;
+  h.len = len;
+  h.nr = nr;
+  h.crc = cj_record_crc(op, nr, json, len);
+
+  // one write per record keeps a torn append to the tail of the file
+  size_t total = sizeof(h) + len;
+  uint8_t *buf = (uint8_t *)malloc(total);
+  if (!buf) return false;
+  memcpy(buf, &h, sizeof(h));
+  if (len) memcpy(buf + sizeof(h), json, len);
+
+  ulong before = file_size(fn);
+  file_append_block(fn, buf, total);
+  free(buf);
+  return file_size(fn) == before + total;
+}
+
+bool cj_replay(const char *snapshot, cj_apply_fn fn, void *ctx) {
+  char jn[40];
+  cj_filename(snapshot, jn, sizeof(jn));
+  if (!file_exists(jn)) return true;
+  ulong size = file_size(jn);
+  if (!size) return true;
+
+  FileReader reader(jn);
+  ulong pos = 0;
+  while (pos < size) {
+    CjHeader h;
+    if (size - pos < sizeof(h)) return false;
+    if (reader.readBytes((char *)&h, sizeof(h)) != sizeof(h)) return false;
+    if (h.magic != CJ_MAGIC || (h.op != CJ_UPSERT && h.op != CJ_DELETE)) return false;
+    if (size - pos - sizeof(h) < h.len) return false;
+
+    char *json = (char *)malloc(h.len + 1);
+    if (!json) return false;
+    if (reader.readBytes(json, h.len) != h.len) {
+      free(json);
+      return false;
+    }
+    json[h.len] = 0;
+    bool ok = (cj_record_crc(h.op, h.nr, json, h.len) == h.crc);
+    if (ok) fn(h.op, h.nr, json, ctx);
+    free(json);
+    if (!ok) return false;
+    pos += sizeof(h) + h.len;
+  }
+  return true;
+}
+
+bool cj_needs_compact(const char *snapshot) {
+  char fn[40];
+  cj_filename(snapshot, fn, sizeof(fn));
+  ulong jsize = file_size(fn);
+  if (jsize <= CJ_COMPACT_BYTES) return false;
+  return jsize > file_size(snapshot);
+}
+
+void cj_reset(const char *snapshot) {
+  char fn[40];
+  cj_filename(snapshot, fn, sizeof(fn));
+  if (file_exists(fn)) remove_file(fn);
+}
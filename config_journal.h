@@ -0,0 +1,76 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Append-only change journal for the JSON configuration files
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CONFIG_JOURNAL_H
+#define _CONFIG_JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "defines.h"
+
+/**
+ * A JSON config file (sensors, monitors, program adjustments) is the snapshot.
+ * Changes after the last snapshot are appended to "<snapshot>.jnl" as records
+ * of one whole object each, so a single edit costs one small append instead of
+ * a full rewrite. Records are idempotent: replaying them onto a newer snapshot
+ * yields the same state, so the journal is simply removed after compaction.
+ *
+ * Record: magic, op, payload length, object nr, CRC-32 of op/nr/payload,
+ * followed by the object JSON (upserts) or nothing (deletes).
+ */
+#define CJ_UPSERT  1
+#define CJ_DELETE  2
+
+// Compact once the journal outgrows this or the snapshot, whichever is larger
+#if defined(ESP8266)
+  #define CJ_COMPACT_BYTES  8192
+#else
+  #define CJ_COMPACT_BYTES  32768
+#endif
+
+/** Journal file name of a snapshot */
+void cj_filename(const char *snapshot, char *out, size_t size);
+
+/** Append a record, returns false if it did not reach the file */
+bool cj_append(const char *snapshot, uint8_t op, uint32_t nr, const char *json, uint16_t len);
+
+/** Called for every intact record, json is NUL-terminated (empty for deletes) */
+typedef void (*cj_apply_fn)(uint8_t op, uint32_t nr, const char *json, void *ctx);
+
+/**
+ * @brief Replay the journal in write order
+ * @return false if a torn or corrupt record ended the replay early;
+ *         the caller should compact so later appends are not lost behind it
+ */
+bool cj_replay(const char *snapshot, cj_apply_fn fn, void *ctx);
+
+/** True once the journal is due for compaction */
+bool cj_needs_compact(const char *snapshot);
+
+/** Drop the journal, after the snapshot has been rewritten */
+void cj_reset(const char *snapshot);
+
+/** CRC-32 (IEEE), also used to tell whether an object changed */
+uint32_t cj_crc32(uint32_t crc, const void *data, size_t len);
+
+#endif // _CONFIG_JOURNAL_H
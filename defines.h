@@ -183,6 +183,11 @@ enum {
 #define HTTP_RQT_STALE         -6
 #define HTTP_RQT_NOT_ENOUGH_SPACE -7  // not enough flash/filesystem space to store a new entry
 
+/** Async HTTP request priorities, lower runs first */
+#define HTTP_PRIO_HIGH         0  // station commands
+#define HTTP_PRIO_NORMAL       1
+#define HTTP_PRIO_LOW          2  // notifications and telemetry
+
 /** Sensor macro defines */
 #define SENSOR_TYPE_NONE    0x00
 #define SENSOR_TYPE_RAIN    0x01  // rain sensor
@@ -272,6 +277,15 @@ enum {
 	#endif
 #endif
 
+// On Linux a separate thread serves web clients (see web_thread.h); the
+// request buffers are then per thread.
+#if defined(OSPI) && defined(USE_OTF)
+	#define OS_HTTP_THREAD
+	#define OS_THREAD_LOCAL thread_local
+#else
+	#define OS_THREAD_LOCAL
+#endif
+
 #if !defined(OS_ETH_TOE)
   #define OS_ETH_TOE 0
 #endif
@@ -403,6 +417,9 @@ enum {
 	IOPT_FLOW_PULSE_DIV_0, ///< low byte of flow pulse divisor (effective volume = pulse_rate/100/divisor)
 	IOPT_FLOW_PULSE_DIV_1, ///< high byte of flow pulse divisor
 	IOPT_WIFI_MODEM_SLEEP, ///< ESP8266 WiFi modem sleep: 0 = off/full power (default, fewer disconnects); 1 = modem sleep (lower power, better weak-signal RX)
+	IOPT_FLOW_BUDGET_0,    ///< low byte of supply flow budget (0.1 flow units); non-zero enables capacity scheduling
+	IOPT_FLOW_BUDGET_1,    ///< high byte of supply flow budget
+	IOPT_CURRENT_BUDGET,   ///< valve current budget scaled down by 10 (mA); non-zero enables capacity scheduling
 	NUM_IOPTS // total number of integer options
 };
 
@@ -801,8 +818,8 @@ inline  void DEBUG_PRINT(const std::string& s) {fprintf(stdout, "%s", s.c_str())
   extern char* ether_buffer;
   extern char* tmp_buffer;
 #else
-  extern char ether_buffer[];
-  extern char tmp_buffer[];
+  extern OS_THREAD_LOCAL char ether_buffer[];
+  extern OS_THREAD_LOCAL char tmp_buffer[];
 #endif
 
 // ====== Utility macros ======
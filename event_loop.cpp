@@ -0,0 +1,239 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Linux main loop reactor: epoll over sockets and a per-second timerfd
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "event_loop.h"
+
+#if !defined(ARDUINO)
+
+#include "OpenSprinkler.h"
+#include "utils.h"
+
+#if defined(__linux__)
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <netinet/in.h>
+
+#ifndef TFD_TIMER_CANCEL_ON_SET
+#define TFD_TIMER_CANCEL_ON_SET (1 << 1)
+#endif
+
+extern OpenSprinkler os;
+
+#define EVENT_LOOP_MAX_EVENTS   8
+#define EVENT_LOOP_MAX_OWN      16     // sockets served by the firmware itself
+#define EVENT_LOOP_BUSY_MS      250    // keep 1 ms passes after a connection arrives
+
+static int ep_fd = -1;
+static int tick_fd = -1;
+static int wake_fd = -1;
+static int mqtt_fd = -1;
+static int listen_fd = -1;
+static int own_fds[EVENT_LOOP_MAX_OWN];
+static int n_own = 0;
+static ulong busy_until = 0;
+static long wake_cap = -1;
+static bool watch_listen = true;
+
+static void watch_fd(int fd) {
+	struct epoll_event ev = {};
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	epoll_ctl(ep_fd, EPOLL_CTL_ADD, fd, &ev);  // EEXIST is fine
+}
+
+// Fire on every wall-clock second so the scheduler sees each new second
+// right away. CANCEL_ON_SET re-arms it after the clock is stepped (NTP).
+static void arm_tick() {
+	struct itimerspec its = {};
+	uint16_t rate = sim_clock_rate();
+	if (rate > 1) {
+		// a simulated clock ticks faster, wake once per controller second
+		long ns = 1000000000L / rate;
+		its.it_value.tv_nsec = ns;
+		its.it_interval.tv_nsec = ns;
+		timerfd_settime(tick_fd, 0, &its, NULL);
+		return;
+	}
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	its.it_value.tv_sec = now.tv_sec + 1;
+	its.it_interval.tv_sec = 1;
+	timerfd_settime(tick_fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &its, NULL);
+}
+
+static bool event_loop_init() {
+	if (ep_fd >= 0) return true;
+	ep_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (ep_fd < 0) return false;
+	tick_fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+	wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (tick_fd < 0 || wake_fd < 0) {
+		DEBUG_PRINTLN(F("event loop: timerfd/eventfd unavailable, polling"));
+		close(ep_fd);
+		ep_fd = -1;
+		return false;
+	}
+	arm_tick();
+	watch_fd(tick_fd);
+	watch_fd(wake_fd);
+	return true;
+}
+
+static bool is_own_fd(int fd) {
+	for (int i = 0; i < n_own; i++) {
+		if (own_fds[i] == fd) return true;
+	}
+	return false;
+}
+
+// The OpenThings library does not hand out its server socket, so look up
+// the one bound to the port it was just given.
+int event_loop_find_listen_fd(uint16_t port) {
+	DIR *dir = opendir("/proc/self/fd");
+	if (!dir) return -1;
+	int found = -1;
+	struct dirent *de;
+	while (found < 0 && (de = readdir(dir)) != NULL) {
+		if (de->d_name[0] < '0' || de->d_name[0] > '9') continue;
+		int fd = atoi(de->d_name);
+		if (fd == dirfd(dir)) continue;
+		int val = 0;
+		socklen_t len = sizeof(val);
+		if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &val, &len) != 0 || !val) continue;
+		struct sockaddr_storage addr;
+		len = sizeof(addr);
+		if (getsockname(fd, (struct sockaddr *)&addr, &len) != 0) continue;
+		uint16_t p = 0;
+		if (addr.ss_family == AF_INET) p = ntohs(((struct sockaddr_in *)&addr)->sin_port);
+		else if (addr.ss_family == AF_INET6) p = ntohs(((struct sockaddr_in6 *)&addr)->sin6_port);
+		if (p == port) found = fd;
+	}
+	closedir(dir);
+	return found;
+}
+
+void event_loop_set_listen(int fd) {
+	if (fd == listen_fd) return;
+	if (listen_fd >= 0 && ep_fd >= 0) epoll_ctl(ep_fd, EPOLL_CTL_DEL, listen_fd, NULL);
+	listen_fd = fd;
+	if (listen_fd >= 0 && watch_listen && event_loop_init()) watch_fd(listen_fd);
+}
+
+int event_loop_listen_fd() {
+	return listen_fd;
+}
+
+void event_loop_watch_listen(bool on) {
+	if (watch_listen == on) return;
+	watch_listen = on;
+	if (listen_fd < 0 || !event_loop_init()) return;
+	if (on) watch_fd(listen_fd);
+	else epoll_ctl(ep_fd, EPOLL_CTL_DEL, listen_fd, NULL);
+}
+
+void event_loop_watch(int fd, bool on) {
+	if (fd < 0) return;
+	if (on) {
+		if (is_own_fd(fd) || n_own >= EVENT_LOOP_MAX_OWN) return;
+		own_fds[n_own++] = fd;
+		if (event_loop_init()) watch_fd(fd);
+	} else {
+		for (int i = 0; i < n_own; i++) {
+			if (own_fds[i] != fd) continue;
+			own_fds[i] = own_fds[--n_own];
+			if (ep_fd >= 0) epoll_ctl(ep_fd, EPOLL_CTL_DEL, fd, NULL);
+			break;
+		}
+	}
+}
+
+void event_loop_wake_within(ulong ms) {
+	if (wake_cap < 0 || (long)ms < wake_cap) wake_cap = (long)ms;
+}
+
+void event_loop_wakeup() {
+	if (wake_fd < 0) return;
+	uint64_t one = 1;
+	if (write(wake_fd, &one, sizeof(one)) < 0) {}
+}
+
+void event_loop_wait() {
+	if (!event_loop_init()) {
+		delay(1);
+		return;
+	}
+	ulong now = millis();
+
+	// the broker socket changes across reconnects; re-adding is a no-op
+	int fd = os.mqtt.socket_fd();
+	if (fd != mqtt_fd && mqtt_fd >= 0) epoll_ctl(ep_fd, EPOLL_CTL_DEL, mqtt_fd, NULL);
+	mqtt_fd = fd;
+	if (mqtt_fd >= 0) {
+		watch_fd(mqtt_fd);
+		if (os.mqtt.want_write()) event_loop_wake_within(0);
+	}
+
+	// -1 blocks until an fd is ready; tick_fd bounds that to the next second
+	int timeout = -1;
+	if ((long)(busy_until - now) > 0) timeout = 1;
+	if (wake_cap >= 0 && (timeout < 0 || wake_cap < timeout)) timeout = (int)wake_cap;
+	wake_cap = -1;
+
+	struct epoll_event evs[EVENT_LOOP_MAX_EVENTS];
+	int n = epoll_wait(ep_fd, evs, EVENT_LOOP_MAX_EVENTS, timeout);
+	for (int i = 0; i < n; i++) {
+		int rfd = evs[i].data.fd;
+		uint64_t val;
+		if (rfd == tick_fd) {
+			if (read(tick_fd, &val, sizeof(val)) < 0 && errno == ECANCELED) arm_tick();
+		} else if (rfd == wake_fd) {
+			if (read(wake_fd, &val, sizeof(val)) < 0) {}
+		} else if (rfd == listen_fd) {
+			// the server reads the request over several passes
+			busy_until = millis() + EVENT_LOOP_BUSY_MS;
+		}
+	}
+}
+
+#else
+
+void event_loop_wait() { delay(1); }
+int event_loop_find_listen_fd(uint16_t port) { (void)port; return -1; }
+void event_loop_set_listen(int fd) {(void)fd;}
+int event_loop_listen_fd() { return -1; }
+void event_loop_watch_listen(bool on) {(void)on;}
+void event_loop_watch(int fd, bool on) {(void)fd; (void)on;}
+void event_loop_wake_within(ulong ms) {(void)ms;}
+void event_loop_wakeup() {}
+
+#endif
+
+#endif
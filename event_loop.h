@@ -0,0 +1,71 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Linux main loop reactor: epoll over sockets and a per-second timerfd
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _EVENT_LOOP_H
+#define _EVENT_LOOP_H
+
+#include "defines.h"
+
+#if !defined(ARDUINO)
+
+/**
+ * @brief Block between two do_loop() passes until there is work.
+ * Wakes on a connection to a listening socket, MQTT broker traffic, the
+ * next wall-clock second (which also covers minute ticks), a wakeup from
+ * another thread, or the cap set by event_loop_wake_within().
+ * Falls back to a 1 ms sleep where epoll is not available.
+ */
+void event_loop_wait();
+
+/** Cap the next wait at ms milliseconds; call every pass while polling */
+void event_loop_wake_within(ulong ms);
+
+/** Wake the main loop from any thread */
+void event_loop_wakeup();
+
+/** Wake on incoming connections (default) or leave them to another thread */
+void event_loop_watch_listen(bool on);
+
+/** Find the socket listening on a TCP port; -1 if there is none */
+int event_loop_find_listen_fd(uint16_t port);
+
+/** Register the web server's listening socket (-1 clears it) */
+void event_loop_set_listen(int fd);
+
+/** The registered web server socket, -1 if none */
+int event_loop_listen_fd();
+
+/**
+ * @brief Wake on input from a socket the firmware serves itself.
+ * Stop watching before the socket is closed.
+ */
+void event_loop_watch(int fd, bool on);
+
+#else
+
+inline void event_loop_wake_within(ulong ms) {(void)ms;}
+inline void event_loop_wakeup() {}
+
+#endif
+
+#endif // _EVENT_LOOP_H
@@ -0,0 +1,384 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Server-sent event stream of controller state changes
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "event_stream.h"
+
+#if !defined(ARDUINO)
+
+#include "OpenSprinkler.h"
+#include "state_snapshot.h"
+#include "event_loop.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+extern OpenSprinkler os;
+
+#define EVENT_STREAM_RING          256    // events kept for resuming clients
+#define EVENT_STREAM_FRAME_SIZE    320    // one encoded event
+#define EVENT_STREAM_MAX_CLIENTS   8
+#define EVENT_STREAM_REQUEST_SIZE  1024   // request line and headers
+#define EVENT_STREAM_OUT_SIZE      2048   // frames batched into one send
+#define EVENT_STREAM_REQUEST_MS    5000   // time allowed for the request
+#define EVENT_STREAM_PING_MS       15000  // keep idle connections (and proxies) alive
+
+struct StreamFrame {
+	uint16_t len;
+	char text[EVENT_STREAM_FRAME_SIZE];
+};
+
+struct StreamClient {
+	int fd;           // -1: free slot
+	bool streaming;   // request accepted, events flow
+	uint32_t next;    // seq of the next event to send
+	ulong last_ms;    // accept time, then time of the last write
+	size_t in_len;
+	size_t out_pos;
+	size_t out_len;
+	char in[EVENT_STREAM_REQUEST_SIZE];
+	char out[EVENT_STREAM_OUT_SIZE];
+};
+
+static StreamFrame ring[EVENT_STREAM_RING];
+static uint32_t last_seq = 0;
+static uint32_t boot_id = 0;  // tells ids of a previous run apart
+static StreamClient clients[EVENT_STREAM_MAX_CLIENTS];
+static int listen_fd = -1;
+static uint16_t listen_port = 0;
+
+static const char stream_header[] =
+	"HTTP/1.1 200 OK\r\n"
+	"Content-Type: text/event-stream\r\n"
+	"Cache-Control: no-cache\r\n"
+	"Connection: keep-alive\r\n"
+	"Access-Control-Allow-Origin: *\r\n"
+	"\r\n"
+	"retry: 3000\n\n";
+
+static uint32_t stream_boot_id() {
+	if (!boot_id) boot_id = (((uint32_t)time(NULL) * 2654435761u) ^ (uint32_t)getpid()) | 1;
+	return boot_id;
+}
+
+static uint32_t first_seq() {
+	return (last_seq >= EVENT_STREAM_RING) ? last_seq - EVENT_STREAM_RING + 1 : 1;
+}
+
+static void client_close(StreamClient &c) {
+	if (c.fd < 0) return;
+	event_loop_watch(c.fd, false);
+	close(c.fd);
+	c.fd = -1;
+}
+
+// Best effort reply to a request that does not become a stream
+static void client_reject(StreamClient &c, const char *status, uint8_t result) {
+	char buf[192];
+	char body[16];
+	int blen = snprintf(body, sizeof(body), "{\"result\":%d}", result);
+	int len = snprintf(buf, sizeof(buf),
+		"HTTP/1.1 %s\r\nContent-Type: application/json\r\nAccess-Control-Allow-Origin: *\r\n"
+		"Connection: close\r\nContent-Length: %d\r\n\r\n%s", status, blen, body);
+	if (send(c.fd, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {}
+	client_close(c);
+}
+
+static bool client_append(StreamClient &c, const char *text, size_t len) {
+	if (c.out_len + len > sizeof(c.out)) return false;
+	memcpy(c.out + c.out_len, text, len);
+	c.out_len += len;
+	return true;
+}
+
+// Tell the client it missed events: reload the full state, then follow on
+static void client_append_reset(StreamClient &c) {
+	char buf[96];
+	int len = snprintf(buf, sizeof(buf), "id: %08x.%u\nevent: reset\ndata: {\"seq\":%u}\n\n",
+		stream_boot_id(), last_seq, last_seq);
+	client_append(c, buf, len);
+	c.next = last_seq + 1;
+}
+
+// Look up a query parameter; values used here need no url decoding
+static bool query_value(const char *query, const char *key, char *val, size_t size) {
+	size_t klen = strlen(key);
+	const char *p = query;
+	while (p && *p) {
+		if (!strncmp(p, key, klen) && p[klen] == '=') {
+			p += klen + 1;
+			size_t n = strcspn(p, "&");
+			if (n >= size) n = size - 1;
+			memcpy(val, p, n);
+			val[n] = 0;
+			return true;
+		}
+		p = strchr(p, '&');
+		if (p) p++;
+	}
+	return false;
+}
+
+// Parse "<boot>.<seq>" and pick the first event to send
+static void client_resume(StreamClient &c, const char *last_id) {
+	unsigned int boot = 0, seq = 0;
+	if (last_id && sscanf(last_id, "%x.%u", &boot, &seq) == 2 && boot == stream_boot_id() &&
+	    seq <= last_seq && seq + 1 >= first_seq()) {
+		c.next = seq + 1;
+	} else {
+		client_append_reset(c);
+	}
+}
+
+static void client_request(StreamClient &c) {
+	c.in[c.in_len] = 0;
+	if (!strstr(c.in, "\r\n\r\n")) {
+		if (c.in_len >= sizeof(c.in) - 1) client_reject(c, "431 Request Header Fields Too Large", 0x10);
+		return;
+	}
+	if (strncmp(c.in, "GET ", 4)) {
+		client_reject(c, "405 Method Not Allowed", 0x20);
+		return;
+	}
+	char *path = c.in + 4;
+	char *end = path + strcspn(path, " \r\n");
+	*end = 0;
+	char *query = strchr(path, '?');
+	if (query) *query++ = 0;
+	if (strcmp(path, "/events")) {
+		client_reject(c, "404 Not Found", 0x20);
+		return;
+	}
+
+	char pw[40] = {0};
+	if (query) query_value(query, "pw", pw, sizeof(pw));
+#if !defined(DEMO)
+	if (!os.iopts[IOPT_IGNORE_PASSWORD] && !os.password_verify(pw)) {
+		client_reject(c, "401 Unauthorized", 0x02);
+		return;
+	}
+#endif
+
+	char last_id[32];
+	const char *resume = NULL;
+	const char *h = strcasestr(end + 1, "\nLast-Event-ID:");
+	if (h) {
+		h += strlen("\nLast-Event-ID:");
+		h += strspn(h, " ");
+		size_t n = strcspn(h, "\r\n");
+		if (n >= sizeof(last_id)) n = sizeof(last_id) - 1;
+		memcpy(last_id, h, n);
+		last_id[n] = 0;
+		resume = last_id;
+	} else if (query && query_value(query, "id", last_id, sizeof(last_id))) {
+		resume = last_id;
+	}
+
+	c.streaming = true;
+	c.out_pos = c.out_len = 0;
+	client_append(c, stream_header, sizeof(stream_header) - 1);
+	client_resume(c, resume);
+	DEBUG_PRINTF("event stream: client on fd %d from seq %u\n", c.fd, c.next);
+}
+
+// Read the request, or drain what a streaming client sends; false once closed
+static bool client_read(StreamClient &c) {
+	for (;;) {
+		char drain[256];
+		char *buf = c.streaming ? drain : c.in + c.in_len;
+		size_t size = c.streaming ? sizeof(drain) : sizeof(c.in) - 1 - c.in_len;
+		if (size == 0) return true;
+		ssize_t n = recv(c.fd, buf, size, MSG_DONTWAIT);
+		if (n == 0) return false;
+		if (n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+		if (!c.streaming) c.in_len += n;
+	}
+}
+
+// Send what is pending and refill from the ring; false once the client is gone
+static bool client_write(StreamClient &c, ulong now) {
+	for (;;) {
+		while (c.out_pos < c.out_len) {
+			ssize_t n = send(c.fd, c.out + c.out_pos, c.out_len - c.out_pos, MSG_DONTWAIT | MSG_NOSIGNAL);
+			if (n < 0) {
+				if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+					event_loop_wake_within(20);  // socket buffer full, retry soon
+					return true;
+				}
+				return false;
+			}
+			c.out_pos += n;
+			c.last_ms = now;
+		}
+		c.out_pos = c.out_len = 0;
+
+		if (c.next > last_seq) {
+			if (now - c.last_ms < EVENT_STREAM_PING_MS) return true;
+			client_append(c, ":\n\n", 3);
+			continue;
+		}
+		if (c.next < first_seq()) client_append_reset(c);  // too slow, events were dropped
+		while (c.next <= last_seq) {
+			const StreamFrame &f = ring[c.next % EVENT_STREAM_RING];
+			if (!client_append(c, f.text, f.len)) break;
+			c.next++;
+		}
+	}
+}
+
+static void accept_clients(ulong now) {
+	for (;;) {
+		int fd = accept(listen_fd, NULL, NULL);
+		if (fd < 0) return;
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+		StreamClient *c = NULL;
+		for (uint8_t i = 0; i < EVENT_STREAM_MAX_CLIENTS; i++) {
+			if (clients[i].fd < 0) { c = &clients[i]; break; }
+		}
+		if (!c) {
+			StreamClient busy;
+			busy.fd = fd;
+			client_reject(busy, "503 Service Unavailable", 0x20);
+			continue;
+		}
+		c->fd = fd;
+		c->streaming = false;
+		c->in_len = c->out_pos = c->out_len = 0;
+		c->next = 0;
+		c->last_ms = now;
+		event_loop_watch(fd, true);
+	}
+}
+
+void event_stream_start(uint16_t port) {
+	if (port == listen_port && listen_fd >= 0) return;
+	for (uint8_t i = 0; i < EVENT_STREAM_MAX_CLIENTS; i++) client_close(clients[i]);
+	if (listen_fd >= 0) {
+		event_loop_watch(listen_fd, false);
+		close(listen_fd);
+		listen_fd = -1;
+	}
+	listen_port = port;
+	if (!port) return;
+
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) return;
+	int one = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	struct sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 4) < 0) {
+		DEBUG_PRINTF("event stream: cannot listen on port %u\n", port);
+		close(fd);
+		return;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	listen_fd = fd;
+	event_loop_watch(listen_fd, true);
+	DEBUG_PRINTF("event stream: listening on port %u\n", port);
+}
+
+void event_stream_loop() {
+	if (listen_fd < 0) return;
+	ulong now = millis();
+	accept_clients(now);
+	for (uint8_t i = 0; i < EVENT_STREAM_MAX_CLIENTS; i++) {
+		StreamClient &c = clients[i];
+		if (c.fd < 0) continue;
+		if (!client_read(c)) {
+			client_close(c);
+			continue;
+		}
+		if (!c.streaming) {
+			client_request(c);
+			if (c.fd >= 0 && !c.streaming && now - c.last_ms > EVENT_STREAM_REQUEST_MS) client_close(c);
+			if (c.fd < 0 || !c.streaming) continue;
+		}
+		if (!client_write(c, now)) client_close(c);
+	}
+}
+
+void event_stream_post(const char *type, const char *fmt, ...) {
+	char data[EVENT_STREAM_FRAME_SIZE];
+	va_list ap;
+	va_start(ap, fmt);
+	int n = vsnprintf(data, sizeof(data), fmt, ap);
+	va_end(ap);
+
+	// the slot still holds the oldest buffered event until this one fits
+	char text[EVENT_STREAM_FRAME_SIZE];
+	uint32_t seq = last_seq + 1;
+	int len = (n < 0 || n >= (int)sizeof(data)) ? -1 :
+		snprintf(text, sizeof(text), "id: %08x.%u\nevent: %s\ndata: %s\n\n", stream_boot_id(), seq, type, data);
+	if (len < 0 || len >= (int)sizeof(text)) {
+		DEBUG_PRINTF("event stream: %s event too long, dropped\n", type);
+		return;
+	}
+	StreamFrame &f = ring[seq % EVENT_STREAM_RING];
+	memcpy(f.text, text, len);
+	f.len = (uint16_t)len;
+	last_seq = seq;
+}
+
+void event_stream_state(const StateSnapshot &prev, const StateSnapshot &next) {
+	for (uint8_t sid = 0; sid < next.nstations; sid++) {
+		if (prev.is_running(sid) != next.is_running(sid)) {
+			event_stream_post("station", "{\"sid\":%d,\"on\":%d}", sid, next.is_running(sid));
+		}
+		const StationSnapshot &a = prev.stations[sid];
+		const StationSnapshot &b = next.stations[sid];
+		if (a.pid != b.pid || a.st != b.st || a.dur != b.dur) {
+			event_stream_post("queue", "{\"sid\":%d,\"pid\":%d,\"st\":%u,\"dur\":%u}", sid, b.pid, b.st, b.dur);
+		}
+	}
+	if (prev.enabled != next.enabled || prev.rain_delayed != next.rain_delayed ||
+	    prev.rd_stop_time != next.rd_stop_time || prev.sensor1_active != next.sensor1_active ||
+	    prev.sensor2_active != next.sensor2_active || prev.pause_state != next.pause_state ||
+	    prev.nqueue != next.nqueue) {
+		event_stream_post("status", "{\"en\":%d,\"rd\":%d,\"rdst\":%u,\"sn1\":%d,\"sn2\":%d,\"pq\":%d,\"nq\":%d}",
+			next.enabled, next.rain_delayed, next.rd_stop_time, next.sensor1_active,
+			next.sensor2_active, next.pause_state, next.nqueue);
+	}
+	if (memcmp(&prev.lastrun, &next.lastrun, sizeof(LogStruct))) {
+		event_stream_post("lrun", "{\"sid\":%d,\"pid\":%d,\"dur\":%u,\"end\":%lu}", next.lastrun.station,
+			next.lastrun.program, (unsigned)next.lastrun.duration, (ulong)next.lastrun.endtime);
+	}
+	if (prev.flowcount_rt != next.flowcount_rt) {
+		event_stream_post("flow", "{\"flcrt\":%lu,\"flcto\":%lu}", next.flowcount_rt, next.flow_count);
+	}
+}
+
+#endif
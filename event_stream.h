@@ -0,0 +1,72 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Server-sent event stream of controller state changes
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _EVENT_STREAM_H
+#define _EVENT_STREAM_H
+
+#include "defines.h"
+
+struct StateSnapshot;
+
+#if !defined(ARDUINO)
+
+/**
+ * Local push channel for UIs and bridges that would otherwise poll /jc and
+ * /js. Clients open an EventSource on http://<host>:<port>/events?pw=<md5>
+ * and receive one Server-Sent Event per change:
+ *   station  {"sid":s,"on":0|1}
+ *   queue    {"sid":s,"pid":p,"st":t,"dur":d}   (pid 0: left the queue)
+ *   status   {"en","rd","rdst","sn1","sn2","pq","nq"}
+ *   lrun     {"sid","pid","dur","end"}
+ *   flow     {"flcrt":pulses per window,"flcto":total pulses}
+ *   sensor   {"nr","data","ok"}
+ *   monitor  {"nr","active"}
+ *   log      one log record, as stored in the log files
+ * Event ids are "<boot>.<seq>". A reconnecting EventSource sends the last id
+ * back (Last-Event-ID, or ?id= for clients that cannot set headers) and
+ * resumes without loss while the events are still buffered. Otherwise the
+ * stream starts with a "reset" event: reload the full state, then apply
+ * the events that follow.
+ */
+
+/** Listen on port (0 closes the listener and all clients); main loop only */
+void event_stream_start(uint16_t port);
+
+/** Accept clients and send them the pending events (main loop, every pass) */
+void event_stream_loop();
+
+/** Queue an event; fmt and the arguments produce the JSON data (main loop only) */
+void event_stream_post(const char *type, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/** Queue the events describing the change from prev to next */
+void event_stream_state(const StateSnapshot &prev, const StateSnapshot &next);
+
+#else
+
+inline void event_stream_loop() {}
+inline void event_stream_post(const char *type, const char *fmt, ...) {(void)type; (void)fmt;}
+inline void event_stream_state(const StateSnapshot &prev, const StateSnapshot &next) {(void)prev; (void)next;}
+
+#endif
+
+#endif // _EVENT_STREAM_H
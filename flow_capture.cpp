@@ -0,0 +1,190 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Edge-triggered flow meter capture: timestamped pulse ring and rate estimator
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "flow_capture.h"
+#include "defines.h"
+#include "utils.h"
+
+#if defined(ARDUINO)
+	#include <Arduino.h>
+	#define FLOW_ISR_ATTR IRAM_ATTR
+#else
+	#include "gpio.h"
+	#include <pthread.h>
+	#include <stdio.h>
+	#include <stdlib.h>
+	#include <string.h>
+	#include <unistd.h>
+	#define FLOW_ISR_ATTR
+#endif
+
+#define FLOW_RING_MASK (FLOW_RING_SIZE - 1)
+static_assert((FLOW_RING_SIZE & FLOW_RING_MASK) == 0, "FLOW_RING_SIZE must be a power of two");
+
+// Single producer (ISR, GPIO event thread, trace thread or the polling
+// fallback, only one of them at a time) and single consumer (main loop).
+static uint32_t flow_ring[FLOW_RING_SIZE];
+static uint16_t flow_ring_head = 0;  // written by the producer
+static uint16_t flow_ring_tail = 0;  // written by the consumer
+static volatile uint32_t flow_dropped = 0;
+static uint32_t flow_last_edge_us = 0;
+static bool flow_have_edge = false;
+static volatile bool flow_edge_on = false;
+
+void FLOW_ISR_ATTR flow_capture_push(uint32_t ts_us) {
+	if (flow_have_edge && (uint32_t)(ts_us - flow_last_edge_us) < FLOW_DEBOUNCE_US) return;
+	flow_have_edge = true;
+	flow_last_edge_us = ts_us;
+
+	uint16_t head = __atomic_load_n(&flow_ring_head, __ATOMIC_RELAXED);
+	uint16_t tail = __atomic_load_n(&flow_ring_tail, __ATOMIC_ACQUIRE);
+	if ((uint16_t)(head - tail) >= FLOW_RING_SIZE) {
+		flow_dropped = flow_dropped + 1;
+		return;
+	}
+	flow_ring[head & FLOW_RING_MASK] = ts_us;
+	__atomic_store_n(&flow_ring_head, (uint16_t)(head + 1), __ATOMIC_RELEASE);
+}
+
+uint8_t flow_capture_drain(uint32_t *ts_us, uint8_t max) {
+	uint16_t tail = __atomic_load_n(&flow_ring_tail, __ATOMIC_RELAXED);
+	uint16_t head = __atomic_load_n(&flow_ring_head, __ATOMIC_ACQUIRE);
+	uint8_t n = 0;
+	while (tail != head && n < max) {
+		ts_us[n++] = flow_ring[tail & FLOW_RING_MASK];
+		tail++;
+	}
+	__atomic_store_n(&flow_ring_tail, tail, __ATOMIC_RELEASE);
+	return n;
+}
+
+uint32_t flow_capture_dropped() {
+	return flow_dropped;
+}
+
+bool flow_capture_edge_driven() {
+	return flow_edge_on;
+}
+
+bool FlowRateEstimator::add(uint32_t ts_us) {
+	if (!seeded) {
+		seeded = true;
+		last_us = ts_us;
+		return false;
+	}
+	uint32_t interval = ts_us - last_us;
+	last_us = ts_us;
+	if (!interval) interval = 1;
+	period = period ? (interval / 5 + period / 5 * 4) : interval;
+	return true;
+}
+
+#if defined(ARDUINO)
+
+static int flow_irq_pin = -1;
+
+static void FLOW_ISR_ATTR flow_isr() {
+	flow_capture_push((uint32_t)micros());
+}
+
+bool flow_capture_begin(unsigned char pin) {
+	if (flow_edge_on) return true;
+	#if defined(IOEXP_PIN)
+	if (pin >= IOEXP_PIN) return false;  // expander inputs cannot interrupt, keep polling
+	#endif
+	int irq = digitalPinToInterrupt(pin);
+	if (irq < 0) return false;
+	pinMode(pin, INPUT_PULLUP);
+	attachInterrupt(irq, flow_isr, FALLING);
+	flow_irq_pin = pin;
+	flow_edge_on = true;
+	return true;
+}
+
+void flow_capture_end() {
+	if (!flow_edge_on) return;
+	detachInterrupt(digitalPinToInterrupt(flow_irq_pin));
+	flow_irq_pin = -1;
+	flow_edge_on = false;
+}
+
+#else
+
+// Linux event threads cannot be torn down, so once started they stay and
+// flow_edge_on gates whether their pulses are recorded.
+static bool flow_events_started = false;
+
+static void flow_event_cb(uint32_t ts_us) {
+	if (flow_edge_on) flow_capture_push(ts_us);
+}
+
+static void *flow_trace_thread(void *arg) {
+	char *path = (char*)arg;
+	FILE *fp = fopen(path, "r");
+	if (!fp) {
+		DEBUG_PRINTF("[FLOW] cannot open trace %s\n", path);
+		free(path);
+		return NULL;
+	}
+	DEBUG_PRINTF("[FLOW] replaying trace %s\n", path);
+	char line[32];
+	uint32_t start = (uint32_t)micros();
+	while (fgets(line, sizeof(line), fp)) {
+		if (line[0] == '#' || line[0] == '\n') continue;
+		uint32_t offset = (uint32_t)strtoul(line, NULL, 10);
+		uint32_t elapsed = (uint32_t)micros() - start;
+		if (offset > elapsed) usleep(offset - elapsed);
+		flow_event_cb((uint32_t)micros());
+	}
+	fclose(fp);
+	DEBUG_PRINTF("[FLOW] trace %s done\n", path);
+	free(path);
+	return NULL;
+}
+
+bool flow_capture_begin(unsigned char pin) {
+	if (!flow_events_started) {
+		const char *trace = getenv("OS_FLOW_TRACE");
+		if (trace && *trace) {
+			pthread_t tid;
+			char *path = strdup(trace);
+			if (!path || pthread_create(&tid, NULL, flow_trace_thread, path) != 0) {
+				free(path);
+				return false;
+			}
+			pthread_detach(tid);
+			flow_events_started = true;
+		} else {
+			if (!gpio_edge_start(pin, flow_event_cb)) return false;
+			flow_events_started = true;
+		}
+	}
+	flow_edge_on = true;
+	return true;
+}
+
+void flow_capture_end() {
+	flow_edge_on = false;
+}
+
+#endif
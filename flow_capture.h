@@ -0,0 +1,77 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Edge-triggered flow meter capture: timestamped pulse ring and rate estimator
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _FLOW_CAPTURE_H
+#define _FLOW_CAPTURE_H
+
+#include <stdint.h>
+
+// Pulses buffered between two main loop drains. Must be a power of two;
+// 64 covers a 200 Hz meter for over 300 ms of a stalled loop.
+#define FLOW_RING_SIZE     64
+// Edges closer than this are contact bounce or RF glitches (caps at 200 Hz)
+#define FLOW_DEBOUNCE_US   5000
+
+/**
+ * @brief Start edge-driven capture on the flow sensor pin.
+ * On ESP the pin gets a falling-edge interrupt; on Linux the GPIO backend
+ * delivers kernel edge events. Returns false if the pin cannot raise edges
+ * (e.g. it sits on an IO expander), in which case the caller keeps polling
+ * and feeds flow_capture_push() itself.
+ * On Linux, if OS_FLOW_TRACE names a file of pulse offsets (microseconds from
+ * the start, one per line), the trace is replayed instead of reading the pin.
+ */
+bool flow_capture_begin(unsigned char pin);
+void flow_capture_end();
+/** True while pulses arrive from interrupts/events rather than polling */
+bool flow_capture_edge_driven();
+
+/** Record a falling edge at micros() time ts_us. Single producer. */
+void flow_capture_push(uint32_t ts_us);
+/** Move up to max buffered pulse timestamps into ts_us, oldest first */
+uint8_t flow_capture_drain(uint32_t *ts_us, uint8_t max);
+/** Pulses lost because the ring was full */
+uint32_t flow_capture_dropped();
+
+/**
+ * Pulse interval average on microsecond timestamps. Each new interval is
+ * weighted 1/5 against the running average, matching the previous
+ * millisecond estimator but without its rounding at high pulse rates.
+ * A single instance serves the one flow sensor; per-station averages are
+ * still kept by update_station_flow_average() when a station stops.
+ */
+class FlowRateEstimator {
+public:
+	FlowRateEstimator() { reset(); }
+	void reset() { last_us = 0; period = 0; seeded = false; }
+	/** Add a pulse; returns true once an interval estimate is available */
+	bool add(uint32_t ts_us);
+	/** Average pulse interval in microseconds, 0 until two pulses are seen */
+	uint32_t period_us() const { return period; }
+private:
+	uint32_t last_us;
+	uint32_t period;
+	bool seeded;
+};
+
+#endif // _FLOW_CAPTURE_H
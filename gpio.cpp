@@ -217,6 +217,7 @@ unsigned char digitalReadExt(unsigned char pin) {
 	#include <poll.h>
 	#include <pthread.h>
 #endif
+#include <errno.h>
 
 // sysfs GPIO implementation for OSPI (non-LIBGPIOD)
 
@@ -231,8 +232,8 @@ static int sysFds[GPIO_MAX] = {
 	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
 } ;
 
-// Interrupt service routine functions
-static void (*isrFunctions [GPIO_MAX])(void);
+// Edge event callbacks
+static void (*edgeCallbacks [GPIO_MAX])(uint32_t);
 
 static volatile int		 pinPass = -1 ;
 static pthread_mutex_t pinMutex ;
@@ -383,6 +384,28 @@ void digitalWrite(int pin, unsigned char value) {
 	close(fd);
 }
 
+/** Shift bytes out with the value files held open for the whole transfer */
+void gpio_shift_out(int clk, int dat, const unsigned char *bytes, int n) {
+	int fclk = gpio_fd_open(clk);
+	int fdat = gpio_fd_open(dat);
+	if (fclk >= 0 && fdat >= 0) {
+		int level = -1;
+		for (int i = 0; i < n; i++) {
+			for (unsigned char s = 0; s < 8; s++) {
+				int bit = (bytes[i] >> (7-s)) & 1;
+				gpio_write(fclk, LOW);
+				if (bit != level) {
+					gpio_write(fdat, bit);
+					level = bit;
+				}
+				gpio_write(fclk, HIGH);
+			}
+		}
+	}
+	if (fclk >= 0) close(fclk);
+	if (fdat >= 0) close(fdat);
+}
+
 static int HiPri (const int pri) {
 	struct sched_param sched ;
 
@@ -419,7 +442,9 @@ static int waitForInterrupt (int pin, int mS)
 	return x ;
 }
 
-static void *interruptHandler (void *arg) {
+#include "utils.h"
+
+static void *edgeHandler (void *arg) {
 	int myPin ;
 
 	(void) HiPri (55) ;  // Only effective if we run as root
@@ -427,24 +452,31 @@ static void *interruptHandler (void *arg) {
 	myPin		= pinPass ;
 	pinPass = -1 ;
 
-	for (;;)
-		if (waitForInterrupt (myPin, -1) > 0)
-			isrFunctions[myPin]() ;
+	for (;;) {
+		int x = waitForInterrupt (myPin, -1) ;
+		if (x > 0)
+			edgeCallbacks[myPin]((uint32_t)micros()) ;  // stamp as soon as poll() returns
+		else if (x < 0 && errno != EINTR)
+			delay (1000) ;  // don't spin on a broken fd
+	}
 
 	return NULL ;
 }
 
-#include "utils.h"
-/** Attach an interrupt function to pin */
-void attachInterrupt(int pin, const char* mode, void (*isr)(void)) {
-	if((pin<0)||(pin>GPIO_MAX)) {
+/** Deliver falling edges on pin to cb from a dedicated thread */
+bool gpio_edge_start(int pin, void (*cb)(uint32_t ts_us)) {
+	if((pin<0)||(pin>=GPIO_MAX)) {
 		DEBUG_PRINTLN(F("pin out of range"));
-		return;
+		return false;
+	}
+	if(edgeCallbacks[pin]) {  // already running, just swap the callback
+		edgeCallbacks[pin] = cb;
+		return true;
 	}
 
 	// set pin to INPUT mode and set interrupt edge mode
 	pinMode(pin, INPUT);
-	GPIOSetEdge(pin, mode);
+	GPIOSetEdge(pin, "falling");
 
 	char path[BUFFER_MAX];
 	snprintf(path, BUFFER_MAX, "/sys/class/gpio/gpio%d/value", pin);
@@ -453,7 +485,7 @@ void attachInterrupt(int pin, const char* mode, void (*isr)(void)) {
 	if(sysFds[pin]==-1) {
 		if((sysFds[pin]=open(path, O_RDWR))<0) {
 			DEBUG_PRINTLN(F("failed to open gpio value for reading"));
-			return;
+			return false;
 		}
 	}
 
@@ -464,16 +496,21 @@ void attachInterrupt(int pin, const char* mode, void (*isr)(void)) {
 	for (i=0; i<count; i++)
 		read (sysFds[pin], &c, 1) ;
 
-	// record isr function
-	isrFunctions[pin] = isr;
+	// record callback
+	edgeCallbacks[pin] = cb;
 
 	pthread_t threadId ;
 	pthread_mutex_lock (&pinMutex) ;
 		pinPass = pin ;
-		pthread_create (&threadId, NULL, interruptHandler, NULL) ;
+		if (pthread_create (&threadId, NULL, edgeHandler, NULL) != 0) {
+			pinPass = -1 ;
+			edgeCallbacks[pin] = NULL;
+		}
 		while (pinPass != -1)
 			delay(1) ;
 	pthread_mutex_unlock (&pinMutex) ;
+	if (edgeCallbacks[pin]) pthread_detach (threadId) ;
+	return edgeCallbacks[pin] != NULL;
 }
 #elif defined(LIBLGPIO) // use lgpio (Raspberry Pi OS Trixie / Debian 13+)
 
@@ -575,6 +612,32 @@ void digitalWrite(int pin, unsigned char value) {
 	}
 }
 
+static void (*lgpio_edge_cb)(uint32_t) = NULL;
+
+// lgpio delivers alerts in batches with kernel timestamps (ns); map them onto
+// micros() relative to the newest alert so the spacing is preserved
+static void lgpio_alerts(int num_alerts, lgGpioAlert_p alerts, void *userdata) {
+	(void)userdata;
+	if (num_alerts <= 0 || !lgpio_edge_cb) return;
+	uint32_t now_us = (uint32_t)micros();
+	uint64_t newest = alerts[num_alerts-1].report.timestamp;
+	for (int i = 0; i < num_alerts; i++) {
+		if (alerts[i].report.level != 0) continue;  // falling edges only
+		lgpio_edge_cb(now_us - (uint32_t)((newest - alerts[i].report.timestamp) / 1000));
+	}
+}
+
+/** Deliver falling edges on pin to cb from the lgpio alert thread */
+bool gpio_edge_start(int pin, void (*cb)(uint32_t ts_us)) {
+	if (init_lgpio() != 0) return false;
+	lgpio_edge_cb = cb;
+	if (lgGpioClaimAlert(lgpio_handle, LG_SET_PULL_UP, LG_FALLING_EDGE, pin, -1) < 0) {
+		DEBUG_PRINTLN(F("failed to claim gpio alert"));
+		return false;
+	}
+	return lgGpioSetAlertsFunc(lgpio_handle, pin, lgpio_alerts, NULL) >= 0;
+}
+
 #else // use GPIOD (Raspberry Pi OS Bookworm / Debian 12)
 
 /**
@@ -595,6 +658,7 @@ void digitalWrite(int pin, unsigned char value) {
 #include <string.h>
 #include <poll.h>
 #include <pthread.h>
+#include <errno.h>
 #include <gpiod.h>
 
 #include "utils.h"
@@ -736,7 +800,102 @@ void digitalWrite(int pin, unsigned char value) {
 		DEBUG_PRINTLN(pin);
 	}
 }
+
+static void (*gpiod_edge_cb)(uint32_t) = NULL;
+
+static uint64_t gpiod_event_ns(const struct gpiod_line_event &ev) {
+	return (uint64_t)ev.ts.tv_sec * 1000000000ULL + (uint64_t)ev.ts.tv_nsec;
+}
+
+// Blocks on the line's event queue. The kernel timestamps every edge and
+// queues it, so a delayed wake-up only batches events without losing them.
+static void *gpiod_edge_thread(void *arg) {
+	struct gpiod_line *line = (struct gpiod_line *)arg;
+	struct gpiod_line_event events[16];
+	for (;;) {
+		int n = gpiod_line_event_wait(line, NULL);
+		if (n > 0) n = gpiod_line_event_read_multiple(line, events, 16);
+		if (n < 0 && errno != EINTR) {
+			// the line went away or the chip reports errors: back off instead
+			// of spinning, the pulses are lost either way
+			DEBUG_PRINTLN(F("gpio edge wait failed"));
+			delay(1000);
+		}
+		if (n <= 0) continue;
+		uint32_t now_us = (uint32_t)micros();
+		uint64_t newest = gpiod_event_ns(events[n-1]);
+		for (int i = 0; i < n; i++) {
+			if (events[i].event_type != GPIOD_LINE_EVENT_FALLING_EDGE) continue;
+			gpiod_edge_cb(now_us - (uint32_t)((newest - gpiod_event_ns(events[i])) / 1000));
+		}
+	}
+	return NULL;
+}
+
+/** Deliver falling edges on pin to cb from a dedicated thread */
+bool gpio_edge_start(int pin, void (*cb)(uint32_t ts_us)) {
+	if (gpiod_edge_cb) {  // already running, just swap the callback
+		gpiod_edge_cb = cb;
+		return true;
+	}
+	if( assert_gpiod_line(pin) ) { return false; }
+	// re-request the line for edge events (it may be claimed as a plain input)
+	gpiod_line_release(gpio_lines[pin]);
+	if (gpiod_line_request_falling_edge_events_flags(gpio_lines[pin], gpio_consumer, GPIOD_LINE_REQUEST_FLAG_BIAS_PULL_UP) < 0) {
+		DEBUG_PRINTLN(F("failed to request gpio edge events"));
+		pinMode(pin, INPUT_PULLUP);
+		return false;
+	}
+	gpiod_edge_cb = cb;
+	pthread_t threadId;
+	if (pthread_create(&threadId, NULL, gpiod_edge_thread, gpio_lines[pin]) != 0) {
+		gpiod_edge_cb = NULL;
+		return false;
+	}
+	pthread_detach(threadId);
+	return true;
+}
 #endif
 
-#else
+#elif defined(OSPI) && defined(GPIO_SIMULATION)
+
+#define GPIO_MAX 64
+
+static unsigned char sim_levels[GPIO_MAX];
+static unsigned long sim_writes = 0;
+static unsigned long sim_transitions = 0;
+
+void digitalWrite(int pin, unsigned char value) {
+	sim_writes++;
+	if (pin < 0 || pin >= GPIO_MAX) return;
+	value = value ? HIGH : LOW;
+	if (sim_levels[pin] != value) {
+		sim_levels[pin] = value;
+		sim_transitions++;
+	}
+}
+
+void gpio_sim_counters(unsigned long *writes, unsigned long *transitions) {
+	if (writes) *writes = sim_writes;
+	if (transitions) *transitions = sim_transitions;
+}
+
+#endif
+
+#if defined(OSPI) && (defined(LIBGPIOD) || defined(LIBLGPIO) || defined(GPIO_SIMULATION))
+/** Shift bytes out; the data line is only written when the bit changes */
+void gpio_shift_out(int clk, int dat, const unsigned char *bytes, int n) {
+	int level = -1;
+	for (int i = 0; i < n; i++) {
+		for (unsigned char s = 0; s < 8; s++) {
+			int bit = (bytes[i] >> (7-s)) & 1;
+			digitalWrite(clk, LOW);
+			if (bit != level) {
+				digitalWrite(dat, bit);
+				level = bit;
+			}
+			digitalWrite(clk, HIGH);
+		}
+	}
+}
 #endif
@@ -129,12 +129,16 @@ unsigned char digitalReadExt(unsigned char pin);
 #define LOW    0
 
 inline void pinMode(int pin, unsigned char mode) {(void)pin; (void)mode;}
-inline void digitalWrite(int pin, unsigned char value) {(void)pin; (void)value;}
+void digitalWrite(int pin, unsigned char value);
 inline int gpio_fd_open(int pin, int mode = 0) {(void)pin; (void)mode; return -1;}
 inline void gpio_fd_close(int fd) {(void)fd;}
 inline void gpio_write(int fd, unsigned char value) {(void)fd; (void)value;}
 inline unsigned char digitalRead(int pin) {(void)pin; return LOW;}
-inline void attachInterrupt(int pin, const char* mode, void (*isr)(void)) {(void)pin; (void)mode; (void)isr;}
+inline bool gpio_edge_start(int pin, void (*cb)(uint32_t ts_us)) {(void)pin; (void)cb; return false;}
+void gpio_shift_out(int clk, int dat, const unsigned char *bytes, int n);
+// pin writes and actual level changes seen by the simulated backend,
+// used to measure output traffic without hardware
+void gpio_sim_counters(unsigned long *writes, unsigned long *transitions);
 
 #else
 
@@ -157,8 +161,12 @@ int gpio_fd_open(int pin, int mode = O_WRONLY);
 void gpio_fd_close(int fd);
 void gpio_write(int fd, unsigned char value);
 unsigned char digitalRead(int pin);
-// mode can be any of 'rising', 'falling', 'both'
-void attachInterrupt(int pin, const char* mode, void (*isr)(void));
+// deliver falling edges on pin to cb (from a gpio event thread) with the
+// micros() timestamp of each edge; returns false if events are unavailable
+bool gpio_edge_start(int pin, void (*cb)(uint32_t ts_us));
+// clock n bytes out MSB first on dat/clk (data set while clk is low,
+// sampled on the rising edge); the caller drives the latch
+void gpio_shift_out(int clk, int dat, const unsigned char *bytes, int n);
 
 #endif
 
@@ -181,7 +189,7 @@ inline int gpio_fd_open(int pin, int mode = 0) {(void)pin; (void)mode; return -1
 inline void gpio_fd_close(int fd) {(void)fd;}
 inline void gpio_write(int fd, unsigned char value) {(void)fd; (void)value;}
 inline unsigned char digitalRead(int pin) {(void)pin; return LOW;}
-inline void attachInterrupt(int pin, const char* mode, void (*isr)(void)) {(void)pin; (void)mode; (void)isr;}
+inline bool gpio_edge_start(int pin, void (*cb)(uint32_t ts_us)) {(void)pin; (void)cb; return false;}
 
 #endif
 
@@ -0,0 +1,334 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Keep-alive connection pool and host health for outbound HTTP requests
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "http_pool.h"
+#include "defines.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#if defined(ESP8266)
+#include <WiFiClientSecure.h>
+#endif
+#if defined(OSPI)
+#include <pthread.h>
+#include <sys/socket.h>
+#include <errno.h>
+#endif
+
+struct PoolSlot {
+	HttpPoolClient *c;
+	char host[64];
+	uint16_t port;
+	bool tls;
+	ulong since;
+};
+
+struct HostState {
+	char host[64];
+	uint16_t port;
+	bool tls;
+	uint8_t fails;
+	ulong retry_at;
+	ulong used;
+#if defined(ESP8266)
+	BearSSL::Session *session;
+#endif
+};
+
+static PoolSlot pool[HTTP_POOL_IDLE_MAX];
+static HostState hosts[HTTP_POOL_HOSTS];
+
+#if defined(OSPI)
+// requests also run on the async HTTP worker threads
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+struct PoolLock {
+	PoolLock() { pthread_mutex_lock(&pool_mutex); }
+	~PoolLock() { pthread_mutex_unlock(&pool_mutex); }
+};
+#else
+struct PoolLock {
+	PoolLock() {}
+};
+#endif
+
+static bool same_key(const char *h1, uint16_t p1, bool t1, const char *h2, uint16_t p2, bool t2) {
+	return p1 == p2 && t1 == t2 && strncmp(h1, h2, 63) == 0;
+}
+
+static void slot_drop(PoolSlot &s) {
+	if (!s.c) return;
+	s.c->stop();
+	delete s.c;
+	s.c = NULL;
+}
+
+// An idle connection must have nothing to read: EOF means the peer closed
+// it, and stray bytes (e.g. a TLS close_notify) mean it can't be reused
+static bool idle_usable(HttpPoolClient *c) {
+	if (!c->connected()) return false;
+#if defined(ARDUINO)
+	return c->available() == 0;
+#else
+	char b;
+	int n = recv(c->GetSocket(), &b, 1, MSG_PEEK | MSG_DONTWAIT);
+	return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+#endif
+}
+
+HttpPoolClient* http_pool_take(const char *host, uint16_t port, bool tls) {
+	PoolLock lock;
+	ulong now = millis();
+	HttpPoolClient *found = NULL;
+	for (uint8_t i = 0; i < HTTP_POOL_IDLE_MAX; i++) {
+		PoolSlot &s = pool[i];
+		if (!s.c) continue;
+		if (now - s.since > HTTP_POOL_IDLE_MS || !idle_usable(s.c)) {
+			slot_drop(s);
+			continue;
+		}
+		if (!found && same_key(s.host, s.port, s.tls, host, port, tls)) {
+			found = s.c;
+			s.c = NULL;
+		}
+	}
+	return found;
+}
+
+void http_pool_drop(const char *host, uint16_t port, bool tls) {
+	PoolLock lock;
+	for (uint8_t i = 0; i < HTTP_POOL_IDLE_MAX; i++) {
+		if (pool[i].c && same_key(pool[i].host, pool[i].port, pool[i].tls, host, port, tls)) slot_drop(pool[i]);
+	}
+}
+
+void http_pool_put(const char *host, uint16_t port, bool tls, HttpPoolClient *c, bool keep_alive) {
+	if (!c) return;
+#if defined(ESP8266)
+	if (tls) keep_alive = false;  // not enough heap to park BearSSL buffers
+#endif
+	if (!keep_alive || !c->connected()) {
+		c->stop();
+		delete c;
+		return;
+	}
+	PoolLock lock;
+	int free_slot = -1, oldest = -1, oldest_tls = -1;
+	uint8_t ntls = 0;
+	for (uint8_t i = 0; i < HTTP_POOL_IDLE_MAX; i++) {
+		PoolSlot &s = pool[i];
+		if (!s.c) {
+			if (free_slot < 0) free_slot = i;
+			continue;
+		}
+		if (oldest < 0 || s.since < pool[oldest].since) oldest = i;
+		if (s.tls) {
+			ntls++;
+			if (oldest_tls < 0 || s.since < pool[oldest_tls].since) oldest_tls = i;
+		}
+	}
+	if (tls && ntls >= HTTP_POOL_IDLE_TLS_MAX) {
+		slot_drop(pool[oldest_tls]);
+		free_slot = oldest_tls;
+	} else if (free_slot < 0) {
+		slot_drop(pool[oldest]);
+		free_slot = oldest;
+	}
+	PoolSlot &s = pool[free_slot];
+	s.c = c;
+	strncpy(s.host, host, sizeof(s.host) - 1);
+	s.host[sizeof(s.host) - 1] = 0;
+	s.port = port;
+	s.tls = tls;
+	s.since = millis();
+}
+
+static HostState* host_get(const char *host, uint16_t port, bool tls, bool create) {
+	HostState *lru = NULL;
+	for (uint8_t i = 0; i < HTTP_POOL_HOSTS; i++) {
+		HostState &h = hosts[i];
+		if (h.host[0] && same_key(h.host, h.port, h.tls, host, port, tls)) {
+			h.used = millis();
+			return &h;
+		}
+		if (!lru || !h.host[0] || (lru->host[0] && h.used < lru->used)) lru = &h;
+	}
+	if (!create || !lru) return NULL;
+#if defined(ESP8266)
+	delete lru->session;
+#endif
+	memset(lru, 0, sizeof(HostState));
+	strncpy(lru->host, host, sizeof(lru->host) - 1);
+	lru->port = port;
+	lru->tls = tls;
+	lru->used = millis();
+	return lru;
+}
+
+bool http_pool_host_ready(const char *host, uint16_t port, bool tls) {
+	PoolLock lock;
+	HostState *h = host_get(host, port, tls, false);
+	return !h || !h->fails || (long)(millis() - h->retry_at) >= 0;
+}
+
+void http_pool_host_result(const char *host, uint16_t port, bool tls, bool ok) {
+	PoolLock lock;
+	HostState *h = host_get(host, port, tls, !ok);
+	if (!h) return;
+	if (ok) {
+		h->fails = 0;
+		return;
+	}
+	if (h->fails < 16) h->fails++;
+	ulong backoff = 1000UL << (h->fails - 1);
+	if (backoff > HTTP_POOL_BACKOFF_MAX_MS || h->fails > 7) backoff = HTTP_POOL_BACKOFF_MAX_MS;
+	h->retry_at = millis() + backoff;
+	DEBUG_PRINTF("http: %s:%d unreachable, backing off %lu ms\n", host, port, backoff);
+}
+
+#if defined(ESP8266)
+BearSSL::Session* http_pool_tls_session(const char *host, uint16_t port) {
+	HostState *h = host_get(host, port, true, true);
+	if (!h) return NULL;
+	if (!h->session) h->session = new BearSSL::Session();
+	return h->session;
+}
+#endif
+
+bool http_request_keepalive(char *req) {
+	char *eol = strstr(req, "\r\n");
+	if (!eol || eol - req < 8) return false;
+	for (const char *h = eol; (h = strstr(h, "\r\n")) != NULL; ) {
+		h += 2;
+		if (h[0] == '\r') break;  // end of headers
+		if (strncasecmp(h, "Connection:", 11) == 0) {
+			const char *v = h + 11;
+			while (*v == ' ') v++;
+			if (strncasecmp(v, "close", 5) == 0) return false;
+		}
+	}
+	if (memcmp(eol - 8, "HTTP/1.0", 8) == 0) eol[-1] = '1';
+	return memcmp(eol - 8, "HTTP/1.1", 8) == 0;
+}
+
+bool http_request_idempotent(const char *req) {
+	if (strncmp(req, "GET ", 4) != 0) return false;
+	const char *eol = strstr(req, "\r\n");
+	size_t n = eol ? (size_t)(eol - req) : strlen(req);
+	for (const char *cmd : {"/cm?", "/cb?"}) {
+		const char *m = strstr(req, cmd);
+		if (m && (size_t)(m - req) < n) return false;
+	}
+	return true;
+}
+
+// value of header name (with colon) between the status line and the blank line
+static const char* frame_header(const char *buf, size_t hdr_end, const char *name) {
+	size_t nlen = strlen(name);
+	const char *p = buf;
+	const char *end = buf + hdr_end;
+	while (p < end) {
+		const char *eol = (const char*)memchr(p, '\n', end - p);
+		if (!eol) break;
+		p = eol + 1;
+		if ((size_t)(end - p) > nlen && strncasecmp(p, name, nlen) == 0) {
+			p += nlen;
+			while (*p == ' ') p++;
+			return p;
+		}
+	}
+	return NULL;
+}
+
+void http_frame_parse(const char *buf, size_t len, HttpFrame *fr) {
+	memset(fr, 0, sizeof(HttpFrame));
+	const char *hend = NULL;
+	for (size_t i = 0; i + 3 < len; i++) {
+		if (buf[i] == '\r' && buf[i+1] == '\n' && buf[i+2] == '\r' && buf[i+3] == '\n') {
+			hend = buf + i;
+			break;
+		}
+	}
+	if (!hend || len < 12 || strncmp(buf, "HTTP/1.", 7) != 0) return;
+	size_t hdr_end = hend - buf + 2;
+	fr->body = hdr_end + 2;
+
+	bool v11 = buf[7] == '1';
+	int code = atoi(buf + 9);
+	const char *conn = frame_header(buf, hdr_end, "Connection:");
+	fr->keep_alive = conn ? strncasecmp(conn, "keep-alive", 10) == 0 : v11;
+
+	if ((code >= 100 && code < 200) || code == 204 || code == 304) {
+		fr->complete = true;
+		return;
+	}
+	const char *te = frame_header(buf, hdr_end, "Transfer-Encoding:");
+	if (te && strncasecmp(te, "chunked", 7) == 0) {
+		fr->chunked = true;
+		size_t p = fr->body;
+		while (p < len) {
+			unsigned long n = strtoul(buf + p, NULL, 16);
+			const char *eol = (const char*)memchr(buf + p, '\n', len - p);
+			if (!eol) return;
+			p = eol - buf + 1;
+			if (n == 0) {
+				// optional trailers, then a blank line
+				while (p + 1 < len) {
+					if (buf[p] == '\r' && buf[p+1] == '\n') {
+						fr->complete = true;
+						return;
+					}
+					eol = (const char*)memchr(buf + p, '\n', len - p);
+					if (!eol) return;
+					p = eol - buf + 1;
+				}
+				return;
+			}
+			p += n + 2;
+		}
+		return;
+	}
+	const char *cl = frame_header(buf, hdr_end, "Content-Length:");
+	if (cl) {
+		fr->complete = len - fr->body >= (size_t)strtoul(cl, NULL, 10);
+		return;
+	}
+	fr->keep_alive = false;  // body ends when the server closes
+}
+
+size_t http_dechunk(char *buf, size_t len, size_t body) {
+	size_t src = body, dst = body;
+	while (src < len) {
+		unsigned long n = strtoul(buf + src, NULL, 16);
+		char *eol = (char*)memchr(buf + src, '\n', len - src);
+		if (!eol || n == 0) break;
+		src = eol - buf + 1;
+		if (n > len - src) n = len - src;
+		memmove(buf + dst, buf + src, n);
+		dst += n;
+		src += n + 2;
+	}
+	buf[dst] = 0;
+	return dst;
+}
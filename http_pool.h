@@ -0,0 +1,111 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Keep-alive connection pool and host health for outbound HTTP requests
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HTTP_POOL_H
+#define _HTTP_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(ARDUINO)
+#include <Client.h>
+typedef Client HttpPoolClient;
+#else
+#include "etherport.h"
+typedef EthernetClient HttpPoolClient;
+#endif
+
+/** Idle sockets kept open, and how long an idle one may wait for reuse */
+#if defined(ESP8266)
+	#define HTTP_POOL_IDLE_MAX      2   // plain sockets only, TLS uses session resumption
+#elif defined(ESP32) && defined(BOARD_HAS_PSRAM)
+	#define HTTP_POOL_IDLE_MAX      4
+#elif defined(ESP32)
+	#define HTTP_POOL_IDLE_MAX      2
+#else
+	#define HTTP_POOL_IDLE_MAX      8
+#endif
+#if defined(ESP32) && !defined(BOARD_HAS_PSRAM)
+	#define HTTP_POOL_IDLE_TLS_MAX  1   // an idle mbedTLS session holds ~40 KB
+#else
+	#define HTTP_POOL_IDLE_TLS_MAX  HTTP_POOL_IDLE_MAX
+#endif
+#define HTTP_POOL_IDLE_MS          30000
+#define HTTP_POOL_HOSTS            8
+#define HTTP_POOL_BACKOFF_MAX_MS   60000
+
+/**
+ * @brief Take an idle keep-alive connection to host:port, NULL if none.
+ * Connections found closed by the peer are dropped on the way.
+ */
+HttpPoolClient* http_pool_take(const char *host, uint16_t port, bool tls);
+
+/** Close the idle connections to host:port, e.g. after one turned out stale */
+void http_pool_drop(const char *host, uint16_t port, bool tls);
+
+/**
+ * @brief Return a connection after a complete response.
+ * It is kept for reuse if keep_alive is set and the pool has room,
+ * otherwise it is stopped and deleted.
+ */
+void http_pool_put(const char *host, uint16_t port, bool tls, HttpPoolClient *c, bool keep_alive);
+
+/** False while the host is backing off after failed connects */
+bool http_pool_host_ready(const char *host, uint16_t port, bool tls);
+
+/** Record a connect result; failures double the backoff up to HTTP_POOL_BACKOFF_MAX_MS */
+void http_pool_host_result(const char *host, uint16_t port, bool tls, bool ok);
+
+#if defined(ESP8266)
+namespace BearSSL { class Session; }
+/** TLS session of the host, used to resume instead of a full handshake */
+BearSSL::Session* http_pool_tls_session(const char *host, uint16_t port);
+#endif
+
+/**
+ * @brief Switch a caller-built "HTTP/1.0" request to HTTP/1.1 in place,
+ * unless it asks for Connection: close. Returns true if it can be kept alive.
+ */
+bool http_request_keepalive(char *req);
+
+/**
+ * @brief True if the request may be sent again after a connection dropped
+ * without a reply: a GET that is not a controller command (/cm, /cb).
+ */
+bool http_request_idempotent(const char *req);
+
+/** Framing state of a response held in a buffer */
+struct HttpFrame {
+	bool complete;     // headers and the whole body are in the buffer
+	bool keep_alive;   // the connection can carry another request
+	bool chunked;
+	size_t body;       // offset of the body
+};
+
+/** Inspect a (partial) response; call again as more bytes arrive */
+void http_frame_parse(const char *buf, size_t len, HttpFrame *fr);
+
+/** Decode a chunked body in place, returns the new total length */
+size_t http_dechunk(char *buf, size_t len, size_t body);
+
+#endif // _HTTP_POOL_H
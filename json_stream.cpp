@@ -0,0 +1,290 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Streaming JSON path extractor (SAX style, no document buffer)
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "json_stream.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define JSON_FNV_INIT   2166136261u
+#define JSON_FNV_PRIME  16777619u
+
+enum {
+    LEX_NONE = 0,
+    LEX_STRING,
+    LEX_ESCAPE,
+    LEX_SCALAR,
+};
+
+static inline uint32_t json_fnv(uint32_t h, char c) {
+    return (h ^ (uint8_t)c) * JSON_FNV_PRIME;
+}
+
+static int json_path_index(const char *s, const char *end, int now_index) {
+    while (s < end && *s == ' ') s++;
+    int idx;
+    if (end - s >= 3 && (s[0]|0x20) == 'n' && (s[1]|0x20) == 'o' && (s[2]|0x20) == 'w') {
+        s += 3;
+        while (s < end && *s == ' ') s++;
+        idx = now_index + ((*s == '+' || *s == '-') ? atoi(s) : 0);
+    } else {
+        idx = atoi(s);
+    }
+    return idx < 0 ? 0 : idx;
+}
+
+bool json_path_compile(const char *filter, int now_index, JsonPath *out) {
+    out->n = 0;
+    if (!filter) return true;
+    const char *p = filter;
+    int16_t pending_skip = 0;  // [n] of the previous segment, applies to this key
+    while (*p) {
+        const char *seg = p;
+        while (*p && *p != '|') p++;
+        const char *end = p;
+        if (*p) p++;
+
+        // tolerate quoted keys and stray spaces from hand-written filters
+        while (seg < end && (*seg == ' ' || *seg == '"')) seg++;
+        const char *key_end = seg;
+        while (key_end < end && *key_end != '[') key_end++;
+        const char *k = key_end;
+        while (k > seg && (k[-1] == ' ' || k[-1] == '"')) k--;
+
+        if (k > seg) {
+            if (out->n >= JSON_PATH_MAX_STEPS) return false;
+            uint32_t h = JSON_FNV_INIT;
+            for (const char *c = seg; c < k; c++) h = json_fnv(h, *c);
+            out->steps[out->n].hash = h ? h : 1;  // 0 marks a number step
+            out->steps[out->n].skip = pending_skip;
+            out->n++;
+        }
+        // only the last bracket counts, as in the old filter parser
+        int16_t idx = -1;
+        const char *b = key_end;
+        while (b < end && *b == '[') {
+            const char *rb = (const char*)memchr(b, ']', end - b);
+            if (!rb) return false;
+            idx = (int16_t)json_path_index(b + 1, rb, now_index);
+            b = rb + 1;
+        }
+        pending_skip = 0;
+        if (idx < 0) continue;
+        if (*p) {
+            pending_skip = idx;  // repeats the search for the next key
+        } else {
+            if (out->n >= JSON_PATH_MAX_STEPS) return false;
+            out->steps[out->n].hash = 0;
+            out->steps[out->n].skip = idx;
+            out->n++;
+        }
+    }
+    return true;
+}
+
+JsonStreamExtractor::JsonStreamExtractor() {
+    memset(this, 0, sizeof(*this));
+    expect_key = false;
+}
+
+int JsonStreamExtractor::add(const JsonPath *path) {
+    if (ntargets >= JSON_STREAM_MAX_TARGETS) return -1;
+    Target &t = targets[ntargets];
+    memset(&t, 0, sizeof(t));
+    t.path = path;
+    if (path->n == 0 || path->steps[0].hash == 0) {
+        t.grab = true;  // first (or n-th) number anywhere
+        t.grab_skip = path->n ? path->steps[0].skip : 0;
+    }
+    pending++;
+    return ntargets++;
+}
+
+bool JsonStreamExtractor::get(uint8_t slot, double *value) const {
+    if (slot >= ntargets || !targets[slot].ok) return false;
+    *value = targets[slot].value;
+    return true;
+}
+
+void JsonStreamExtractor::value_begin(bool container) {
+    cap_mask = 0;
+    cap_len = 0;
+    if (overflow) return;
+    bool in_obj = depth > 0 && !is_arr[depth - 1];
+
+    for (uint8_t i = 0; i < ntargets; i++) {
+        Target &t = targets[i];
+        if (t.done) continue;
+        if (t.grab) {
+            if (!container) cap_mask |= (1 << i);
+            continue;
+        }
+        const JsonPathStep &st = t.path->steps[t.matched];
+        uint8_t base = t.matched ? t.depth_at[t.matched - 1] : 0;
+        if (!in_obj || key_hash != st.hash || depth < base + 1) continue;
+        if (t.seen < st.skip) {
+            t.seen++;
+            continue;
+        }
+        t.seen = 0;
+
+        const JsonPathStep *next = t.matched + 1 < t.path->n ? &t.path->steps[t.matched + 1] : NULL;
+        if (!next || next->hash == 0) {
+            int16_t skip = next ? next->skip : 0;
+            if (container) {
+                t.grab = true;
+                t.grab_depth = depth;
+                t.grab_skip = skip;
+            } else if (!skip) {
+                cap_mask |= (1 << i);
+            }
+        } else if (container) {
+            t.depth_at[t.matched++] = depth;
+        }
+    }
+}
+
+void JsonStreamExtractor::container_end() {
+    if (overflow) {
+        overflow--;
+        return;
+    }
+    if (depth == 0) return;
+    depth--;
+    for (uint8_t i = 0; i < ntargets; i++) {
+        Target &t = targets[i];
+        if (t.done) continue;
+        if (t.grab && t.path->n && depth <= t.grab_depth) {
+            // selected container held no number, fall back to later matches
+            t.grab = false;
+        }
+        while (t.matched && depth <= t.depth_at[t.matched - 1]) {
+            t.matched--;
+            t.seen = 0;
+        }
+    }
+}
+
+void JsonStreamExtractor::scalar_end() {
+    if (!cap_mask) return;
+    cap[cap_len] = 0;
+    double v = 0;
+    bool ok = false;
+    if (!strcmp(cap, "true")) { v = 1; ok = true; }
+    else if (!strcmp(cap, "false")) { v = 0; ok = true; }
+    else if (cap_len) {
+        char *endp;
+        v = strtod(cap, &endp);
+        ok = endp != cap;
+    }
+    if (ok) {
+        for (uint8_t i = 0; i < ntargets; i++) {
+            if (!(cap_mask & (1 << i)) || targets[i].done) continue;
+            if (targets[i].grab && targets[i].grab_skip > 0) {
+                targets[i].grab_skip--;  // [n]: not the n-th number yet
+                continue;
+            }
+            targets[i].done = true;
+            targets[i].ok = true;
+            targets[i].value = v;
+            pending--;
+        }
+    }
+    cap_mask = 0;
+    cap_len = 0;
+}
+
+bool JsonStreamExtractor::feed(const char *data, size_t len) {
+    for (size_t n = 0; n < len && pending; n++) {
+        char c = data[n];
+        switch (lex) {
+        case LEX_STRING:
+        case LEX_ESCAPE:
+            if (lex == LEX_ESCAPE) {
+                lex = LEX_STRING;
+            } else if (c == '"') {
+                lex = LEX_NONE;
+                if (in_key) in_key = false;
+                else scalar_end();
+                continue;
+            } else if (c == '\\') {
+                lex = LEX_ESCAPE;
+            }
+            // escapes are matched and captured verbatim
+            if (in_key) key_hash = json_fnv(key_hash, c);
+            else if (cap_mask && cap_len < sizeof(cap) - 1) cap[cap_len++] = c;
+            continue;
+        case LEX_SCALAR:
+            if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                c == '.' || c == '-' || c == '+') {
+                if (cap_mask && cap_len < sizeof(cap) - 1) cap[cap_len++] = c;
+                continue;
+            }
+            lex = LEX_NONE;
+            scalar_end();
+            break;  // c still needs structural handling below
+        }
+
+        switch (c) {
+        case ' ': case '\t': case '\r': case '\n':
+            break;
+        case '{':
+        case '[':
+            value_begin(true);
+            if (overflow || depth >= JSON_STREAM_MAX_DEPTH) {
+                overflow++;
+                break;
+            }
+            is_arr[depth] = (c == '[');
+            depth++;
+            expect_key = (c == '{');
+            break;
+        case '}':
+        case ']':
+            container_end();
+            expect_key = false;
+            break;
+        case ',':
+            if (overflow || !depth) break;
+            if (!is_arr[depth - 1]) expect_key = true;
+            break;
+        case ':':
+            expect_key = false;
+            break;
+        case '"':
+            lex = LEX_STRING;
+            if (!overflow && depth && !is_arr[depth - 1] && expect_key) {
+                in_key = true;
+                key_hash = JSON_FNV_INIT;
+            } else {
+                value_begin(false);
+            }
+            break;
+        default:
+            value_begin(false);
+            lex = LEX_SCALAR;
+            if (cap_mask) cap[cap_len++] = c;
+            break;
+        }
+    }
+    return pending == 0;
+}
@@ -0,0 +1,119 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Streaming JSON path extractor (SAX style, no document buffer)
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JSON_STREAM_H
+#define _JSON_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define JSON_PATH_MAX_STEPS      16
+#define JSON_STREAM_MAX_DEPTH    24
+#if defined(ESP8266)
+#define JSON_STREAM_MAX_TARGETS  4  // paths live on the stack of the caller
+#else
+#define JSON_STREAM_MAX_TARGETS  8
+#endif
+
+/** One path step: an object key (by hash), or the n-th number below the previous step */
+struct JsonPathStep {
+    uint32_t hash;   // FNV-1a of the key, 0 for a number step (always the last one)
+    int16_t skip;    // matches of this step to pass over before it is taken
+};
+
+struct JsonPath {
+    uint8_t n;
+    JsonPathStep steps[JSON_PATH_MAX_STEPS];
+};
+
+/**
+ * @brief Compile a sensor filter into a path.
+ * @param filter segments separated by '|', each a key with an optional [n]
+ *        suffix. "[now]" / "[now+1]" resolve relative to now_index
+ *        (hour-of-day for forecast arrays).
+ * @note The meaning of [n] is the one of the old substring search: on a
+ *       segment followed by another one it selects the (n+1)-th match of
+ *       the next key below it ("ch_soil[3]|humidity"), on the last segment
+ *       the (n+1)-th number below it ("temp[2]"). Keys match at any depth
+ *       below the previous step. An empty filter selects the first number
+ *       in the document.
+ */
+bool json_path_compile(const char *filter, int now_index, JsonPath *out);
+
+/**
+ * @brief Push parser that resolves several paths in one pass over a stream.
+ * Feed bytes as they arrive; once every path has its value the caller can
+ * stop reading. A path ending on an object or array yields the first
+ * number inside it; numeric strings and true/false are accepted.
+ */
+class JsonStreamExtractor {
+public:
+    JsonStreamExtractor();
+
+    /** Register a path, returns its slot or -1 when full */
+    int add(const JsonPath *path);
+
+    /** Parse more input, returns true when all paths are resolved */
+    bool feed(const char *data, size_t len);
+
+    bool done() const { return pending == 0; }
+
+    /** Value of a slot, false if it was not found */
+    bool get(uint8_t slot, double *value) const;
+
+private:
+    struct Target {
+        const JsonPath *path;
+        uint8_t matched;                       // steps matched so far
+        uint8_t depth_at[JSON_PATH_MAX_STEPS]; // depth where each matched value sits
+        uint8_t grab_depth;                    // >0: take first number below this depth
+        uint8_t seen;                          // matches of the current step passed over
+        int16_t grab_skip;                     // numbers to pass over while grabbing
+        bool grab;
+        bool done;
+        bool ok;
+        double value;
+    };
+
+    void value_begin(bool container);
+    void container_end();
+    void scalar_end();
+
+    Target targets[JSON_STREAM_MAX_TARGETS];
+    uint8_t ntargets;
+    uint8_t pending;
+
+    uint8_t lex;
+    uint8_t depth;
+    uint8_t overflow;                          // nesting beyond the stack, ignored
+    bool is_arr[JSON_STREAM_MAX_DEPTH];
+    bool expect_key;
+    bool in_key;
+    bool cap_string;
+    uint32_t key_hash;
+    uint8_t cap_mask;                          // targets waiting for this scalar
+    uint8_t cap_len;
+    char cap[24];
+};
+
+#endif // _JSON_STREAM_H
@@ -35,6 +35,15 @@
 #include "sensors.h"
 #include "sensor_ble.h"
 #include "main.h"
+#include "flow_capture.h"
+#include "event_loop.h"
+#include "web_thread.h"
+#include "state_snapshot.h"
+#include "event_stream.h"
+#include "remote_station.h"
+#include "runtime_timeline.h"
+#include "response_cache.h"
+#include "capacity_sched.h"
 #include "notifier.h"
 #include "osinfluxdb.h"
 #include "opensprinkler_matter.h"
@@ -203,6 +212,9 @@ int16_t flow_sid = -1; // current flow sensor station id, -1 means not set
 // Per-station flags, indexed directly by station id (sid). One byte per station.
 static uint8_t station_log_written_on_handoff[MAX_NUM_STATIONS] = {0};
 uint32_t reboot_timer = 0;
+#if !defined(ARDUINO)
+ulong loop_skipped_seconds = 0;  // reported by /db
+#endif
 unsigned char curr_alert_sid = 0;
 uint32_t ping_ok = 0;
 
@@ -272,43 +284,57 @@ static inline void update_station_flow_average(unsigned char sid, float flow_las
 	}
 }
 
-#if defined(ESP32)
+// valve current of each station in 10 mA units, learned while it runs alone (RAM only)
+static uint8_t station_valve_current[MAX_NUM_STATIONS];
+
+static inline void update_station_valve_current(unsigned char sid, int16_t vcurr) {
+	if (vcurr <= 0 || sid >= MAX_NUM_STATIONS) return;
+
+	uint16_t v = (uint16_t)(vcurr + 5) / 10;
+	if (v > 255) v = 255;
+	if (v == 0) v = 1;
+	uint8_t current = station_valve_current[sid];
+	station_valve_current[sid] = current ? (uint8_t)((current + v) / 2) : (uint8_t)v;
+}
+
+static FlowRateEstimator flow_rate;
+static uint32_t flow_dropped_seen = 0;
+
 static void flow_update_input_mode() {
 	bool want_flow = (os.iopts[IOPT_SENSOR1_TYPE] == SENSOR_TYPE_FLOW);
 	static bool flow_input_configured = false;
 	if (want_flow == flow_input_configured) return;
 
 	if (want_flow) {
-		DEBUG_PRINTLN(F("[FLOW-INPUT-MODE]Configuring flow sensor pin GPIO12"));
+		#if defined(ESP32)
 		pinMode(PIN_SENSOR1, INPUT_PULLUP);
+		#endif
 		prev_flow_state = HIGH;
+		if (flow_capture_begin(PIN_SENSOR1)) {
+			DEBUG_PRINTLN(F("[FLOW-INPUT-MODE]Flow sensor on edge capture"));
+		} else {
+			DEBUG_PRINTLN(F("[FLOW-INPUT-MODE]Flow sensor on polling"));
+		}
 		flow_input_configured = true;
 	} else {
 		DEBUG_PRINTLN(F("[FLOW-INPUT-MODE]De-configuring flow sensor"));
+		flow_capture_end();
 		flow_input_configured = false;
 	}
 }
-#else
-static inline void flow_update_input_mode() {}
-#endif
 
 static void flow_update_timeout(ulong curr) {
 	if (flow_rt_reset && curr > flow_rt_reset) {
 		os.flowcount_rt = 0;
 		flow_rt_period = -1;
 		flow_rt_reset = 0;
+		flow_rate.reset();
 	}
 }
 
-static void flow_process_pulses(ulong curr, uint32_t pulses) {
-	if (!pulses) return;
-
-	if (flow_rt_period < 0) {
-		last_flow_rt = curr;
-		flow_rt_period = 0; // Transition to 0 to seed the first pulse!
-	}
-
-	flow_count += pulses;
+// curr is the pulse time in millis(), ts_us the same instant in micros()
+static void flow_process_pulse(ulong curr, uint32_t ts_us) {
+	flow_count++;
 
 	/* RAH implementation of flow sensor */
 	if (flow_start == 0) {
@@ -322,20 +348,11 @@ static void flow_process_pulses(ulong curr, uint32_t pulses) {
 		flow_begin = curr;
 	}
 
-	ulong elapsed = curr - last_flow_rt;
-	ulong curr_period = (elapsed > 0) ? (elapsed / pulses) : 0;
-	if (curr_period == 0 && elapsed > 0) curr_period = 1;
-
-	if (curr_period > 0) {
-		if (flow_rt_period > 0) {
-			flow_rt_period = (curr_period  / 5 + flow_rt_period * 4 / 5);
-		} else {
-			flow_rt_period = curr_period;
-		}
-	}
-
-	if (flow_rt_period > 0) {
-		os.flowcount_rt = (ulong) (FLOWCOUNT_RT_WINDOW * 1000L / flow_rt_period);
+	if (flow_rate.add(ts_us)) {
+		uint32_t period_us = flow_rate.period_us();
+		flow_rt_period = (int32_t)((period_us + 500) / 1000);
+		if (flow_rt_period == 0) flow_rt_period = 1;
+		os.flowcount_rt = (ulong) ((uint64_t)FLOWCOUNT_RT_WINDOW * 1000000UL / period_us);
 		flow_rt_reset = curr + max((ulong)(flow_rt_period * 10), 10000UL); // Keep flow rate for at least 10 seconds to allow the UI to display it
 	} else {
 		os.flowcount_rt = 0;
@@ -344,13 +361,34 @@ static void flow_process_pulses(ulong curr, uint32_t pulses) {
 
 	last_flow_rt = curr;
 	flow_stop = curr;
-	flow_gallons += pulses;
+	flow_gallons++;
 	/* End of RAH implementation of flow sensor */
 }
 
+// Fold captured pulses into the counters. Each timestamp is mapped from the
+// micros() domain back to millis() for the RAH bookkeeping.
+static void flow_drain() {
+	uint32_t ts[16];
+	uint8_t n;
+	while ((n = flow_capture_drain(ts, sizeof(ts)/sizeof(ts[0]))) > 0) {
+		ulong now_ms = millis();
+		uint32_t now_us = (uint32_t)micros();
+		for (uint8_t i = 0; i < n; i++) {
+			flow_process_pulse(now_ms - (ulong)((uint32_t)(now_us - ts[i]) / 1000), ts[i]);
+		}
+	}
+	uint32_t dropped = flow_capture_dropped();
+	if (dropped != flow_dropped_seen) { // ring overflowed: keep the volume, skip the rate
+		DEBUG_PRINTF("[FLOW] %lu pulses over ring capacity\n", (ulong)(dropped - flow_dropped_seen));
+		flow_count += dropped - flow_dropped_seen;
+		flow_gallons += dropped - flow_dropped_seen;
+		flow_dropped_seen = dropped;
+	}
+}
+
+// Polling fallback for pins that cannot raise edges (e.g. on an IO expander)
 void flow_poll() {
 	ulong curr = millis();
-	flow_update_timeout(curr);
 
 	#if defined(ESP8266) || defined(ESP32)
 	if(os.hw_rev>=2) {
@@ -374,8 +412,7 @@ void flow_poll() {
 	}
 	last_pulse_time = curr;
 
-	DEBUG_PRINTF("[FLOW-POLL] Pulse detected! flow_count=%lu\n", flow_count + 1);
-	flow_process_pulses(curr, 1);
+	flow_capture_push((uint32_t)micros());
 }
 
 #if defined(USE_DISPLAY)
@@ -872,6 +909,10 @@ void do_setup() {
 	sensor_api_init(true);
 
 	initialize_otf();
+	state_snapshot_publish();
+#if defined(OS_HTTP_THREAD)
+	web_thread_start();
+#endif
 	// Delayed initialization: sensor_api_connect at 10s, matter_init at 15s
 	// This prevents boot-time conflicts between Zigbee, BLE, and Matter stacks
 	DEBUG_PRINTLN(F("Delaying sensor_api_connect and matter_init for stack stabilization"));
@@ -880,6 +921,9 @@ void do_setup() {
 #endif
 
 void turn_on_station(unsigned char sid, ulong duration);
+static void station_timekeeping(unsigned char sid, unsigned char running, time_os_t curr_time);
+static bool capacity_scheduling();
+static void schedule_capacity(time_os_t curr_time, unsigned char qo, bool repack);
 static void check_network();
 void check_weather();
 static bool process_special_program_command(const char*, uint32_t curr_time);
@@ -1002,6 +1046,16 @@ void gratuitousARPTask() {
 }
 #endif
 
+// Serve web clients between potentially blocking steps. With the Linux web
+// thread only the requests it handed to the main loop are left to run here.
+static inline void serve_web_clients() {
+	if (web_thread_running()) {
+		web_thread_process();
+		return;
+	}
+	if(otf) otf->loop();
+}
+
 /** Main Loop */
 void do_loop()
 {
@@ -1117,13 +1171,16 @@ void do_loop()
 
 	static ulong flowpoll_timeout=0;
 	if(os.iopts[IOPT_SENSOR1_TYPE]==SENSOR_TYPE_FLOW) {
-	// handle flow sensor with ESP8266-style polling.
 		ulong tm = millis();
-		if((long)(tm-flowpoll_timeout) > 0) { // overflow proof timeout
-			flowpoll_timeout = tm+FLOWPOLL_INTERVAL;
-			flow_update_timeout(tm);
-			flow_poll();
+		if(!flow_capture_edge_driven()) {
+			if((long)(tm-flowpoll_timeout) > 0) { // overflow proof timeout
+				flowpoll_timeout = tm+FLOWPOLL_INTERVAL;
+				flow_poll();
+			}
+			event_loop_wake_within(FLOWPOLL_INTERVAL);
 		}
+		flow_drain();
+		flow_update_timeout(tm);
 	}
 
 #if defined(ARDUINO)
@@ -1514,13 +1571,14 @@ void do_loop()
 	ui_state_machine();
 
 #else // Process Ethernet packets for RPI/LINUX
-	if(otf) otf->loop();
+	serve_web_clients();
 #if defined(USE_DISPLAY)
     ui_state_machine();
 #endif
 #endif	// Process Ethernet packets
 
-	// Start up MQTT when we have a network connection (skip during ZigBee lock or join)
+	// Send batched remote station changes, then any queued HTTP request
+	remote_station_loop();
 	os.process_async_http_requests();
 
 	// Start up MQTT when we have a network connection (skip during ZigBee lock or join)
@@ -1533,13 +1591,13 @@ void do_loop()
 	os.mqtt.loop();
 	
 	// Service web clients between potentially blocking operations
-	if(otf) otf->loop();
+	serve_web_clients();
 
 	// Legacy sensor maintenance loop (BLE/Zigbee auto-stop timers)
 	sensor_api_loop();
 
 	// Service web clients after sensor/radio maintenance
-	if(otf) otf->loop();
+	serve_web_clients();
 
 #ifdef ENABLE_MATTER
 	// Matter loop handler
@@ -1552,6 +1610,10 @@ void do_loop()
 
 	// The main control loop runs once every second
 	if (curr_time != last_time) {
+#if !defined(ARDUINO)
+		// seconds the loop never saw, e.g. a simulated clock it cannot keep up with
+		if (last_time && curr_time > last_time + 1) loop_skipped_seconds += curr_time - last_time - 1;
+#endif
 		#if defined(ESP8266) || defined(ESP32)
 		if(os.hw_rev>=2) {
 			pinMode(PIN_SENSOR1, INPUT_PULLUP); // this seems necessary for OS 3.2
@@ -1828,86 +1890,88 @@ void do_loop()
 		}//if_check_current_minute
 
 		// ====== Run program data ======
+		// While nothing but the time changes, only the stations with a start,
+		// stop or dequeue edge due in this second are visited. Any other
+		// change falls back to a full sweep of the queue and stations.
+		bool tl_full = !timeline_check(curr_time);
+		bool tl_events = false;
+		bool tl_masters = false;
+
 		// Check if a program is running currently
 		// If so, do station run-time keeping
 		if (os.status.program_busy){
-			// first, go through run time queue to assign queue elements to stations
-			q = pd.queue;
-			qid=0;
-			for(;q<pd.queue+pd.nqueue;q++,qid++) {
-				sid=q->sid;
-				unsigned char sqi=pd.station_qid[sid];
-				// skip if station is already assigned a queue element
-				// and that queue element has an earlier start time
-				if(sqi<pd.nqueue && pd.queue[sqi].st<q->st) continue;
-				// otherwise assign the queue element to station
-				pd.station_qid[sid]=qid;
-			}
-			// next, go through the stations and perform time keeping
-			for(bid=0;bid<os.nboards; bid++) {
-				bitvalue = os.station_bits[bid];
-				for(s=0;s<8;s++) {
-					unsigned char sid = bid*8+s;
-
-					// skip master stations and any station that's not in the queue
-					if (os.status.mas == sid+1) continue;
-					if (os.status.mas2== sid+1) continue;
-					if (pd.station_qid[sid] >= pd.nqueue) continue;
-
-					q = pd.queue + pd.station_qid[sid];
-
-					// if current station is not running, check if we should turn it on
-					if(!((bitvalue >> s) & 1)) {
-						if (curr_time >= q->st && curr_time < q->st+q->dur) {
-							turn_on_station(sid, q->st+q->dur-curr_time); // the last parameter is expected run time
-						} //if curr_time > scheduled_start_time
-					} // if current station is not running
-
-					// check if this station should be turned off
-					if (q->st > 0) {
-						if (curr_time >= q->st+q->dur) {
-							turn_off_station(sid, curr_time);
-						}
+			if (tl_full) {
+				// first, go through run time queue to assign queue elements to stations
+				q = pd.queue;
+				qid=0;
+				for(;q<pd.queue+pd.nqueue;q++,qid++) {
+					sid=q->sid;
+					unsigned char sqi=pd.station_qid[sid];
+					// skip if station is already assigned a queue element
+					// and that queue element has an earlier start time
+					if(sqi<pd.nqueue && pd.queue[sqi].st<q->st) continue;
+					// otherwise assign the queue element to station
+					pd.station_qid[sid]=qid;
+				}
+				// next, go through the stations and perform time keeping
+				for(bid=0;bid<os.nboards; bid++) {
+					bitvalue = os.station_bits[bid];
+					for(s=0;s<8;s++) {
+						station_timekeeping(bid*8+s, (bitvalue >> s) & 1, curr_time);
+					}
+				}
+			} else {
+				TimelineEvent ev;
+				while (timeline_pop(curr_time, &ev)) {
+					tl_events = true;
+					if (ev.kind == TL_MASTER) {
+						tl_masters = true;
+					} else {
+						station_timekeeping(ev.sid, os.is_running(ev.sid), curr_time);
+					}
+				}
+			}
+
+			if (tl_full || tl_events) {
+				// finally, go through the queue again and clear up elements marked for removal
+				int qi;
+				for(qi=pd.nqueue-1;qi>=0;qi--) {
+					q=pd.queue+qi;
+					if(!q->dur || curr_time >= q->deque_time) {
+						unsigned char dequeued_sid = q->sid;
+						pd.dequeue(qi);
+						pd.station_qid[dequeued_sid] = 0xFF;
 					}
-				}//end_s
-			}//end_bid
-
-			// finally, go through the queue again and clear up elements marked for removal
-			int qi;
-			for(qi=pd.nqueue-1;qi>=0;qi--) {
-				q=pd.queue+qi;
-				if(!q->dur || curr_time >= q->deque_time) {
-					unsigned char dequeued_sid = q->sid;
-					pd.dequeue(qi);
-					pd.station_qid[dequeued_sid] = 0xFF;
 				}
 			}
 
 			// process dynamic events
-			process_dynamic_events(curr_time);
+			if (tl_full) process_dynamic_events(curr_time);
 
 			// activate / deactivate valves
 			os.apply_all_station_bits(overcurrent_monitor);
 
-			// check through runtime queue, calculate the last stop time of sequential stations
-			memset(pd.last_seq_stop_times, 0, sizeof(time_os_t) * NUM_SCHED_GROUPS);
-			time_os_t sst;
-			unsigned char re=os.iopts[IOPT_REMOTE_EXT_MODE];
-			unsigned char invert_group_sched = os.iopts[IOPT_INVERT_GROUP_SCHEDULING];
-			q = pd.queue;
-			for(;q<pd.queue+pd.nqueue;q++) {
-				sid = q->sid;
-				bid = sid>>3;
-				s = sid&0x07;
-				gid = os.get_station_gid(sid);
-				unsigned char sched_gid = (gid < NUM_SEQ_GROUPS) ? gid : NUM_SEQ_GROUPS;
-				// check if any sequential station has a valid stop time
-				// and the stop time must be larger than curr_time
-				sst = q->st + q->dur;
-				if (sst>curr_time) {
-					// only need to update last_seq_stop_time for sequential stations
-					if (!re && (invert_group_sched || os.is_sequential_station(sid))) {
-						pd.last_seq_stop_times[sched_gid] = (sst > pd.last_seq_stop_times[sched_gid]) ? sst : pd.last_seq_stop_times[sched_gid];
+			if (tl_full || tl_events) {
+				// check through runtime queue, calculate the last stop time of sequential stations
+				memset(pd.last_seq_stop_times, 0, sizeof(time_os_t) * NUM_SCHED_GROUPS);
+				time_os_t sst;
+				unsigned char re=os.iopts[IOPT_REMOTE_EXT_MODE];
+				unsigned char invert_group_sched = os.iopts[IOPT_INVERT_GROUP_SCHEDULING];
+				q = pd.queue;
+				for(;q<pd.queue+pd.nqueue;q++) {
+					sid = q->sid;
+					bid = sid>>3;
+					s = sid&0x07;
+					gid = os.get_station_gid(sid);
+					unsigned char sched_gid = (gid < NUM_SEQ_GROUPS) ? gid : NUM_SEQ_GROUPS;
+					// check if any sequential station has a valid stop time
+					// and the stop time must be larger than curr_time
+					sst = q->st + q->dur;
+					if (sst>curr_time) {
+						// only need to update last_seq_stop_time for sequential stations
+						if (!re && (invert_group_sched || os.is_sequential_station(sid))) {
+							pd.last_seq_stop_times[sched_gid] = (sst > pd.last_seq_stop_times[sched_gid]) ? sst : pd.last_seq_stop_times[sched_gid];
+						}
 					}
 				}
 			}
@@ -1944,7 +2008,7 @@ void do_loop()
 		}//if_some_program_is_running
 
 		// handle master
-		for (unsigned char mas = MASTER_1; mas < NUM_MASTER_ZONES; mas++) {
+		for (unsigned char mas = MASTER_1; mas < NUM_MASTER_ZONES && (tl_full || tl_masters); mas++) {
 
 			unsigned char mas_id = os.masters[mas][MASOPT_SID];
 
@@ -1954,13 +2018,15 @@ void do_loop()
 
 				unsigned char masbit = 0;
 
-				for(sid = 0; sid < os.nstations; sid++) {
+				// walk the stations' queue elements instead of all stations
+				for(qid = 0; qid < pd.nqueue; qid++) {
+					q = pd.queue + qid;
+					sid = q->sid;
 					// skip if this is the master station
 					if (mas_id == sid + 1) continue;
 
-					if(pd.station_qid[sid] >= pd.nqueue) continue; // skip if station is not in the queue
-
-					q = pd.queue + pd.station_qid[sid];
+					// skip elements other than the one assigned to the station
+					if (sid >= os.nstations || pd.station_qid[sid] != qid) continue;
 
 					if (os.bound_to_master(q->sid, mas)) {
 						// check if timing is within the acceptable range
@@ -1985,7 +2051,8 @@ void do_loop()
 			}
 		}
 		// process dynamic events
-		process_dynamic_events(curr_time);
+		if (tl_full) process_dynamic_events(curr_time);
+		timeline_commit(curr_time, tl_events);
 
 		// handle master on / off notif events
 		for (unsigned char mas = MASTER_1; mas < NUM_MASTER_ZONES; mas++) {
@@ -2042,18 +2109,18 @@ void do_loop()
 
                 // Service web clients between potentially blocking operations
                 // to keep HTTPS/HTTP response times low on single-core ESP32-C5
-                if(otf) otf->loop();
+                serve_web_clients();
 
                 // check network connection
                 if (curr_time && (curr_time % CHECK_NETWORK_INTERVAL==0))  os.status.req_network = 1;
                 check_network();
 
-                if(otf) otf->loop();
+                serve_web_clients();
 
                 // check weather
                 check_weather();
 
-                if(otf) otf->loop();
+                serve_web_clients();
 
                 // process notifier events.
                 // Skip the TLS email/push flush during the early-boot quiet
@@ -2062,7 +2129,7 @@ void do_loop()
                         notif.run();
                 }
 
-                if(otf) otf->loop();
+                serve_web_clients();
 
                 if(os.weather_update_flag & WEATHER_UPDATE_WL) {
                         // at the moment, we only send notification if water level changed
@@ -2074,7 +2141,7 @@ void do_loop()
                 read_all_sensors(curr_time && os.network_connected());
 
                 // Service web clients after sensor reads (can be blocking)
-                if(otf) otf->loop();
+                serve_web_clients();
 
 		static unsigned char reboot_notification = 1;
 		if(reboot_notification && os.network_connected() && boot_elapsed >= 10000) {
@@ -2083,8 +2150,14 @@ void do_loop()
 			}
 		}
 
+	// publish the state for readers outside the main loop
+	state_snapshot_update(curr_time);
+	event_stream_loop();
+
 	#if !defined(ARDUINO)
-		delay(1); // For OSPI/LINUX, sleep 1 ms to minimize CPU usage
+		web_state_release();  // read-only requests may run while the loop sleeps
+		event_loop_wait(); // For OSPI/LINUX, sleep until there is work to do
+		web_state_acquire();
 	#endif
 }
 
@@ -2163,6 +2236,7 @@ void check_weather() {
 			} else {
 				os.iopts[IOPT_WATER_PERCENTAGE] = 100;
 			}
+			cache_invalidate(CACHE_DOM_OPTIONS);  // not saved, but /jo and the timeline see it
 			wt_restricted = 0; // reset wt_rawData, errCode, and md_scales array
 			wt_rawData[0] = 0;
 			wt_errCode = HTTP_RQT_STALE;
@@ -2180,6 +2254,33 @@ void check_weather() {
 	}
 }
 
+/** Run-time keeping of one station
+ * Turns the station on inside the time window of its queue element
+ * and off once the window has passed
+ */
+static void station_timekeeping(unsigned char sid, unsigned char running, time_os_t curr_time) {
+	// skip master stations and any station that's not in the queue
+	if (os.status.mas == sid+1) return;
+	if (os.status.mas2== sid+1) return;
+	if (pd.station_qid[sid] >= pd.nqueue) return;
+
+	RuntimeQueueStruct *q = pd.queue + pd.station_qid[sid];
+
+	// if current station is not running, check if we should turn it on
+	if(!running) {
+		if (curr_time >= q->st && curr_time < q->st+q->dur) {
+			turn_on_station(sid, q->st+q->dur-curr_time); // the last parameter is expected run time
+		} //if curr_time > scheduled_start_time
+	} // if current station is not running
+
+	// check if this station should be turned off
+	if (q->st > 0) {
+		if (curr_time >= q->st+q->dur) {
+			turn_off_station(sid, curr_time);
+		}
+	}
+}
+
 /** Turn on a station
  * This function turns on a scheduled station
  */
@@ -2345,8 +2446,9 @@ void turn_off_running_station_immediate(unsigned char sid, time_os_t curr_time,
 	unsigned char gid = os.get_station_gid(q->sid);
 	unsigned char sched_gid = (gid < NUM_SEQ_GROUPS) ? gid : NUM_SEQ_GROUPS;
 	unsigned char invert_group_sched = os.iopts[IOPT_INVERT_GROUP_SCHEDULING];
+	bool repack = shift && capacity_scheduling();
 
-	if (shift && !os.iopts[IOPT_REMOTE_EXT_MODE] && (invert_group_sched || os.is_sequential_station(sid))) {
+	if (!repack && shift && !os.iopts[IOPT_REMOTE_EXT_MODE] && (invert_group_sched || os.is_sequential_station(sid))) {
 		handle_shift_remaining_stations(q, gid, curr_time);
 	}
 
@@ -2356,6 +2458,7 @@ void turn_off_running_station_immediate(unsigned char sid, time_os_t curr_time,
 	}
 	pd.dequeue(qid);
 	pd.station_qid[sid] = 0xFF;
+	if (repack) schedule_capacity(curr_time, 0, true);
 }
 
 /** Turn off a station
@@ -2376,8 +2479,10 @@ void turn_off_station(unsigned char sid, time_os_t curr_time, unsigned char shif
 	unsigned char gid = os.get_station_gid(q->sid);
 	unsigned char sched_gid = (gid < NUM_SEQ_GROUPS) ? gid : NUM_SEQ_GROUPS;
 	unsigned char invert_group_sched = os.iopts[IOPT_INVERT_GROUP_SCHEDULING];
+	// in capacity mode the waiting stations are packed again into the freed capacity
+	bool repack = shift && capacity_scheduling();
 
-	if (shift && !os.iopts[IOPT_REMOTE_EXT_MODE] && (invert_group_sched || os.is_sequential_station(sid))) {
+	if (!repack && shift && !os.iopts[IOPT_REMOTE_EXT_MODE] && (invert_group_sched || os.is_sequential_station(sid))) {
 		handle_shift_remaining_stations(q, gid, curr_time);
 	}
 
@@ -2387,6 +2492,7 @@ void turn_off_station(unsigned char sid, time_os_t curr_time, unsigned char shif
 		} else { // if already off just remove from the queue
 			pd.dequeue(qid);
 			pd.station_qid[sid] = 0xFF;
+			if (repack) schedule_capacity(curr_time, 0, true);
 			return;
 		}
 	} else if (curr_time >= q->st + q->dur) { // end time and dequeue time are not equal due to master handling
@@ -2401,6 +2507,14 @@ void turn_off_station(unsigned char sid, time_os_t curr_time, unsigned char shif
 	if((current < imin) && (os.hw_type==HW_TYPE_AC || os.hw_type==HW_TYPE_DC)) {
 		notif.add(NOTIFY_CURR_ALERT, sid, current, CURR_ALERT_TYPE_UNDER);
 	}
+	// learn the valve current for capacity scheduling while this is the only zone on
+	if (station_bit && os.baseline_current > 0) {
+		unsigned char nrunning = 0;
+		for (unsigned char i = 0; i < os.nstations; i++) {
+			if (os.is_running(i) && !os.is_master_station(i)) nrunning++;
+		}
+		if (nrunning == 1) update_station_valve_current(sid, current - (int16_t)os.baseline_current);
+	}
 	#endif
 
 	os.set_station_bit(sid, 0);
@@ -2494,6 +2608,7 @@ void turn_off_station(unsigned char sid, time_os_t curr_time, unsigned char shif
 		pd.dequeue(qid);
 		pd.station_qid[sid] = 0xFF;
 	}
+	if (repack) schedule_capacity(curr_time, 0, true);
 }
 
 /** Process dynamic events
@@ -2579,6 +2694,111 @@ void handle_master_adjustments(time_os_t curr_time, RuntimeQueueStruct *q, unsig
 	q->deque_time = q->st + q->dur + dequeue_adj;
 }
 
+/** Capacity scheduling is on when a flow or current budget is set */
+static bool capacity_scheduling() {
+	if (os.iopts[IOPT_REMOTE_EXT_MODE] || os.iopts[IOPT_INVERT_GROUP_SCHEDULING]) return false;
+	if (os.get_flow_budget()) return true;
+#if defined(ARDUINO)
+	if (os.get_current_budget()) return true;
+#endif
+	return false;
+}
+
+/** Capacity scheduler
+ * Instead of sequential groups, packs new stations into the earliest slot
+ * where the learned flow averages (and valve currents) of all stations
+ * running at the same time stay within the budgets. A station with no
+ * learned value yet takes the whole budget, i.e. runs alone.
+ * If repack is set, stations that have not started yet are packed again
+ * too, in their previous order; qo>0 puts the new stations first.
+ */
+static void schedule_capacity(time_os_t curr_time, unsigned char qo, bool repack) {
+	time_os_t start = curr_time;
+	if (os.status.pause_state) {
+		start += os.pause_timer;
+	}
+	int16_t station_delay = water_time_decode_signed(os.iopts[IOPT_STATION_DELAY_TIME]);
+	time_os_t gap = (station_delay > 0) ? station_delay : 0; // capacity is released after the station delay
+	uint32_t ma_cap = 0;
+#if defined(ARDUINO)
+	ma_cap = os.get_current_budget();
+#endif
+	CapacityProfile profile((uint32_t)os.get_flow_budget() * 10, ma_cap); // flow averages are in 0.01 units
+
+	unsigned char fresh[RUNTIME_QUEUE_SIZE], waiting[RUNTIME_QUEUE_SIZE];
+	unsigned char nfresh = 0, nwaiting = 0;
+	RuntimeQueueStruct *q;
+	for (q = pd.queue; q < pd.queue + pd.nqueue; q++) {
+		if (!q->dur) continue;
+		unsigned char qid = q - pd.queue;
+		if (!q->st) {
+			fresh[nfresh++] = qid;
+		} else if (repack && q->st > curr_time) {
+			// keep the previous order, sorted by start time
+			unsigned char i = nwaiting++;
+			for (; i > 0 && pd.queue[waiting[i-1]].st > q->st; i--) waiting[i] = waiting[i-1];
+			waiting[i] = qid;
+		} else if (q->st + q->dur + gap > curr_time) {
+			unsigned char sid = q->sid;
+			profile.add(max(q->st, curr_time), q->st + q->dur + gap,
+			            profile.flow_demand(os.get_flow_avg_value(sid)),
+			            profile.ma_demand((uint32_t)station_valve_current[sid] * 10));
+		}
+	}
+
+	time_os_t placed_st[RUNTIME_QUEUE_SIZE];
+	unsigned char nplaced = 0;
+	for (unsigned char n = 0; n < nfresh + nwaiting; n++) {
+		bool fresh_first = (qo > 0);
+		unsigned char qid;
+		if (fresh_first) qid = (n < nfresh) ? fresh[n] : waiting[n - nfresh];
+		else qid = (n < nwaiting) ? waiting[n] : fresh[n - nwaiting];
+		q = pd.queue + qid;
+
+		uint32_t flow = profile.flow_demand(os.get_flow_avg_value(q->sid));
+		uint32_t ma = profile.ma_demand((uint32_t)station_valve_current[q->sid] * 10);
+		time_os_t len = q->dur + gap;
+		time_os_t from = start;
+		for (;;) {
+			q->st = profile.earliest(from, len, flow, ma);
+			handle_master_adjustments(curr_time, q, NUM_SCHED_GROUPS, NULL, false);
+			if (profile.earliest(q->st, len, flow, ma) != q->st) { // master adjustment moved it into a busy slot
+				from = q->st;
+				continue;
+			}
+			// stagger starts by 1 second, like concurrent stations
+			bool taken = false;
+			for (unsigned char i = 0; i < nplaced; i++) {
+				if (placed_st[i] == q->st) { taken = true; break; }
+			}
+			if (!taken) break;
+			from = q->st + 1;
+		}
+		placed_st[nplaced++] = q->st;
+		profile.add(q->st, q->st + len, flow, ma);
+
+		if (!os.status.program_busy) {
+			os.status.program_busy = 1;  // set program busy bit
+			// start flow count
+			if(os.iopts[IOPT_SENSOR1_TYPE] == SENSOR_TYPE_FLOW) {  // if flow sensor is connected
+				os.flowcount_log_start = flow_count;
+				os.sensor1_active_lasttime = curr_time;
+			}
+		}
+	}
+
+	// keep the group stop times consistent for a later switch back to group scheduling
+	memset(pd.last_seq_stop_times, 0, sizeof(time_os_t) * NUM_SCHED_GROUPS);
+	for (q = pd.queue; q < pd.queue + pd.nqueue; q++) {
+		if (!q->dur || q->st + q->dur <= curr_time) continue;
+		unsigned char gid = os.get_station_gid(q->sid);
+		unsigned char sched_gid = (gid < NUM_SEQ_GROUPS) ? gid : NUM_SEQ_GROUPS;
+		if (q->st + q->dur > pd.last_seq_stop_times[sched_gid]) {
+			pd.last_seq_stop_times[sched_gid] = q->st + q->dur;
+		}
+	}
+}
+
 /** Scheduler
  * This function loops through the queue
  * and schedules the start time of each station
@@ -2586,6 +2806,11 @@ void handle_master_adjustments(time_os_t curr_time, RuntimeQueueStruct *q, unsig
  * preemptively, before existing queued stations
  */
 void schedule_all_stations(time_os_t curr_time, unsigned char qo) {
+	if (capacity_scheduling()) {
+		schedule_capacity(curr_time, qo, qo > 0);
+		return;
+	}
+
 	ulong con_start_time = curr_time;   // concurrent start time
 	// if the queue is paused, make sure the start time is after the scheduled pause ends
 	if (os.status.pause_state) {
@@ -3310,6 +3535,7 @@ void write_log(unsigned char type, time_os_t curr_time) {
 		#endif
 	}
 	strcat_P(tmp_buffer, PSTR("]\r\n"));
+	event_stream_post("log", "%.*s", (int)strlen(tmp_buffer) - 2, tmp_buffer);
 
 #if defined(ARDUINO)
 	#if defined(ESP8266) || defined(ESP32)
@@ -3845,13 +4071,16 @@ static void perform_ntp_sync() {
 
 #if !defined(ARDUINO) // main function for RPI/LINUX
 int override_http_port = 0;
+int override_event_port = -1;  // event stream port, default: http port + 1
 int main(int argc, char *argv[]) {
     // Disable buffering to work with systemctl journal
     setvbuf(stdout, NULL, _IOLBF, 0);
 	printf("Starting OpenSprinkler\n");
 
 	int opt;
-	while(-1 != (opt = getopt(argc, argv, "d:p:"))) {
+	time_t sim_start = 0;
+	int sim_rate = 0;
+	while(-1 != (opt = getopt(argc, argv, "d:p:e:c:r:"))) {
 		switch(opt) {
 		case 'd':
 			set_data_dir(optarg);
@@ -3859,12 +4088,27 @@ int main(int argc, char *argv[]) {
 		case 'p':
 			override_http_port = atoi(optarg);
 			break;
+		case 'e':
+			override_event_port = atoi(optarg);  // 0 turns the event stream off
+			break;
+		case 'c':
+			sim_start = (time_t)strtol(optarg, NULL, 0);  // simulated clock start (UTC)
+			break;
+		case 'r':
+			sim_rate = atoi(optarg);  // simulated clock speed-up
+			break;
 		default:
 			// ignore options we don't understand
 			break;
 		}
 	}
 
+	if (sim_start || sim_rate > 1) {
+		if (sim_rate < 1 || sim_rate > 1000) sim_rate = 1;
+		sim_clock_set(sim_start, (uint16_t)sim_rate);
+		printf("Simulated clock: start %ld, %dx\n", (long)sim_clock_now(), sim_rate);
+	}
+
   do_setup();
 
 	while(true) {
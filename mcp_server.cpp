@@ -18,6 +18,7 @@
 #include "opensprinkler_server.h"
 #include "ArduinoJson.hpp"
 #include "psram_utils.h"
+#include "request_arena.h"
 #if defined(ARDUINO)
 #include <LittleFS.h>
 #  if defined(ESP32)
@@ -40,17 +41,18 @@ extern "C" {
 
 extern OpenSprinkler os;
 extern ProgramData pd;
-extern BufferFiller bfill;
+extern OS_THREAD_LOCAL BufferFiller bfill;
 extern bool useEth;
 extern OTF::OpenThingsFramework *otf;
 extern volatile ulong flow_count;
 
 // Capture-mode globals (defined in opensprinkler_server.cpp)
-extern bool   g_mcp_capture_active;
-extern String g_mcp_capture_buf;
+extern OS_THREAD_LOCAL bool   g_mcp_capture_active;
+extern OS_THREAD_LOCAL String g_mcp_capture_buf;
 
 // Helpers from opensprinkler_server.cpp
 void rewind_ether_buffer();
+void mcp_capture_append(const char *data, size_t len);
 
 // Data-building helpers (defined in opensprinkler_server.cpp)
 void server_json_controller_main(const OTF::Request& req, OTF::Response& res);
@@ -146,51 +148,43 @@ static bool mcp_check_auth(const OTF::Request& req) {
 
 // ─── Capture helpers ─────────────────────────────────────────────────────────
 
-// Begin capturing ether_buffer writes into g_mcp_capture_buf.
-// Writes `open_brace` literal to ether_buffer before calling the supplied
-// function so the caller does not need to manage it.
+// Begin capturing ether_buffer writes. Each full buffer is handed to
+// mcp_capture_append(), which forwards it to the active McpTextStream.
 static void mcp_begin_capture() {
   g_mcp_capture_active = true;
   g_mcp_capture_buf.clear();
-#if defined(ESP8266)
-  // Pre-allocate to avoid repeated reallocation and fragmentation
-  g_mcp_capture_buf.reserve(3072);
-#endif
   rewind_ether_buffer();
 }
 
-// Flush remaining ether_buffer content into g_mcp_capture_buf and stop capture.
-static String mcp_end_capture() {
-  // Append whatever is still in ether_buffer
+// Flush remaining ether_buffer content and stop capture.
+static void mcp_end_capture() {
   unsigned int remaining = (unsigned int)bfill.position();
-  if (remaining > 0) {
-#if defined(ARDUINO)
-    g_mcp_capture_buf.concat(ether_buffer, remaining);
-#else
-    g_mcp_capture_buf.append(ether_buffer, (size_t)remaining);
-#endif
-  }
+  if (remaining > 0) mcp_capture_append(ether_buffer, remaining);
   g_mcp_capture_active = false;
-  String result = std::move(g_mcp_capture_buf);
-  g_mcp_capture_buf.clear();
-  return result;
+  rewind_ether_buffer();
 }
 
 // Flush current ether_buffer segment (used between sections of get_all).
 static void mcp_flush_segment() {
   unsigned int len = (unsigned int)bfill.position();
-  if (len > 0) {
-#if defined(ARDUINO)
-    g_mcp_capture_buf.concat(ether_buffer, len);
-#else
-    g_mcp_capture_buf.append(ether_buffer, (size_t)len);
-#endif
-  }
+  if (len > 0) mcp_capture_append(ether_buffer, len);
   rewind_ether_buffer();
 }
 
 // ─── JSON-RPC response helpers ────────────────────────────────────────────────
 
+// Status line and headers shared by all JSON-RPC responses. A negative
+// length omits Content-Length; the body then ends when the connection closes.
+static void mcp_write_headers(OTF::Response& res, int length) {
+  res.writeStatus(200, F("OK"));
+  res.writeHeader(F("Content-Type"), F("application/json"));
+  res.writeHeader(F("Access-Control-Allow-Origin"), F("*"));
+  res.writeHeader(F("Cache-Control"), F("no-store"));
+  res.writeHeader(F("Mcp-Session-Id"), mcp_get_session_id());
+  res.writeHeader(F("Connection"), F("close"));
+  if (length >= 0) res.writeHeader(F("Content-Length"), length);
+}
+
 // Write a complete JSON-RPC response (result or error) to res.
 // The document is cleared after serialization to free heap before writing.
 static void mcp_send_response(OTF::Response& res,
@@ -204,13 +198,7 @@ static void mcp_send_response(OTF::Response& res,
                (unsigned)expected, (unsigned)body.length(),
                (unsigned)freeMemory());
 
-  res.writeStatus(200, F("OK"));
-  res.writeHeader(F("Content-Type"), F("application/json"));
-  res.writeHeader(F("Access-Control-Allow-Origin"), F("*"));
-  res.writeHeader(F("Cache-Control"), F("no-store"));
-  res.writeHeader(F("Mcp-Session-Id"), mcp_get_session_id());
-  res.writeHeader(F("Connection"), F("close"));
-  res.writeHeader(F("Content-Length"), (int)body.length());
+  mcp_write_headers(res, (int)body.length());
   res.writeBodyData(body.c_str(), body.length());
 }
 
@@ -249,9 +237,111 @@ static void mcp_build_code_result(ArduinoJson::JsonDocument& doc,
   mcp_build_text_result(doc, id, String(buf));
 }
 
+// ─── Streamed text result ─────────────────────────────────────────────────────
+// Read-only tools used to be captured into one String, copied into a
+// JsonDocument and serialized again, so a large get_all or get_log needed
+// about three times its size in contiguous heap. The envelope around the
+// text item is fixed, so it is written directly instead: the prefix up to the
+// opening quote of "text", then the captured output escaped as a JSON string
+// chunk by chunk, then the closing suffix. Only the staging buffer is held.
+// The total length is unknown up front, so no Content-Length is sent; the
+// response is delimited by Connection: close like every MCP reply.
+
+#define MCP_STREAM_BUF  256
+
+class McpTextStream {
+public:
+  McpTextStream(OTF::Response& res, ArduinoJson::JsonVariantConst id)
+    : res(res), id(id), started(false), used(0), text_len(0) {
+    g_mcp_capture_sink = capture_sink;
+    g_mcp_capture_ctx  = this;
+  }
+  ~McpTextStream() {
+    g_mcp_capture_sink = NULL;
+    g_mcp_capture_ctx  = NULL;
+  }
+
+  // Append captured output to the text item, escaped as a JSON string
+  size_t write(const uint8_t* data, size_t len) {
+    if (!started) begin();
+    for (size_t i = 0; i < len; i++) {
+      uint8_t c = data[i];
+      if (c == '"' || c == '\\') {
+        put('\\'); put((char)c);
+      } else if (c >= 0x20) {
+        put((char)c);  // UTF-8 sequences pass through unchanged
+      } else if (c == '\n') {
+        put('\\'); put('n');
+      } else if (c == '\r') {
+        put('\\'); put('r');
+      } else if (c == '\t') {
+        put('\\'); put('t');
+      } else {
+        char esc[8];
+        snprintf(esc, sizeof(esc), "\\u%04x", c);
+        put(esc);
+      }
+    }
+    text_len += len;
+    return len;
+  }
+
+  // Close the envelope and send what is left
+  void finish() {
+    if (!started) begin();
+    put("\"}]}}");
+    flush();
+    DEBUG_PRINTF("[MCP] streamed text=%u heap=%u\n",
+                 (unsigned)text_len, (unsigned)freeMemory());
+  }
+
+private:
+  // Writes already-encoded JSON (the request id) without escaping
+  struct RawWriter {
+    McpTextStream* s;
+    size_t write(uint8_t c) { s->put((char)c); return 1; }
+    size_t write(const uint8_t* data, size_t len) {
+      for (size_t i = 0; i < len; i++) s->put((char)data[i]);
+      return len;
+    }
+  };
+
+  static void capture_sink(const char* data, size_t len, void* ctx) {
+    ((McpTextStream*)ctx)->write((const uint8_t*)data, len);
+  }
+
+  void begin() {
+    started = true;
+    mcp_write_headers(res, -1);
+    put("{\"jsonrpc\":\"2.0\",\"id\":");
+    RawWriter raw = { this };
+    ArduinoJson::serializeJson(id, raw);
+    put(",\"result\":{\"content\":[{\"type\":\"text\",\"text\":\"");
+  }
+
+  void put(char c) {
+    if (used == sizeof(buf)) flush();
+    buf[used++] = c;
+  }
+  void put(const char* str) {
+    while (*str) put(*str++);
+  }
+  void flush() {
+    if (used) res.writeBodyData(buf, used);
+    used = 0;
+  }
+
+  OTF::Response& res;
+  ArduinoJson::JsonVariantConst id;
+  bool started;
+  size_t used;
+  size_t text_len;
+  char buf[MCP_STREAM_BUF];
+};
+
 // ─── Tool: get_all ────────────────────────────────────────────────────────────
 
-static String tool_get_all(const OTF::Request& req, OTF::Response& res) {
+static void tool_get_all(const OTF::Request& req, OTF::Response& res) {
   mcp_begin_capture();
 
   // settings section (server_json_controller_main closes its own "{")
@@ -279,57 +369,57 @@ static String tool_get_all(const OTF::Request& req, OTF::Response& res) {
   server_json_stations_main(req, res);
   bfill.emit_p(PSTR("}"));  // close outer object
 
-  return mcp_end_capture();
+  mcp_end_capture();
 }
 
 // ─── Tool: get_controller_variables ──────────────────────────────────────────
 
-static String tool_get_controller_variables(const OTF::Request& req, OTF::Response& res) {
+static void tool_get_controller_variables(const OTF::Request& req, OTF::Response& res) {
   mcp_begin_capture();
   bfill.emit_p(PSTR("{"));
   server_json_controller_main(req, res);
-  return mcp_end_capture();
+  mcp_end_capture();
 }
 
 // ─── Tool: get_options ───────────────────────────────────────────────────────
 
-static String tool_get_options(const OTF::Request& /*req*/, OTF::Response& /*res*/) {
+static void tool_get_options(const OTF::Request& /*req*/, OTF::Response& /*res*/) {
   mcp_begin_capture();
   bfill.emit_p(PSTR("{"));
   server_json_options_main();
-  return mcp_end_capture();
+  mcp_end_capture();
 }
 
 // ─── Tool: get_stations ──────────────────────────────────────────────────────
 
-static String tool_get_stations(const OTF::Request& req, OTF::Response& res) {
+static void tool_get_stations(const OTF::Request& req, OTF::Response& res) {
   mcp_begin_capture();
   bfill.emit_p(PSTR("{"));
   server_json_stations_main(req, res);
-  return mcp_end_capture();
+  mcp_end_capture();
 }
 
 // ─── Tool: get_station_status ─────────────────────────────────────────────────
 
-static String tool_get_station_status(const OTF::Request& /*req*/, OTF::Response& /*res*/) {
+static void tool_get_station_status(const OTF::Request& /*req*/, OTF::Response& /*res*/) {
   mcp_begin_capture();
   bfill.emit_p(PSTR("{"));
   server_json_status_main();
-  return mcp_end_capture();
+  mcp_end_capture();
 }
 
 // ─── Tool: get_programs ───────────────────────────────────────────────────────
 
-static String tool_get_programs(const OTF::Request& req, OTF::Response& res) {
+static void tool_get_programs(const OTF::Request& req, OTF::Response& res) {
   mcp_begin_capture();
   bfill.emit_p(PSTR("{"));
   server_json_programs_main(req, res);
-  return mcp_end_capture();
+  mcp_end_capture();
 }
 
 // ─── Tool: get_debug ─────────────────────────────────────────────────────────
 
-static String tool_get_debug(const OTF::Request& /*req*/, OTF::Response& /*res*/) {
+static void tool_get_debug(const OTF::Request& /*req*/, OTF::Response& /*res*/) {
   ArduinoJson::JsonDocument doc;
   auto obj = doc.to<ArduinoJson::JsonObject>();
   obj["date"]  = __DATE__;
@@ -362,91 +452,91 @@ static String tool_get_debug(const OTF::Request& /*req*/, OTF::Response& /*res*/
 #endif
   String out;
   ArduinoJson::serializeJson(doc, out);
-  return out;
+  mcp_capture_append(out.c_str(), out.length());
 }
 
 // ─── Capture-based read-only tool helper ─────────────────────────────────────
 // Calls a full server handler in MCP capture mode (process_password and
 // print_header are no-ops in capture mode; handle_return appends the final
-// buffer chunk to g_mcp_capture_buf rather than writing to the OTF response).
+// buffer chunk to the capture sink rather than writing to the OTF response).
 
-static String tool_capture(void (*handler)(const OTF::Request&, OTF::Response&),
+static void tool_capture(void (*handler)(const OTF::Request&, OTF::Response&),
                             const OTF::Request& req, OTF::Response& res) {
   mcp_begin_capture();
   handler(req, res);
-  return mcp_end_capture();
+  mcp_end_capture();
 }
 
 // ─── Tool: get_special_stations ──────────────────────────────────────────────
 
-static String tool_get_special_stations(const OTF::Request& req, OTF::Response& res) {
-  return tool_capture(server_json_station_special, req, res);
+static void tool_get_special_stations(const OTF::Request& req, OTF::Response& res) {
+  tool_capture(server_json_station_special, req, res);
 }
 
 // ─── Tool: get_sensors ───────────────────────────────────────────────────────
 
-static String tool_get_sensors(const OTF::Request& req, OTF::Response& res) {
-  return tool_capture(server_sensor_list, req, res);
+static void tool_get_sensors(const OTF::Request& req, OTF::Response& res) {
+  tool_capture(server_sensor_list, req, res);
 }
 
 // ─── Tool: list_adjustments ──────────────────────────────────────────────────
 
-static String tool_list_adjustments(const OTF::Request& req, OTF::Response& res) {
-  return tool_capture(server_sensorprog_list, req, res);
+static void tool_list_adjustments(const OTF::Request& req, OTF::Response& res) {
+  tool_capture(server_sensorprog_list, req, res);
 }
 
 // ─── Tool: list_monitors ─────────────────────────────────────────────────────
 
-static String tool_list_monitors(const OTF::Request& req, OTF::Response& res) {
-  return tool_capture(server_monitor_list, req, res);
+static void tool_list_monitors(const OTF::Request& req, OTF::Response& res) {
+  tool_capture(server_monitor_list, req, res);
 }
 
 // ─── Tool: backup_sensor_config ──────────────────────────────────────────────
 
-static String tool_backup_sensor_config(const OTF::Request& req, OTF::Response& res) {
-  return tool_capture(server_sensorconfig_backup, req, res);
+static void tool_backup_sensor_config(const OTF::Request& req, OTF::Response& res) {
+  tool_capture(server_sensorconfig_backup, req, res);
 }
 
 // ─── Tool: get_system_resources ──────────────────────────────────────────────
 
-static String tool_get_system_resources(const OTF::Request& req, OTF::Response& res) {
-  return tool_capture(server_usage, req, res);
+static void tool_get_system_resources(const OTF::Request& req, OTF::Response& res) {
+  tool_capture(server_usage, req, res);
 }
 
 // ─── Tool: get_ieee802154_config ─────────────────────────────────────────────
 
 #if defined(ESP32C5)
-static String tool_get_ieee802154_config(const OTF::Request& req, OTF::Response& res) {
-  return tool_capture(server_ieee802154_get, req, res);
+static void tool_get_ieee802154_config(const OTF::Request& req, OTF::Response& res) {
+  tool_capture(server_ieee802154_get, req, res);
 }
 #endif
 
 // ─── Tool: get_zigbee_devices ────────────────────────────────────────────────
 
 #if defined(OS_ENABLE_ZIGBEE)
-static String tool_get_zigbee_devices(const OTF::Request& req, OTF::Response& res) {
-  return tool_capture(server_zigbee_discovered_devices, req, res);
+static void tool_get_zigbee_devices(const OTF::Request& req, OTF::Response& res) {
+  tool_capture(server_zigbee_discovered_devices, req, res);
 }
 
 // ─── Tool: get_zigbee_status ─────────────────────────────────────────────────
 
-static String tool_get_zigbee_status(const OTF::Request& req, OTF::Response& res) {
-  return tool_capture(server_zigbee_status, req, res);
+static void tool_get_zigbee_status(const OTF::Request& req, OTF::Response& res) {
+  tool_capture(server_zigbee_status, req, res);
 }
 #endif // OS_ENABLE_ZIGBEE
 
 // ─── Tool: get_ble_devices ───────────────────────────────────────────────────
 
 #if defined(OS_ENABLE_BLE)
-static String tool_get_ble_devices(const OTF::Request& req, OTF::Response& res) {
-  return tool_capture(server_ble_discovered_devices, req, res);
+static void tool_get_ble_devices(const OTF::Request& req, OTF::Response& res) {
+  tool_capture(server_ble_discovered_devices, req, res);
 }
 #endif // OS_ENABLE_BLE
 
 // ─── Tool: get_rainmaker_status ──────────────────────────────────────────────
 #if defined(ENABLE_RAINMAKER)
-static String tool_get_rainmaker_status(const OTF::Request& req, OTF::Response& res) {
-  return tool_capture(server_json_rainmaker, req, res);
+static void tool_get_rainmaker_status(const OTF::Request& req, OTF::Response& res) {
+  tool_capture(server_json_rainmaker, req, res);
 }
 #endif
 
@@ -488,7 +578,7 @@ extern unsigned char findKeyVal(const char *str, char *strbuf, uint16_t maxlen,
                                 const char *key, bool key_in_pgm = false,
                                 uint8_t *keyfound = NULL);
 
-static String tool_get_log(const OTF::Request& req, OTF::Response& res,
+static void tool_get_log(const OTF::Request& req, OTF::Response& res,
                             const ArduinoJson::JsonObjectConst& args) {
   // Build a synthetic query string from the MCP arguments so that
   // server_json_log (capture mode) can find the parameters it expects.
@@ -626,7 +716,7 @@ static String tool_get_log(const OTF::Request& req, OTF::Response& res,
     }
   }
   bfill.emit_p(PSTR("]"));
-  return mcp_end_capture();
+  mcp_end_capture();
 }
 
 // ─── Tool: manual_station_run ────────────────────────────────────────────────
@@ -987,7 +1077,8 @@ static void build_tools_list(ArduinoJson::JsonObject& result) {
 // ─── Main handler ─────────────────────────────────────────────────────────────
 
 void server_mcp_handler(const OTF::Request& req, OTF::Response& res) {
-  ArduinoJson::JsonDocument resp_doc;
+  RequestArenaScope arena_scope;
+  ArduinoJson::JsonDocument resp_doc(&request_arena);
 
   // ── CORS pre-flight ──────────────────────────────────────────────────────
   // OTF registers this handler for POST only, but browsers send OPTIONS first.
@@ -1027,7 +1118,7 @@ void server_mcp_handler(const OTF::Request& req, OTF::Response& res) {
     return;
   }
 
-  ArduinoJson::JsonDocument req_doc;
+  ArduinoJson::JsonDocument req_doc(&request_arena);
   ArduinoJson::DeserializationError parse_err =
       ArduinoJson::deserializeJson(req_doc, body_raw, body_len);
 
@@ -1137,8 +1228,10 @@ void server_mcp_handler(const OTF::Request& req, OTF::Response& res) {
     ArduinoJson::JsonObjectConst args =
         params["arguments"].as<ArduinoJson::JsonObjectConst>();
 
-    // Read-only tools that capture internal JSON output:
-    String content_json;
+    // Read-only tools stream their captured output through `out`;
+    // it only starts writing once the first byte arrives, so the action
+    // and error paths below can still reply with mcp_send_response().
+    McpTextStream out(res, rpc_id);
     bool handled = true;
 
 #if defined(ESP8266)
@@ -1157,37 +1250,37 @@ void server_mcp_handler(const OTF::Request& req, OTF::Response& res) {
 #endif
 
     if (strcmp(tool_name, "get_all") == 0) {
-      content_json = tool_get_all(req, res);
+      tool_get_all(req, res);
 
     } else if (strcmp(tool_name, "get_controller_variables") == 0) {
-      content_json = tool_get_controller_variables(req, res);
+      tool_get_controller_variables(req, res);
 
     } else if (strcmp(tool_name, "get_options") == 0) {
-      content_json = tool_get_options(req, res);
+      tool_get_options(req, res);
 
     } else if (strcmp(tool_name, "get_stations") == 0) {
-      content_json = tool_get_stations(req, res);
+      tool_get_stations(req, res);
 
     } else if (strcmp(tool_name, "get_station_status") == 0) {
-      content_json = tool_get_station_status(req, res);
+      tool_get_station_status(req, res);
 
     } else if (strcmp(tool_name, "get_programs") == 0) {
-      content_json = tool_get_programs(req, res);
+      tool_get_programs(req, res);
 
     } else if (strcmp(tool_name, "get_debug") == 0) {
-      content_json = tool_get_debug(req, res);
+      tool_get_debug(req, res);
 
     } else if (strcmp(tool_name, "get_special_stations") == 0) {
-      content_json = tool_get_special_stations(req, res);
+      tool_get_special_stations(req, res);
 
     } else if (strcmp(tool_name, "get_sensors") == 0) {
-      content_json = tool_get_sensors(req, res);
+      tool_get_sensors(req, res);
 
     } else if (strcmp(tool_name, "list_adjustments") == 0) {
-      content_json = tool_list_adjustments(req, res);
+      tool_list_adjustments(req, res);
 
     } else if (strcmp(tool_name, "list_monitors") == 0) {
-      content_json = tool_list_monitors(req, res);
+      tool_list_monitors(req, res);
 
     } else if (strcmp(tool_name, "configure_monitor") == 0) {
       if (args.isNull()) {
@@ -1201,32 +1294,32 @@ void server_mcp_handler(const OTF::Request& req, OTF::Response& res) {
       return;
 
     } else if (strcmp(tool_name, "backup_sensor_config") == 0) {
-      content_json = tool_backup_sensor_config(req, res);
+      tool_backup_sensor_config(req, res);
 
     } else if (strcmp(tool_name, "get_system_resources") == 0) {
-      content_json = tool_get_system_resources(req, res);
+      tool_get_system_resources(req, res);
 
 #if defined(ESP32C5)
     } else if (strcmp(tool_name, "get_ieee802154_config") == 0) {
-      content_json = tool_get_ieee802154_config(req, res);
+      tool_get_ieee802154_config(req, res);
 #endif
 
 #if defined(OS_ENABLE_ZIGBEE)
     } else if (strcmp(tool_name, "get_zigbee_devices") == 0) {
-      content_json = tool_get_zigbee_devices(req, res);
+      tool_get_zigbee_devices(req, res);
 
     } else if (strcmp(tool_name, "get_zigbee_status") == 0) {
-      content_json = tool_get_zigbee_status(req, res);
+      tool_get_zigbee_status(req, res);
 #endif
 
 #if defined(OS_ENABLE_BLE)
     } else if (strcmp(tool_name, "get_ble_devices") == 0) {
-      content_json = tool_get_ble_devices(req, res);
+      tool_get_ble_devices(req, res);
 #endif
 
 #if defined(ENABLE_RAINMAKER)
     } else if (strcmp(tool_name, "get_rainmaker_status") == 0) {
-      content_json = tool_get_rainmaker_status(req, res);
+      tool_get_rainmaker_status(req, res);
 
     } else if (strcmp(tool_name, "start_rainmaker_provisioning") == 0) {
       if (args.isNull()) {
@@ -1241,7 +1334,7 @@ void server_mcp_handler(const OTF::Request& req, OTF::Response& res) {
 #endif
 
     } else if (strcmp(tool_name, "get_log") == 0) {
-      content_json = tool_get_log(req, res, args);
+      tool_get_log(req, res, args);
 
     // Action tools:
     } else if (strcmp(tool_name, "manual_station_run") == 0) {
@@ -1279,13 +1372,9 @@ void server_mcp_handler(const OTF::Request& req, OTF::Response& res) {
       return;
     }
 
-    // Return text result (for read-only tools)
-    req_doc.clear();  // free request doc before building large response
-    mcp_build_text_result(resp_doc, rpc_id, content_json);
-    DEBUG_PRINTF("[MCP] capture=%u overflowed=%d\n",
-                 (unsigned)content_json.length(), (int)resp_doc.overflowed());
-    content_json = String();  // free captured data before serializing response
-    mcp_send_response(res, resp_doc);
+    // Close the text result (for read-only tools). req_doc stays alive
+    // until here, rpc_id points into it.
+    out.finish();
     return;
   }
 
@@ -103,6 +103,8 @@
 	void OSMqtt::suspend(void) {}
 	void OSMqtt::resume(void) {}
 	void OSMqtt::setCallback(int key, void (*on_message)(struct mosquitto *, void *, const struct mosquitto_message *)) {(void)key; (void)on_message;}
+	int OSMqtt::socket_fd(void) { return -1; }
+	bool OSMqtt::want_write(void) { return false; }
 
 #else
 
@@ -1056,7 +1058,16 @@ int OSMqtt::_subscribe(void) {
 int OSMqtt::_loop(void) {
 	// Skip polling when the client has no valid socket (e.g. connect failed)
 	if (mosquitto_socket(mqtt_client) < 0) return MOSQ_ERR_NO_CONN;
-	return mosquitto_loop(mqtt_client, 1, 1);  // 1ms timeout to avoid busy-polling
+	return mosquitto_loop(mqtt_client, 0, 1);  // no wait, the event loop blocks on the socket
+}
+
+int OSMqtt::socket_fd(void) {
+	if (!mqtt_client || !_enabled) return -1;
+	return mosquitto_socket(mqtt_client);
+}
+
+bool OSMqtt::want_write(void) {
+	return mqtt_client && mosquitto_want_write(mqtt_client);
 }
 
 bool OSMqtt::subscribe(const char *topic) {
@@ -91,6 +91,8 @@ private:
     static Client * client;
 #else
 	static void setCallback(int key, void (*on_message)(struct mosquitto *, void *, const struct mosquitto_message *));
+	static int socket_fd(void);    // broker socket for the event loop to wait on, -1 if none
+	static bool want_write(void);  // outgoing packets are queued
 #endif
 };
 
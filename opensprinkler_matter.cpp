@@ -12,6 +12,7 @@
 #include "sensors.h"
 #include "SensorBase.hpp"
 #include "opensprinkler_matter.h"
+#include "state_snapshot.h"
 #include "ieee802154_config.h"
 
 #if defined(ESP32)
@@ -428,7 +429,8 @@ namespace {
   }
 
   bool matter_binary_sensor_active(uint8_t port) {
-    return port == 0 ? os.status.sensor1_active : os.status.sensor2_active;
+    StateSnapshotRef snap;  // polled from the Matter task
+    return port == 0 ? snap->sensor1_active : snap->sensor2_active;
   }
 
   String matter_configured_device_name() {
@@ -664,7 +666,7 @@ void create_station_endpoints(int &budget) {
       continue;
     }
     stations[sid] = std::unique_ptr<MatterWaterValve>(new(mem) MatterWaterValve());
-    bool is_on = (os.station_bits[bid] >> sbit) & 1;
+    bool is_on = StateSnapshotRef()->is_running(sid);
     
     if(stations[sid]->begin(is_on)) {
       budget--;
@@ -31,6 +31,7 @@
 #include "program.h"
 #include "sensors.h"
 #include "SensorBase.hpp"
+#include "state_snapshot.h"
 #if defined(OS_ENABLE_BLE)
 #include "sensor_ble.h"
 #endif
@@ -1044,10 +1045,9 @@ static void rmaker_event_handler(void *arg, esp_event_base_t base,
 // ─── Helper: check if a program is currently running ─────────────────────────
 
 static bool is_program_running(uint8_t pid) {
-  for (uint8_t sid = 0; sid < os.nstations; sid++) {
-    uint8_t qid = pd.station_qid[sid];
-    if (qid == 0xFF) continue;
-    if (qpid_decode(pd.queue[qid].pid) == (uint8_t)(pid + 1)) return true;
+  StateSnapshotRef snap;  // the run queue belongs to the main loop
+  for (uint8_t sid = 0; sid < snap->nstations; sid++) {
+    if (snap->stations[sid].pid == (uint8_t)(pid + 1)) return true;
   }
   return false;
 }
@@ -1276,7 +1276,7 @@ static void create_zone_devices(esp_rmaker_node_t *node) {
     // Power param — writable so Alexa/Google Home can control it
     esp_rmaker_param_t *ppower = esp_rmaker_param_create(
         ESP_RMAKER_DEF_POWER_NAME, ESP_RMAKER_PARAM_POWER,
-        esp_rmaker_bool(os.is_running(sid) ? true : false),
+        esp_rmaker_bool(StateSnapshotRef()->is_running(sid)),
         PROP_FLAG_READ | PROP_FLAG_WRITE | PROP_FLAG_TIME_SERIES);
     esp_rmaker_param_add_ui_type(ppower, ESP_RMAKER_UI_TOGGLE);
     esp_rmaker_device_add_param(dev, ppower);
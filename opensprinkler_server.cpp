@@ -50,6 +50,7 @@ static void emit_monthly_water_backup_json(T &bfill) {
 #include <esp_heap_caps.h>
 #endif
 #include "sensors.h"
+#include "sensorlog_store.h"
 #include "osinfluxdb.h"
 #include "ArduinoJson.hpp"
 #include "sensor_fyta.h"
@@ -62,6 +63,11 @@ static void emit_monthly_water_backup_json(T &bfill) {
 #include "sensor_mqtt.h"
 #include "sensor_remote_json.h"
 #include "LinkedMap.h"
+#include "request_arena.h"
+#include "response_cache.h"
+#include "web_thread.h"
+#include "response_pool.h"
+#include "state_snapshot.h"
 #include <new>
 #include <stdlib.h>
 
@@ -114,9 +120,9 @@ extern "C" {
 #else
   #define MCP_BUF_APPEND(buf, data, len) (buf).append((data), (size_t)(len))
 #endif
-	#define handle_return(x) { if(g_mcp_capture_active){if((x)==HTML_OK){int _l=(int)bfill.position();if(_l>0)MCP_BUF_APPEND(g_mcp_capture_buf,ether_buffer,_l);}rewind_ether_buffer();return;} if((x)==HTML_OK)res.writeBodyData(ether_buffer,(int)bfill.position());else otf_send_result(req,res,(x));return;}
+	#define handle_return(x) { if(g_mcp_capture_active){if((x)==HTML_OK){int _l=(int)bfill.position();if(_l>0)mcp_capture_append(ether_buffer,_l);}rewind_ether_buffer();return;} if((x)==HTML_OK)write_body(res,ether_buffer,bfill.position());else otf_send_result(req,res,(x));return;}
 #else
-	#define handle_return(x) {if(x==HTML_OK) res.writeBodyData(ether_buffer, (int)bfill.position()); else otf_send_result(req,res,x); return;}
+	#define handle_return(x) {if(x==HTML_OK) write_body(res, ether_buffer, bfill.position()); else otf_send_result(req,res,x); return;}
 #endif
 #else
 	extern EthernetClient *m_client;
@@ -171,8 +177,22 @@ using ArduinoJson::DeserializationError;
 // g_mcp_capture_buf instead of writing to the OTF response.  This lets the
 // embedded MCP server reuse all existing _main() helper functions.
 #if defined(USE_OTF)
-bool   g_mcp_capture_active = false;
-String g_mcp_capture_buf;
+OS_THREAD_LOCAL bool   g_mcp_capture_active = false;
+OS_THREAD_LOCAL String g_mcp_capture_buf;
+OS_THREAD_LOCAL McpCaptureSink g_mcp_capture_sink = NULL;
+OS_THREAD_LOCAL void *g_mcp_capture_ctx = NULL;
+
+void mcp_capture_append(const char *data, size_t len) {
+	if (g_mcp_capture_sink) g_mcp_capture_sink(data, len, g_mcp_capture_ctx);
+	else MCP_BUF_APPEND(g_mcp_capture_buf, data, len);
+}
+#endif
+
+#if defined(USE_OTF)
+// Set by server_api_dispatch() for cacheable endpoints: the entity tag
+// print_header() sends, and whether the password was already verified.
+static OS_THREAD_LOCAL uint32_t response_etag = 0;
+static OS_THREAD_LOCAL bool request_authorized = false;
 #endif
 using ArduinoJson::JsonArray;
 using ArduinoJson::JsonVariant;
@@ -181,13 +201,24 @@ using ArduinoJson::JsonVariant;
 extern OpenSprinkler os;
 extern ProgramData pd;
 extern volatile ulong flow_count;
+#if !defined(ARDUINO)
+extern ulong loop_skipped_seconds;
+#endif
 
 #if !defined(USE_OTF)
 static unsigned char return_code;
 static char* get_buffer = NULL;
 #endif
 
-BufferFiller bfill;
+OS_THREAD_LOCAL BufferFiller bfill;
+
+#if defined(USE_OTF)
+/** Send body bytes, queued while the web thread holds the state lock */
+static void write_body(OTF::Response &res, const char *data, size_t len) {
+	if (response_pool_active()) response_pool_write(data, len);
+	else res.writeBodyData(data, len);
+}
+#endif
 
 /* Check available space (number of bytes) in the Ethernet buffer */
 int available_ether_buffer() {
@@ -373,15 +404,11 @@ void send_packet(OTF_PARAMS_DEF) {
 	if (len > 0) {
 #if defined(USE_OTF)
 		if (g_mcp_capture_active) {
-			// MCP capture mode: accumulate into string instead of HTTP response
-#if defined(ARDUINO)
-			g_mcp_capture_buf.concat(ether_buffer, (unsigned int)len);
-#else
-			g_mcp_capture_buf.append(ether_buffer, (size_t)len);
-#endif
+			// MCP capture mode: hand the output to MCP instead of the HTTP response
+			mcp_capture_append(ether_buffer, (size_t)len);
 		} else {
 #endif
-			res.writeBodyData(ether_buffer, len);
+			write_body(res, ether_buffer, len);
 #if defined(USE_OTF)
 		}
 #endif
@@ -409,6 +436,10 @@ char dec2hexchar(unsigned char dec) {
 }
 
 #if defined(USE_OTF)
+static void format_etag(char *buf, uint32_t tag) {
+	snprintf(buf, 12, "\"%08lx\"", (unsigned long)tag);
+}
+
 void print_header(OTF_PARAMS_DEF, bool isJson=true, int len=0) {
 	if (g_mcp_capture_active) return;
 	 // Signal radio coex: WiFi is serving a request
@@ -417,7 +448,14 @@ void print_header(OTF_PARAMS_DEF, bool isJson=true, int len=0) {
 	if(len>0)
 		res.writeHeader(F("Content-Length"), len);
 	res.writeHeader(F("Access-Control-Allow-Origin"), F("*"));
-	res.writeHeader(F("Cache-Control"), F("max-age=0, no-cache, no-store, must-revalidate"));
+	if(response_etag) {
+		char etag[12];
+		format_etag(etag, response_etag);
+		res.writeHeader(F("ETag"), etag);
+		res.writeHeader(F("Cache-Control"), F("no-cache"));
+	} else {
+		res.writeHeader(F("Cache-Control"), F("max-age=0, no-cache, no-store, must-revalidate"));
+	}
 	res.writeHeader(F("Connection"), F("close"));
 }
 
@@ -651,8 +689,8 @@ boolean check_password(char *p)
 	return true;
 #endif
 #if defined(USE_OTF)
-	// MCP capture mode: auth already verified by the MCP handler
-	if (g_mcp_capture_active) return true;
+	// MCP capture mode / cached dispatch: auth already verified by the caller
+	if (g_mcp_capture_active || request_authorized) return true;
 #endif
 	if (os.iopts[IOPT_IGNORE_PASSWORD])  return true;
 
@@ -944,6 +982,7 @@ void server_change_stations(OTF_PARAMS_DEF) {
 			// write spe data
 			file_write_block(STATIONS_FILENAME, tmp_buffer,
 				(uint32_t)sid*sizeof(StationData)+offsetof(StationData,type), STATION_SPECIAL_DATA_SIZE+1);
+			cache_invalidate(CACHE_DOM_STATIONS);
 
 		} else {
 
@@ -1428,7 +1467,7 @@ void server_json_options_main() {
 			else v<<=2;
 		}
 
-		if (oid==IOPT_I_MIN_THRESHOLD || oid==IOPT_I_MAX_LIMIT) {
+		if (oid==IOPT_I_MIN_THRESHOLD || oid==IOPT_I_MAX_LIMIT || oid==IOPT_CURRENT_BUDGET) {
 			if (os.hw_type==HW_TYPE_AC || os.hw_type==HW_TYPE_DC ) v*=10;
 			else continue;
 		}
@@ -1441,7 +1480,7 @@ void server_json_options_main() {
 			if (!(os.hw_rev==4 && os.hw_type==HW_TYPE_DC)) continue;
 		}
 		#else
-		if (oid==IOPT_BOOST_TIME || oid==IOPT_I_MIN_THRESHOLD || oid==IOPT_I_MAX_LIMIT || oid==IOPT_LATCH_ON_VOLTAGE || oid==IOPT_LATCH_OFF_VOLTAGE || oid==IOPT_TARGET_PD_VOLTAGE) continue;
+		if (oid==IOPT_BOOST_TIME || oid==IOPT_I_MIN_THRESHOLD || oid==IOPT_I_MAX_LIMIT || oid==IOPT_CURRENT_BUDGET || oid==IOPT_LATCH_ON_VOLTAGE || oid==IOPT_LATCH_OFF_VOLTAGE || oid==IOPT_TARGET_PD_VOLTAGE) continue;
 		#endif
 
 		#if defined(ESP8266)
@@ -1603,16 +1642,17 @@ function rst_wsp() {document.getElementById('wsp').value='$S';}</script>)"),
 void server_json_controller_main(OTF_PARAMS_DEF) {
 	unsigned char bid, sid;
 	time_os_t curr_time = os.now_tz();
+	StateSnapshotRef snap;  // run state as of one point of the schedule
 	bfill.emit_p(PSTR("\"devt\":$L,\"nbrd\":$D,\"en\":$D,\"sn1\":$D,\"sn2\":$D,\"rd\":$D,\"rdst\":$L,"
 										"\"sunrise\":$D,\"sunset\":$D,\"eip\":$L,\"lwc\":$L,\"lswc\":$L,"
 									"\"lupt\":$L,\"lrbtc\":$D,\"lrun\":[$D,$D,$D,$L],\"pq\":$D,\"pt\":$L,\"nq\":$D,\"ocs\":$D,\"ocma\":$D,"),
 							(uint32_t)curr_time,
-							os.nboards,
-							os.status.enabled,
-							os.status.sensor1_active,
-							os.status.sensor2_active,
-							os.status.rain_delayed,
-							(uint32_t)os.nvdata.rd_stop_time,
+							snap->nboards,
+							snap->enabled,
+							snap->sensor1_active,
+							snap->sensor2_active,
+							snap->rain_delayed,
+							(uint32_t)snap->rd_stop_time,
 							os.nvdata.sunrise_time,
 							os.nvdata.sunset_time,
 							os.nvdata.external_ip,
@@ -1620,15 +1660,15 @@ void server_json_controller_main(OTF_PARAMS_DEF) {
 							(uint32_t)os.checkwt_success_lasttime,
 							(uint32_t)os.powerup_lasttime,
 							os.last_reboot_cause,
-							pd.lastrun.station,
-							pd.lastrun.program,
-							pd.lastrun.duration,
-							pd.lastrun.endtime,
-							os.status.pause_state,
-							os.pause_timer,
-							pd.nqueue,
-							os.status.overcurrent_sid,
-							os.status.overcurrent_ma);
+							snap->lastrun.station,
+							snap->lastrun.program,
+							snap->lastrun.duration,
+							snap->lastrun.endtime,
+							snap->pause_state,
+							snap->pause_timer,
+							snap->nqueue,
+							snap->overcurrent_sid,
+							snap->overcurrent_ma);
 
 #if defined(ESP8266) || defined(ESP32)
 	bfill.emit_p(PSTR("\"RSSI\":$D,"), (int16_t)WiFi.RSSI());
@@ -1708,31 +1748,25 @@ void server_json_controller_main(OTF_PARAMS_DEF) {
 		bfill.emit_p(PSTR("\"curr\":$D,\"vcurr\":$D,\"blcurr\":$D,"), current, valve_current, os.baseline_current);
 #endif
 	if(os.iopts[IOPT_SENSOR1_TYPE]==SENSOR_TYPE_FLOW) {
-		bfill.emit_p(PSTR("\"flcrt\":$L,\"flwrt\":$D,\"flcto\":$L,"), os.flowcount_rt, FLOWCOUNT_RT_WINDOW, flow_count);
+		bfill.emit_p(PSTR("\"flcrt\":$L,\"flwrt\":$D,\"flcto\":$L,"), snap->flowcount_rt, FLOWCOUNT_RT_WINDOW, snap->flow_count);
 	}
 
 	bfill.emit_p(PSTR("\"sbits\":["));
 	// print sbits
-	for(bid=0;bid<os.nboards;bid++)
-		bfill.emit_p(PSTR("$D,"), os.station_bits[bid]);
+	for(bid=0;bid<snap->nboards;bid++)
+		bfill.emit_p(PSTR("$D,"), snap->station_bits[bid]);
 	bfill.emit_p(PSTR("0],\"ps\":["));
 	// print ps
-	for(sid=0;sid<os.nstations;sid++) {
+	for(sid=0;sid<snap->nstations;sid++) {
 		// if available ether buffer is getting small
 		// send out a packet
 		if(available_ether_buffer() <= 0) {
 			send_packet(OTF_PARAMS);
 		}
-		unsigned long rem = 0;
-		unsigned char qid = pd.station_qid[sid];
-		RuntimeQueueStruct *q = pd.queue + qid;
-		if (qid<255) {
-			rem = (curr_time >= q->st) ? (q->st+q->dur-curr_time) : q->dur;
-			if(rem>65535) rem = 0;
-		}
+		const StationSnapshot &q = snap->stations[sid];
 		bfill.emit_p(PSTR("[$D,$L,$L,$D]"),
-		(qid<255)?qpid_decode(q->pid):0, (uint32_t)rem, (uint32_t)((qid<255)?q->st:0), os.attrib_grp[sid]);
-		bfill.emit_p((sid<os.nstations-1)?PSTR(","):PSTR("]"));
+		q.pid, (uint32_t)snap->remaining(sid, curr_time), q.st, os.attrib_grp[sid]);
+		bfill.emit_p((sid<snap->nstations-1)?PSTR(","):PSTR("]"));
 	}
 
 	unsigned char gpioList[] = PIN_FREE_LIST;
@@ -1764,7 +1798,7 @@ void server_json_controller_main(OTF_PARAMS_DEF) {
 	//end belowmode
 
 	// Currently manually-running program id (1-based pid, 0 = none in manual execution)
-	bfill.emit_p(PSTR(",\"nqpid\":$D"), pd.current_mpid);
+	bfill.emit_p(PSTR(",\"nqpid\":$D"), snap->current_mpid);
 
 	bfill.emit_p(PSTR("}"));
 }
@@ -2002,7 +2036,7 @@ void server_change_options(OTF_PARAMS_DEF)
 			if(oid==IOPT_BOOST_TIME) {
 				 v>>=2;
 			}
-			if(oid==IOPT_I_MIN_THRESHOLD || oid==IOPT_I_MAX_LIMIT) {
+			if(oid==IOPT_I_MIN_THRESHOLD || oid==IOPT_I_MAX_LIMIT || oid==IOPT_CURRENT_BUDGET) {
 				v/=10;
 			}
 			if (v>=0 && v<=max_value) {
@@ -2262,10 +2296,11 @@ void server_change_password(OTF_PARAMS_DEF) {
 void server_json_status_main() {
 	bfill.emit_p(PSTR("\"sn\":["));
 	unsigned char sid;
+	StateSnapshotRef snap;
 
-	for (sid=0;sid<os.nstations;sid++) {
-		bfill.emit_p(PSTR("$D"), (os.station_bits[(sid>>3)]>>(sid&0x07))&1);
-		if(sid!=os.nstations-1) bfill.emit_p(PSTR(","));
+	for (sid=0;sid<snap->nstations;sid++) {
+		bfill.emit_p(PSTR("$D"), snap->is_running(sid));
+		if(sid!=snap->nstations-1) bfill.emit_p(PSTR(","));
 	}
 	bfill.emit_p(PSTR("]"));
 #if defined(ESP32C5) && defined(OS_ENABLE_ZIGBEE)
@@ -2276,7 +2311,7 @@ void server_json_status_main() {
 	}
 	bfill.emit_p(PSTR("]"));
 #endif
-	bfill.emit_p(PSTR(",\"nstations\":$D}"), os.nstations);
+	bfill.emit_p(PSTR(",\"nstations\":$D}"), snap->nstations);
 }
 
 /** Output station status */
@@ -2295,6 +2330,54 @@ void server_json_status(OTF_PARAMS_DEF)
 	handle_return(HTML_OK);
 }
 
+/**
+ * Turn one station on for timer seconds, or off; shared by /cm and /cb.
+ * Returns the HTML_* result code. When a station was queued, *queued is set
+ * and the caller runs schedule_all_stations().
+ */
+static unsigned char manual_station_change(int sid, unsigned char en, uint16_t timer, unsigned char ssta, unsigned long curr_time, bool *queued) {
+	if (sid<0 || sid>=os.nstations) return HTML_DATA_OUTOFBOUND;
+	if (en) { // if turning on a station, must provide timer
+		if (timer==0 || timer>64800) return HTML_DATA_OUTOFBOUND;
+		// schedule manual station
+		// skip if the station is a master station
+		// (because master cannot be scheduled independently)
+		if ((os.status.mas==sid+1) || (os.status.mas2==sid+1))
+			return HTML_NOT_PERMITTED;
+
+		unsigned char bid = sid >> 3;
+		unsigned char s = sid & 0x07;
+		if (os.attrib_dis[bid] & (1 << s))
+			return HTML_NOT_PERMITTED;
+
+		RuntimeQueueStruct *q = NULL;
+		unsigned char sqi = pd.station_qid[sid];
+		// check if the station already has a schedule
+		if (sqi!=0xFF) { // if so, do nothing
+
+		} else {  // otherwise create a new queue element
+			q = pd.enqueue();
+		}
+		// if the queue is not full (and the station doesn't already have a schedule
+		if (!q) return HTML_NOT_PERMITTED;
+		q->st = 0;
+		q->dur = timer;
+		q->sid = sid;
+		q->pid = 99;  // testing stations are assigned program index 99
+		*queued = true;
+	} else {	// turn off station
+		// mark station for removal
+		if(pd.station_qid[sid]==255) {
+			// Station is already stopped (not in queue) - desired state achieved, return success
+			return HTML_SUCCESS;
+		}
+		RuntimeQueueStruct *q = pd.queue + pd.station_qid[sid];
+		q->deque_time = curr_time;
+		turn_off_station(sid, curr_time, ssta);
+	}
+	return HTML_SUCCESS;
+}
+
 /**
  * Test station (previously manual operation)
  * Command: /cm?pw=xxx&sid=x&en=x&t=x&ssta=x&qo=x
@@ -2329,66 +2412,79 @@ void server_change_manual(OTF_PARAMS_DEF) {
 	}
 
 	uint16_t timer=0;
+	unsigned char qo = 0, ssta = 0;
 	unsigned long curr_time = os.now_tz();
-	if (en) { // if turning on a station, must provide timer
-		if (findKeyVal(FKV_SOURCE, tmp_buffer, TMP_BUFFER_SIZE, PSTR("t"), true)) {
-			timer=(uint16_t)atol(tmp_buffer);
-			if (timer==0 || timer>64800) {
-				handle_return(HTML_DATA_OUTOFBOUND);
-			}
-
-			unsigned char qo = 0;
-			if (findKeyVal(FKV_SOURCE, tmp_buffer, TMP_BUFFER_SIZE, PSTR("qo"), true)) {
-				qo=(unsigned char)atoi(tmp_buffer);
-			}
-			// schedule manual station
-			// skip if the station is a master station
-			// (because master cannot be scheduled independently)
-			if ((os.status.mas==sid+1) || (os.status.mas2==sid+1))
-				handle_return(HTML_NOT_PERMITTED);
-
-			unsigned char bid = sid >> 3;
-			unsigned char s = sid & 0x07;
-			if (os.attrib_dis[bid] & (1 << s))
-				handle_return(HTML_NOT_PERMITTED);
-
-			RuntimeQueueStruct *q = NULL;
-			unsigned char sqi = pd.station_qid[sid];
-			// check if the station already has a schedule
-			if (sqi!=0xFF) { // if so, do nothing
-
-			} else {  // otherwise create a new queue element
-				q = pd.enqueue();
-			}
-			// if the queue is not full (and the station doesn't already have a schedule
-			if (q) {
-				q->st = 0;
-				q->dur = timer;
-				q->sid = sid;
-				q->pid = 99;  // testing stations are assigned program index 99
-				schedule_all_stations(curr_time, qo);
-			} else {
-				handle_return(HTML_NOT_PERMITTED);
-			}
-		} else {
+	if (en) {
+		if (!findKeyVal(FKV_SOURCE, tmp_buffer, TMP_BUFFER_SIZE, PSTR("t"), true))
 			handle_return(HTML_DATA_MISSING);
+		timer=(uint16_t)atol(tmp_buffer);
+		if (findKeyVal(FKV_SOURCE, tmp_buffer, TMP_BUFFER_SIZE, PSTR("qo"), true)) {
+			qo=(unsigned char)atoi(tmp_buffer);
 		}
-	} else {	// turn off station
-		unsigned char ssta = 0;
-		if (findKeyVal(FKV_SOURCE, tmp_buffer, TMP_BUFFER_SIZE, PSTR("ssta"), true)) {
-			ssta = atoi(tmp_buffer);
-		}
-		// mark station for removal
-		if(pd.station_qid[sid]==255) {
-			// Station is already stopped (not in queue) - desired state achieved, return success
-			handle_return(HTML_SUCCESS);
-		} else {
-			RuntimeQueueStruct *q = pd.queue + pd.station_qid[sid];
-			q->deque_time = curr_time;
-			turn_off_station(sid, curr_time, ssta);
+	} else if (findKeyVal(FKV_SOURCE, tmp_buffer, TMP_BUFFER_SIZE, PSTR("ssta"), true)) {
+		ssta = atoi(tmp_buffer);
+	}
+
+	bool queued = false;
+	unsigned char ret = manual_station_change(sid, en, timer, ssta, curr_time, &queued);
+	if (queued) schedule_all_stations(curr_time, qo);
+	handle_return(ret);
+}
+
+#define BATCH_MAX_STATIONS 32
+
+// parse a comma separated list of numbers, returns the count
+static unsigned char parse_num_list(const char *s, long *out, unsigned char max) {
+	unsigned char n = 0;
+	while (*s && n < max) {
+		out[n++] = atol(s);
+		while (*s && *s != ',') s++;
+		if (*s == ',') s++;
+	}
+	return n;
+}
+
+/**
+ * Change several stations in one request (used by master controllers
+ * driving remote stations on this controller)
+ * Command: /cb?pw=xxx&sid=x,x,x&en=x,x,x&t=x,x,x
+ *
+ * sid: station indices
+ * en:  enable (0 or 1) per station
+ * t:   timer per station (ignored for en=0)
+ * All changes are applied; the result is that of the first failing one.
+ */
+void server_change_batch(OTF_PARAMS_DEF) {
+#if defined(USE_OTF)
+	if(!process_password(OTF_PARAMS)) return;
+#else
+	char *p = get_buffer;
+#endif
+
+	long sids[BATCH_MAX_STATIONS], ens[BATCH_MAX_STATIONS], timers[BATCH_MAX_STATIONS];
+	unsigned char n, nen, nt = 0;
+	if (!findKeyVal(FKV_SOURCE, tmp_buffer, TMP_BUFFER_SIZE, PSTR("sid"), true)) handle_return(HTML_DATA_MISSING);
+	n = parse_num_list(tmp_buffer, sids, BATCH_MAX_STATIONS);
+	if (!findKeyVal(FKV_SOURCE, tmp_buffer, TMP_BUFFER_SIZE, PSTR("en"), true)) handle_return(HTML_DATA_MISSING);
+	nen = parse_num_list(tmp_buffer, ens, BATCH_MAX_STATIONS);
+	if (findKeyVal(FKV_SOURCE, tmp_buffer, TMP_BUFFER_SIZE, PSTR("t"), true))
+		nt = parse_num_list(tmp_buffer, timers, BATCH_MAX_STATIONS);
+	if (!n || nen != n) handle_return(HTML_DATA_FORMATERROR);
+
+	unsigned long curr_time = os.now_tz();
+	unsigned char ret = HTML_SUCCESS;
+	bool queued = false;
+	for (unsigned char i = 0; i < n; i++) {
+		if (ens[i] && i >= nt) {
+			if (ret == HTML_SUCCESS) ret = HTML_DATA_MISSING;
+			continue;
 		}
+		long t = ens[i] ? timers[i] : 0;
+		unsigned char r = manual_station_change((int)sids[i], ens[i] ? 1 : 0, (t < 0 || t > 65535) ? 0 : (uint16_t)t, 0, curr_time, &queued);
+		if (r != HTML_SUCCESS && ret == HTML_SUCCESS) ret = r;
 	}
-	handle_return(HTML_SUCCESS);
+	if (queued) schedule_all_stations(curr_time, 0);
+	handle_return(ret);
 }
 
 
@@ -2676,6 +2772,8 @@ void server_json_debug(OTF_PARAMS_DEF) {
 #else
 	0);
 #endif
+	bfill.emit_p(PSTR(",\"arena\":{\"cap\":$L,\"peak\":$L,\"fb\":$L}"),
+		(unsigned long)request_arena.capacity(), (unsigned long)request_arena.high_water(), (unsigned long)request_arena.fallback_count());
 
 	#if defined(ESP8266)
 	FSInfo fs_info;
@@ -2725,6 +2823,16 @@ void server_json_debug(OTF_PARAMS_DEF) {
 #else
 	0);
 #endif
+	bfill.emit_p(PSTR(",\"arena\":{\"cap\":$L,\"peak\":$L,\"fb\":$L}"),
+		(unsigned long)request_arena.capacity(), (unsigned long)request_arena.high_water(), (unsigned long)request_arena.fallback_count());
+#if defined(GPIO_SIMULATION)
+	{
+		unsigned long gw, gt;
+		gpio_sim_counters(&gw, &gt);
+		bfill.emit_p(PSTR(",\"gpio\":{\"writes\":$L,\"trans\":$L}"), gw, gt);
+	}
+#endif
+	bfill.emit_p(PSTR(",\"clock\":{\"rate\":$D,\"skip\":$L}"), sim_clock_rate(), loop_skipped_seconds);
 	bfill.emit_p(PSTR("}"));
 #endif
 	handle_return(HTML_OK);
@@ -3866,7 +3974,7 @@ void server_sensor_config(OTF_PARAMS_DEF)
 
 	// Build JSON configuration off the loop stack; ArduinoJson v7's
 	// JsonDocument object is large enough to trip stack protection here.
-	JsonDocument *doc = new (std::nothrow) JsonDocument();
+	JsonDocument *doc = new (std::nothrow) JsonDocument(&request_arena);
 	if (!doc) handle_return(HTML_DATA_MISSING);
 	JsonObject config = doc->to<JsonObject>();
 
@@ -3880,7 +3988,7 @@ void server_sensor_config(OTF_PARAMS_DEF)
 			strncpy(tmp_buffer, value, TMP_BUFFER_SIZE-1);
 			tmp_buffer[TMP_BUFFER_SIZE-1] = '\0';
 			urlDecodeAndUnescape(tmp_buffer);
-			config[key] = String(tmp_buffer);  // ArduinoJson copies char* (isLinked=false)
+			config[key] = (char*)tmp_buffer;  // ArduinoJson copies char* into the arena pool
 		}
 		qp = qp->next;
 	}
@@ -4374,21 +4482,7 @@ void server_sensorlog_list(OTF_PARAMS_DEF) {
 		DEBUG_PRINT(F("lastHours="));
 		DEBUG_PRINTLN(lastHours);
 
-		ulong a = 0;
-		ulong b = log_size-1;
-		ulong lastIdx = 0;
-		while (true) {
-			ulong idx = (b-a)/2+a;
-			sensorlog_load(log, idx, sensorlog);
-			if (sensorlog->time < after) {
-				a = idx;
-			} else if (sensorlog->time > after) {
-				b = idx;
-			}
-			if (a >= b || idx == lastIdx) break;
-			lastIdx = idx;
-		}
-		startAt = lastIdx;
+		startAt = findLogPosition(log, after);
 	}
 	if (maxResults > 0 && maxResults < log_size)
 	{
@@ -4402,8 +4496,12 @@ void server_sensorlog_list(OTF_PARAMS_DEF) {
 	uint sensor_type = 0;
 
 	DEBUG_PRINTLN(F("start so"));
+	// the main loop may switch or clear the log while a packet goes out
+	// (URL_YIELD); the indices are only valid for this generation
+	const uint32_t generation = sensorlog_generation(log);
+	bool truncated = false;
 	ulong idx = startAt;
-	while (idx < log_size) {
+	while (idx < log_size && !truncated) {
 		int n = sensorlog_load2(log, idx, BLOCKSIZE, sensorlog);
 		if (n <= 0) break;
 
@@ -4475,6 +4573,14 @@ void server_sensorlog_list(OTF_PARAMS_DEF) {
 			// send out a packet
 			if (available_ether_buffer() <=0 ) {
 				send_packet(OTF_PARAMS);
+				// sensors may change while a slow client holds up the packet (URL_YIELD),
+				// look the next one up again by its nr
+				sensor = NULL;
+				if (sensorlog_generation(log) != generation) {
+					DEBUG_PRINTLN(F("so: log changed, export stopped"));
+					truncated = true;
+					break;
+				}
 			}
 			if (++count >= maxResults) {
 				break;
@@ -4486,7 +4592,7 @@ void server_sensorlog_list(OTF_PARAMS_DEF) {
 	DEBUG_PRINTLN(F("end so"));
 
 	if (isjson)
-		bfill.emit_p(PSTR("]}"));
+		bfill.emit_p(truncated ? PSTR("],\"truncated\":1}") : PSTR("]}"));
 	else
 		bfill.emit_p(PSTR("\r\n"));
 	free(sensorlog);
@@ -5294,7 +5400,7 @@ void server_sensorprog_config(OTF_PARAMS_DEF) {
 	//DEBUG_PRINTLN(F("server_sensorprog_config"));
 
 	// Build JSON object from request parameters
-	ArduinoJson::JsonDocument doc;
+	ArduinoJson::JsonDocument doc(&request_arena);
 	ArduinoJson::JsonObject obj = doc.to<ArduinoJson::JsonObject>();
 
 	if (!findKeyVal(FKV_SOURCE, tmp_buffer, TMP_BUFFER_SIZE, PSTR("nr"), true))
@@ -5883,12 +5989,12 @@ extern uint32_t ping_ok;
 #endif
 
 	bfill.emit_p(PSTR(",\"logfiles\":{\"l01\":$D,\"l02\":$D,\"l11\":$D,\"l12\":$D,\"l21\":$D,\"l22\":$D}"),
-		file_size(SENSORLOG_FILENAME1) / sizeof(SensorLog_t),
-		file_size(SENSORLOG_FILENAME2) / sizeof(SensorLog_t),
-		file_size(SENSORLOG_FILENAME_WEEK1) / sizeof(SensorLog_t),
-		file_size(SENSORLOG_FILENAME_WEEK2) / sizeof(SensorLog_t),
-		file_size(SENSORLOG_FILENAME_MONTH1) / sizeof(SensorLog_t),
-		file_size(SENSORLOG_FILENAME_MONTH2) / sizeof(SensorLog_t));
+		slog_count(SENSORLOG_FILENAME1),
+		slog_count(SENSORLOG_FILENAME2),
+		slog_count(SENSORLOG_FILENAME_WEEK1),
+		slog_count(SENSORLOG_FILENAME_WEEK2),
+		slog_count(SENSORLOG_FILENAME_MONTH1),
+		slog_count(SENSORLOG_FILENAME_MONTH2));
 
 	bfill.emit_p(PSTR("}"));
 
@@ -6177,38 +6283,36 @@ void server_app_config_set(OTF_PARAMS_DEF) {
 		handle_return(HTML_SUCCESS);
 	}
 
-	char *jbuf = (char*)malloc(APP_CONFIG_MAX_SIZE);
+	// All scratch memory below comes from the request arena and is released
+	// in one step when the request completes.
+	char *jbuf = (char*)request_arena.allocate(APP_CONFIG_MAX_SIZE);
 	if (!jbuf) handle_return(HTML_DATA_MISSING);
 
 	if (!findKeyVal(FKV_SOURCE, jbuf, APP_CONFIG_MAX_SIZE, PSTR("json"), true)) {
-		free(jbuf);
 		handle_return(HTML_DATA_MISSING);
 	}
 	urlDecodeAndUnescape(jbuf);
 
-	JsonDocument *incoming = new (std::nothrow) JsonDocument();
-	if (!incoming) { free(jbuf); handle_return(HTML_DATA_MISSING); }
+	JsonDocument *incoming = new (std::nothrow) JsonDocument(&request_arena);
+	if (!incoming) handle_return(HTML_DATA_MISSING);
 	if (deserializeJson(*incoming, jbuf) != DeserializationError::Ok || !incoming->is<JsonObject>()) {
 		delete incoming;
-		free(jbuf);
 		handle_return(HTML_DATA_FORMATERROR);
 	}
-	free(jbuf);
 
 	// Load the existing store (start empty if missing/corrupt).
-	JsonDocument *store = new (std::nothrow) JsonDocument();
+	JsonDocument *store = new (std::nothrow) JsonDocument(&request_arena);
 	if (!store) { delete incoming; handle_return(HTML_DATA_MISSING); }
 
 	ulong sz = file_exists(APP_CONFIG_FILENAME) ? file_size(APP_CONFIG_FILENAME) : 0;
 	if (sz > 0 && sz <= APP_CONFIG_MAX_SIZE) {
-		char *existing = (char*)malloc(sz + 1);
+		char *existing = (char*)request_arena.allocate(sz + 1);
 		if (existing) {
 			file_read_block(APP_CONFIG_FILENAME, existing, 0, sz);
 			existing[sz] = 0;
 			if (deserializeJson(*store, existing) != DeserializationError::Ok || !store->is<JsonObject>()) {
 				store->clear();
 			}
-			free(existing);
 		}
 	}
 	if (!store->is<JsonObject>()) store->to<JsonObject>();
@@ -6226,11 +6330,11 @@ void server_app_config_set(OTF_PARAMS_DEF) {
 
 	if (store->overflowed()) { delete store; handle_return(HTML_NOT_ENOUGH_SPACE); }
 
-	char *out = (char*)malloc(APP_CONFIG_MAX_SIZE);
+	char *out = (char*)request_arena.allocate(APP_CONFIG_MAX_SIZE);
 	if (!out) { delete store; handle_return(HTML_DATA_MISSING); }
 	size_t len = serializeJson(*store, out, APP_CONFIG_MAX_SIZE);
 	delete store;
-	if (len < 2 || len >= APP_CONFIG_MAX_SIZE) { free(out); handle_return(HTML_NOT_ENOUGH_SPACE); }
+	if (len < 2 || len >= APP_CONFIG_MAX_SIZE) handle_return(HTML_NOT_ENOUGH_SPACE);
 
 	ensureConfigSpace();  // config takes priority over old logs on a full FS
 
@@ -6238,11 +6342,11 @@ void server_app_config_set(OTF_PARAMS_DEF) {
 	const char *tmpfile = APP_CONFIG_FILENAME ".tmp";
 	if (file_exists(tmpfile)) remove_file(tmpfile);
 	file_write_block(tmpfile, out, 0, len);
-	free(out);
 	if (file_size(tmpfile) != (ulong)len) {
 		remove_file(tmpfile);
 		handle_return(HTML_NOT_ENOUGH_SPACE);
 	}
+	cache_invalidate(CACHE_DOM_OPTIONS);
 	if (file_exists(APP_CONFIG_FILENAME)) remove_file(APP_CONFIG_FILENAME);
 	if (!rename_file(tmpfile, APP_CONFIG_FILENAME)) {
 		remove_file(tmpfile);
@@ -6273,7 +6377,7 @@ void server_influx_set(OTF_PARAMS_DEF) {
 	if (findKeyVal(FKV_SOURCE, tmp_buffer, TMP_BUFFER_SIZE, PSTR("url"), true)) {
 		urlDecodeAndUnescape(tmp_buffer);
 		DEBUG_PRINTLN(tmp_buffer);
-		url = strdup(tmp_buffer);
+		url = request_arena.strdup(tmp_buffer);
 	}
 
 	int port = 8086;
@@ -6286,21 +6390,21 @@ void server_influx_set(OTF_PARAMS_DEF) {
 	if (findKeyVal(FKV_SOURCE, tmp_buffer, TMP_BUFFER_SIZE, PSTR("org"), true)) {
 		urlDecodeAndUnescape(tmp_buffer);
 		DEBUG_PRINTLN(tmp_buffer);
-		org = strdup(tmp_buffer);
+		org = request_arena.strdup(tmp_buffer);
 	}
 
 	char *bucket = NULL;
 	if (findKeyVal(FKV_SOURCE, tmp_buffer, TMP_BUFFER_SIZE, PSTR("bucket"), true)) {
 		urlDecodeAndUnescape(tmp_buffer);
 		DEBUG_PRINTLN(tmp_buffer);
-		bucket = strdup(tmp_buffer);
+		bucket = request_arena.strdup(tmp_buffer);
 	}
 
 	char *token = NULL;
 	if (findKeyVal(FKV_SOURCE, tmp_buffer, TMP_BUFFER_SIZE, PSTR("token"), true)) {
 		urlDecodeAndUnescape(tmp_buffer);
 		DEBUG_PRINTLN(tmp_buffer);
-		token = strdup(tmp_buffer);
+		token = request_arena.strdup(tmp_buffer);
 	}
 
 #if defined(USE_OTF)
@@ -7646,238 +7750,303 @@ void server_ble_clear_flags(OTF_PARAMS_DEF) {
 
 typedef void (*URLHandler)(OTF_PARAMS_DEF);
 
+/* Endpoint flags */
+#define URL_AUTH_NONE   0x01  // no password required
+#define URL_AUTH_FWV    0x02  // on password failure reply with the firmware version only
+#define URL_READONLY    0x08  // handler only reads state, may run on the web thread (Linux)
+#define URL_SNAPSHOT    0x10  // run state comes from the state snapshot, no state lock needed
+#define URL_YIELD       0x20  // keeps no state across send_packet(), may drop the state lock there
+
 /* Server function urls
  * To save RAM space, each GET command keyword is exactly
- * 2 characters long, with no ending 0
- * The order must exactly match the order of the
- * handler functions below
+ * 2 lower-case characters long. Each entry carries the
+ * handler together with its flags, the CACHE_DOM_* data
+ * domains a read-only response depends on (0: not cacheable)
+ * and the maximum request body size in KB (0: no limit
+ * beyond the server's own).
  */
-const char _url_keys[] PROGMEM =
-	"cv"
-	"jc"
-	"dp"
-	"cp"
-	"cr"
-	"mp"
-	"up"
-	"jp"
-	"co"
-	"jo"
-	"sp"
-	"js"
-	"cm"
-	"cs"
-	"jn"
-	"je"
-	"jl"
-	"dl"
-	"su"
-	"cu"
-	"ja"
-	"jw"
-	"pq"
-	"sc"
-	"sl"
-	"sg"
-	"sr"
-	"sa"
-	"so"
-	"sn"
-	"sb"
-	"sd"
-	"se"
-	"sf"
-	"du"
-	"sh"
-	"sx"
-    "db"
-    "dg"
-	"is"
-	"ig"
-	"ap"  // universal app/UI config store: get JSON
-	"au"  // universal app/UI config store: merge/update JSON
-	"mc"
-	"ml"
-	"mt"
-	"od"  // persist display order of sensors/monitors/program adjustments
-	"nl"  // notification event log (mobile app push/local notifications)
+struct URLEntry {
+	char key[2];
+	unsigned char flags;
+	unsigned char cache;
+	unsigned char max_body_kb;
+	URLHandler handler;
+};
+
+static constexpr URLEntry url_table[] PROGMEM = {
+	{{'c','v'}, 0, 0, 0, server_change_values},
+	{{'j','c'}, URL_READONLY, 0, 0, server_json_controller},
+	{{'d','p'}, 0, 0, 0, server_delete_program},
+	{{'c','p'}, 0, 0, 0, server_change_program},
+	{{'c','r'}, 0, 0, 0, server_change_runonce},
+	{{'m','p'}, 0, 0, 0, server_manual_program},
+	{{'u','p'}, 0, 0, 0, server_moveup_program},
+	{{'j','p'}, URL_READONLY, CACHE_DOM_PROGRAMS|CACHE_DOM_OPTIONS|CACHE_DOM_DATE, 0, server_json_programs},
+	{{'c','o'}, 0, 0, 0, server_change_options},
+	{{'j','o'}, URL_AUTH_FWV|URL_READONLY, CACHE_DOM_OPTIONS, 0, server_json_options},
+	{{'s','p'}, 0, 0, 0, server_change_password},
+	{{'j','s'}, URL_READONLY|URL_SNAPSHOT, 0, 0, server_json_status},
+	{{'c','m'}, 0, 0, 0, server_change_manual},
+	{{'c','b'}, 0, 0, 0, server_change_batch},
+	{{'c','s'}, 0, 0, 0, server_change_stations},
+	{{'j','n'}, URL_READONLY, CACHE_DOM_STATIONS|CACHE_DOM_OPTIONS, 0, server_json_stations},
+	{{'j','e'}, URL_READONLY, CACHE_DOM_STATIONS|CACHE_DOM_OPTIONS, 0, server_json_station_special},
+	{{'j','l'}, URL_READONLY|URL_YIELD, 0, 0, server_json_log},
+	{{'d','l'}, 0, 0, 0, server_delete_log},
+	{{'s','u'}, URL_AUTH_NONE|URL_READONLY, 0, 0, server_view_scripturl},
+	{{'c','u'}, 0, 0, 0, server_change_scripturl},
+	{{'j','a'}, URL_AUTH_FWV|URL_READONLY, 0, 0, server_json_all},
+	{{'j','w'}, 0, 0, 0, server_json_water},
+	{{'p','q'}, 0, 0, 0, server_pause_queue},
+	{{'s','c'}, 0, 0, 0, server_sensor_config},
+	{{'s','l'}, URL_READONLY, CACHE_DOM_SENSORS, 0, server_sensor_list},
+	{{'s','g'}, URL_READONLY, 0, 0, server_sensor_get},
+	{{'s','r'}, 0, 0, 0, server_sensor_readnow},
+	{{'s','a'}, 0, 0, 0, server_set_sensor_address},
+	{{'s','o'}, URL_READONLY|URL_YIELD, 0, 0, server_sensorlog_list},
+	{{'s','n'}, 0, 0, 0, server_sensorlog_clear},
+	{{'s','b'}, 0, 0, 0, server_sensorprog_config},
+	{{'s','d'}, 0, 0, 0, server_sensorprog_calc},
+	{{'s','e'}, URL_READONLY, CACHE_DOM_SENSORS, 0, server_sensorprog_list},
+	{{'s','f'}, URL_READONLY, CACHE_DOM_STATIC, 0, server_sensor_types},
+	{{'d','u'}, URL_READONLY, 0, 0, server_usage},
+	{{'s','h'}, URL_READONLY, CACHE_DOM_STATIC, 0, server_sensorprog_types},
+	{{'s','x'}, URL_READONLY, 0, 0, server_sensorconfig_backup},
+	{{'d','b'}, URL_AUTH_NONE|URL_READONLY, 0, 0, server_json_debug},
+	{{'d','g'}, URL_READONLY, 0, 0, server_json_debug_log},
+	{{'i','s'}, 0, 0, 0, server_influx_set},
+	{{'i','g'}, URL_READONLY, 0, 0, server_influx_get},
+	{{'a','p'}, URL_READONLY, CACHE_DOM_OPTIONS, 0, server_app_config_get}, // universal app/UI config store: get JSON
+	{{'a','u'}, 0, 0, 8, server_app_config_set}, // universal app/UI config store: merge/update JSON
+	{{'m','c'}, 0, 0, 0, server_monitor_config},
+	{{'m','l'}, URL_READONLY, CACHE_DOM_MONITORS, 0, server_monitor_list},
+	{{'m','t'}, URL_READONLY, CACHE_DOM_STATIC, 0, server_monitor_types},
+	{{'o','d'}, 0, 0, 0, server_config_order}, // persist display order of sensors/monitors/program adjustments
+	{{'n','l'}, URL_READONLY, 0, 0, server_notification_log}, // notification event log (mobile app push/local notifications)
 #if defined(ESP32C5)
-	"ir"  // IEEE 802.15.4: get radio config
-	"iw"  // IEEE 802.15.4: set radio mode (+ reboot)
+	{{'i','r'}, 0, 0, 0, server_ieee802154_get}, // IEEE 802.15.4: get radio config
+	{{'i','w'}, 0, 0, 0, server_ieee802154_set}, // IEEE 802.15.4: set radio mode (+ reboot)
 #endif
 #if defined(ESP32C5) && defined(OS_ENABLE_ZIGBEE)
-	"zj"  // Zigbee Client: join/search network
-	"zs"  // Zigbee: get connection status
-	"zl"  // Zigbee Client: leave/disconnect network
-	"zg"  // Zigbee Gateway: manage devices
-	"zd"  // Zigbee: get discovered devices
-	"zo"  // Zigbee: open network
-	"zc"  // Zigbee: clear new device flags
+	{{'z','j'}, 0, 0, 0, server_zigbee_join_network}, // Zigbee Client: join/search network
+	{{'z','s'}, 0, 0, 0, server_zigbee_status}, // Zigbee: get connection status
+	{{'z','l'}, 0, 0, 0, server_zigbee_leave_network}, // Zigbee Client: leave/disconnect network
+	{{'z','g'}, 0, 0, 0, server_zigbee_gw_manage}, // Zigbee Gateway: manage devices
+	{{'z','d'}, 0, 0, 0, server_zigbee_discovered_devices}, // Zigbee: get discovered devices
+	{{'z','o'}, 0, 0, 0, server_zigbee_open_network}, // Zigbee: open network
+	{{'z','c'}, 0, 0, 0, server_zigbee_clear_flags}, // Zigbee: clear new device flags
 #endif
 #if defined(ESP32) && defined(OS_ENABLE_BLE)
-	"bd"  // BLE: get discovered devices
-	"bs"  // BLE: start scan
-	"bc"  // BLE: clear new device flags
+	{{'b','d'}, 0, 0, 0, server_ble_discovered_devices}, // BLE: get discovered devices
+	{{'b','s'}, 0, 0, 0, server_ble_start_scan}, // BLE: start scan
+	{{'b','c'}, 0, 0, 0, server_ble_clear_flags}, // BLE: clear new device flags
 #endif
 #if defined(ESP32) && defined(ENABLE_MATTER)
-	"jm"  // Matter: get pairing information
-	"mm"  // Matter: open commissioning window
-	"md"  // Matter: remove commissioning/fabrics
-	"mk"  // Matter: write matter_kvs partition
+	{{'j','m'}, 0, 0, 0, server_json_matter}, // Matter: get pairing information
+	{{'m','m'}, 0, 0, 0, server_matter_commission}, // Matter: open commissioning window
+	{{'m','d'}, 0, 0, 0, server_matter_decommission}, // Matter: remove commissioning/fabrics
+	{{'m','k'}, 0, 0, 0, server_matter_write_kvs}, // Matter: write matter_kvs partition
 #endif
 #if defined(ESP32) && defined(ENABLE_RAINMAKER)
-	"rk"  // RainMaker: get status
-	"rp"  // RainMaker: start user-node provisioning
-	"ru"  // RainMaker: unlink account mapping
-#endif
-#if defined(ESP32) || defined(ESP8266)
-	"uc"  // Online update: check for update
-	"uu"  // Online update: start update
-	"us"  // Online update: get status
-	#endif
-#if defined(ESP32)
-	"tg"  // TLS cert: get certificate info
-	"tl"  // TLS cert: upload custom cert+key (PEM)
-	"td"  // TLS cert: delete custom cert
-	"ta"  // ACME/Let's Encrypt: get config+status
-	"tc"  // ACME/Let's Encrypt: set config
-	"tx"  // ACME/Let's Encrypt: delete all ACME data
+	{{'r','k'}, 0, 0, 0, server_json_rainmaker}, // RainMaker: get status
+	{{'r','p'}, 0, 0, 0, server_rainmaker_provision}, // RainMaker: start user-node provisioning
+	{{'r','u'}, 0, 0, 0, server_rainmaker_unlink}, // RainMaker: unlink account mapping
 #endif
 #if defined(ESP32) || defined(ESP8266)
-	"ub"  // OTA backup: get config backup JSON
-#endif
-#if defined(ESP32) || defined(OSPI)
-	"fy"
-	"fc"
-	"gl"
-	"ga"
-#elif defined(ESP8266)
-	"fy"
-	"fc"
-#endif
-#if defined(ARDUINO)
-	//"ff"
-#endif
-	;
-
-// Server function handlers
-URLHandler urls[] = {
-	server_change_values,   // cv
-	server_json_controller, // jc
-	server_delete_program,  // dp
-	server_change_program,  // cp
-	server_change_runonce,  // cr
-	server_manual_program,  // mp
-	server_moveup_program,  // up
-	server_json_programs,   // jp
-	server_change_options,  // co
-	server_json_options,    // jo
-	server_change_password, // sp
-	server_json_status,     // js
-	server_change_manual,   // cm
-	server_change_stations, // cs
-	server_json_stations,   // jn
-	server_json_station_special,// je
-	server_json_log,        // jl
-	server_delete_log,      // dl
-	server_view_scripturl,  // su
-	server_change_scripturl,// cu
-	server_json_all,        // ja
-	server_json_water,      // jw
-	server_pause_queue,     // pq
-	server_sensor_config,//sc
-	server_sensor_list,//sl
-	server_sensor_get,//sg
-	server_sensor_readnow,//sr
-	server_set_sensor_address,//sa
-	server_sensorlog_list,//so
-	server_sensorlog_clear,//sn
-	server_sensorprog_config,//sb
-	server_sensorprog_calc,//sd
-	server_sensorprog_list,//se
-	server_sensor_types,//sf
-	server_usage,//du
-	server_sensorprog_types,//sh
-	server_sensorconfig_backup,//sx
-	server_json_debug,      // db
-	server_json_debug_log,  // dg
-	server_influx_set,// is
-	server_influx_get,// ig
-	server_app_config_get,// ap
-	server_app_config_set,// au
-	server_monitor_config, // mc
-	server_monitor_list, // ml
-	server_monitor_types, // mt
-	server_config_order, // od
-	server_notification_log, // nl
-#if defined(ESP32C5)
-	server_ieee802154_get, // ir
-	server_ieee802154_set, // iw
-#endif
-#if defined(ESP32C5) && defined(OS_ENABLE_ZIGBEE)
-	server_zigbee_join_network, // zj
-	server_zigbee_status, // zs
-	server_zigbee_leave_network, // zl
-	server_zigbee_gw_manage, // zg
-	server_zigbee_discovered_devices, // zd
-	server_zigbee_open_network, // zo
-	server_zigbee_clear_flags, // zc
+	{{'u','c'}, 0, 0, 0, server_update_check}, // Online update: check for update
+	{{'u','u'}, 0, 0, 0, server_update_upgrade}, // Online update: start update
+	{{'u','s'}, 0, 0, 0, server_update_status}, // Online update: get status
 #endif
-#if defined(ESP32) && defined(OS_ENABLE_BLE)
-	server_ble_discovered_devices, // bd
-	server_ble_start_scan, // bs
-	server_ble_clear_flags, // bc
-#endif
-#if defined(ESP32) && defined(ENABLE_MATTER)
-	server_json_matter, // jm
-	server_matter_commission, // mm
-	server_matter_decommission, // md
-	server_matter_write_kvs, // mk
-#endif
-#if defined(ESP32) && defined(ENABLE_RAINMAKER)
-	server_json_rainmaker, // rk
-	server_rainmaker_provision, // rp
-	server_rainmaker_unlink, // ru
-#endif
-#if defined(ESP32) || defined(ESP8266)
-	server_update_check, // uc
-	server_update_upgrade, // uu
-	server_update_status, // us
-	#endif
 #if defined(ESP32)
-	server_cert_get, // tg
-	server_cert_upload, // tl
-	server_cert_delete, // td
-	server_acme_get, // ta
-	server_acme_set, // tc
-	server_acme_delete, // tx
+	{{'t','g'}, 0, 0, 0, server_cert_get}, // TLS cert: get certificate info
+	{{'t','l'}, 0, 0, 16, server_cert_upload}, // TLS cert: upload custom cert+key (PEM)
+	{{'t','d'}, 0, 0, 0, server_cert_delete}, // TLS cert: delete custom cert
+	{{'t','a'}, 0, 0, 0, server_acme_get}, // ACME/Let's Encrypt: get config+status
+	{{'t','c'}, 0, 0, 2, server_acme_set}, // ACME/Let's Encrypt: set config
+	{{'t','x'}, 0, 0, 0, server_acme_delete}, // ACME/Let's Encrypt: delete all ACME data
 #endif
 #if defined(ESP32) || defined(ESP8266)
-	server_backup_get, // ub
+	{{'u','b'}, 0, 0, 0, server_backup_get}, // OTA backup: get config backup JSON
 #endif
 #if defined(ESP32) || defined(OSPI)
-	server_fyta_query_plants, // fy
-	server_fyta_get_credentials, //fc
-	server_gardena_query_locations, // gl
-	server_gardena_get_credentials, // ga
+	{{'f','y'}, 0, 0, 0, server_fyta_query_plants},
+	{{'f','c'}, 0, 0, 0, server_fyta_get_credentials},
+	{{'g','l'}, 0, 0, 0, server_gardena_query_locations},
+	{{'g','a'}, 0, 0, 0, server_gardena_get_credentials},
 #elif defined(ESP8266)
-	server_fyta_query_plants, // fy
-	server_fyta_get_credentials, //fc
+	{{'f','y'}, 0, 0, 0, server_fyta_query_plants},
+	{{'f','c'}, 0, 0, 0, server_fyta_get_credentials},
 #endif
-	//server_fill_files,
 };
 
-static int find_url_handler_index(char k0, char k1) {
-	for (unsigned char i = 0; i < sizeof(urls) / sizeof(URLHandler); i++) {
-		if (pgm_read_byte(_url_keys + 2 * i) == k0 &&
-			pgm_read_byte(_url_keys + 2 * i + 1) == k1) {
-			return i;
+#define URL_TABLE_SIZE   (sizeof(url_table) / sizeof(URLEntry))
+#define URL_KEY_SLOTS    (26 * 26)
+
+/* Direct index from the two key characters to the table entry (index+1,
+ * 0: not found), generated at compile time so dispatch cost stays constant
+ * as the endpoint list grows. */
+struct URLIndex {
+	unsigned char slot[URL_KEY_SLOTS];
+};
+
+static constexpr bool url_key_valid(char c) { return c >= 'a' && c <= 'z'; }
+static constexpr int url_key_slot(char k0, char k1) { return (k0 - 'a') * 26 + (k1 - 'a'); }
+
+static constexpr bool url_table_valid() {
+	for (size_t i = 0; i < URL_TABLE_SIZE; i++) {
+		if (!url_key_valid(url_table[i].key[0]) || !url_key_valid(url_table[i].key[1])) return false;
+		for (size_t j = 0; j < i; j++) {
+			if (url_table[i].key[0] == url_table[j].key[0] &&
+				url_table[i].key[1] == url_table[j].key[1]) return false;
 		}
 	}
-	return -1;
+	return true;
+}
+
+static constexpr URLIndex build_url_index() {
+	URLIndex x{};
+	for (size_t i = 0; i < URL_TABLE_SIZE; i++) {
+		x.slot[url_key_slot(url_table[i].key[0], url_table[i].key[1])] = (unsigned char)(i + 1);
+	}
+	return x;
+}
+
+static_assert(URL_TABLE_SIZE < 255, "url_table too large for 8-bit index");
+static_assert(url_table_valid(), "url_table keys must be unique lower-case pairs");
+
+static constexpr URLIndex url_index PROGMEM = build_url_index();
+
+static int find_url_handler_index(char k0, char k1) {
+	if (!url_key_valid(k0) || !url_key_valid(k1)) return -1;
+	return (int)pgm_read_byte(&url_index.slot[url_key_slot(k0, k1)]) - 1;
+}
+
+/** Copy a table entry out of flash */
+static void get_url_entry(int idx, URLEntry &e) {
+	memcpy_P(&e, &url_table[idx], sizeof(URLEntry));
 }
 
 #if defined(USE_OTF)
+// Query parameters that select the content of a cacheable response
+static const char* const cache_vary_params[] = {"nr", "prog", "sensor", "test"};
+
+static void send_not_modified(OTF_PARAMS_DEF, const char *etag) {
+	res.writeStatus(304, F("Not Modified"));
+	res.writeHeader(F("ETag"), etag);
+	res.writeHeader(F("Access-Control-Allow-Origin"), F("*"));
+	res.writeHeader(F("Cache-Control"), F("no-cache"));
+	res.writeHeader(F("Connection"), F("close"));
+	res.writeHeader(F("Content-Length"), 0);
+	res.writeBodyData("", 0);
+}
+
+/**
+ * @brief Serve a read-only endpoint with ETag validation.
+ * Replies 304 if the client's If-None-Match matches the current tag,
+ * otherwise serves the rendered body from the response cache or renders
+ * it through the capture buffer and stores it.
+ */
+static void server_cached_dispatch(OTF_PARAMS_DEF, const URLEntry &e) {
+	// verify the password first so cached data is never served unauthenticated
+	if (!(e.flags & URL_AUTH_NONE) && !process_password(OTF_PARAMS, e.flags & URL_AUTH_FWV)) return;
+
+	uint32_t key = cache_hash(CACHE_HASH_INIT, req.getPath());
+	for (unsigned char i = 0; i < sizeof(cache_vary_params) / sizeof(cache_vary_params[0]); i++) {
+		key = cache_hash(key, cache_vary_params[i]);
+		key = cache_hash(key, req.getQueryParameter(cache_vary_params[i]));
+	}
+	uint32_t etag = cache_etag(e.cache, key);
+	char etag_str[12];
+	format_etag(etag_str, etag);
+
+	const char *inm = req.getHeader("if-none-match");
+	if (inm && strstr(inm, etag_str)) {
+		send_not_modified(OTF_PARAMS, etag_str);
+		return;
+	}
+
+	const char *body = NULL;
+	size_t len = 0;
+	response_etag = etag;
+	if (response_cache_get(key, etag, &body, &len)) {
+		print_header(OTF_PARAMS, true, (int)len);
+		res.writeBodyData(body, len);
+		response_etag = 0;
+		return;
+	}
+
+	request_authorized = true;
+	if (RESPONSE_CACHE_BYTES > 0) {
+		// render into the capture buffer (the MCP server uses the same path)
+		g_mcp_capture_active = true;
+		g_mcp_capture_buf.clear();
+		rewind_ether_buffer();
+		e.handler(OTF_PARAMS);
+		int remaining = (int)bfill.position();
+		if (remaining > 0) MCP_BUF_APPEND(g_mcp_capture_buf, ether_buffer, remaining);
+		rewind_ether_buffer();
+		g_mcp_capture_active = false;
+
+		if (g_mcp_capture_buf.length() > 0) {
+			response_cache_put(key, etag, g_mcp_capture_buf.c_str(), g_mcp_capture_buf.length());
+			print_header(OTF_PARAMS, true, (int)g_mcp_capture_buf.length());
+			res.writeBodyData(g_mcp_capture_buf.c_str(), g_mcp_capture_buf.length());
+		} else {
+			// nothing captured (handler reported an error): render it directly
+			response_etag = 0;
+			e.handler(OTF_PARAMS);
+		}
+		g_mcp_capture_buf.clear();
+	} else {
+		e.handler(OTF_PARAMS);
+	}
+	request_authorized = false;
+	response_etag = 0;
+}
+
+static void server_api_run(OTF_PARAMS_DEF, const URLEntry &e) {
+	RequestArenaScope arena_scope;  // handler scratch memory is released on return
+	if (e.cache) {
+		server_cached_dispatch(OTF_PARAMS, e);
+	} else {
+		e.handler(OTF_PARAMS);
+	}
+}
+
+#if defined(OS_HTTP_THREAD)
+// A request handed from the web thread to the main loop
+struct MainLoopCall {
+	const URLEntry *e;
+	URLHandler handler;
+	const OTF::Request *req;
+	OTF::Response *res;
+};
+
+static void main_loop_call(void *arg) {
+	MainLoopCall *c = (MainLoopCall*)arg;
+	if (c->e) server_api_run(*c->req, *c->res, *c->e);
+	else c->handler(*c->req, *c->res);
+}
+
+static void write_response(const char *data, size_t len, void *ctx) {
+	((OTF::Response*)ctx)->writeBodyData(data, len);
+}
+
+/** Handlers registered outside the url table: run them on the main loop */
+template <URLHandler H>
+static void on_main_loop(OTF_PARAMS_DEF) {
+	MainLoopCall c = {NULL, H, &req, &res};
+	web_thread_call_main(main_loop_call, &c);
+}
+
+/** Handlers registered outside the url table that only read state */
+template <URLHandler H>
+static void read_only(OTF_PARAMS_DEF) {
+	WebStateReadLock state_lock;
+	H(OTF_PARAMS);
+}
+#endif
+
 void server_api_dispatch(OTF_PARAMS_DEF) {
 	const char* path = req.getPath();
 
@@ -7892,7 +8061,34 @@ void server_api_dispatch(OTF_PARAMS_DEF) {
 		return;
 	}
 
-	(urls[idx])(OTF_PARAMS);
+	URLEntry e;
+	get_url_entry(idx, e);
+	if (e.max_body_kb && req.getBodyLength() > (size_t)e.max_body_kb * 1024) {
+		otf_send_result(OTF_PARAMS, HTML_NOT_ENOUGH_SPACE, "body");
+		return;
+	}
+
+#if defined(OS_HTTP_THREAD)
+	if (web_thread_current()) {
+		if (e.flags & URL_SNAPSHOT) {
+			server_api_run(OTF_PARAMS, e);  // never holds up the main loop
+		} else if (e.flags & URL_READONLY) {
+			// the main loop waits until the response is built, not until it is sent
+			response_pool_begin(write_response, &res, e.flags & URL_YIELD);
+			{
+				WebStateReadLock state_lock;
+				server_api_run(OTF_PARAMS, e);
+			}
+			response_pool_end();
+		} else {
+			// state changes are applied by the main loop, one request at a time
+			MainLoopCall c = {&e, NULL, &req, &res};
+			web_thread_call_main(main_loop_call, &c);
+		}
+		return;
+	}
+#endif
+	server_api_run(OTF_PARAMS, e);
 }
 #endif
 
@@ -8213,9 +8409,9 @@ void start_server_client() {
 		char uri[4];
 		uri[0]='/';
 		uri[3]=0;
-		for(unsigned char i=0;i<sizeof(urls)/sizeof(URLHandler);i++) {
-			uri[1]=pgm_read_byte(_url_keys+2*i);
-			uri[2]=pgm_read_byte(_url_keys+2*i+1);
+		for(unsigned char i=0;i<URL_TABLE_SIZE;i++) {
+			uri[1]=pgm_read_byte(&url_table[i].key[0]);
+			uri[2]=pgm_read_byte(&url_table[i].key[1]);
 			otf->on(uri, server_api_dispatch);
 		}
 		callback_initialized = true;
@@ -8262,9 +8458,9 @@ void start_server_ap() {
 	char uri[4];
 	uri[0]='/';
 	uri[3]=0;
-	for(unsigned char i=0;i<sizeof(urls)/sizeof(URLHandler);i++) {
-		uri[1]=pgm_read_byte(_url_keys+2*i);
-		uri[2]=pgm_read_byte(_url_keys+2*i+1);
+	for(unsigned char i=0;i<URL_TABLE_SIZE;i++) {
+		uri[1]=pgm_read_byte(&url_table[i].key[0]);
+		uri[2]=pgm_read_byte(&url_table[i].key[1]);
 		otf->on(uri, server_api_dispatch);
 	}
 
@@ -8293,6 +8489,16 @@ void initialize_otf() {
 	static bool callback_initialized = false;
 
 	if(!callback_initialized) {
+#if defined(OS_HTTP_THREAD)
+		otf->on("/", read_only<server_home>);  // handle home page
+		otf->on("/index.html", read_only<server_home>);
+
+		// MCP (Model Context Protocol) JSON-RPC endpoint, tools may change state
+		otf->on("/mcp", on_main_loop<server_mcp_handler>, OTF::OTF_HTTP_POST);
+		otf->on("/mcp", on_main_loop<server_mcp_get_handler>, OTF::OTF_HTTP_GET);
+		otf->on("/mcp", on_main_loop<server_mcp_options_handler>, OTF::OTF_HTTP_OPTIONS);
+		otf->on("/mcp", on_main_loop<server_mcp_delete_handler>, OTF::OTF_HTTP_DELETE);
+#else
 		otf->on("/", server_home);  // handle home page
 		otf->on("/index.html", server_home);
 
@@ -8301,6 +8507,7 @@ void initialize_otf() {
 		otf->on("/mcp", server_mcp_get_handler, OTF::OTF_HTTP_GET);
 		otf->on("/mcp", server_mcp_options_handler, OTF::OTF_HTTP_OPTIONS);
 		otf->on("/mcp", server_mcp_delete_handler, OTF::OTF_HTTP_DELETE);
+#endif
 
 #if defined(ESP32C5)
 		otf->on("/ir", server_ieee802154_get);
@@ -8320,9 +8527,9 @@ void initialize_otf() {
 		char uri[4];
 		uri[0]='/';
 		uri[3]=0;
-		for(unsigned char i=0;i<sizeof(urls)/sizeof(URLHandler);i++) {
-			uri[1]=pgm_read_byte(_url_keys+2*i);
-			uri[2]=pgm_read_byte(_url_keys+2*i+1);
+		for(unsigned char i=0;i<URL_TABLE_SIZE;i++) {
+			uri[1]=pgm_read_byte(&url_table[i].key[0]);
+			uri[2]=pgm_read_byte(&url_table[i].key[1]);
 			otf->on(uri, server_api_dispatch);
 		}
 		callback_initialized = true;
@@ -8333,6 +8540,7 @@ void initialize_otf() {
 #if !defined(USE_OTF)
 // This funtion is only used for non-OTF platforms
 void handle_web_request(char *p) {
+	RequestArenaScope arena_scope;  // handler scratch memory is released on return
 	rewind_ether_buffer();
 
 	// assume this is a GET request
@@ -8349,38 +8557,22 @@ void handle_web_request(char *p) {
 		int idx = find_url_handler_index(com[0], com[1]);
 
 		if(idx >= 0) {
-			// check password
+			URLEntry e;
+			get_url_entry(idx, e);
 			int ret = HTML_UNAUTHORIZED;
 
-			if (com[0]=='s' && com[1]=='u') { // for /su do not require password
-				get_buffer = dat;
-				(urls[idx])();
-				ret = return_code;
-			} else if ((com[0]=='j' && com[1]=='o') ||
-								 (com[0]=='j' && com[1]=='a'))  { // for /jo and /ja we output fwv if password fails
-				if(check_password(dat)==false) {
+			// check password unless the endpoint is public
+			if (!(e.flags & URL_AUTH_NONE) && check_password(dat)==false) {
+				if (e.flags & URL_AUTH_FWV) { // output fwv if password fails
 					print_header();
 					bfill.emit_p(PSTR("{\"$F\":$D}"),
 								 iopt_json_names+0, os.iopts[0]);
 					ret = HTML_OK;
-				} else {
-					get_buffer = dat;
-					(urls[idx])();
-					ret = return_code;
 				}
-			} else if (com[0]=='d' && com[1]=='b') {
+			} else {
 				get_buffer = dat;
-				(urls[idx])();
+				e.handler();
 				ret = return_code;
-			} else {
-				// first check password
-				if(check_password(dat)==false) {
-					ret = HTML_UNAUTHORIZED;
-				} else {
-					get_buffer = dat;
-					(urls[idx])();
-					ret = return_code;
-				}
 			}
 			if (ret == -1) {
 				if (m_client)
@@ -234,8 +234,16 @@ void server_json_programs_main(const OTF::Request& req, OTF::Response& res);
 
 // MCP capture-mode globals (all platforms with USE_OTF)
 #if defined(USE_OTF)
-extern bool   g_mcp_capture_active;
-extern String g_mcp_capture_buf;
+extern OS_THREAD_LOCAL bool   g_mcp_capture_active;
+extern OS_THREAD_LOCAL String g_mcp_capture_buf;
+
+// When set, captured output is handed to the sink instead of g_mcp_capture_buf
+typedef void (*McpCaptureSink)(const char *data, size_t len, void *ctx);
+extern OS_THREAD_LOCAL McpCaptureSink g_mcp_capture_sink;
+extern OS_THREAD_LOCAL void *g_mcp_capture_ctx;
+
+/** Take captured handler output */
+void mcp_capture_append(const char *data, size_t len);
 #endif
 
 char* urlDecodeAndUnescape(char *buf);
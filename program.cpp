@@ -24,6 +24,8 @@
 #include <limits.h>
 #include "program.h"
 #include "main.h"
+#include "response_cache.h"
+#include "state_snapshot.h"
 
 #if !defined(SECS_PER_DAY)
 #define SECS_PER_MIN  (60UL)
@@ -52,6 +54,7 @@ void ProgramData::reset_runtime() {
 	nqueue = 0;
 	current_mpid = 0;  // clear currently-running manual program
 	memset(last_seq_stop_times, 0, sizeof(last_seq_stop_times));
+	state_snapshot_touch();
 }
 
 /** Insert a new element to the queue
@@ -60,6 +63,7 @@ void ProgramData::reset_runtime() {
  */
 RuntimeQueueStruct* ProgramData::enqueue() {
 	if (nqueue < RUNTIME_QUEUE_SIZE) {
+		state_snapshot_touch();  // publish once the caller filled it in
 		nqueue ++;
 		return queue + (nqueue-1);
 	} else {
@@ -82,6 +86,7 @@ void ProgramData::dequeue(unsigned char qid) {
 			station_qid[queue[qid].sid] = qid;
 	}
 	nqueue--;
+	state_snapshot_touch();
 }
 
 /** Load program count from program file */
@@ -96,6 +101,7 @@ void ProgramData::save_count() {
 
 /** Erase all program data */
 void ProgramData::eraseall() {
+	cache_invalidate(CACHE_DOM_PROGRAMS);
 	time_os_t curr_time = os.now_tz();
 	for (int i = (int)nqueue - 1; i >= 0; i--) {
 		RuntimeQueueStruct *q = queue + i;
@@ -119,6 +125,7 @@ void ProgramData::read(unsigned char pid, ProgramStruct *buf) {
 
 /** Add a program */
 unsigned char ProgramData::add(ProgramStruct *buf) {
+	cache_invalidate(CACHE_DOM_PROGRAMS);
 	if (nprograms >= MAX_NUM_PROGRAMS)	return 0;
 	file_write_block(PROG_FILENAME, buf, 1+(ulong)nprograms*PROGRAMSTRUCT_SIZE, PROGRAMSTRUCT_SIZE);
 	nprograms ++;
@@ -128,6 +135,7 @@ unsigned char ProgramData::add(ProgramStruct *buf) {
 
 /** Move a program up (i.e. swap a program with the one above it) */
 void ProgramData::moveup(unsigned char pid) {
+	cache_invalidate(CACHE_DOM_PROGRAMS);
 	if(pid >= nprograms || pid == 0) return;
 	// swap program pid-1 and pid
 	ulong pos = 1+(ulong)(pid-1)*PROGRAMSTRUCT_SIZE;
@@ -195,6 +203,7 @@ void ProgramData::clear_pause() {
 
 /** Modify a program */
 unsigned char ProgramData::modify(unsigned char pid, ProgramStruct *buf) {
+	cache_invalidate(CACHE_DOM_PROGRAMS);
 	if (pid >= nprograms)  return 0;
 	ulong pos = 1+(ulong)pid*PROGRAMSTRUCT_SIZE;
 	file_write_block(PROG_FILENAME, buf, pos, PROGRAMSTRUCT_SIZE);
@@ -203,6 +212,7 @@ unsigned char ProgramData::modify(unsigned char pid, ProgramStruct *buf) {
 
 /** Delete program(s) */
 unsigned char ProgramData::del(unsigned char pid) {
+	cache_invalidate(CACHE_DOM_PROGRAMS);
 	if (pid >= nprograms)  return 0;
 	if (nprograms == 0) return 0;
 
@@ -244,6 +254,7 @@ unsigned char ProgramData::del(unsigned char pid) {
 
 // set the enable bit
 unsigned char ProgramData::set_flagbit(unsigned char pid, unsigned char bid, unsigned char value) {
+	cache_invalidate(CACHE_DOM_PROGRAMS);
 	if (pid >= nprograms)  return 0;
 	unsigned char flag = file_read_byte(PROG_FILENAME, 1+(ulong)pid*PROGRAMSTRUCT_SIZE);
 	if(value) flag|=(1<<bid);
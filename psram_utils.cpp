@@ -300,6 +300,6 @@ void log_matter_ble_memory_optimization() {
 
 #else
 // Non-PSRAM platforms: static allocation
-char ether_buffer[ETHER_BUFFER_SIZE_L];
-char tmp_buffer[TMP_BUFFER_SIZE_L];
+OS_THREAD_LOCAL char ether_buffer[ETHER_BUFFER_SIZE_L];
+OS_THREAD_LOCAL char tmp_buffer[TMP_BUFFER_SIZE_L];
 #endif
@@ -24,6 +24,8 @@
 #ifndef _PSRAM_UTILS_H
 #define _PSRAM_UTILS_H
 
+#include "defines.h"
+
 #if defined(ESP32) && defined(BOARD_HAS_PSRAM)
 
 // Buffer sizes are defined in defines.h, use those directly
@@ -64,8 +66,8 @@ void log_heap_snapshot(const char *tag);
 
 #else
 // Non-PSRAM platforms
-extern char ether_buffer[];
-extern char tmp_buffer[];
+extern OS_THREAD_LOCAL char ether_buffer[];
+extern OS_THREAD_LOCAL char tmp_buffer[];
 
 inline void init_psram_buffers() {}
 inline void print_psram_stats() {}
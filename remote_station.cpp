@@ -0,0 +1,216 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Per-peer command channel for remote IP / OTC stations
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "remote_station.h"
+#include "OpenSprinkler.h"
+#include "opensprinkler_server.h"
+
+extern OpenSprinkler os;
+extern const char* user_agent_string;
+
+#define REMOTE_PEER_NONE  0
+#define REMOTE_PEER_IP    1
+#define REMOTE_PEER_OTC   2
+
+#define REMOTE_RESULT_NOT_FOUND  0x20  // HTML_PAGE_NOT_FOUND: peer firmware has no /cb
+
+struct RemoteChange {
+	uint8_t sid;
+	uint8_t en;
+	uint16_t timer;
+};
+
+struct RemotePeer {
+	uint8_t kind;
+	bool legacy;          // peer only understands /cm, send one change per request
+	bool sent;            // inflight batch has been handed to the HTTP client
+	uint8_t retries;
+	uint32_t ip4;
+	uint16_t port;
+	char token[DEFAULT_OTC_TOKEN_LENGTH+1];
+	RemoteChange queued[REMOTE_BATCH_MAX];
+	uint8_t nqueued;
+	RemoteChange inflight[REMOTE_BATCH_MAX];
+	uint8_t ninflight;
+	volatile int16_t ack; // result code of the reply, -1 while waiting
+	ulong sent_at;
+};
+
+static RemotePeer peers[REMOTE_PEERS_MAX];
+
+// The HTTP client callback carries no context, so each peer slot gets its own.
+// A reply without a result (404 or home page of an old firmware) counts as
+// "no /cb", so the batch is resent through /cm instead of being dropped.
+static void remote_peer_ack(uint8_t i, char *buf) {
+	const char *r = buf ? strstr(buf, "\"result\":") : NULL;
+	peers[i].ack = r ? (int16_t)atoi(r + 9) : REMOTE_RESULT_NOT_FOUND;
+}
+template<uint8_t I> static void remote_peer_cb(char *buf) { remote_peer_ack(I, buf); }
+static void (* const remote_peer_cbs[REMOTE_PEERS_MAX])(char*) = {
+	remote_peer_cb<0>, remote_peer_cb<1>, remote_peer_cb<2>, remote_peer_cb<3>,
+	remote_peer_cb<4>, remote_peer_cb<5>, remote_peer_cb<6>, remote_peer_cb<7>,
+};
+
+static bool remote_peer_idle(const RemotePeer &p) {
+	return p.nqueued == 0 && p.ninflight == 0;
+}
+
+static RemotePeer* remote_peer_get(uint8_t kind, uint32_t ip4, uint16_t port, const char *token) {
+	RemotePeer *spare = NULL;
+	for (uint8_t i = 0; i < REMOTE_PEERS_MAX; i++) {
+		RemotePeer &p = peers[i];
+		if (p.kind == kind && (kind == REMOTE_PEER_IP ? (p.ip4 == ip4 && p.port == port) : strcmp(p.token, token) == 0))
+			return &p;
+		if (!spare && (p.kind == REMOTE_PEER_NONE || remote_peer_idle(p))) spare = &p;
+	}
+	if (!spare) return NULL;
+	memset(spare, 0, sizeof(RemotePeer));
+	spare->kind = kind;
+	spare->ip4 = ip4;
+	spare->port = port;
+	if (token) strncpy(spare->token, token, DEFAULT_OTC_TOKEN_LENGTH);
+	spare->ack = -1;
+	return spare;
+}
+
+static bool remote_change_put(RemoteChange *list, uint8_t &n, const RemoteChange &c) {
+	for (uint8_t i = 0; i < n; i++) {
+		if (list[i].sid == c.sid) {
+			list[i] = c;
+			return true;
+		}
+	}
+	if (n >= REMOTE_BATCH_MAX) return false;
+	list[n++] = c;
+	return true;
+}
+
+static void remote_station_queue(RemotePeer *p, uint8_t sid, bool turnon, uint16_t timer) {
+	if (!p) {
+		DEBUG_PRINTLN(F("remote station: no free peer slot"));
+		return;
+	}
+	RemoteChange c = {sid, (uint8_t)turnon, timer};
+	if (!remote_change_put(p->queued, p->nqueued, c))
+		DEBUG_PRINTLN(F("remote station: batch full, dropping change"));
+}
+
+void remote_station_queue_ip(uint32_t ip4, uint16_t port, uint8_t sid, bool turnon, uint16_t timer) {
+	remote_station_queue(remote_peer_get(REMOTE_PEER_IP, ip4, port, NULL), sid, turnon, timer);
+}
+
+void remote_station_queue_otc(const char *token, uint8_t sid, bool turnon, uint16_t timer) {
+	remote_station_queue(remote_peer_get(REMOTE_PEER_OTC, 0, 0, token), sid, turnon, timer);
+}
+
+/** Emit the inflight batch as one request and hand it to the async client */
+static bool remote_peer_send(uint8_t i) {
+	RemotePeer &p = peers[i];
+	char *buf = tmp_buffer;
+	BufferFiller bf = BufferFiller(buf, TMP_BUFFER_SIZE_L);
+
+	if (p.kind == REMOTE_PEER_OTC) bf.emit_p(PSTR("GET /forward/v1/$S"), p.token);
+	else bf.emit_p(PSTR("GET "));
+
+	if (p.legacy) {
+		const RemoteChange &c = p.inflight[0];
+		bf.emit_p(PSTR("/cm?pw=$O&sid=$D&en=$D&t=$D"), SOPT_PASSWORD, c.sid, c.en, c.timer);
+	} else {
+		bf.emit_p(PSTR("/cb?pw=$O&sid="), SOPT_PASSWORD);
+		for (uint8_t k = 0; k < p.ninflight; k++) bf.emit_p(k ? PSTR(",$D") : PSTR("$D"), p.inflight[k].sid);
+		bf.emit_p(PSTR("&en="));
+		for (uint8_t k = 0; k < p.ninflight; k++) bf.emit_p(k ? PSTR(",$D") : PSTR("$D"), p.inflight[k].en);
+		bf.emit_p(PSTR("&t="));
+		for (uint8_t k = 0; k < p.ninflight; k++) bf.emit_p(k ? PSTR(",$D") : PSTR("$D"), p.inflight[k].timer);
+	}
+
+	char server[20];
+	snprintf(server, sizeof(server), "%d.%d.%d.%d", (int)(p.ip4>>24), (int)((p.ip4>>16)&0xff), (int)((p.ip4>>8)&0xff), (int)(p.ip4&0xff));
+	bf.emit_p(PSTR(" HTTP/1.0\r\nHOST: $S\r\n"), p.kind == REMOTE_PEER_OTC ? DEFAULT_OTC_SERVER_APP : server);
+	bf.emit_p(PSTR("User-Agent: $S\r\n\r\n"), user_agent_string);
+
+	p.ack = -1;
+	int8_t ret = (p.kind == REMOTE_PEER_OTC) ?
+		os.send_http_request_async(DEFAULT_OTC_SERVER_APP, DEFAULT_OTC_PORT_APP, buf, remote_peer_cbs[i], true, 12000, true, HTTP_PRIO_HIGH) :
+		os.send_http_request_async(server, p.port, buf, remote_peer_cbs[i], false, 12000, true, HTTP_PRIO_HIGH);
+	return ret == HTTP_RQT_SUCCESS;
+}
+
+/** Move queued changes into the (empty) inflight batch */
+static void remote_peer_take(RemotePeer &p) {
+	uint8_t n = p.legacy ? 1 : p.nqueued;
+	memcpy(p.inflight, p.queued, n * sizeof(RemoteChange));
+	p.ninflight = n;
+	p.nqueued -= n;
+	memmove(p.queued, p.queued + n, p.nqueued * sizeof(RemoteChange));
+	p.sent = false;
+	p.retries = 0;
+}
+
+/** Put an unacknowledged batch back in front of newer changes */
+static void remote_peer_requeue(RemotePeer &p) {
+	RemoteChange merged[REMOTE_BATCH_MAX];
+	uint8_t n = 0;
+	for (uint8_t k = 0; k < p.ninflight; k++) remote_change_put(merged, n, p.inflight[k]);
+	for (uint8_t k = 0; k < p.nqueued; k++) remote_change_put(merged, n, p.queued[k]);
+	memcpy(p.queued, merged, n * sizeof(RemoteChange));
+	p.nqueued = n;
+	p.ninflight = 0;
+}
+
+void remote_station_loop() {
+	ulong now = millis();
+	for (uint8_t i = 0; i < REMOTE_PEERS_MAX; i++) {
+		RemotePeer &p = peers[i];
+		if (p.kind == REMOTE_PEER_NONE || remote_peer_idle(p)) continue;
+
+		if (p.ninflight && p.sent) {
+			int16_t ack = p.ack;
+			if (ack == REMOTE_RESULT_NOT_FOUND && !p.legacy) {
+				DEBUG_PRINTLN(F("remote station: peer has no /cb, using /cm"));
+				p.legacy = true;
+				remote_peer_requeue(p);
+			} else if (ack >= 0) {
+				if (ack != 1) DEBUG_PRINTF("remote station: peer answered %d\n", ack);
+				p.ninflight = 0;  // delivered; a refusal is not retried
+			} else if (now - p.sent_at > REMOTE_ACK_TIMEOUT_MS) {
+				if (p.retries++ < REMOTE_RETRY_MAX) {
+					DEBUG_PRINTLN(F("remote station: no ack, resending"));
+					p.sent = false;
+				} else {
+					DEBUG_PRINTLN(F("remote station: peer unreachable, dropping batch"));
+					p.ninflight = 0;
+				}
+			}
+		}
+
+		if (!p.ninflight && p.nqueued) remote_peer_take(p);
+		if (p.ninflight && !p.sent) {
+			// the async client may be busy with another request, try again next loop
+			if (remote_peer_send(i)) {
+				p.sent = true;
+				p.sent_at = now;
+			}
+		}
+	}
+}
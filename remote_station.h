@@ -0,0 +1,49 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Per-peer command channel for remote IP / OTC stations
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _REMOTE_STATION_H
+#define _REMOTE_STATION_H
+
+#include <stdint.h>
+#include "defines.h"
+
+#define REMOTE_PEERS_MAX       8
+#define REMOTE_BATCH_MAX       16     // station changes carried by one request
+#define REMOTE_ACK_TIMEOUT_MS  15000  // resend a batch not acknowledged by then
+#define REMOTE_RETRY_MAX       3
+
+/**
+ * @brief Queue a station change for a remote controller reached by IP.
+ * Changes for the same peer are collected until remote_station_loop() and
+ * then sent as one /cb request (or one /cm each to older firmware).
+ * A later change for the same station replaces a queued one.
+ */
+void remote_station_queue_ip(uint32_t ip4, uint16_t port, uint8_t sid, bool turnon, uint16_t timer);
+
+/** Same for a remote controller reached through the OpenThings Cloud */
+void remote_station_queue_otc(const char *token, uint8_t sid, bool turnon, uint16_t timer);
+
+/** Send queued batches, track acknowledgements and retries; call every loop */
+void remote_station_loop();
+
+#endif // _REMOTE_STATION_H
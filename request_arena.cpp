@@ -0,0 +1,184 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Per-request bump arena for HTTP handlers
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "request_arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(ESP32)
+#include <esp_heap_caps.h>
+#endif
+
+OS_THREAD_LOCAL RequestArena request_arena;
+
+// Every block is preceded by a header holding its size, so reallocate()
+// knows how much to copy and whether the block is the topmost one.
+struct ArenaHeader {
+	uint32_t size;
+	uint32_t prev;  // offset of the previous topmost header
+};
+
+static const size_t ARENA_ALIGN = 8;
+static const uint32_t ARENA_NO_BLOCK = 0xFFFFFFFF;
+
+static inline size_t arena_align(size_t n) {
+	return (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+// Blocks that do not fit in the arena are malloc()ed with this header in
+// front and kept on a doubly linked list until they are freed or reset().
+struct FallbackBlock {
+	FallbackBlock* next;
+	FallbackBlock* prev;
+	uint64_t pad;  // keeps the payload 8-byte aligned on 32 bit targets
+};
+
+void* RequestArena::fallback_alloc(size_t size) {
+	FallbackBlock* b = (FallbackBlock*)malloc(sizeof(FallbackBlock) + size);
+	if (!b) return nullptr;
+	fallbacks++;
+	b->prev = nullptr;
+	b->next = fallback_list;
+	if (fallback_list) fallback_list->prev = b;
+	fallback_list = b;
+	return b + 1;
+}
+
+void RequestArena::fallback_free(void* ptr) {
+	FallbackBlock* b = (FallbackBlock*)ptr - 1;
+	if (b->prev) b->prev->next = b->next;
+	else fallback_list = b->next;
+	if (b->next) b->next->prev = b->prev;
+	free(b);
+}
+
+bool RequestArena::ensure_base() {
+	if (base) return true;
+#if defined(ESP32) && defined(BOARD_HAS_PSRAM)
+	base = (uint8_t*)heap_caps_malloc(REQUEST_ARENA_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#endif
+	if (!base) base = (uint8_t*)malloc(REQUEST_ARENA_SIZE);
+	if (!base) return false;
+	cap = REQUEST_ARENA_SIZE;
+	top = 0;
+	last = ARENA_NO_BLOCK;
+	return true;
+}
+
+bool RequestArena::owns(const void* ptr) const {
+	return base && (const uint8_t*)ptr >= base && (const uint8_t*)ptr < base + cap;
+}
+
+void* RequestArena::allocate(size_t size) {
+	size_t need = sizeof(ArenaHeader) + arena_align(size);
+	if (ensure_base() && top + need <= cap) {
+		ArenaHeader* h = (ArenaHeader*)(base + top);
+		h->size = (uint32_t)size;
+		h->prev = (uint32_t)last;
+		last = top;
+		top += need;
+		if (top > peak) peak = top;
+		return h + 1;
+	}
+	return fallback_alloc(size);
+}
+
+void RequestArena::deallocate(void* ptr) {
+	if (!ptr) return;
+	if (!owns(ptr)) {
+		fallback_free(ptr);
+		return;
+	}
+	ArenaHeader* h = (ArenaHeader*)ptr - 1;
+	if ((uint8_t*)h == base + last) {
+		// Topmost block: roll the bump pointer back
+		top = last;
+		last = h->prev;
+	}
+	// Other blocks are reclaimed by reset()
+}
+
+void* RequestArena::reallocate(void* ptr, size_t new_size) {
+	if (!ptr) return allocate(new_size);
+	if (!owns(ptr)) {
+		FallbackBlock* b = (FallbackBlock*)ptr - 1;
+		FallbackBlock* n = (FallbackBlock*)realloc(b, sizeof(FallbackBlock) + new_size);
+		if (!n) return nullptr;
+		if (n->prev) n->prev->next = n;
+		else fallback_list = n;
+		if (n->next) n->next->prev = n;
+		return n + 1;
+	}
+
+	ArenaHeader* h = (ArenaHeader*)ptr - 1;
+	size_t off = (uint8_t*)h - base;
+	if (off == last) {
+		size_t need = sizeof(ArenaHeader) + arena_align(new_size);
+		if (off + need <= cap) {
+			// Topmost block grows or shrinks in place (ArduinoJson shrinkToFit)
+			h->size = (uint32_t)new_size;
+			top = off + need;
+			if (top > peak) peak = top;
+			return ptr;
+		}
+	} else if (new_size <= h->size) {
+		h->size = (uint32_t)new_size;
+		return ptr;
+	}
+
+	size_t old_size = h->size;
+	void* p = allocate(new_size);
+	if (!p) return nullptr;
+	memcpy(p, ptr, old_size < new_size ? old_size : new_size);
+	deallocate(ptr);
+	return p;
+}
+
+char* RequestArena::strdup(const char* s) {
+	if (!s) return nullptr;
+	size_t len = strlen(s) + 1;
+	char* p = (char*)allocate(len);
+	if (p) memcpy(p, s, len);
+	return p;
+}
+
+void RequestArena::reset() {
+	while (fallback_list) {
+		FallbackBlock* next = fallback_list->next;
+		free(fallback_list);
+		fallback_list = next;
+	}
+	top = 0;
+	last = ARENA_NO_BLOCK;
+}
+
+static OS_THREAD_LOCAL uint8_t request_arena_depth = 0;
+
+RequestArenaScope::RequestArenaScope() {
+	request_arena_depth++;
+}
+
+RequestArenaScope::~RequestArenaScope() {
+	if (request_arena_depth > 0) request_arena_depth--;
+	if (request_arena_depth == 0) request_arena.reset();
+}
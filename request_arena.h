@@ -0,0 +1,101 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Per-request bump arena for HTTP handlers
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _REQUEST_ARENA_H
+#define _REQUEST_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "defines.h"
+#include "ArduinoJson.hpp"
+
+// Arena size per platform. The block is allocated once on first use and kept
+// for the lifetime of the firmware, so handler scratch memory never touches
+// the general heap while it fits. Larger requests fall back to malloc().
+#if defined(ESP32) && defined(BOARD_HAS_PSRAM)
+	#define REQUEST_ARENA_SIZE  65536   // PSRAM-backed
+#elif defined(ESP32)
+	#define REQUEST_ARENA_SIZE  8192
+#elif defined(ESP8266)
+	#define REQUEST_ARENA_SIZE  3072
+#else
+	#define REQUEST_ARENA_SIZE  65536
+#endif
+
+/**
+ * @brief Bump allocator for everything a single HTTP request needs.
+ *
+ * Implements ArduinoJson::Allocator so handler JsonDocuments can draw their
+ * pools from it: JsonDocument doc(&request_arena). Allocation is a pointer
+ * bump, freeing the most recent block rolls the pointer back, anything else
+ * is reclaimed in one step by reset() when the response is complete. Blocks
+ * that did not fit fall back to malloc() and are tracked, so reset() frees
+ * them as well.
+ * Not thread-safe: each thread serving requests has its own instance.
+ */
+class RequestArena : public ArduinoJson::Allocator {
+public:
+	void* allocate(size_t size) override;
+	void deallocate(void* ptr) override;
+	void* reallocate(void* ptr, size_t new_size) override;
+
+	/** Copy a string into the arena (replaces strdup() in handlers). */
+	char* strdup(const char* s);
+	/** Release all arena blocks at once. */
+	void reset();
+
+	size_t capacity() const { return cap; }
+	size_t used() const { return top; }
+	size_t high_water() const { return peak; }
+	uint32_t fallback_count() const { return fallbacks; }
+
+private:
+	bool owns(const void* ptr) const;
+	bool ensure_base();
+
+	void* fallback_alloc(size_t size);
+	void fallback_free(void* ptr);
+
+	uint8_t* base = nullptr;
+	struct FallbackBlock* fallback_list = nullptr;  // malloc()ed blocks, freed by reset()
+	size_t cap = 0;
+	size_t top = 0;     // bump offset
+	size_t last = 0;    // offset of the most recent block header
+	size_t peak = 0;
+	uint32_t fallbacks = 0;
+};
+
+extern OS_THREAD_LOCAL RequestArena request_arena;
+
+/**
+ * @brief Marks the lifetime of one request.
+ * Scopes may nest (e.g. MCP tools calling URL handlers); the outermost one
+ * resets the arena when it ends.
+ */
+class RequestArenaScope {
+public:
+	RequestArenaScope();
+	~RequestArenaScope();
+};
+
+#endif // _REQUEST_ARENA_H
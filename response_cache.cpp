@@ -0,0 +1,206 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * ETag generations and rendered-response cache for read-mostly endpoints
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "response_cache.h"
+#include "OpenSprinkler.h"
+#include "sensors.h"
+#include "SensorBase.hpp"
+#include "TimeLib.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(ESP32)
+#include <esp_heap_caps.h>
+#endif
+
+extern OpenSprinkler os;
+
+#define CACHE_NUM_DOMAINS  5
+
+// One counter per domain, bumped by cache_invalidate(). boot_id makes tags
+// from a previous boot (with counters back at 0) never match again.
+static volatile uint16_t cache_gen[CACHE_NUM_DOMAINS];
+static uint32_t boot_id = 0;
+
+void cache_invalidate(uint8_t domains) {
+	for (uint8_t d = 0; d < CACHE_NUM_DOMAINS; d++) {
+		if (domains & (1 << d)) cache_gen[d]++;
+	}
+}
+
+uint32_t cache_generation(uint8_t domains) {
+	uint32_t g = 0;
+	for (uint8_t d = 0; d < CACHE_NUM_DOMAINS; d++) {
+		if (domains & (1 << d)) g = (g << 7) ^ (g >> 25) ^ cache_gen[d];
+	}
+	return g;
+}
+
+uint32_t cache_hash(uint32_t h, const char *s) {
+	if (!s) return h;
+	while (*s) {
+		h ^= (uint8_t)*s++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static inline uint32_t cache_mix(uint32_t h, uint32_t v) {
+	for (uint8_t i = 0; i < 4; i++) {
+		h ^= (v & 0xFF);
+		h *= 16777619u;
+		v >>= 8;
+	}
+	return h;
+}
+
+uint32_t cache_etag(uint8_t domains, uint32_t key) {
+	if (!boot_id) {
+		boot_id = cache_mix(CACHE_HASH_INIT, (uint32_t)os.now_tz());
+		boot_id = cache_mix(boot_id, (uint32_t)millis()) | 1;
+	}
+	uint32_t h = cache_mix(key, boot_id);
+	for (uint8_t d = 0; d < CACHE_NUM_DOMAINS; d++) {
+		if (domains & (1 << d)) h = cache_mix(h, ((uint32_t)d << 16) | cache_gen[d]);
+	}
+
+	// Readings and monitor states change without a config mutation, fold them
+	// in directly. This only walks the in-memory maps, no flash access.
+	if (domains & CACHE_DOM_SENSORS) {
+		SensorIterator it = sensors_iterate_begin();
+		SensorBase *sensor;
+		while ((sensor = sensors_iterate_next(it)) != NULL) {
+			uint32_t flags = 0;
+			memcpy(&flags, &sensor->flags, sizeof(sensor->flags) < sizeof(flags) ? sizeof(sensor->flags) : sizeof(flags));
+			h = cache_mix(h, (uint32_t)sensor->last_read);
+			h = cache_mix(h, sensor->last_native_data);
+			h = cache_mix(h, flags ^ ((uint32_t)(uint8_t)sensor->trend_state << 24));
+		}
+	}
+	if (domains & CACHE_DOM_DATE) {
+		h = cache_mix(h, (uint32_t)(os.now_tz() / SECS_PER_DAY));
+	}
+	if (domains & CACHE_DOM_MONITORS) {
+		MonitorIterator it = monitor_iterate_begin();
+		Monitor *mon;
+		while ((mon = monitor_iterate_next(it)) != NULL) {
+			h = cache_mix(h, (uint32_t)mon->active);
+			h = cache_mix(h, (uint32_t)mon->time);
+			h = cache_mix(h, (uint32_t)mon->reset_time);
+		}
+	}
+	return h ? h : 1;
+}
+
+#if RESPONSE_CACHE_BYTES > 0
+
+struct CacheSlot {
+	uint32_t key;
+	uint32_t etag;
+	uint32_t stamp;  // last use, for LRU eviction
+	size_t len;
+	char *body;
+};
+
+static CacheSlot slots[RESPONSE_CACHE_SLOTS];
+static size_t cache_used = 0;
+static uint32_t cache_clock = 0;
+
+static char* cache_alloc(size_t len) {
+#if defined(ESP32) && defined(BOARD_HAS_PSRAM)
+	char *p = (char*)heap_caps_malloc(len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+	if (p) return p;
+#endif
+	return (char*)malloc(len);
+}
+
+static void cache_drop(CacheSlot &s) {
+	if (s.body) {
+		free(s.body);
+		cache_used -= s.len;
+	}
+	s.body = NULL;
+	s.len = 0;
+	s.key = 0;
+	s.etag = 0;
+}
+
+bool response_cache_get(uint32_t key, uint32_t etag, const char **body, size_t *len) {
+	for (uint8_t i = 0; i < RESPONSE_CACHE_SLOTS; i++) {
+		CacheSlot &s = slots[i];
+		if (!s.body || s.key != key) continue;
+		if (s.etag != etag) {  // outdated, free it right away
+			cache_drop(s);
+			return false;
+		}
+		s.stamp = ++cache_clock;
+		*body = s.body;
+		*len = s.len;
+		return true;
+	}
+	return false;
+}
+
+void response_cache_put(uint32_t key, uint32_t etag, const char *body, size_t len) {
+	if (!body || !len || len > RESPONSE_CACHE_BYTES / 2) return;
+
+	for (uint8_t i = 0; i < RESPONSE_CACHE_SLOTS; i++) {
+		if (slots[i].body && slots[i].key == key) cache_drop(slots[i]);
+	}
+	// evict least recently used entries until the body fits in a free slot
+	for (;;) {
+		int free_slot = -1, lru = -1;
+		for (uint8_t i = 0; i < RESPONSE_CACHE_SLOTS; i++) {
+			if (!slots[i].body) { if (free_slot < 0) free_slot = i; continue; }
+			if (lru < 0 || slots[i].stamp < slots[lru].stamp) lru = i;
+		}
+		if (free_slot >= 0 && cache_used + len <= RESPONSE_CACHE_BYTES) {
+			char *p = cache_alloc(len);
+			if (!p) return;
+			memcpy(p, body, len);
+			CacheSlot &s = slots[free_slot];
+			s.key = key;
+			s.etag = etag;
+			s.stamp = ++cache_clock;
+			s.len = len;
+			s.body = p;
+			cache_used += len;
+			return;
+		}
+		if (lru < 0) return;
+		cache_drop(slots[lru]);
+	}
+}
+
+#else
+
+bool response_cache_get(uint32_t key, uint32_t etag, const char **body, size_t *len) {
+	(void)key; (void)etag; (void)body; (void)len;
+	return false;
+}
+
+void response_cache_put(uint32_t key, uint32_t etag, const char *body, size_t len) {
+	(void)key; (void)etag; (void)body; (void)len;
+}
+
+#endif
@@ -0,0 +1,76 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * ETag generations and rendered-response cache for read-mostly endpoints
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RESPONSE_CACHE_H
+#define _RESPONSE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Data domains a cached response can depend on */
+#define CACHE_DOM_STATIONS  0x01
+#define CACHE_DOM_PROGRAMS  0x02
+#define CACHE_DOM_OPTIONS   0x04
+#define CACHE_DOM_SENSORS   0x08  // sensors and program adjustments
+#define CACHE_DOM_MONITORS  0x10
+#define CACHE_DOM_DATE      0x40  // rendered relative to today's date
+#define CACHE_DOM_STATIC    0x80  // depends on firmware build only
+
+// Byte budget for rendered bodies. Platforms with 0 still answer
+// If-None-Match with 304 but re-render on every full request.
+#if defined(ESP32) && defined(BOARD_HAS_PSRAM)
+	#define RESPONSE_CACHE_BYTES  65536
+#elif defined(ESP32) || defined(ESP8266)
+	#define RESPONSE_CACHE_BYTES  0
+#else
+	#define RESPONSE_CACHE_BYTES  262144
+#endif
+#define RESPONSE_CACHE_SLOTS  8
+
+/** Mark all cached responses depending on the given domains as stale */
+void cache_invalidate(uint8_t domains);
+
+/** Combined change counter of the given domains, for callers caching derived state */
+uint32_t cache_generation(uint8_t domains);
+
+/**
+ * @brief Compute the entity tag for a response.
+ * @param domains CACHE_DOM_* mask the response depends on
+ * @param key hash of the endpoint key and the query values that select content
+ * The tag also folds in live sensor and monitor state for those domains,
+ * so readings and monitor transitions change it without a config mutation.
+ */
+uint32_t cache_etag(uint8_t domains, uint32_t key);
+
+/** Look up a rendered body; returns false if missing or the tag is outdated */
+bool response_cache_get(uint32_t key, uint32_t etag, const char **body, size_t *len);
+
+/** Store a rendered body, evicting the least recently used entries as needed */
+void response_cache_put(uint32_t key, uint32_t etag, const char *body, size_t len);
+
+/** Incremental FNV-1a, used to build cache keys */
+uint32_t cache_hash(uint32_t h, const char *s);
+
+#define CACHE_HASH_INIT  2166136261u
+
+#endif // _RESPONSE_CACHE_H
@@ -0,0 +1,98 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Queued response output for requests served from the web thread
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "response_pool.h"
+
+#if defined(OS_HTTP_THREAD)
+
+#include "web_thread.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct ResponseQueue {
+	char *blocks[RESPONSE_POOL_BUFFERS];  // kept for the next request
+	size_t used[RESPONSE_POOL_BUFFERS];
+	uint8_t n;         // blocks holding data
+	bool active;
+	bool may_yield;
+	ResponseSink sink;
+	void *ctx;
+};
+
+static thread_local ResponseQueue queue;
+
+static void response_pool_flush() {
+	for (uint8_t i = 0; i < queue.n; i++) {
+		queue.sink(queue.blocks[i], queue.used[i], queue.ctx);
+	}
+	queue.n = 0;
+}
+
+void response_pool_begin(ResponseSink sink, void *ctx, bool may_yield) {
+	queue.sink = sink;
+	queue.ctx = ctx;
+	queue.may_yield = may_yield;
+	queue.n = 0;
+	queue.active = true;
+}
+
+bool response_pool_active() {
+	return queue.active;
+}
+
+void response_pool_write(const char *data, size_t len) {
+	while (len > 0) {
+		if (queue.n == 0 || queue.used[queue.n - 1] == ETHER_BUFFER_SIZE) {
+			if (queue.n == RESPONSE_POOL_BUFFERS) {
+				if (queue.may_yield) {
+					WebStateReadUnlock yield;  // the handler keeps no state across packets
+					response_pool_flush();
+				} else {
+					response_pool_flush();
+				}
+			}
+			char *&b = queue.blocks[queue.n];
+			if (!b) b = (char *)malloc(ETHER_BUFFER_SIZE);
+			if (!b) {  // out of memory: send directly, in order
+				response_pool_flush();
+				queue.sink(data, len, queue.ctx);
+				return;
+			}
+			queue.used[queue.n++] = 0;
+		}
+		size_t &used = queue.used[queue.n - 1];
+		size_t chunk = ETHER_BUFFER_SIZE - used;
+		if (chunk > len) chunk = len;
+		memcpy(queue.blocks[queue.n - 1] + used, data, chunk);
+		used += chunk;
+		data += chunk;
+		len -= chunk;
+	}
+}
+
+void response_pool_end() {
+	queue.active = false;
+	response_pool_flush();
+}
+
+#endif
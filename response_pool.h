@@ -0,0 +1,64 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Queued response output for requests served from the web thread
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RESPONSE_POOL_H
+#define _RESPONSE_POOL_H
+
+#include <stddef.h>
+#include "defines.h"
+
+#if defined(OS_HTTP_THREAD)
+
+// Body bytes a read-only request may queue before it has to wait for the
+// client, in blocks of ETHER_BUFFER_SIZE allocated on first use.
+#define RESPONSE_POOL_BUFFERS  8
+
+typedef void (*ResponseSink)(const char *data, size_t len, void *ctx);
+
+/**
+ * @brief Queue the body of the current request instead of sending it.
+ * Read-only requests run under a shared hold of the state lock. Writing to
+ * a slow client in that span holds up the main loop, so their body is queued
+ * and sent by response_pool_end() once the lock is released. When the queue
+ * is full, the handler waits until the client took it (backpressure), with
+ * the lock dropped meanwhile if may_yield is set.
+ */
+void response_pool_begin(ResponseSink sink, void *ctx, bool may_yield);
+
+/** True while the current thread queues its response */
+bool response_pool_active();
+
+/** Queue body bytes; sends the queue first when it is full */
+void response_pool_write(const char *data, size_t len);
+
+/** Send what is queued and stop queueing; call with the state lock released */
+void response_pool_end();
+
+#else
+
+inline bool response_pool_active() { return false; }
+inline void response_pool_write(const char *data, size_t len) {(void)data; (void)len;}
+
+#endif
+
+#endif // _RESPONSE_POOL_H
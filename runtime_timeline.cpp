@@ -0,0 +1,121 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Event timeline of the runtime queue
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "runtime_timeline.h"
+#include "OpenSprinkler.h"
+#include "program.h"
+#include "response_cache.h"
+#include <algorithm>
+#include <vector>
+
+extern OpenSprinkler os;
+extern ProgramData pd;
+
+#define TL_FULL_SWEEP_SECS  60
+
+static std::vector<TimelineEvent> heap;
+static uint32_t tl_print = 0;   // state fingerprint at the last commit
+static uint32_t tl_seen = 0;    // fingerprint computed by the last check
+static time_os_t tl_time = 0;   // time of the last commit
+static time_os_t tl_sweep = 0;  // time of the last full sweep
+static bool tl_valid = false;
+static bool tl_full = true;     // the current tick does a full sweep
+
+static inline uint32_t tl_mix(uint32_t h, uint32_t v) {
+	for (uint8_t i = 0; i < 4; i++) {
+		h ^= (v & 0xFF);
+		h *= 16777619u;
+		v >>= 8;
+	}
+	return h;
+}
+
+// Everything the run-time keeping in do_loop() depends on besides the time
+static uint32_t timeline_fingerprint() {
+	uint32_t h = tl_mix(CACHE_HASH_INIT, pd.nqueue);
+	for (RuntimeQueueStruct *q = pd.queue; q < pd.queue + pd.nqueue; q++) {
+		h = tl_mix(h, (uint32_t)q->st);
+		h = tl_mix(h, (uint32_t)q->deque_time);
+		h = tl_mix(h, ((uint32_t)q->dur << 16) | ((uint32_t)q->sid << 8) | q->pid);
+	}
+	for (unsigned char bid = 0; bid < os.nboards; bid++) {
+		h = tl_mix(h, os.station_bits[bid]);
+	}
+	h = tl_mix(h, (uint32_t)os.status.enabled | ((uint32_t)os.status.rain_delayed << 1) |
+		((uint32_t)os.status.sensor1_active << 2) | ((uint32_t)os.status.sensor2_active << 3) |
+		((uint32_t)os.status.program_busy << 4) | ((uint32_t)os.status.pause_state << 5) |
+		((uint32_t)os.status.mas << 8) | ((uint32_t)os.status.mas2 << 16));
+	return tl_mix(h, cache_generation(CACHE_DOM_STATIONS | CACHE_DOM_OPTIONS));
+}
+
+static inline bool tl_later(const TimelineEvent &a, const TimelineEvent &b) {
+	return a.t > b.t;
+}
+
+static void tl_push(time_os_t t, unsigned char sid, unsigned char kind, time_os_t curr_time) {
+	if (t <= curr_time) return;  // already reflected in the state just committed
+	TimelineEvent ev = {t, sid, kind};
+	heap.push_back(ev);
+	std::push_heap(heap.begin(), heap.end(), tl_later);
+}
+
+static void timeline_rebuild(time_os_t curr_time) {
+	heap.clear();
+	for (RuntimeQueueStruct *q = pd.queue; q < pd.queue + pd.nqueue; q++) {
+		tl_push(q->deque_time, q->sid, TL_STATION, curr_time);
+		if (!q->st) continue;  // not scheduled yet
+		tl_push(q->st, q->sid, TL_STATION, curr_time);
+		if (q->st + q->dur != q->deque_time) tl_push(q->st + q->dur, q->sid, TL_STATION, curr_time);
+		for (unsigned char mas = MASTER_1; mas < NUM_MASTER_ZONES; mas++) {
+			unsigned char mas_id = os.masters[mas][MASOPT_SID];
+			if (!mas_id || mas_id == q->sid + 1 || !os.bound_to_master(q->sid, mas)) continue;
+			tl_push(q->st + os.get_on_adj(mas), q->sid, TL_MASTER, curr_time);
+			tl_push(q->st + q->dur + os.get_off_adj(mas) + 1, q->sid, TL_MASTER, curr_time);
+		}
+	}
+}
+
+bool timeline_check(time_os_t curr_time) {
+	tl_seen = timeline_fingerprint();
+	tl_full = !tl_valid || tl_seen != tl_print || curr_time < tl_time ||
+		curr_time - tl_sweep >= TL_FULL_SWEEP_SECS;
+	return !tl_full;
+}
+
+bool timeline_pop(time_os_t curr_time, TimelineEvent *ev) {
+	if (heap.empty() || heap.front().t > curr_time) return false;
+	std::pop_heap(heap.begin(), heap.end(), tl_later);
+	*ev = heap.back();
+	heap.pop_back();
+	return true;
+}
+
+void timeline_commit(time_os_t curr_time, bool changed) {
+	if (tl_full) tl_sweep = curr_time;
+	if (changed || tl_full) {
+		timeline_rebuild(curr_time);
+		tl_print = timeline_fingerprint();
+	}
+	tl_time = curr_time;
+	tl_valid = true;
+}
@@ -0,0 +1,56 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Event timeline of the runtime queue
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RUNTIME_TIMELINE_H
+#define _RUNTIME_TIMELINE_H
+
+#include "types.h"
+
+/** Event kinds */
+#define TL_STATION  0  // start, stop or dequeue time of a queue element
+#define TL_MASTER   1  // a master station window opens or closes
+
+struct TimelineEvent {
+	time_os_t t;
+	unsigned char sid;
+	unsigned char kind;
+};
+
+/**
+ * @brief Check whether the per-second run-time keeping can go by events
+ * Returns false, asking for a full sweep, if the queue, the station outputs,
+ * controller status or station/option settings changed since the last
+ * timeline_commit(), if time went backwards, or once a minute as a safety net.
+ */
+bool timeline_check(time_os_t curr_time);
+
+/** Pop the next event due at curr_time, returns false if there is none */
+bool timeline_pop(time_os_t curr_time, TimelineEvent *ev);
+
+/**
+ * @brief Record the state at the end of a tick
+ * @param changed the tick swept or handled events, rebuild the heap
+ */
+void timeline_commit(time_os_t curr_time, bool changed);
+
+#endif // _RUNTIME_TIMELINE_H
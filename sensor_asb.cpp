@@ -26,20 +26,15 @@
 #include "sensor_asb.h"
 #include "OpenSprinkler.h"
 #include "sensors.h"
+#include "adc_sampler.h"
 
 extern OpenSprinkler os;
 extern uint16_t get_asb_detected_boards();
 
-#if defined(ESP8266)
-static void reset_asb_read_bus() {
-  Wire.begin(SDA, SCL);
-  Wire.setClock(100000);
-  delay(5);
-}
-#endif
-
 /**
  * Read ESP8266/ESP32 ADS1115 sensors (Analog Sensor Board)
+ * The ADC sampler converts the channel in the background; this only picks
+ * up its oversampled mean.
  */
 int AsbSensor::read(unsigned long time) {
   //DEBUG_PRINTLN(F("AsbSensor::read"));
@@ -53,73 +48,20 @@ int AsbSensor::read(unsigned long time) {
       ((get_asb_detected_boards() & ASB_BOARD2) == 0))
     return HTTP_RQT_NOT_RECEIVED;
 
-  int port = ASB_BOARD_ADDR1a + this->id / 4;
-  int id = this->id % 4;
-
-  // unsigned long startTime = millis();
-  ADS1115 adc(port);
-  if (!adc.begin()) {
-#if defined(ESP8266)
-    // I2C bus lockup recovery: reinitialize the software I2C and retry once
-    reset_asb_read_bus();
-    if (!adc.begin()) {
-#endif
-      DEBUG_PRINTLN(F("no asb board?!?"));
-      return HTTP_RQT_NOT_RECEIVED;
-#if defined(ESP8266)
-    }
-#endif
-  }
-  // unsigned long endTime = millis();
-  // DEBUG_PRINTF("t=%lu ms\n", endTime-startTime);
-
-  // startTime = millis();
-  int16_t raw = adc.readADC(id);
-#if defined(ESP8266)
-  if (raw == ADS1X15_ERROR_I2C || raw == ADS1X15_ERROR_TIMEOUT) {
-    reset_asb_read_bus();
-    raw = adc.readADC(id);
-  }
-#endif
-  this->repeat_native += raw;
-  // endTime = millis();
-  // DEBUG_PRINTF("t=%lu ms\n", endTime-startTime);
-
-  // Track the start of the current averaging period independently of
-  // last_read.  The scheduler overwrites last_read each second for non-
-  // ZigBee sensors when HTTP_RQT_NOT_RECEIVED is returned (to prevent
-  // tight spin-loops).  Using last_read here caused the time condition to
-  // be permanently true, so the averaging period never ended after the
-  // initial boot-time read.
-  if (this->period_start == 0) {
-    // First call after boot or after a completed period.
-    // If we have never produced a result yet (data_ok==false), skip the
-    // averaging delay and return the very first sample immediately so the
-    // sensor shows a value right after startup.
-    if (!this->flags.data_ok) {
-      // repeat_native already has the sample from above; use it directly.
-      this->repeat_read = 1;
-      // fall through to the processing code below
-    } else {
-      this->period_start = time;
-    }
-  }
-
-  if (this->period_start != 0) {
-    if (++this->repeat_read < MAX_SENSOR_REPEAT_READ &&
-        time < this->period_start + this->read_interval)
-      return HTTP_RQT_NOT_RECEIVED;
+  // Keep repeat_read set until the first samples are in, so the scheduler
+  // retries every second instead of waiting a full read_interval
+  AdcChannelStats st;
+  if (!adc_sampler_get(ADC_SRC_ASB, this->id, &st, this->read_interval)) {
+    this->repeat_read = 1;
+    return HTTP_RQT_NOT_RECEIVED;
   }
 
-  uint64_t avgValue = this->repeat_native / this->repeat_read;
-
-  this->repeat_native = avgValue;
+  this->repeat_native = st.mean;
   this->repeat_data = 0;
-  this->repeat_read = 1;  // read continously
-  this->period_start = 0;  // reset so the next period starts fresh
+  this->repeat_read = 0;
 
-  this->last_native_data = avgValue;
-  this->last_data = adc.toVoltage(this->last_native_data);
+  this->last_native_data = st.mean;
+  this->last_data = st.volts;
   double v = this->last_data;
 
   switch (this->type) {
@@ -27,6 +27,7 @@
 #include "OpenSprinkler.h"
 #include "sensor_payload_decoder.h"
 #include <vector>
+#include <algorithm>
 #include <ctype.h>
 #include <esp_memory_utils.h>
 #include "ieee802154_config.h"
@@ -68,6 +69,7 @@ void ble_semaphore_init();
 static bool ble_ensure_initialized(const char* reason);
 static BLEClient* ble_get_client();
 static bool ble_uuid_extract_16bit(const char* uuid_in, uint16_t* out_uuid16);
+static bool ble_is_uuid_ec88_service(const char* uuid_str);
 
 // BLE state
 static bool ble_initialized = false;
@@ -137,6 +139,7 @@ static volatile uint32_t ble_dbg_disc_added = 0;
 static volatile uint32_t ble_dbg_disc_updated = 0;
 static volatile uint32_t ble_dbg_lock_null = 0;
 static volatile uint32_t ble_dbg_lock_timeout = 0;
+static volatile uint32_t ble_dbg_ring_drop = 0;
 
 // Background scan completion callback
 static void ble_bg_scan_complete_cb(BLEScanResults results) {
@@ -160,9 +163,10 @@ static void ble_discovery_scan_complete_cb(BLEScanResults results) {
                  (unsigned long)ble_dbg_disc_unmanaged_skip,
                  (unsigned long)ble_dbg_disc_lock_miss,
                  discovered_count);
-    DEBUG_PRINTF("[BLE][DBG] lock_stats: null=%lu timeout=%lu\n",
+    DEBUG_PRINTF("[BLE][DBG] lock_stats: null=%lu timeout=%lu ring_drop=%lu\n",
                  (unsigned long)ble_dbg_lock_null,
-                 (unsigned long)ble_dbg_lock_timeout);
+                 (unsigned long)ble_dbg_lock_timeout,
+                 (unsigned long)ble_dbg_ring_drop);
     // Background scan will auto-restart from sensor_ble_loop()
 }
 
@@ -245,93 +249,350 @@ static inline void discovered_devices_unlock() {
 }
 
 // ============================================================================
-// Ignored BLE MAC hash set — lives in PSRAM, suppresses repeated log output
-// for unmanaged devices that are seen during background scan.
-// Open-addressing hash table: each slot is 6 bytes (MAC) + 1 byte (occupied flag).
+// BLE MAC map — single open-addressing hash table (FNV-1a) keyed by MAC.
+// Holds managed (configured) MACs together with the sensors sharing them and
+// the advertisement decoder picked for the device, listed MACs (in the
+// discovered list without a sensor, kept up to date like the managed ones),
+// plus ignored MACs that are rejected by the scan callback before any
+// decoding happens.
+//
+// The table is rebuilt from the main loop only when the BLE sensor set or
+// the discovered list changes and published with a single pointer store; the NimBLE scan
+// callback (onResult) reads it lock-free. Each callback counts itself in
+// ble_mac_map_readers while it holds the table; a replaced table is only
+// freed once that count has dropped to zero, and the next rebuild waits
+// until it has. The callback itself only ever writes the decoder id of an
+// existing entry or claims an EMPTY slot for an ignored MAC.
 // ============================================================================
-#define BLE_IGNORE_SLOTS 128  // must be power of 2
-struct BleIgnoreSlot { uint8_t mac[6]; uint8_t occupied; };
-static BleIgnoreSlot EXT_RAM_BSS_ATTR ble_ignore_table[BLE_IGNORE_SLOTS];
+#define BLE_MAC_MAP_MIN_SLOTS 256   // must be power of 2
+#define BLE_MAC_IGNORE_MAX    128   // ignored MACs per table (best-effort)
+#define BLE_MAC_IGNORE_PROBES 8
+
+enum : uint8_t { BLE_MAC_EMPTY = 0, BLE_MAC_MANAGED, BLE_MAC_IGNORED, BLE_MAC_LISTED };
+
+// Advertisement decoder selected once per managed MAC (see ble_adv_decoders)
+enum : uint8_t {
+    BLE_DEC_PROBE = 0,    // not classified yet: try all decoders, remember the match
+    BLE_DEC_GOVEE_MFG,    // Govee values in manufacturer data
+    BLE_DEC_GOVEE_SVC,    // Govee values in service data 0xEC88
+    BLE_DEC_GOVEE_RAW,    // Govee values in raw AD 0x16 / 0xEC88
+    BLE_DEC_NONE,         // GATT-only device (BMS, Xiaomi, configured characteristic)
+    BLE_DEC_COUNT
+};
 
-static uint16_t ble_ignore_count() {
-    uint16_t count = 0;
-    for (uint16_t i = 0; i < BLE_IGNORE_SLOTS; i++) {
-        if (ble_ignore_table[i].occupied) count++;
-    }
-    return count;
-}
+struct BleMacEntry {
+    uint8_t mac[6];
+    volatile uint8_t state;
+    volatile uint8_t decoder;
+    uint16_t sensor_first;    // index into BleMacMap::sensor_nrs
+    uint16_t sensor_count;
+};
+
+struct BleMacMap {
+    uint32_t mask;            // slot count - 1
+    uint32_t managed;         // number of distinct managed MACs
+    volatile uint32_t ignored;
+    uint32_t signature;       // FNV-1a over (mac, nr, gatt) of all BLE sensors and the listed MACs
+    BleMacEntry* slots;
+    uint* sensor_nrs;
+};
 
-static uint32_t ble_ignore_hash(const uint8_t* mac) {
-    // FNV-1a 32-bit over 6 bytes
+static BleMacMap* ble_mac_map_active = nullptr;   // read by onResult
+static BleMacMap* ble_mac_map_retired = nullptr;  // replaced, may still be read
+static uint32_t ble_mac_map_readers = 0;          // onResult calls holding a table
+static bool ble_mac_map_drop_pending = false;     // fresh ignore set still due
+static uint32_t managed_ble_mac_refresh_at = 0;
+
+// Diagnostic: count how many times onResult() was called (any advertisement received)
+static volatile int ble_onresult_total = 0;
+
+static inline uint32_t ble_mac_hash(const uint8_t* mac) {
     uint32_t h = 2166136261u;
     for (int i = 0; i < 6; i++) { h ^= mac[i]; h *= 16777619u; }
     return h;
 }
 
-/** Returns true if mac is already in the ignore set. */
-static bool ble_ignore_contains(const uint8_t* mac) {
-    uint32_t idx = ble_ignore_hash(mac) & (BLE_IGNORE_SLOTS - 1);
-    for (int probe = 0; probe < 8; probe++) {
-        uint32_t slot = (idx + probe) & (BLE_IGNORE_SLOTS - 1);
-        if (!ble_ignore_table[slot].occupied) return false;
-        if (memcmp(ble_ignore_table[slot].mac, mac, 6) == 0) return true;
+static inline BleMacMap* ble_mac_map_get() {
+    return __atomic_load_n(&ble_mac_map_active, __ATOMIC_ACQUIRE);
+}
+
+/** Holds the published table for one onResult call. */
+struct BleMacMapReader {
+    BleMacMap* map;
+    BleMacMapReader() {
+        // counted before the load: a rebuild that sees no readers after its
+        // store knows nobody can still pick up the table it replaced
+        __atomic_add_fetch(&ble_mac_map_readers, 1, __ATOMIC_SEQ_CST);
+        map = __atomic_load_n(&ble_mac_map_active, __ATOMIC_SEQ_CST);
     }
-    return false;
+    ~BleMacMapReader() {
+        __atomic_sub_fetch(&ble_mac_map_readers, 1, __ATOMIC_RELEASE);
+    }
+};
+
+static inline bool ble_mac_map_in_use() {
+    return __atomic_load_n(&ble_mac_map_readers, __ATOMIC_SEQ_CST) != 0;
+}
+
+/** Lookup mac, returns nullptr if it is not in the table. */
+static BleMacEntry* ble_mac_map_find(BleMacMap* map, const uint8_t* mac) {
+    if (!map) return nullptr;
+    uint32_t idx = ble_mac_hash(mac) & map->mask;
+    for (uint32_t probe = 0; probe <= map->mask; probe++) {
+        BleMacEntry* e = &map->slots[(idx + probe) & map->mask];
+        uint8_t state = __atomic_load_n(&e->state, __ATOMIC_ACQUIRE);
+        if (state == BLE_MAC_EMPTY) return nullptr;
+        if (memcmp(e->mac, mac, 6) == 0) return e;
+    }
+    return nullptr;
+}
+
+/** Claim a slot for mac (main loop while building, not yet published). */
+static BleMacEntry* ble_mac_map_claim(BleMacMap* map, const uint8_t* mac) {
+    uint32_t idx = ble_mac_hash(mac) & map->mask;
+    for (uint32_t probe = 0; probe <= map->mask; probe++) {
+        BleMacEntry* e = &map->slots[(idx + probe) & map->mask];
+        if (e->state == BLE_MAC_EMPTY) {
+            memcpy(e->mac, mac, 6);
+            return e;
+        }
+        if (memcmp(e->mac, mac, 6) == 0) return e;
+    }
+    return nullptr;
 }
 
-/** Insert mac into the ignore set (best-effort, may fail if full). */
-static void ble_ignore_insert(const uint8_t* mac) {
-    uint32_t idx = ble_ignore_hash(mac) & (BLE_IGNORE_SLOTS - 1);
-    for (int probe = 0; probe < 8; probe++) {
-        uint32_t slot = (idx + probe) & (BLE_IGNORE_SLOTS - 1);
-        if (!ble_ignore_table[slot].occupied) {
-            memcpy(ble_ignore_table[slot].mac, mac, 6);
-            ble_ignore_table[slot].occupied = 1;
+/** Insert mac into the ignore set of the published table (best-effort, from onResult). */
+static void ble_mac_map_ignore(BleMacMap* map, const uint8_t* mac) {
+    if (!map || map->ignored >= BLE_MAC_IGNORE_MAX) return;
+    uint32_t idx = ble_mac_hash(mac) & map->mask;
+    for (int probe = 0; probe < BLE_MAC_IGNORE_PROBES; probe++) {
+        BleMacEntry* e = &map->slots[(idx + probe) & map->mask];
+        if (e->state == BLE_MAC_EMPTY) {
+            memcpy(e->mac, mac, 6);
+            e->decoder = BLE_DEC_NONE;
+            __atomic_store_n(&e->state, (uint8_t)BLE_MAC_IGNORED, __ATOMIC_RELEASE);
+            map->ignored = map->ignored + 1;
             return;
         }
-        if (memcmp(ble_ignore_table[slot].mac, mac, 6) == 0) return; // already present
+        if (memcmp(e->mac, mac, 6) == 0) return; // already present
     }
 }
 
-// ============================================================================
-// Managed BLE MAC cache — rebuilt periodically from main loop,
-// read lock-free from the NimBLE scan callback (onResult).
-// ============================================================================
-#define BLE_MAX_MANAGED_MACS 32
-static uint8_t EXT_RAM_BSS_ATTR managed_ble_macs[BLE_MAX_MANAGED_MACS][6];
-static volatile int managed_ble_mac_count = 0;
-static uint32_t managed_ble_mac_refresh_at = 0;
+static void ble_mac_map_free(BleMacMap* map) {
+    if (!map) return;
+    heap_caps_free(map->slots);
+    heap_caps_free(map->sensor_nrs);
+    heap_caps_free(map);
+}
 
-// Diagnostic: count how many times onResult() was called (any advertisement received)
-static volatile int ble_onresult_total = 0;
+static void* ble_mac_map_calloc(size_t n, size_t size) {
+    void* p = heap_caps_calloc(n, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!p) p = heap_caps_calloc(n, size, MALLOC_CAP_8BIT);
+    return p;
+}
+
+/** Parse "aa:bb:cc:dd:ee:ff" without sscanf (hot path in onResult). */
+static bool ble_parse_mac(const char* s, uint8_t* out) {
+    if (!s) return false;
+    for (int i = 0; i < 6; i++) {
+        uint8_t v = 0;
+        for (int j = 0; j < 2; j++) {
+            char c = *s++;
+            v <<= 4;
+            if (c >= '0' && c <= '9') v |= (uint8_t)(c - '0');
+            else if (c >= 'a' && c <= 'f') v |= (uint8_t)(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') v |= (uint8_t)(c - 'A' + 10);
+            else return false;
+        }
+        if (i < 5 && *s++ != ':') return false;
+    }
+    return true;
+}
+
+struct BleManagedRow { uint8_t mac[6]; bool gatt; uint nr; };
+struct BleMacRow { uint8_t mac[6]; };
 
-/** Rebuild the managed-MAC cache from the sensor list (main-loop only). */
-static void ble_refresh_managed_macs() {
-    int count = 0;
+/**
+ * Rebuild the MAC map from the sensor list (main-loop only).
+ * Skipped when the BLE sensor set is unchanged, unless drop_ignored is set
+ * (discovery scan start), which also starts a fresh ignore set.
+ */
+static void ble_refresh_managed_macs(bool drop_ignored = false) {
+    managed_ble_mac_refresh_at = millis() + 10000; // refresh every 10 s
+    drop_ignored = drop_ignored || ble_mac_map_drop_pending;
+
+    // Only one replaced table at a time: retry shortly while a callback may
+    // still be reading the last one
+    if (ble_mac_map_retired) {
+        if (ble_mac_map_in_use()) {
+            managed_ble_mac_refresh_at = millis() + 100;
+            ble_mac_map_drop_pending = drop_ignored;
+            return;
+        }
+        ble_mac_map_free(ble_mac_map_retired);
+        ble_mac_map_retired = nullptr;
+    }
+
+    std::vector<BleManagedRow> rows;
+    uint32_t sig = 2166136261u;
     SensorIterator it = sensors_iterate_begin();
     SensorBase* sensor;
-    while ((sensor = sensors_iterate_next(it)) != NULL && count < BLE_MAX_MANAGED_MACS) {
+    while ((sensor = sensors_iterate_next(it)) != NULL) {
         if (!sensor || sensor->type != SENSOR_BLE) continue;
         BLESensor* ble = static_cast<BLESensor*>(sensor);
-        if (!ble->mac_address_cfg[0]) continue;
-        uint8_t addr[6];
-        if (sscanf(ble->mac_address_cfg, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx",
-                   &addr[0], &addr[1], &addr[2], &addr[3], &addr[4], &addr[5]) == 6) {
-            memcpy(managed_ble_macs[count], addr, 6);
-            count++;
+        BleManagedRow row;
+        if (!ble->mac_address_cfg[0] || !ble_parse_mac(ble->mac_address_cfg, row.mac)) continue;
+        row.gatt = ble->characteristic_uuid_cfg[0] && !ble_is_uuid_ec88_service(ble->characteristic_uuid_cfg);
+        row.nr = sensor->nr;
+        rows.push_back(row);
+        for (int i = 0; i < 6; i++) { sig ^= row.mac[i]; sig *= 16777619u; }
+        sig ^= (uint32_t)row.nr; sig *= 16777619u;
+        sig ^= (uint32_t)row.gatt; sig *= 16777619u;
+    }
+
+    BleMacMap* old = ble_mac_map_active;
+
+    // Devices in the discovered list keep getting rssi/last_seen (and values)
+    // from the background scan; without the list lock carry the old set over
+    std::vector<BleMacRow> listed;
+    if (discovered_devices_lock(0)) {
+        for (const auto& dev : discovered_ble_devices) {
+            BleMacRow l;
+            memcpy(l.mac, dev.address, 6);
+            listed.push_back(l);
         }
+        discovered_devices_unlock();
+    } else if (old) {
+        for (uint32_t i = 0; i <= old->mask; i++) {
+            if (old->slots[i].state != BLE_MAC_LISTED) continue;
+            BleMacRow l;
+            memcpy(l.mac, old->slots[i].mac, 6);
+            listed.push_back(l);
+        }
+    }
+    std::sort(listed.begin(), listed.end(), [](const BleMacRow& a, const BleMacRow& b) {
+        return memcmp(a.mac, b.mac, 6) < 0;
+    });
+    for (const BleMacRow& l : listed) {
+        for (int i = 0; i < 6; i++) { sig ^= l.mac[i]; sig *= 16777619u; }
+    }
+
+    if (old && !drop_ignored && old->signature == sig) return;
+
+    // Group sensors sharing a MAC so each entry references a contiguous range
+    std::sort(rows.begin(), rows.end(), [](const BleManagedRow& a, const BleManagedRow& b) {
+        int c = memcmp(a.mac, b.mac, 6);
+        return c != 0 ? c < 0 : a.nr < b.nr;
+    });
+
+    uint32_t slots = BLE_MAC_MAP_MIN_SLOTS;
+    while (slots < (rows.size() + listed.size() + BLE_MAC_IGNORE_MAX) * 2) slots <<= 1;
+
+    BleMacMap* map = (BleMacMap*)ble_mac_map_calloc(1, sizeof(BleMacMap));
+    if (!map) return;
+    map->slots = (BleMacEntry*)ble_mac_map_calloc(slots, sizeof(BleMacEntry));
+    map->sensor_nrs = (uint*)ble_mac_map_calloc(rows.empty() ? 1 : rows.size(), sizeof(uint));
+    if (!map->slots || !map->sensor_nrs) {
+        ble_mac_map_free(map);
+        return;
     }
-    managed_ble_mac_count = count;  // atomic-width write visible to callback
-    managed_ble_mac_refresh_at = millis() + 10000; // refresh every 10 s
+    map->mask = slots - 1;
+    map->signature = sig;
+
+    for (size_t i = 0; i < rows.size(); ) {
+        BleMacEntry* e = ble_mac_map_claim(map, rows[i].mac);
+        bool all_gatt = true;
+        e->sensor_first = (uint16_t)i;
+        while (i < rows.size() && memcmp(rows[i].mac, e->mac, 6) == 0) {
+            map->sensor_nrs[i] = rows[i].nr;
+            all_gatt = all_gatt && rows[i].gatt;
+            e->sensor_count++;
+            i++;
+        }
+        // Keep the decoder already picked for this device
+        BleMacEntry* prev = ble_mac_map_find(old, e->mac);
+        if (all_gatt) e->decoder = BLE_DEC_NONE;
+        else if (prev && prev->state == BLE_MAC_MANAGED) e->decoder = prev->decoder;
+        else e->decoder = BLE_DEC_PROBE;
+        e->state = BLE_MAC_MANAGED;
+        map->managed++;
+    }
+
+    for (const BleMacRow& l : listed) {
+        BleMacEntry* e = ble_mac_map_claim(map, l.mac);
+        if (!e || e->state != BLE_MAC_EMPTY) continue;  // managed already
+        BleMacEntry* prev = ble_mac_map_find(old, l.mac);
+        e->decoder = prev && (prev->state == BLE_MAC_LISTED || prev->state == BLE_MAC_MANAGED) ?
+                     prev->decoder : BLE_DEC_PROBE;
+        e->state = BLE_MAC_LISTED;
+    }
+
+    if (old && !drop_ignored) {
+        for (uint32_t i = 0; i <= old->mask && map->ignored < BLE_MAC_IGNORE_MAX; i++) {
+            const BleMacEntry* o = &old->slots[i];
+            if (o->state != BLE_MAC_IGNORED) continue;
+            BleMacEntry* e = ble_mac_map_claim(map, o->mac);
+            if (e && e->state == BLE_MAC_EMPTY) {
+                e->decoder = BLE_DEC_NONE;
+                e->state = BLE_MAC_IGNORED;
+                map->ignored++;
+            }
+        }
+    }
+
+    __atomic_store_n(&ble_mac_map_active, map, __ATOMIC_SEQ_CST);
+    ble_mac_map_drop_pending = false;
+    if (ble_mac_map_in_use()) ble_mac_map_retired = old;
+    else ble_mac_map_free(old);
 }
 
-/** Check whether addr matches a managed (configured) BLE sensor MAC. */
-static bool ble_is_managed_mac(const uint8_t* addr) {
-    int n = managed_ble_mac_count; // snapshot
-    for (int i = 0; i < n; i++) {
-        if (memcmp(managed_ble_macs[i], addr, 6) == 0) return true;
+// ============================================================================
+// Advertisement event ring — single producer (NimBLE host task, onResult),
+// single consumer (sensor_ble_loop on the main task). Managed devices are
+// decoded in the callback and handed over here, so the per-packet path never
+// takes discovered_devices_mutex.
+// ============================================================================
+#define BLE_ADV_RING_SIZE 64  // must be power of 2
+
+struct BleAdvEvent {
+    uint8_t mac[6];
+    int16_t rssi;
+    uint32_t seen;            // millis()
+    float temp;
+    float hum;
+    uint8_t battery;
+    bool has_adv_data;
+    BLESensorType sensor_type;
+    char name[32];
+    char service_uuid[40];    // filled while probing and for GATT-only devices
+};
+
+static BleAdvEvent EXT_RAM_BSS_ATTR ble_adv_ring[BLE_ADV_RING_SIZE];
+static uint16_t ble_adv_ring_head = 0;   // written by producer
+static uint16_t ble_adv_ring_tail = 0;   // written by consumer
+
+static BleAdvEvent* ble_adv_ring_reserve() {
+    uint16_t head = __atomic_load_n(&ble_adv_ring_head, __ATOMIC_RELAXED);
+    uint16_t tail = __atomic_load_n(&ble_adv_ring_tail, __ATOMIC_ACQUIRE);
+    if ((uint16_t)(head - tail) >= BLE_ADV_RING_SIZE) {
+        ble_dbg_ring_drop = ble_dbg_ring_drop + 1;
+        return nullptr;
     }
-    return false;
+    return &ble_adv_ring[head & (BLE_ADV_RING_SIZE - 1)];
+}
+
+static void ble_adv_ring_commit() {
+    uint16_t head = __atomic_load_n(&ble_adv_ring_head, __ATOMIC_RELAXED);
+    __atomic_store_n(&ble_adv_ring_head, (uint16_t)(head + 1), __ATOMIC_RELEASE);
+}
+
+static bool ble_adv_ring_pop(BleAdvEvent* out) {
+    uint16_t tail = __atomic_load_n(&ble_adv_ring_tail, __ATOMIC_RELAXED);
+    uint16_t head = __atomic_load_n(&ble_adv_ring_head, __ATOMIC_ACQUIRE);
+    if (tail == head) return false;
+    memcpy(out, &ble_adv_ring[tail & (BLE_ADV_RING_SIZE - 1)], sizeof(BleAdvEvent));
+    __atomic_store_n(&ble_adv_ring_tail, (uint16_t)(tail + 1), __ATOMIC_RELEASE);
+    return true;
 }
 
 // ============================================================================
@@ -1106,9 +1367,13 @@ void BLESensor::pushAdvData(const char* mac_address, const BLEDeviceInfo* cached
     unsigned long time = os.now_tz();
     if (time < 100) return;  // Not yet initialized
 
-    SensorIterator it = sensors_iterate_begin();
-    SensorBase* sensor;
-    while ((sensor = sensors_iterate_next(it)) != NULL) {
+    // The MAC map already lists the sensors sharing this device
+    BleMacMap* map = ble_mac_map_get();
+    const BleMacEntry* entry = ble_mac_map_find(map, cached_dev->address);
+    if (!entry || entry->state != BLE_MAC_MANAGED) return;
+
+    for (uint16_t i = 0; i < entry->sensor_count; i++) {
+        SensorBase* sensor = sensor_by_nr(map->sensor_nrs[entry->sensor_first + i]);
         if (!sensor || sensor->type != SENSOR_BLE) continue;
         if (!sensor->flags.enable) continue;
         BLESensor* ble = static_cast<BLESensor*>(sensor);
@@ -1355,306 +1620,393 @@ const char* ble_uuid_to_name(const char* uuid) {
     return "Unknown";
 }
 
+// ============================================================================
+// Advertisement decoder table. The first packets of a managed MAC are probed
+// against every decoder; the one that matched is remembered in the MAC map so
+// later packets of that device call exactly one function.
+// ============================================================================
+struct BleAdvReading {
+    float temp;
+    float hum;
+    uint8_t battery;
+    BLESensorType type;
+    bool saw_ec88_service;
+    bool saw_govee_mfg;
+};
+
+typedef bool (*BleAdvDecodeFn)(BLEAdvertisedDevice& dev, const char* name, BleAdvReading* out);
+
+/** Govee values carried in manufacturer data (0xEC88 / 0x0001). */
+static bool ble_adv_decode_govee_mfg(BLEAdvertisedDevice& dev, const char* name, BleAdvReading* out) {
+    if (!dev.haveManufacturerData()) return false;
+    String mfg_data = dev.getManufacturerData();
+    if (mfg_data.length() < 2) return false;
+    // First 2 bytes are manufacturer ID (little-endian)
+    uint16_t mfg_id = (uint8_t)mfg_data[0] | ((uint8_t)mfg_data[1] << 8);
+    if (mfg_id == 0xec88 || mfg_id == 0x0001) {
+        out->saw_govee_mfg = true;
+    }
+    const uint8_t* payload = (const uint8_t*)mfg_data.c_str() + 2;
+    size_t payload_len = mfg_data.length() - 2;
+    return govee_decode_adv_data(mfg_id, payload, payload_len, name,
+                                 &out->temp, &out->hum, &out->battery, &out->type);
+}
+
 /**
- * @brief Callback class for BLE scan results
+ * Some Govee models expose current values in Service Data (UUID 0xEC88)
+ * while Manufacturer Data only carries Apple iBeacon (0x004C).
  */
-class MyAdvertisedDeviceCallbacks: public BLEAdvertisedDeviceCallbacks {
-    void onResult(BLEAdvertisedDevice advertisedDevice) {
-        ble_onresult_total = ble_onresult_total + 1;  // count every advertisement received
-        if (discovery_scan_active) {
-            ble_dbg_disc_onresult = ble_dbg_disc_onresult + 1;
+static bool ble_adv_decode_govee_svc(BLEAdvertisedDevice& dev, const char* name, BleAdvReading* out) {
+    if (!dev.haveServiceData()) return false;
+    int svc_count = dev.getServiceDataCount();
+    for (int i = 0; i < svc_count; i++) {
+        String svc_uuid_str = dev.getServiceDataUUID(i).toString().c_str();
+        uint16_t svc_uuid16 = 0;
+        if (!ble_uuid_extract_16bit(svc_uuid_str.c_str(), &svc_uuid16) || svc_uuid16 != 0xec88) {
+            continue;
         }
-        // Get device address (format: "aa:bb:cc:dd:ee:ff")
-        String addr_str = advertisedDevice.getAddress().toString();
-        uint8_t addr_bytes[6];
+        out->saw_ec88_service = true;
 
-        // Parse address string to bytes
-        if (sscanf(addr_str.c_str(), "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx",
-                   &addr_bytes[0], &addr_bytes[1], &addr_bytes[2],
-                   &addr_bytes[3], &addr_bytes[4], &addr_bytes[5]) != 6) {
-            return; // Invalid address format
+        String svc_data = dev.getServiceData(i);
+        size_t svc_len = svc_data.length();
+        if (svc_len == 0) {
+            continue;
         }
+        const uint8_t* svc_payload = (const uint8_t*)svc_data.c_str();
 
-        // Skip devices we have already decided to ignore, but NOT during a
-        // discovery scan – the user explicitly wants to see all nearby devices.
-        if (!discovery_scan_active && ble_ignore_contains(addr_bytes)) {
-            ble_dbg_disc_ignored = ble_dbg_disc_ignored + 1;
-            return;
+        // 1) Try direct decode first
+        if (govee_decode_adv_data(0xec88, svc_payload, svc_len, name,
+                                  &out->temp, &out->hum, &out->battery, &out->type)) {
+            return true;
         }
 
-        // Get device name
-        char device_name[32] = "Unknown";
-        if (advertisedDevice.haveName()) {
-            ble_sanitize_json_string(device_name, sizeof(device_name), advertisedDevice.getName().c_str());
-        }
-
-        // Try to decode Govee advertisement data
-        float adv_temp = 0, adv_hum = 0;
-        uint8_t adv_battery = 0;
-        BLESensorType sensor_type = BLE_TYPE_UNKNOWN;
-        bool has_adv_data = false;
-        bool saw_govee_mfg = false;
-        bool saw_ec88_service = false;
-
-        // Check for manufacturer data (where Govee sends sensor readings)
-        if (advertisedDevice.haveManufacturerData()) {
-            String mfg_data = advertisedDevice.getManufacturerData();
-            if (mfg_data.length() >= 2) {
-                // First 2 bytes are manufacturer ID (little-endian)
-                uint16_t mfg_id = (uint8_t)mfg_data[0] | ((uint8_t)mfg_data[1] << 8);
-                if (mfg_id == 0xec88 || mfg_id == 0x0001) {
-                    saw_govee_mfg = true;
+        // 2) Fallback for H5075-like payloads where service data contains
+        // extra leading bytes before the 6-byte Govee value block.
+        BLESensorType name_type = govee_detect_type_from_name(name);
+        if (name_type == BLE_TYPE_GOVEE_H5075 && svc_len >= 6) {
+            for (size_t off = 0; off + 6 <= svc_len && off < 10; off++) {
+                float t = 0, h = 0;
+                uint8_t b = 0;
+                if (govee_decode_h5075(svc_payload + off, 6, &t, &h, &b)) {
+                    // Plausibility bounds
+                    if (t > -40.0f && t < 85.0f && h >= 0.0f && h <= 100.0f) {
+                        out->temp = t;
+                        out->hum = h;
+                        out->battery = b;
+                        out->type = BLE_TYPE_GOVEE_H5075;
+                        return true;
+                    }
                 }
-                const uint8_t* payload = (const uint8_t*)mfg_data.c_str() + 2;
-                size_t payload_len = mfg_data.length() - 2;
-
+            }
+        }
+    }
+    return false;
+}
 
+/**
+ * Raw AD payload fallback: some stack versions don't always populate
+ * service-data vectors for 0x16, but ec88 bytes are still present in payload.
+ */
+static bool ble_adv_decode_govee_raw(BLEAdvertisedDevice& dev, const char* name, BleAdvReading* out) {
+    return ble_decode_raw_service_data_ec88(dev, name, &out->temp, &out->hum, &out->battery,
+                                            &out->type, &out->saw_ec88_service);
+}
 
-                has_adv_data = govee_decode_adv_data(mfg_id, payload, payload_len, device_name,
-                                                     &adv_temp, &adv_hum, &adv_battery, &sensor_type);
+/** GATT-only devices (BMS, Xiaomi, configured characteristic): nothing to decode. */
+static bool ble_adv_decode_none(BLEAdvertisedDevice&, const char*, BleAdvReading*) {
+    return false;
+}
 
+static const BleAdvDecodeFn ble_adv_decoders[BLE_DEC_COUNT] = {
+    nullptr,                    // BLE_DEC_PROBE
+    ble_adv_decode_govee_mfg,   // BLE_DEC_GOVEE_MFG
+    ble_adv_decode_govee_svc,   // BLE_DEC_GOVEE_SVC
+    ble_adv_decode_govee_raw,   // BLE_DEC_GOVEE_RAW
+    ble_adv_decode_none,        // BLE_DEC_NONE
+};
 
-            }
+/**
+ * @brief Try all value decoders in order
+ * @param decoder_out Output: id of the decoder that matched (BLE_DEC_*)
+ * @return true if advertisement values were decoded
+ */
+static bool ble_adv_decode_probe(BLEAdvertisedDevice& dev, const char* name, BleAdvReading* out, uint8_t* decoder_out) {
+    for (uint8_t d = BLE_DEC_GOVEE_MFG; d <= BLE_DEC_GOVEE_RAW; d++) {
+        if (ble_adv_decoders[d](dev, name, out)) {
+            if (decoder_out) *decoder_out = d;
+            return true;
         }
+    }
+    return false;
+}
 
-        // Some Govee models expose current values in Service Data (UUID 0xEC88)
-        // while Manufacturer Data only carries Apple iBeacon (0x004C).
-        if (!has_adv_data && advertisedDevice.haveServiceData()) {
-            int svc_count = advertisedDevice.getServiceDataCount();
-            for (int i = 0; i < svc_count && !has_adv_data; i++) {
-                String svc_uuid_str = advertisedDevice.getServiceDataUUID(i).toString().c_str();
-                uint16_t svc_uuid16 = 0;
-                if (!ble_uuid_extract_16bit(svc_uuid_str.c_str(), &svc_uuid16)) {
-                    continue;
-                }
-                if (svc_uuid16 == 0xec88) {
-                    saw_ec88_service = true;
-                }
+/**
+ * @brief Classify a device that could not be identified from its values
+ * Uses name, service UUID and Govee evidence; fills service_uuid_out.
+ */
+static BLESensorType ble_classify_device(BLEAdvertisedDevice& dev, const uint8_t* addr, const char* device_name,
+                                         const BleAdvReading* r, bool has_adv_data,
+                                         char* service_uuid_out, size_t service_uuid_len) {
+    BLESensorType sensor_type = r->type;
+    bool saw_ec88_service = r->saw_ec88_service;
 
-                String svc_data = advertisedDevice.getServiceData(i);
-                size_t svc_len = svc_data.length();
-                if (svc_len == 0) {
-                    continue;
-                }
+    // Also try to detect type from name if not yet detected
+    if (sensor_type == BLE_TYPE_UNKNOWN) {
+        sensor_type = govee_detect_type_from_name(device_name);
+    }
 
-                const uint8_t* svc_payload = (const uint8_t*)svc_data.c_str();
-
-                if (svc_uuid16 == 0xec88) {
-                    // 1) Try direct decode first
-                    has_adv_data = govee_decode_adv_data(0xec88, svc_payload, svc_len, device_name,
-                                                         &adv_temp, &adv_hum, &adv_battery, &sensor_type);
-
-                    // 2) Fallback for H5075-like payloads where service data contains
-                    // extra leading bytes before the 6-byte Govee value block.
-                    if (!has_adv_data) {
-                        BLESensorType name_type = govee_detect_type_from_name(device_name);
-                        if (name_type == BLE_TYPE_GOVEE_H5075 && svc_len >= 6) {
-                            for (size_t off = 0; off + 6 <= svc_len && off < 10 && !has_adv_data; off++) {
-                                float t = 0, h = 0;
-                                uint8_t b = 0;
-                                if (govee_decode_h5075(svc_payload + off, 6, &t, &h, &b)) {
-                                    // Plausibility bounds
-                                    if (t > -40.0f && t < 85.0f && h >= 0.0f && h <= 100.0f) {
-                                        adv_temp = t;
-                                        adv_hum = h;
-                                        adv_battery = b;
-                                        sensor_type = BLE_TYPE_GOVEE_H5075;
-                                        has_adv_data = true;
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
+    // Try to detect BMS from name if not yet detected
+    if (sensor_type == BLE_TYPE_UNKNOWN) {
+        sensor_type = bms_detect_type_from_name(device_name);
+    }
+
+    // Check service UUID for ec88 (Govee indicator) or ff00 (JBD BMS indicator)
+    if (dev.haveServiceUUID()) {
+        String svc = dev.getServiceUUID().toString();
+        strncpy(service_uuid_out, svc.c_str(), service_uuid_len - 1);
+
+        // ec88 is the Govee service UUID
+        if (svc.indexOf("ec88") >= 0 || svc.indexOf("EC88") >= 0) {
+            saw_ec88_service = true;
+            if (sensor_type == BLE_TYPE_UNKNOWN) {
+                sensor_type = BLE_TYPE_GOVEE_H5075; // Default Govee type
             }
         }
 
-        // Raw AD payload fallback: some stack versions don't always populate
-        // service-data vectors for 0x16, but ec88 bytes are still present in payload.
-        if (!has_adv_data) {
-            has_adv_data = ble_decode_raw_service_data_ec88(advertisedDevice, device_name,
-                                                            &adv_temp, &adv_hum, &adv_battery,
-                                                            &sensor_type, &saw_ec88_service);
+        // ff00 is the JBD BMS service UUID
+        if (svc.indexOf("ff00") >= 0 || svc.indexOf("FF00") >= 0) {
+            if (sensor_type == BLE_TYPE_UNKNOWN) {
+                sensor_type = BLE_TYPE_BMS_JBD;
+            }
         }
+    }
 
-        // Also try to detect type from name if not yet detected
-        if (sensor_type == BLE_TYPE_UNKNOWN) {
-            sensor_type = govee_detect_type_from_name(device_name);
+    // Guard against false positives from corrupted/partial names.
+    // A name-only Govee match is accepted only with additional evidence.
+    if (!has_adv_data && ble_is_govee_type(sensor_type)) {
+        bool has_govee_evidence = saw_ec88_service || r->saw_govee_mfg || ble_addr_is_known_govee(addr);
+        if (!has_govee_evidence) {
+            // Don't trust the Govee type detection, but still keep device in list
+            sensor_type = BLE_TYPE_UNKNOWN;
         }
+    }
 
-        // Try to detect BMS from name if not yet detected
-        if (sensor_type == BLE_TYPE_UNKNOWN) {
-            sensor_type = bms_detect_type_from_name(device_name);
+    // Classify devices with known sensor patterns for auto-detection,
+    // but keep ALL devices in the discovery list so the user can see them.
+    if (sensor_type == BLE_TYPE_UNKNOWN && !has_adv_data) {
+        // Check if name looks like a sensor — if so, mark for GATT read
+        if (strstr(device_name, "GVH") != nullptr ||
+            strstr(device_name, "Govee") != nullptr ||
+            strstr(device_name, "LYWSD") != nullptr ||
+            strstr(device_name, "MJ_HT") != nullptr ||
+            strstr(device_name, "ATC_") != nullptr ||
+            strstr(device_name, "Temp") != nullptr ||
+            strstr(device_name, "Thermo") != nullptr ||
+            // BMS patterns
+            strstr(device_name, "BMS") != nullptr ||
+            strstr(device_name, "xiaoxiang") != nullptr ||
+            strstr(device_name, "JBD") != nullptr ||
+            strstr(device_name, "DL-") != nullptr ||
+            strstr(device_name, "JK-") != nullptr ||
+            strstr(device_name, "ANT-") != nullptr ||
+            strstr(device_name, "SP0") != nullptr ||
+            strstr(device_name, "SP1") != nullptr) {
+            sensor_type = BLE_TYPE_GENERIC_GATT; // Mark as generic for later GATT read
         }
+    }
+    return sensor_type;
+}
 
-        // Check service UUID for ec88 (Govee indicator) or ff00 (JBD BMS indicator)
-        char service_uuid_str[40] = {0};
-        if (advertisedDevice.haveServiceUUID()) {
-            String svc = advertisedDevice.getServiceUUID().toString();
-            strncpy(service_uuid_str, svc.c_str(), sizeof(service_uuid_str) - 1);
+/**
+ * @brief Merge one advertisement into the discovered device list
+ * Caller must hold discovered_devices_lock().
+ */
+static void ble_discovered_upsert(const BleAdvEvent& ev) {
+    BLEDeviceInfo* existing_device = nullptr;
+    for (auto& dev : discovered_ble_devices) {
+        if (memcmp(dev.address, ev.mac, 6) == 0) {
+            existing_device = &dev;
+            break;
+        }
+    }
 
-            // ec88 is the Govee service UUID
-            if (svc.indexOf("ec88") >= 0 || svc.indexOf("EC88") >= 0) {
-                saw_ec88_service = true;
-                if (sensor_type == BLE_TYPE_UNKNOWN) {
-                    sensor_type = BLE_TYPE_GOVEE_H5075; // Default Govee type
-                }
-            }
-
-            // ff00 is the JBD BMS service UUID
-            if (svc.indexOf("ff00") >= 0 || svc.indexOf("FF00") >= 0) {
-                if (sensor_type == BLE_TYPE_UNKNOWN) {
-                    sensor_type = BLE_TYPE_BMS_JBD;
-                }
-            }
+    if (existing_device) {
+        ble_dbg_disc_updated = ble_dbg_disc_updated + 1;
+        // Update existing device
+        existing_device->rssi = ev.rssi;
+        existing_device->last_seen = ev.seen;
+        existing_device->is_new = true;
 
+        strncpy(existing_device->name, ev.name, sizeof(existing_device->name) - 1);
 
+        if (ev.service_uuid[0]) {
+            strncpy(existing_device->service_uuid, ev.service_uuid, sizeof(existing_device->service_uuid) - 1);
         }
 
-        // Guard against false positives from corrupted/partial names.
-        // A name-only Govee match is accepted only with additional evidence.
-        if (!has_adv_data && ble_is_govee_type(sensor_type)) {
-            bool has_govee_evidence = saw_ec88_service || saw_govee_mfg || ble_addr_is_known_govee(addr_bytes);
-            if (!has_govee_evidence) {
-                // Don't trust the Govee type detection, but still keep device in list
-                sensor_type = BLE_TYPE_UNKNOWN;
-            }
+        // Update sensor data if available
+        if (ev.has_adv_data) {
+            existing_device->adv_temperature = ev.temp;
+            existing_device->adv_humidity = ev.hum;
+            existing_device->adv_battery = ev.battery;
+            existing_device->has_adv_data = true;
+            existing_device->adv_data_pending_push = true;
         }
+        if (ev.sensor_type != BLE_TYPE_UNKNOWN) {
+            existing_device->sensor_type = ev.sensor_type;
+        }
+        return;
+    }
 
-        // Classify devices with known sensor patterns for auto-detection,
-        // but keep ALL devices in the discovery list so the user can see them.
-        if (sensor_type == BLE_TYPE_UNKNOWN && !has_adv_data) {
-            // Check if name looks like a sensor — if so, mark for GATT read
-            if (strstr(device_name, "GVH") != nullptr ||
-                strstr(device_name, "Govee") != nullptr ||
-                strstr(device_name, "LYWSD") != nullptr ||
-                strstr(device_name, "MJ_HT") != nullptr ||
-                strstr(device_name, "ATC_") != nullptr ||
-                strstr(device_name, "Temp") != nullptr ||
-                strstr(device_name, "Thermo") != nullptr ||
-                // BMS patterns
-                strstr(device_name, "BMS") != nullptr ||
-                strstr(device_name, "xiaoxiang") != nullptr ||
-                strstr(device_name, "JBD") != nullptr ||
-                strstr(device_name, "DL-") != nullptr ||
-                strstr(device_name, "JK-") != nullptr ||
-                strstr(device_name, "ANT-") != nullptr ||
-                strstr(device_name, "SP0") != nullptr ||
-                strstr(device_name, "SP1") != nullptr) {
-                sensor_type = BLE_TYPE_GENERIC_GATT; // Mark as generic for later GATT read
+    ble_dbg_disc_added = ble_dbg_disc_added + 1;
+    // Add new device
+    BLEDeviceInfo new_dev;
+    memset(&new_dev, 0, sizeof(new_dev));
+    memcpy(new_dev.address, ev.mac, 6);
+    strncpy(new_dev.name, ev.name, sizeof(new_dev.name) - 1);
+
+    new_dev.rssi = ev.rssi;
+    new_dev.is_new = true;
+    new_dev.last_seen = ev.seen;
+
+    if (ev.service_uuid[0]) {
+        strncpy(new_dev.service_uuid, ev.service_uuid, sizeof(new_dev.service_uuid) - 1);
+    }
+
+    new_dev.sensor_type = ev.sensor_type;
+    new_dev.adv_temperature = ev.temp;
+    new_dev.adv_humidity = ev.hum;
+    new_dev.adv_battery = ev.battery;
+    new_dev.has_adv_data = ev.has_adv_data;
+    new_dev.adv_data_pending_push = ev.has_adv_data;
+
+    if (discovered_ble_devices.size() >= BLE_DISCOVERED_MAX) {
+        size_t oldest_idx = 0;
+        uint32_t oldest_seen = discovered_ble_devices[0].last_seen;
+        for (size_t i = 1; i < discovered_ble_devices.size(); i++) {
+            if (discovered_ble_devices[i].last_seen < oldest_seen) {
+                oldest_seen = discovered_ble_devices[i].last_seen;
+                oldest_idx = i;
             }
         }
+        discovered_ble_devices.erase(discovered_ble_devices.begin() + oldest_idx);
+    }
 
-        // Check if device already exists in list
-        if (!discovered_devices_lock(0)) {
-            ble_dbg_disc_lock_miss = ble_dbg_disc_lock_miss + 1;
-            return; // skip if vector is busy
+    discovered_ble_devices.push_back(new_dev);
+
+    // Queue DIS query only for likely GATT devices; skip for advertisement-only
+    // sensors (Govee/Xiaomi) and unknown devices (phones, headphones, etc.)
+    // to avoid unnecessary connect/disconnect churn.
+    if (new_dev.sensor_type != BLE_TYPE_UNKNOWN && !sensor_ble_is_adv_sensor(&new_dev)) {
+        char mac_str[18];
+        MAC_TO_STRING(mac_str, ev.mac);
+        ble_queue_dis_query(mac_str);
+    }
+
+    DEBUG_PRINTF("[BLE] New device: %s [%02X:%02X:%02X:%02X:%02X:%02X] type=%d rssi=%d\n",
+                 ev.name,
+                 ev.mac[0], ev.mac[1], ev.mac[2],
+                 ev.mac[3], ev.mac[4], ev.mac[5],
+                 (int)ev.sensor_type, (int)ev.rssi);
+}
+
+/**
+ * @brief Callback class for BLE scan results
+ *
+ * Outside a discovery scan only managed and listed MACs are processed: one
+ * hash lookup rejects everything else, the stored decoder decodes the packet and the
+ * result is queued for sensor_ble_loop() without taking any lock.
+ * During a user discovery scan every device is probed and merged into the
+ * discovered list directly.
+ */
+class MyAdvertisedDeviceCallbacks: public BLEAdvertisedDeviceCallbacks {
+    void onResult(BLEAdvertisedDevice advertisedDevice) {
+        ble_onresult_total = ble_onresult_total + 1;  // count every advertisement received
+        const bool discovery = discovery_scan_active;  // stable for this packet
+        if (discovery) {
+            ble_dbg_disc_onresult = ble_dbg_disc_onresult + 1;
         }
-        bool already_exists = false;
-        BLEDeviceInfo* existing_device = nullptr;
-        for (auto& dev : discovered_ble_devices) {
-            if (memcmp(dev.address, addr_bytes, 6) == 0) {
-                already_exists = true;
-                existing_device = &dev;
-                break;
-            }
+        // Get device address (format: "aa:bb:cc:dd:ee:ff")
+        String addr_str = advertisedDevice.getAddress().toString();
+        uint8_t addr_bytes[6];
+        if (!ble_parse_mac(addr_str.c_str(), addr_bytes)) {
+            return; // Invalid address format
         }
 
-        // Filter: outside discovery scan, only accept managed (configured) devices
-        if (!already_exists && !discovery_scan_active) {
-            if (!ble_is_managed_mac(addr_bytes)) {
-                discovered_devices_unlock();
-                ble_ignore_insert(addr_bytes); // suppress future log output
+        BleMacMapReader reader;  // keeps the table alive until we return
+        BleMacMap* map = reader.map;
+        BleMacEntry* entry = ble_mac_map_find(map, addr_bytes);
+        // managed devices and the ones already in the discovered list
+        bool tracked = entry && (entry->state == BLE_MAC_MANAGED || entry->state == BLE_MAC_LISTED);
+
+        if (!discovery && !tracked) {
+            if (entry) {
+                ble_dbg_disc_ignored = ble_dbg_disc_ignored + 1;
+            } else {
+                ble_mac_map_ignore(map, addr_bytes); // suppress future processing
                 ble_dbg_disc_unmanaged_skip = ble_dbg_disc_unmanaged_skip + 1;
-                return; // not a configured sensor – ignore during background scan
             }
+            return; // not a configured sensor – ignore during background scan
         }
 
-        if (already_exists) {
-            ble_dbg_disc_updated = ble_dbg_disc_updated + 1;
-            // Update existing device
-            existing_device->rssi = advertisedDevice.getRSSI();
-            existing_device->last_seen = millis();
-            existing_device->is_new = true;
-
-            strncpy(existing_device->name, device_name, sizeof(existing_device->name) - 1);
+        BleAdvEvent ev_local;
+        BleAdvEvent* ev = discovery ? &ev_local : ble_adv_ring_reserve();
+        if (!ev) return; // main loop is behind, drop this packet
+        memset(ev, 0, sizeof(BleAdvEvent));
+        memcpy(ev->mac, addr_bytes, 6);
+        ev->rssi = advertisedDevice.getRSSI();
+        ev->seen = millis();
 
-            if (service_uuid_str[0]) {
-                strncpy(existing_device->service_uuid, service_uuid_str, sizeof(existing_device->service_uuid) - 1);
-            }
-
-            // Update sensor data if available
-            if (has_adv_data) {
-                existing_device->adv_temperature = adv_temp;
-                existing_device->adv_humidity = adv_hum;
-                existing_device->adv_battery = adv_battery;
-                existing_device->has_adv_data = true;
-                existing_device->adv_data_pending_push = true;
-            }
-            if (sensor_type != BLE_TYPE_UNKNOWN) {
-                existing_device->sensor_type = sensor_type;
-            }
-
-            if (has_adv_data) {
-                DEBUG_PRINTF("[BLE] %s: T=%.1fC H=%.1f%% Bat=%d%%\n",
-                             device_name, adv_temp, adv_hum, adv_battery);
+        // Get device name
+        strcpy(ev->name, "Unknown");
+        if (advertisedDevice.haveName()) {
+            ble_sanitize_json_string(ev->name, sizeof(ev->name), advertisedDevice.getName().c_str());
+        }
+
+        BleAdvReading r;
+        memset(&r, 0, sizeof(r));
+        uint8_t decoder = tracked ? entry->decoder : BLE_DEC_PROBE;
+        bool has_adv_data;
+        if (decoder == BLE_DEC_PROBE || decoder >= BLE_DEC_COUNT) {
+            uint8_t picked = BLE_DEC_PROBE;
+            has_adv_data = ble_adv_decode_probe(advertisedDevice, ev->name, &r, &picked);
+            BLESensorType type = ble_classify_device(advertisedDevice, addr_bytes, ev->name, &r, has_adv_data,
+                                                     ev->service_uuid, sizeof(ev->service_uuid));
+            ev->sensor_type = type;
+            if (tracked) {
+                if (has_adv_data) entry->decoder = picked;
+                else if (sensor_ble_is_bms_type(type) || type == BLE_TYPE_XIAOMI) entry->decoder = BLE_DEC_NONE;
             }
+        } else if (decoder == BLE_DEC_NONE) {
+            // GATT-only: nothing to decode, but BMS detection in read() and the
+            // discovered list still need the type and service UUID
+            has_adv_data = false;
+            ev->sensor_type = ble_classify_device(advertisedDevice, addr_bytes, ev->name, &r, false,
+                                                  ev->service_uuid, sizeof(ev->service_uuid));
         } else {
-            ble_dbg_disc_added = ble_dbg_disc_added + 1;
-            // Add new device
-            BLEDeviceInfo new_dev;
-            memset(&new_dev, 0, sizeof(new_dev));
-            memcpy(new_dev.address, addr_bytes, 6);
-            strncpy(new_dev.name, device_name, sizeof(new_dev.name) - 1);
-
-            new_dev.rssi = advertisedDevice.getRSSI();
-            new_dev.is_new = true;
-            new_dev.last_seen = millis();
-
-            if (service_uuid_str[0]) {
-                strncpy(new_dev.service_uuid, service_uuid_str, sizeof(new_dev.service_uuid) - 1);
-            }
+            has_adv_data = ble_adv_decoders[decoder](advertisedDevice, ev->name, &r);
+            ev->sensor_type = has_adv_data ? r.type : BLE_TYPE_UNKNOWN;
+        }
 
-            new_dev.sensor_type = sensor_type;
-            new_dev.adv_temperature = adv_temp;
-            new_dev.adv_humidity = adv_hum;
-            new_dev.adv_battery = adv_battery;
-            new_dev.has_adv_data = has_adv_data;
-            new_dev.adv_data_pending_push = has_adv_data;
-
-            if (discovered_ble_devices.size() >= BLE_DISCOVERED_MAX) {
-                size_t oldest_idx = 0;
-                uint32_t oldest_seen = discovered_ble_devices[0].last_seen;
-                for (size_t i = 1; i < discovered_ble_devices.size(); i++) {
-                    if (discovered_ble_devices[i].last_seen < oldest_seen) {
-                        oldest_seen = discovered_ble_devices[i].last_seen;
-                        oldest_idx = i;
-                    }
-                }
-                discovered_ble_devices.erase(discovered_ble_devices.begin() + oldest_idx);
-            }
+        ev->has_adv_data = has_adv_data;
+        ev->temp = r.temp;
+        ev->hum = r.hum;
+        ev->battery = r.battery;
 
-            discovered_ble_devices.push_back(new_dev);
+        if (has_adv_data) {
+            DEBUG_PRINTF("[BLE] %s: T=%.1fC H=%.1f%% Bat=%d%%\n",
+                         ev->name, r.temp, r.hum, r.battery);
+        }
 
-            // Queue DIS query only for likely GATT devices; skip for advertisement-only
-            // sensors (Govee/Xiaomi) and unknown devices (phones, headphones, etc.)
-            // to avoid unnecessary connect/disconnect churn.
-            if (new_dev.sensor_type != BLE_TYPE_UNKNOWN && !sensor_ble_is_adv_sensor(&new_dev)) {
-                char mac_str[18];
-                MAC_TO_STRING(mac_str, addr_bytes);
-                ble_queue_dis_query(mac_str);
-            }
+        if (!discovery) {
+            ble_adv_ring_commit();
+            return;
+        }
 
-            // DEBUG_PRINT("New BLE sensor added: ");
-            // DEBUG_PRINT(new_dev.name);
-            // DEBUG_PRINT(" type=");
-            // DEBUG_PRINTLN((int)sensor_type);
-            DEBUG_PRINTF("[BLE] New device: %s [%02X:%02X:%02X:%02X:%02X:%02X] type=%d rssi=%d\n",
-                         device_name,
-                         addr_bytes[0], addr_bytes[1], addr_bytes[2],
-                         addr_bytes[3], addr_bytes[4], addr_bytes[5],
-                         (int)sensor_type, (int)advertisedDevice.getRSSI());
+        if (!discovered_devices_lock(0)) {
+            ble_dbg_disc_lock_miss = ble_dbg_disc_lock_miss + 1;
+            return; // skip if vector is busy
         }
+        ble_discovered_upsert(ev_local);
         discovered_devices_unlock();
     }
 };
@@ -1834,9 +2186,10 @@ void sensor_ble_start_scan(uint16_t duration, bool passive) {
 
     pBLEScan->clearResults();
 
-    // Clear ignore table so discovery scan can see all devices
-    uint16_t ignore_before = ble_ignore_count();
-    memset(ble_ignore_table, 0, sizeof(ble_ignore_table));
+    // Start a fresh ignore set so discovery scan can see all devices
+    BleMacMap* map_before = ble_mac_map_get();
+    uint32_t ignore_before = map_before ? map_before->ignored : 0;
+    ble_refresh_managed_macs(true);
 
     // Reset discovery debug counters for this scan session
     ble_dbg_disc_onresult = 0;
@@ -1887,15 +2240,25 @@ void sensor_ble_loop() {
         last_list_log = now;
         // DEBUG_PRINTF("[BLE] Lists: discovered=%u ignore=%u dis_queue=%u\n",
                      // (unsigned)discovered_ble_devices.size(),
-                     // (unsigned)ble_ignore_count(),
+                     // (unsigned)(ble_mac_map_get() ? ble_mac_map_get()->ignored : 0),
                      // (unsigned)ble_dis_query_queue.size());
     }
 
-    // Periodically refresh the managed-MAC cache for onResult filtering
+    // Periodically refresh the MAC map for onResult filtering
     if ((int32_t)(now - managed_ble_mac_refresh_at) >= 0) {
         ble_refresh_managed_macs();
     }
 
+    // Drain advertisements queued by onResult (one lock per batch, not per packet)
+    if (__atomic_load_n(&ble_adv_ring_head, __ATOMIC_ACQUIRE) != ble_adv_ring_tail &&
+        discovered_devices_lock(100)) {
+        BleAdvEvent ev;
+        while (ble_adv_ring_pop(&ev)) {
+            ble_discovered_upsert(ev);
+        }
+        discovered_devices_unlock();
+    }
+
     // Safety: if bg_scan_active is stuck true but NimBLE reports no active scan
     // (happens when WiFi.mode(WIFI_OFF) or Zigbee.begin() disrupts an infinite
     // NimBLE scan before the completion callback fires), clear the stale flag.
@@ -2016,7 +2379,8 @@ int sensor_ble_discovered_count() {
 }
 
 int sensor_ble_managed_count() {
-    return managed_ble_mac_count;
+    BleMacMap* map = ble_mac_map_get();
+    return map ? (int)map->managed : 0;
 }
 
 int sensor_ble_onresult_total() {
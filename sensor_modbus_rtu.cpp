@@ -27,15 +27,314 @@
 
 extern OpenSprinkler os;
 
-// modbus transaction id
-static uint16_t modbusTcpId = 0;
 #if defined(OSPI)
 #include <modbus/modbus.h>
 #include "sensor_usbrs485.h"
 #endif
 
+/*
+ * Modbus TCP gateway pool
+ *
+ * Sockets to each gateway (ip:port) stay open between reads. When a sensor
+ * behind a gateway needs a value, one batch asks every unit on that gateway
+ * for the registers its enabled sensors use: adjacent registers of a unit
+ * are merged into one "read holding registers" request, and up to
+ * MODBUS_PIPELINE_DEPTH requests are in flight at once, matched back by
+ * transaction id. The other sensors of the gateway then take their value
+ * from that batch instead of opening their own connection.
+ */
+#if defined(ESP8266)
+  #define MODBUS_POOL_SIZE       2
+#elif defined(ESP32)
+  #define MODBUS_POOL_SIZE       4
+#else
+  #define MODBUS_POOL_SIZE       8
+#endif
+#define MODBUS_MAX_UNITS         8      // units batched per gateway
+#define MODBUS_MAX_REGS          4      // registers per merged unit request
+#define MODBUS_PIPELINE_DEPTH    4      // requests in flight per gateway
+#define MODBUS_BATCH_TTL_MS      5000   // batch results are shared this long
+#define MODBUS_IDLE_CLOSE_MS     300000 // close gateway sockets unused this long
+
+#if defined(ESP8266) || defined(ESP32)
+  typedef WiFiClient ModbusClient;
+#else
+  typedef EthernetClient ModbusClient;
+#endif
+
+struct ModbusUnitBatch {
+  uint8_t unit;
+  uint8_t first;       // first register of the merged request
+  uint8_t count;
+  int8_t status;       // HTTP_RQT_* of the last batch
+  uint16_t tid;        // transaction id of the outstanding request
+  uint16_t regs[MODBUS_MAX_REGS];
+};
+
+struct ModbusGateway {
+  uint32_t ip;
+  uint16_t port;
+  ModbusClient *client;
+  ulong last_used;
+  ulong batch_time;
+  uint8_t nunits;
+  ModbusUnitBatch units[MODBUS_MAX_UNITS];
+};
+
+// modbus transaction id
+static uint16_t modbusTcpId = 0;
+static ModbusGateway *modbus_pool[MODBUS_POOL_SIZE];
+
+static uint16_t modbus_next_tid() {
+  if (modbusTcpId >= 0xFFFE)
+    modbusTcpId = 1;
+  else
+    modbusTcpId++;
+  return modbusTcpId;
+}
+
+static void modbus_gateway_close(ModbusGateway *gw) {
+  if (gw->client) {
+    gw->client->stop();
+    delete gw->client;
+    gw->client = NULL;
+  }
+}
+
 void sensor_modbus_rtu_free() {
-    modbusTcpId = 0;
+  for (int i = 0; i < MODBUS_POOL_SIZE; i++) {
+    if (!modbus_pool[i]) continue;
+    modbus_gateway_close(modbus_pool[i]);
+    delete modbus_pool[i];
+    modbus_pool[i] = NULL;
+  }
+  modbusTcpId = 0;
+}
+
+static bool modbus_is_truebner(uint type) {
+  return type == SENSOR_SMT100_MOIS || type == SENSOR_SMT100_TEMP || type == SENSOR_SMT100_PMTY ||
+         type == SENSOR_TH100_MOIS || type == SENSOR_TH100_TEMP;
+}
+
+// holding register with the reading of a Truebner SMT100/TH100 sensor type
+static uint8_t modbus_truebner_reg(uint type) {
+  if (type == SENSOR_SMT100_TEMP || type == SENSOR_TH100_TEMP) return 0x00;
+  if (type == SENSOR_SMT100_MOIS || type == SENSOR_TH100_MOIS) return 0x01;
+  return 0x02;
+}
+
+/** Find the pooled gateway for ip:port, replacing the least recently used one if needed */
+static ModbusGateway *modbus_gateway_get(uint32_t ip, uint16_t port) {
+  int free_slot = -1, lru = -1;
+  ulong now = millis();
+  for (int i = 0; i < MODBUS_POOL_SIZE; i++) {
+    ModbusGateway *gw = modbus_pool[i];
+    if (!gw) { if (free_slot < 0) free_slot = i; continue; }
+    if (gw->ip == ip && gw->port == port) return gw;
+    if (gw->client && now - gw->last_used > MODBUS_IDLE_CLOSE_MS) modbus_gateway_close(gw);
+    if (lru < 0 || (long)(gw->last_used - modbus_pool[lru]->last_used) < 0) lru = i;
+  }
+  if (free_slot < 0) {
+    free_slot = lru;
+    modbus_gateway_close(modbus_pool[lru]);
+    delete modbus_pool[lru];
+    modbus_pool[lru] = NULL;
+  }
+  ModbusGateway *gw = new ModbusGateway();
+  if (!gw) return NULL;
+  memset(gw, 0, sizeof(ModbusGateway));
+  gw->ip = ip;
+  gw->port = port;
+  gw->last_used = now;
+  modbus_pool[free_slot] = gw;
+  return gw;
+}
+
+static bool modbus_gateway_connect(ModbusGateway *gw) {
+  gw->last_used = millis();
+  if (gw->client && gw->client->connected()) {
+    // discard late replies to requests that timed out earlier
+    uint8_t junk[32];
+    while (gw->client->available() > 0) {
+      if (gw->client->read(junk, sizeof(junk)) <= 0) break;
+    }
+    return true;
+  }
+  modbus_gateway_close(gw);
+  gw->client = new ModbusClient();
+  if (!gw->client) return false;
+  unsigned char ipbytes[4];
+  IP4_EXTRACT_BYTES(ipbytes, gw->ip);
+  char server[20];
+  sprintf(server, "%d.%d.%d.%d", ipbytes[0], ipbytes[1], ipbytes[2], ipbytes[3]);
+  gw->client->setTimeout(200);
+  if (!gw->client->connect(server, gw->port)) {
+    DEBUG_PRINT(server);
+    DEBUG_PRINT(":");
+    DEBUG_PRINT(gw->port);
+    DEBUG_PRINT(" ");
+    DEBUG_PRINTLN(F("failed."));
+    modbus_gateway_close(gw);
+    return false;
+  }
+  return true;
+}
+
+static size_t modbus_frame(uint8_t *buffer, uint16_t tid, uint8_t unit, uint8_t fc, uint16_t reg, uint16_t data) {
+  buffer[0] = (0xFF00 & tid) >> 8;
+  buffer[1] = (0x00FF & tid);
+  buffer[2] = 0;
+  buffer[3] = 0;
+  buffer[4] = 0;
+  buffer[5] = 6;  // len
+  buffer[6] = unit;  // Modbus ID
+  buffer[7] = fc;
+  buffer[8] = (reg >> 8) & 0xFF;
+  buffer[9] = reg & 0xFF;
+  buffer[10] = (data >> 8) & 0xFF;
+  buffer[11] = data & 0xFF;
+  return 12;
+}
+
+static void modbus_send_read(ModbusGateway *gw, ModbusUnitBatch &u) {
+  uint8_t buffer[12];
+  u.tid = modbus_next_tid();
+  u.status = HTTP_RQT_PENDING;
+  gw->client->write(buffer, modbus_frame(buffer, u.tid, u.unit, 0x03, u.first, u.count));
+#if defined(ESP8266) || defined(ESP32)
+  gw->client->flush();
+#endif
+}
+
+/** Take one complete response frame (MBAP header + PDU) and store it in its unit;
+ *  false if no pending unit was waiting for it (late reply, stray write echo) */
+static bool modbus_take_response(ModbusGateway *gw, const uint8_t *f, size_t len) {
+  uint16_t tid = (f[0] << 8) | f[1];
+  for (uint8_t i = 0; i < gw->nunits; i++) {
+    ModbusUnitBatch &u = gw->units[i];
+    if (u.status != HTTP_RQT_PENDING || u.tid != tid) continue;
+    if (f[6] != u.unit && u.unit != 253) {  // 253 is broadcast
+      u.status = HTTP_RQT_NOT_RECEIVED;
+    } else if (f[7] != 0x03 || len < 9 || f[8] != u.count * 2 || len < (size_t)(9 + f[8])) {
+      u.status = HTTP_RQT_NOT_RECEIVED;  // exception or malformed reply
+    } else {
+      for (uint8_t r = 0; r < u.count; r++) u.regs[r] = (f[9 + r*2] << 8) | f[10 + r*2];
+      u.status = HTTP_RQT_SUCCESS;
+    }
+    return true;
+  }
+  return false;
+}
+
+static void modbus_plan_add(ModbusGateway *gw, uint8_t unit, uint8_t reg) {
+  ModbusUnitBatch *u = NULL;
+  for (uint8_t i = 0; i < gw->nunits; i++) {
+    if (gw->units[i].unit == unit) { u = &gw->units[i]; break; }
+  }
+  if (!u) {
+    if (gw->nunits >= MODBUS_MAX_UNITS) return;
+    u = &gw->units[gw->nunits++];
+    u->unit = unit;
+    u->first = reg;
+    u->count = 1;
+    return;
+  }
+  uint8_t last = u->first + u->count - 1;
+  if (reg > last) last = reg;
+  if (reg < u->first) u->first = reg;
+  if (last - u->first + 1 <= MODBUS_MAX_REGS) u->count = last - u->first + 1;
+}
+
+/** Collect the units and registers used by all enabled sensors on this gateway,
+ *  starting with the register that is asked for so it always fits */
+static void modbus_gateway_plan(ModbusGateway *gw, uint8_t unit, uint8_t reg) {
+  gw->nunits = 0;
+  modbus_plan_add(gw, unit, reg);
+  SensorIterator it = sensors_iterate_begin();
+  SensorBase *sensor;
+  while ((sensor = sensors_iterate_next(it)) != NULL) {
+    if (sensor->ip != gw->ip || sensor->port != gw->port) continue;
+    if (!sensor->flags.enable || !modbus_is_truebner(sensor->type)) continue;
+    modbus_plan_add(gw, sensor->id, modbus_truebner_reg(sensor->type));
+  }
+}
+
+/** Run one batch over the gateway: pipelined requests, responses matched by transaction id */
+static void modbus_gateway_poll(ModbusGateway *gw, uint8_t unit, uint8_t reg) {
+  modbus_gateway_plan(gw, unit, reg);
+  gw->batch_time = millis();
+  if (!modbus_gateway_connect(gw)) {
+    for (uint8_t i = 0; i < gw->nunits; i++) gw->units[i].status = HTTP_RQT_TIMEOUT;
+    return;
+  }
+
+  uint8_t next = 0, inflight = 0;
+  for (uint8_t i = 0; i < gw->nunits; i++) gw->units[i].status = HTTP_RQT_STALE;
+  while (next < gw->nunits && inflight < MODBUS_PIPELINE_DEPTH) {
+    modbus_send_read(gw, gw->units[next++]);
+    inflight++;
+  }
+
+  uint8_t rx[9 + MODBUS_MAX_REGS * 2 + 16];
+  size_t rxlen = 0;
+  uint32_t stoptime = millis() + SENSOR_READ_TIMEOUT;
+  while (inflight > 0) {
+    int n = 0;
+    if (gw->client->available() > 0) n = gw->client->read(rx + rxlen, sizeof(rx) - rxlen);
+    if (n <= 0) {
+      if (!gw->client->connected() || (long)(millis() - stoptime) >= 0) break;
+      delay(5);
+      continue;
+    }
+    rxlen += n;
+    while (rxlen >= 7) {
+      size_t flen = 6 + ((rx[4] << 8) | rx[5]);
+      if (flen < 8 || flen > sizeof(rx)) { rxlen = 0; inflight = 0; break; }  // out of sync
+      if (rxlen < flen) break;
+      bool matched = modbus_take_response(gw, rx, flen);
+      memmove(rx, rx + flen, rxlen - flen);
+      rxlen -= flen;
+      if (!matched) continue;  // not one of ours, the pipeline is unchanged
+      if (inflight) inflight--;
+      if (next < gw->nunits) {
+        modbus_send_read(gw, gw->units[next++]);
+        inflight++;
+      }
+      stoptime = millis() + SENSOR_READ_TIMEOUT;
+    }
+  }
+
+  bool lost = false;
+  for (uint8_t i = 0; i < gw->nunits; i++) {
+    ModbusUnitBatch &u = gw->units[i];
+    if (u.status == HTTP_RQT_PENDING || u.status == HTTP_RQT_STALE) {
+      u.status = HTTP_RQT_TIMEOUT;
+      lost = true;
+    }
+  }
+  // a reply stream we could not follow cannot be resynchronized, start over
+  if (lost && rxlen) modbus_gateway_close(gw);
+  gw->last_used = millis();
+}
+
+/** Read one holding register, sharing batches with the gateway's other sensors */
+static int modbus_pool_read(uint32_t ip, uint16_t port, uint8_t unit, uint8_t reg, uint16_t *value) {
+  ModbusGateway *gw = modbus_gateway_get(ip, port);
+  if (!gw) return HTTP_RQT_CONNECT_ERR;
+  for (int pass = 0; pass < 2; pass++) {
+    bool fresh = gw->batch_time && millis() - gw->batch_time < MODBUS_BATCH_TTL_MS;
+    if (fresh) {
+      for (uint8_t i = 0; i < gw->nunits; i++) {
+        ModbusUnitBatch &u = gw->units[i];
+        if (u.unit != unit || reg < u.first || reg >= u.first + u.count) continue;
+        if (u.status != HTTP_RQT_SUCCESS) return u.status;
+        *value = u.regs[reg - u.first];
+        return HTTP_RQT_SUCCESS;
+      }
+    }
+    if (pass == 0) modbus_gateway_poll(gw, unit, reg);
+  }
+  return HTTP_RQT_NOT_RECEIVED;
 }
 
 // Implementations for ModbusRtuSensor declared in header
@@ -45,154 +344,46 @@ int ModbusRtuSensor::read(unsigned long time) {
       flags.enable = false;
       return HTTP_RQT_CONNECT_ERR;
     }
-
-#if defined(ARDUINO)
-    Client *client;
-  #if defined(ESP8266) || defined(ESP32)
-    WiFiClient wifiClient;
-    client = &wifiClient;
-  #else
-    EthernetClient etherClient;
-    client = &etherClient;
-  #endif
-#else
-    EthernetClient etherClient;
-    EthernetClient *client = &etherClient;
-#endif
-    unsigned char ipbytes[4];
-    IP4_EXTRACT_BYTES(ipbytes, ip);
-    char server[20];
-    sprintf(server, "%d.%d.%d.%d", ipbytes[0], ipbytes[1], ipbytes[2], ipbytes[3]);
-    client->setTimeout(200);
-    if (!client->connect(server, port)) {
-      DEBUG_PRINT(server);
-      DEBUG_PRINT(":");
-      DEBUG_PRINT(port);
-      DEBUG_PRINT(" ");
-      DEBUG_PRINTLN(F("failed."));
-      client->stop();
-      return HTTP_RQT_TIMEOUT;
+    if (!modbus_is_truebner(type)) return HTTP_RQT_NOT_RECEIVED;
+
+    uint16_t raw = 0;
+    int ret = modbus_pool_read(ip, port, id, modbus_truebner_reg(type), &raw);
+    if (ret != HTTP_RQT_SUCCESS) {
+      if (ret == HTTP_RQT_TIMEOUT) {
+        DEBUG_PRINT(F("Sensor "));
+        DEBUG_PRINT(nr);
+        DEBUG_PRINTLN(F(" timeout read!"));
+      }
+      return ret;
     }
 
-    uint8_t buffer[20];
-
-    if (modbusTcpId >= 0xFFFE)
-      modbusTcpId = 1;
-    else
-      modbusTcpId++;
-
-    bool isTemp = type == SENSOR_SMT100_TEMP || type == SENSOR_TH100_TEMP;
-    bool isMois = type == SENSOR_SMT100_MOIS || type == SENSOR_TH100_MOIS;
-    uint8_t senstype = isTemp ? 0x00 : isMois ? 0x01 : 0x02;
-
-    buffer[0] = (0xFF00 & modbusTcpId) >> 8;
-    buffer[1] = (0x00FF & modbusTcpId);
-    buffer[2] = 0;
-    buffer[3] = 0;
-    buffer[4] = 0;
-    buffer[5] = 6;  // len
-    buffer[6] = id;  // Modbus ID
-    buffer[7] = 0x03;        // Read Holding Registers
-    buffer[8] = 0x00;
-    buffer[9] = senstype;
-    buffer[10] = 0x00;
-    buffer[11] = 0x01;
-
-    client->write(buffer, 12);
-#if defined(ESP8266) || defined(ESP32)
-    client->flush();
-#endif
+    // Valid result:
+    last_native_data = raw;
+    DEBUG_PRINT(F(" native: "));
+    DEBUG_PRINT(last_native_data);
 
+    // Convert to readable value:
     switch (type) {
+      case SENSOR_TH100_MOIS:
       case SENSOR_SMT100_MOIS:
+        last_data = ((double)last_native_data / 100.0);
+        flags.data_ok = last_native_data < 10000;
+        DEBUG_PRINT(F(" soil moisture %: "));
+        break;
+      case SENSOR_TH100_TEMP:
       case SENSOR_SMT100_TEMP:
+        last_data = ((double)last_native_data / 100.0) - 100.0;
+        flags.data_ok = last_native_data > 7000;
+        DEBUG_PRINT(F(" temperature °C: "));
+        break;
       case SENSOR_SMT100_PMTY:
-      case SENSOR_TH100_MOIS:
-      case SENSOR_TH100_TEMP: {
-        uint32_t stoptime = millis() + SENSOR_READ_TIMEOUT;
-#if defined(ESP8266) || defined(ESP32)
-        while (true) {
-          if (client->available()) break;
-          if (millis() >= stoptime) {
-            client->stop();
-            DEBUG_PRINT(F("Sensor "));
-            DEBUG_PRINT(nr);
-            DEBUG_PRINTLN(F(" timeout read!"));
-            return HTTP_RQT_TIMEOUT;
-          }
-          delay(5);
-        }
-
-        int n = client->read(buffer, 11);
-        if (n < 11) n += client->read(buffer + n, 11 - n);
-#else
-        int n = 0;
-        while (true) {
-          n = client->read(buffer, 11);
-          if (n < 11) n += client->read(buffer + n, 11 - n);
-          if (n > 0) break;
-          if (millis() >= stoptime) {
-            client->stop();
-            DEBUG_PRINT(F("Sensor "));
-            DEBUG_PRINT(nr);
-            DEBUG_PRINT(F(" timeout read!"));
-            return HTTP_RQT_TIMEOUT;
-          }
-          delay(5);
-        }
-#endif
-        client->stop();
-        // DEBUG_PRINT(F("Sensor "));
-        // DEBUG_PRINT(nr);
-        if (n != 11) {
-          // DEBUG_PRINT(F(" returned "));
-          // DEBUG_PRINT(n);
-          // DEBUG_PRINTLN(F(" bytes??"));
-          return n == 0 ? HTTP_RQT_EMPTY_RETURN : HTTP_RQT_TIMEOUT;
-        }
-        if (buffer[0] != (0xFF00 & modbusTcpId) >> 8 ||
-            buffer[1] != (0x00FF & modbusTcpId)) {
-          // DEBUG_PRINT(F(" returned transaction id "));
-          // DEBUG_PRINTLN((uint16_t)((buffer[0] << 8) + buffer[1]));
-          return HTTP_RQT_NOT_RECEIVED;
-        }
-        if ((buffer[6] != id && id != 253)) {  // 253 is broadcast
-          // DEBUG_PRINT(F(" returned sensor id "));
-          // DEBUG_PRINTLN((int)buffer[0]);
-          return HTTP_RQT_NOT_RECEIVED;
-        }
-
-        // Valid result:
-        last_native_data = (buffer[9] << 8) | buffer[10];
-        DEBUG_PRINT(F(" native: "));
-        DEBUG_PRINT(last_native_data);
-
-        // Convert to readable value:
-        switch (type) {
-          case SENSOR_TH100_MOIS:
-          case SENSOR_SMT100_MOIS:
-            last_data = ((double)last_native_data / 100.0);
-            flags.data_ok = last_native_data < 10000;
-            DEBUG_PRINT(F(" soil moisture %: "));
-            break;
-          case SENSOR_TH100_TEMP:
-          case SENSOR_SMT100_TEMP:
-            last_data = ((double)last_native_data / 100.0) - 100.0;
-            flags.data_ok = last_native_data > 7000;
-            DEBUG_PRINT(F(" temperature °C: "));
-            break;
-          case SENSOR_SMT100_PMTY:
-            last_data = ((double)last_native_data / 100.0);
-            flags.data_ok = true;
-            DEBUG_PRINT(F(" permittivity DK: "));
-            break;
-        }
-        DEBUG_PRINTLN(last_data);
-        return flags.data_ok ? HTTP_RQT_SUCCESS : HTTP_RQT_NOT_RECEIVED;
-      }
+        last_data = ((double)last_native_data / 100.0);
+        flags.data_ok = true;
+        DEBUG_PRINT(F(" permittivity DK: "));
+        break;
     }
-
-    return HTTP_RQT_NOT_RECEIVED;
+    DEBUG_PRINTLN(last_data);
+    return flags.data_ok ? HTTP_RQT_SUCCESS : HTTP_RQT_NOT_RECEIVED;
 }
 
 int ModbusRtuSensor::setAddress(uint8_t newAddress) {
@@ -201,139 +392,84 @@ int ModbusRtuSensor::setAddress(uint8_t newAddress) {
 
 // class-level implementation
 bool ModbusRtuSensor::sendCommand(uint32_t ip, uint16_t port, uint8_t address, uint16_t reg,uint16_t data, bool isbit) {
-#if defined(ARDUINO)
-  Client *client;
+  ModbusGateway *gw = modbus_gateway_get(ip, port);
+  if (!gw || !modbus_gateway_connect(gw)) return false;
+
+  uint8_t buffer[12];
+  if (isbit) data = data ? 0xFF00 : 0x0000;
+  // Write Coil / Write Register
+  gw->client->write(buffer, modbus_frame(buffer, modbus_next_tid(), address, isbit?0x05:0x06, reg, data));
   #if defined(ESP8266) || defined(ESP32)
-    WiFiClient wifiClient;
-    client = &wifiClient;
-  #else
-    EthernetClient etherClient;
-    client = &etherClient;
+    gw->client->flush();
   #endif
-#else
-  EthernetClient etherClient;
-  EthernetClient *client = &etherClient;
-#endif
-  unsigned char ips[4];
-  IP4_EXTRACT_BYTES(ips, ip);
-  char server[20];
-  sprintf(server, "%d.%d.%d.%d", ips[0], ips[1], ips[2], ips[3]);
-  client->setTimeout(200);
-  if (!client->connect(server, port)) {
-    DEBUG_PRINT(server);
-    DEBUG_PRINT(":");
-    DEBUG_PRINT(port);
-    DEBUG_PRINT(" ");
-    DEBUG_PRINTLN(F("failed."));
-    client->stop();
-    return false;
-  }
 
-  uint8_t buffer[20];
-
-  if (modbusTcpId >= 0xFFFE)
-    modbusTcpId = 1;
-  else
-    modbusTcpId++;
-
-  buffer[0] = (0xFF00 & modbusTcpId) >> 8;
-  buffer[1] = (0x00FF & modbusTcpId);
-  buffer[2] = 0;
-  buffer[3] = 0;
-  buffer[4] = 0;
-  buffer[5] = 6;  // len
-  buffer[6] = address;  // Modbus ID
-  buffer[7] = isbit?0x05:0x06;        // Write Registers
-  buffer[8] = (reg >> 8) & 0xFF;  // high byte of register address
-  buffer[9] = reg & 0xFF;  // low byte
-  if (isbit) {
-    buffer[10] = data?0xFF:0x00;
-    buffer[11] = 0x00;
-  } else {
-    buffer[10] = (data >> 8) & 0xFF;  // high byte
-    buffer[11] = data & 0xFF;  // low byte
+  // Consume the echo (12 bytes, 9 for an exception) so it is not left on the
+  // pooled connection for the next batch to trip over
+  int n = 0, want = 9;
+  uint32_t stoptime = millis() + SENSOR_READ_TIMEOUT;
+  while (n < want) {
+    int r = gw->client->available() > 0 ? gw->client->read(buffer + n, want - n) : 0;
+    if (r > 0) {
+      n += r;
+      if (n >= 6) want = 6 + ((buffer[4] << 8) | buffer[5]);
+      if (want > (int)sizeof(buffer) || want < 8) break;
+      continue;
+    }
+    if (!gw->client->connected() || (long)(millis() - stoptime) >= 0) break;
+    delay(5);
   }
-
-  client->write(buffer, 12);
-  #if defined(ESP8266) || defined(ESP32)
-    client->flush();
-  #endif
-  client->stop();
-  return true;
+  if (n != want) {
+    modbus_gateway_close(gw);  // reply missing or unparsable, start over
+    return false;
+  }
+  gw->last_used = millis();
+  return !(buffer[7] & 0x80);  // an exception reply sets the top bit of the function code
 }
 
 int ModbusRtuSensor::setAddressIp(SensorBase *sensor, uint8_t new_address) {
-#if defined(ARDUINO)
-  Client *client;
-  #if defined(ESP8266) || defined(ESP32)
-    WiFiClient wifiClient;
-    client = &wifiClient;
-  #else
-    EthernetClient etherClient;
-    client = &etherClient;
-  #endif
-#else
-  EthernetClient etherClient;
-  EthernetClient *client = &etherClient;
-#endif
-  unsigned char ip[4];
-  IP4_EXTRACT_BYTES(ip, sensor->ip);
-  char server[20];
-  sprintf(server, "%d.%d.%d.%d", ip[0], ip[1], ip[2], ip[3]);
-  client->setTimeout(200);
-  if (!client->connect(server, sensor->port)) {
-    DEBUG_PRINT(F("Cannot connect to "));
-    DEBUG_PRINT(server);
-    DEBUG_PRINT(":");
+  ModbusGateway *gw = modbus_gateway_get(sensor->ip, sensor->port);
+  if (!gw || !modbus_gateway_connect(gw)) {
+    DEBUG_PRINT(F("Cannot connect to gateway port "));
     DEBUG_PRINTLN(sensor->port);
-    client->stop();
     return HTTP_RQT_CONNECT_ERR;
   }
 
   uint8_t buffer[20];
-
-  if (modbusTcpId >= 0xFFFE)
-    modbusTcpId = 1;
-  else
-    modbusTcpId++;
-
-  buffer[0] = (0xFF00 & modbusTcpId) >> 8;
-  buffer[1] = (0x00FF & modbusTcpId);
-  buffer[2] = 0;
-  buffer[3] = 0;
-  buffer[4] = 0;
-  buffer[5] = 6;  // len
-  buffer[6] = sensor->id;
-  buffer[7] = 0x06;
-  buffer[8] = 0x00;
-  buffer[9] = 0x04;
-  buffer[10] = 0x00;
-  buffer[11] = new_address;
-
-  client->write(buffer, 12);
+  uint16_t tid = modbus_next_tid();
+  gw->client->write(buffer, modbus_frame(buffer, tid, sensor->id, 0x06, 0x0004, new_address));
   #if defined(ESP8266) || defined(ESP32)
-    client->flush();
+    gw->client->flush();
   #endif
 
-  int n = client->read(buffer, 12);
-  client->stop();
+  int n = 0;
+  uint32_t stoptime = millis() + SENSOR_READ_TIMEOUT;
+  while (n < 12) {
+    int r = gw->client->available() > 0 ? gw->client->read(buffer + n, 12 - n) : 0;
+    if (r > 0) { n += r; continue; }
+    if (!gw->client->connected() || (long)(millis() - stoptime) >= 0) break;
+    delay(5);
+  }
+  gw->batch_time = 0;  // unit ids changed, re-plan on the next read
   // DEBUG_PRINT(F("Sensor "));
   // DEBUG_PRINT(sensor->nr);
   if (n != 12) {
     // DEBUG_PRINT(F(" returned "));
     // DEBUG_PRINT(n);
     // DEBUG_PRINT(F(" bytes??"));
+    modbus_gateway_close(gw);
     return n == 0 ? HTTP_RQT_EMPTY_RETURN : HTTP_RQT_TIMEOUT;
   }
-  if (buffer[0] != (0xFF00 & modbusTcpId) >> 8 ||
-      buffer[1] != (0x00FF & modbusTcpId)) {
+  if (buffer[0] != (0xFF00 & tid) >> 8 ||
+      buffer[1] != (0x00FF & tid)) {
     // DEBUG_PRINT(F(" returned transaction id "));
     // DEBUG_PRINTLN((uint16_t)((buffer[0] << 8) + buffer[1]));
+    modbus_gateway_close(gw);  // the real reply may still arrive, don't leave it to the next batch
     return HTTP_RQT_NOT_RECEIVED;
   }
   if ((buffer[6] != sensor->id && sensor->id != 253)) {  // 253 is broadcast
     // DEBUG_PRINT(F(" returned sensor id "));
     // DEBUG_PRINT((int)buffer[0]);
+    modbus_gateway_close(gw);
     return HTTP_RQT_NOT_RECEIVED;
   }
   sensor->id = new_address;
@@ -23,91 +23,33 @@
 
 #ifdef ADS1115
 
-#include "ospi-analog/driver_ads1115.h"
-#include "ospi-analog/driver_ads1115_interface.h"
 #include "sensor_ospi_ads1115.h"
+#include "adc_sampler.h"
 #include "sensors.h"
 
-#define ADS1115_BASIC_DEFAULT_RANGE        ADS1115_RANGE_6P144V        /**< set range 6.144V */
-#define ADS1115_BASIC_DEFAULT_RATE         ADS1115_RATE_128SPS         /**< set 128 SPS */
-
 #define DEFAULT_RANGE 6.144
 
-static ads1115_handle_t gs_handle; /**< ads1115 handle */
-
-void init_ads1115() {
-        if (gs_handle.inited) return;
-        
-        DRIVER_ADS1115_LINK_INIT(&gs_handle, ads1115_handle_t);
-        DRIVER_ADS1115_LINK_IIC_INIT(&gs_handle, ads1115_interface_iic_init);
-        DRIVER_ADS1115_LINK_IIC_DEINIT(&gs_handle, ads1115_interface_iic_deinit);
-        DRIVER_ADS1115_LINK_IIC_READ(&gs_handle, ads1115_interface_iic_read);
-        DRIVER_ADS1115_LINK_IIC_WRITE(&gs_handle, ads1115_interface_iic_write);
-        DRIVER_ADS1115_LINK_DELAY_MS(&gs_handle, ads1115_interface_delay_ms);
-        DRIVER_ADS1115_LINK_DEBUG_PRINT(&gs_handle, ads1115_interface_debug_print);
-        
-        ads1115_init(&gs_handle);
-}
 /**
 * Read the OSPi 1.6 onboard ADS1115 A2D
+* Conversions run in the ADC sampler, this returns its oversampled mean.
 **/
 int OspiAds1115Sensor::read(unsigned long time) {
         if (!flags.enable) return HTTP_RQT_NOT_RECEIVED;
+        if (id >= ADC_CHANNELS) return HTTP_RQT_NOT_RECEIVED;
 
-        uint8_t res;
-
-        init_ads1115();
-
-        ads1115_address_t addr    = (ads1115_address_t)(ADS1115_ADDR_GND         + id / 4);
-        ads1115_channel_t channel = (ads1115_channel_t)(ADS1115_CHANNEL_AIN0_GND + id % 4);
-
-        /* set addr pin */
-        res = ads1115_set_addr_pin(&gs_handle, addr);
-        if (res != 0)
-                return HTTP_RQT_NOT_RECEIVED;
-
-        res = ads1115_set_channel(&gs_handle, channel);
-        if (res != 0) {
+        AdcChannelStats st;
+        if (!adc_sampler_get(ADC_SRC_OSPI_ADS1115, id, &st, read_interval)) {
+                repeat_read = 1; // retry next second until the first samples are in
                 return HTTP_RQT_NOT_RECEIVED;
         }
 
-        /* set default range */
-        res = ads1115_set_range(&gs_handle, ADS1115_BASIC_DEFAULT_RANGE);
-        if (res != 0) {
-                return HTTP_RQT_NOT_RECEIVED;
-        }
-
-        /* set default rate */
-        res = ads1115_set_rate(&gs_handle, ADS1115_BASIC_DEFAULT_RATE);
-        if (res != 0) {
-                return HTTP_RQT_NOT_RECEIVED;
-        }
-
-        /* disable compare */
-        res = ads1115_set_compare(&gs_handle, ADS1115_BOOL_FALSE);
-        if (res != 0) {
-                return HTTP_RQT_NOT_RECEIVED;
-        }
-
-        int16_t raw;
-        float   v;
-        res = ads1115_single_read(&gs_handle, &raw, &v);
-        if (res != 0) {
-                return HTTP_RQT_NOT_RECEIVED;
-        }
-
-        repeat_native += raw;
-        repeat_data += v;
-        if (++repeat_read < MAX_SENSOR_REPEAT_READ && time < last_read + read_interval)
-                return HTTP_RQT_NOT_RECEIVED;
-
-        raw = repeat_native/repeat_read;
-        v = repeat_data/repeat_read;
+        int16_t raw = st.mean;
+        float   v = st.volts;
 
         repeat_native = raw;
         repeat_data = v;
-        repeat_read = 1;
-        
+        repeat_read = 0;
+
         last_native_data = raw;
         flags.data_ok = true;
         last_read = time;
@@ -23,108 +23,34 @@
 
 #ifdef PCF8591
 
-#include "ospi-analog/driver_pcf8591.h"
-#include "ospi-analog/driver_pcf8591_interface.h"
 #include "sensor_ospi_pcf8591.h"
+#include "adc_sampler.h"
 #include "sensors.h"
 
-#define DEFAULT_ADDR PCF8591_ADDRESS_A000
-#define DEFAULT_MODE PCF8591_MODE_AIN0123_GND
 #define DEFAULT_REF_VOLTAGE 3.3
-/**
-* Read the OSPi onboard PCF8591 A2D
-**/
-static pcf8591_handle_t gs_handle;        /**< pcf8591 handle */
-
-static uint8_t init_pcf8591() {
-        if (gs_handle.inited) return 0;
-
-        DRIVER_PCF8591_LINK_INIT(&gs_handle, pcf8591_handle_t);
-        DRIVER_PCF8591_LINK_IIC_INIT(&gs_handle, pcf8591_interface_iic_init);
-        DRIVER_PCF8591_LINK_IIC_DEINIT(&gs_handle, pcf8591_interface_iic_deinit);
-        DRIVER_PCF8591_LINK_IIC_READ_COMMAND(&gs_handle, pcf8591_interface_iic_read_cmd);
-        DRIVER_PCF8591_LINK_IIC_WRITE_COMMAND(&gs_handle, pcf8591_interface_iic_write_cmd);
-        DRIVER_PCF8591_LINK_DELAY_MS(&gs_handle, pcf8591_interface_delay_ms);
-        DRIVER_PCF8591_LINK_DEBUG_PRINT(&gs_handle, pcf8591_interface_debug_print);
-
-        /* set addr pin */
-        uint8_t res = pcf8591_set_addr_pin(&gs_handle, DEFAULT_ADDR);
-        if (res != 0) return res;
-
-        /* pcf8591 init */
-        res = pcf8591_init(&gs_handle);
-        if (res != 0) return res;
-    
-        /* set mode */
-        res = pcf8591_set_mode(&gs_handle, DEFAULT_MODE);
-        if (res != 0) return res;
-
-        /* disable auto increment */
-        res = pcf8591_set_auto_increment(&gs_handle, PCF8591_BOOL_FALSE);
-        if (res != 0) return res;
-
-        /* set default reference voltage */
-        res = pcf8591_set_reference_voltage(&gs_handle, DEFAULT_REF_VOLTAGE);
-        if (res != 0) return res;
-
-        // Force enable Analog Output (AOUT) to ensure ASB sensor board remains powered
-        gs_handle.conf |= 0x40;
-
-        return 0;
-}
 
 /**
 * Read the OSPi onboard PCF8591 A2D
+* Conversions run in the ADC sampler, which already discards zero readings;
+* this returns its oversampled mean.
 **/
 int OspiPcf8591Sensor::read(unsigned long time) {
         if (!flags.enable) return HTTP_RQT_NOT_RECEIVED;
+        if (id >= 4) return HTTP_RQT_NOT_RECEIVED;
 
-        uint8_t res = init_pcf8591();
-        if (res != 0) return HTTP_RQT_NOT_RECEIVED;
-                
-        pcf8591_channel_t channel = (pcf8591_channel_t)id;
-        res = pcf8591_set_channel(&gs_handle, channel);
-        if (res != 0) {
-                return HTTP_RQT_NOT_RECEIVED;
-        }
-
-        int16_t raw;
-        float v;
-        res = pcf8591_read(&gs_handle, &raw, &v);
-        if (res != 0) {
+        AdcChannelStats st;
+        if (!adc_sampler_get(ADC_SRC_OSPI_PCF8591, id, &st, read_interval)) {
+                repeat_read = 1; // retry next second until the first samples are in
                 return HTTP_RQT_NOT_RECEIVED;
         }
 
-        // Mathias' option: discard zero/null values to avoid false readings
-        if (raw == 0) {
-                DEBUG_PRINTF("OspiPcf8591Sensor: raw is 0, discarding\n");
-                // Do not accumulate.
-        } else {
-                repeat_native += raw;
-                repeat_data += v;
-                repeat_read++;
-        }
-
-        if (time < last_read + read_interval && repeat_read < MAX_SENSOR_REPEAT_READ)
-                return HTTP_RQT_NOT_RECEIVED;
-
-        // If we have received absolutely no valid readings in this entire interval,
-        // we fallback to the last valid readings to avoid sending stale / zero results.
-        if (repeat_read == 0) {
-                if (last_native_data == 0) {
-                        return HTTP_RQT_NOT_RECEIVED;
-                }
-                raw = last_native_data;
-                v = (float)raw / 256.0f * DEFAULT_REF_VOLTAGE;
-        } else {
-                raw = repeat_native/repeat_read;
-                v = repeat_data/repeat_read;
-        }
+        int16_t raw = st.mean;
+        float v = st.volts;
 
         repeat_native = raw;
         repeat_data = v;
-        repeat_read = 1;
-        
+        repeat_read = 0;
+
         last_native_data = raw;
         flags.data_ok = true;
         last_read = time;
@@ -148,12 +74,10 @@ int OspiPcf8591Sensor::read(unsigned long time) {
 }
 
 /**
-* Close resource for PCF8591 ADC
+* The PCF8591 handle is shared by all channels and owned by the ADC sampler,
+* it is closed by adc_sampler_free() on sensor reload.
 **/
 void OspiPcf8591Sensor::deinit() {
-        if (gs_handle.inited) {
-                pcf8591_deinit(&gs_handle);
-        }
 }
 
 
@@ -21,6 +21,7 @@
 #include "sensor_remote_json.h"
 #include "sensors.h"
 #include "OpenSprinkler.h"
+#include "json_stream.h"
 #include <new>
 
 #if defined(ESP8266)
@@ -36,25 +37,6 @@
 
 extern OpenSprinkler os;
 
-// Resolve a JSON-array index token from a filter segment's [..] brackets.
-// Besides a plain number it accepts a dynamic "now" placeholder that resolves to
-// the current local hour-of-day index (0..23), with an optional +N/-N offset,
-// e.g. "[now]", "[now+1]", "[now-2]". This lets HTTP-JSON forecast arrays
-// (e.g. Open-Meteo hourly) be indexed relative to the current hour (ticket 305).
-static int remote_json_parse_array_index(const char* s) {
-    while (*s == ' ') s++;
-    if ((s[0]=='n'||s[0]=='N') && (s[1]=='o'||s[1]=='O') && (s[2]=='w'||s[2]=='W')) {
-        int base = (int)((os.now_tz() % 86400L) / 3600L); // local hour 0..23
-        s += 3;
-        while (*s == ' ') s++;
-        int off = (*s == '+' || *s == '-') ? atoi(s) : 0;
-        int idx = base + off;
-        return idx < 0 ? 0 : idx;
-    }
-    int idx = atoi(s);
-    return idx < 0 ? 0 : idx;
-}
-
 void RemoteJsonSensor::fromJson(ArduinoJson::JsonVariantConst obj) {
     SensorBase::fromJson(obj);
     if (obj.containsKey(F("url"))) {
@@ -79,288 +61,137 @@ void RemoteJsonSensor::emitJson(BufferFiller& bfill) const {
     SensorBase::emitJson(bfill);
 }
 
-int RemoteJsonSensor::read(unsigned long time) {
-    if (!url || url[0] == '\0') {
-        flags.data_ok = false;
-        return HTTP_RQT_NOT_RECEIVED;
-    }
-
-    double extracted_value = -9999;
-    bool value_extracted = false;
-
+// Fetch url and feed the body through the extractor, stopping as soon as
+// every registered path has its value.
+static bool remote_json_fetch(const char *url, JsonStreamExtractor &ex) {
 #if defined(ESP8266) || defined(ESP32)
     HTTPClient http;
-    int httpCode = 0;
-    bool opened = false;
+    WiFiClient plain;
     WiFiClientSecure *client_secure = nullptr;
-    WiFiClient *client = nullptr;
-
-    http.setTimeout(SENSOR_READ_TIMEOUT);
+    WiFiClient *client = &plain;
 
     if (strncmp(url, "https://", 8) == 0) {
-        client_secure = new WiFiClientSecure();
-        if (client_secure) {
-            client_secure->setInsecure();
-            client = client_secure;
-        }
-    } else {
-        client = new WiFiClient();
-    }
-
-    if (!client) {
-        flags.data_ok = false;
-        return HTTP_RQT_NOT_RECEIVED;
+        client_secure = new (std::nothrow) WiFiClientSecure();
+        if (!client_secure) return false;
+        client_secure->setInsecure();
+        client = client_secure;
     }
 
+    http.setTimeout(SENSOR_READ_TIMEOUT);
+    http.useHTTP10(true);  // no chunked framing in the body stream
+    bool ok = false;
     if (http.begin(*client, url)) {
-        httpCode = http.GET();
-        opened = true;
-    }
-
-    if (!opened || httpCode != 200) {
-        if (opened) http.end();
-        if (client_secure) delete client_secure;
-        else if (client) delete client;
-        flags.data_ok = false;
-        return HTTP_RQT_NOT_RECEIVED;
-    }
-
-    WiFiClient *stream = http.getStreamPtr();
-    if (!stream) {
-        http.end();
-        if (client_secure) delete client_secure;
-        else if (client) delete client;
-        flags.data_ok = false;
-        return HTTP_RQT_NOT_RECEIVED;
-    }
-
-    // Parse filters.
-    // Supports legacy repeated-segment syntax and index syntax such as:
-    //   ch_soil[3]|humidity
-    // by expanding it to repeated next-segment matches internally.
-    char filter_copy[200];
-    int num_segments = 0;
-    const char* segments[16];
-    int arrayIndex = 0;
-    if (filter && filter[0]) {
-        strncpy(filter_copy, filter, sizeof(filter_copy) - 1);
-        filter_copy[sizeof(filter_copy) - 1] = '\0';
-
-        char* raw_segments[16];
-        int raw_count = 0;
-        char* token = strtok(filter_copy, "|");
-        while (token && raw_count < 16) {
-            raw_segments[raw_count++] = token;
-            token = strtok(NULL, "|");
-        }
-
-        int parsed_index[16];
-        for (int i = 0; i < raw_count; i++) {
-            parsed_index[i] = -1;
-            char* seg = raw_segments[i];
-            char* lb = strrchr(seg, '[');
-            if (lb) {
-                char* rb = strchr(lb, ']');
-                if (rb && rb[1] == '\0' && rb > lb + 1) {
-                    int idx = remote_json_parse_array_index(lb + 1);
-                    if (idx < 0) idx = 0;
-                    parsed_index[i] = idx;
-                    *lb = '\0';
+        WiFiClient *stream = http.GET() == 200 ? http.getStreamPtr() : nullptr;
+        if (stream) {
+            ok = true;
+            char buf[128];
+            unsigned long start_ms = millis();
+            while (!ex.done()) {
+                if (millis() - start_ms > SENSOR_READ_TIMEOUT) {
+                    DEBUG_PRINTLN(F("RemoteJsonSensor: Read timeout"));
+                    break;
                 }
-            }
-        }
-
-        for (int i = 0; i < raw_count && num_segments < 16; i++) {
-            segments[num_segments++] = raw_segments[i];
-
-            // If index is on a non-last segment, emulate array element selection by
-            // repeating the next key search. Example:
-            // ch_soil[3]|humidity -> ch_soil|humidity|humidity|humidity|humidity
-            if (parsed_index[i] >= 0) {
-                if (i + 1 < raw_count) {
-                    for (int r = 0; r < parsed_index[i] && num_segments < 16; r++) {
-                        segments[num_segments++] = raw_segments[i + 1];
-                    }
-                } else {
-                    arrayIndex = parsed_index[i];
-                }
-            }
-        }
-    }
-
-    char *chunkBuffer = new char[1536];
-    if (!chunkBuffer) {
-        http.end();
-        if (client_secure) delete client_secure;
-        else if (client) delete client;
-        flags.data_ok = false;
-        return HTTP_RQT_NOT_RECEIVED;
-    }
-    int bufferLen = 0;
-    int current_segment_idx = 0;
-    const char* p = chunkBuffer;
-    unsigned long start_ms = millis();
-
-    while (true) {
-        if (millis() - start_ms > SENSOR_READ_TIMEOUT) {
-            DEBUG_PRINTLN(F("RemoteJsonSensor: Read timeout"));
-            break;
-        }
-
-        // Fill buffer from stream if there's space and data
-        if (stream->available() && bufferLen < 1400) {
-            int to_read = 1536 - bufferLen - 1;
-            int read_bytes = stream->read(reinterpret_cast<uint8_t*>(chunkBuffer + bufferLen), to_read);
-            if (read_bytes > 0) {
-                bufferLen += read_bytes;
-                chunkBuffer[bufferLen] = '\0';
-            }
-        }
-
-        if (bufferLen == 0 && !stream->available() && !stream->connected()) {
-            break;
-        }
-
-        if (current_segment_idx < num_segments) {
-            int current_seg_len = strlen(segments[current_segment_idx]);
-            int search_len = bufferLen;
-            if (stream->available()) {
-                search_len = bufferLen - current_seg_len + 1;
-            }
-            if (search_len < 0) search_len = 0;
-
-            const char* found = findSegment(chunkBuffer, p, search_len, segments[current_segment_idx], current_seg_len);
-            if (found) {
-                p = found + current_seg_len;
-                current_segment_idx++;
-                continue;
-            } else {
-                // Shift or wait for more data
-                int p_offset = p - chunkBuffer;
-                if (p_offset > 0) {
-                    int keep_len = bufferLen - p_offset;
-                    if (keep_len > 0) {
-                        memmove(chunkBuffer, p, keep_len);
-                        bufferLen = keep_len;
-                    } else {
-                        bufferLen = 0;
-                    }
-                    chunkBuffer[bufferLen] = '\0';
-                    p = chunkBuffer;
-                    continue;
-                } else if (bufferLen >= 1400) {
-                    // Buffer is full but p is already at the beginning of the buffer.
-                    // This means the segment was not found in 1400 bytes. Discard old data.
-                    int discard_len = bufferLen - current_seg_len + 1;
-                    if (discard_len > 0) {
-                        memmove(chunkBuffer, chunkBuffer + discard_len, current_seg_len - 1);
-                        bufferLen = current_seg_len - 1;
-                    } else {
-                        bufferLen = 0;
-                    }
-                    chunkBuffer[bufferLen] = '\0';
-                    p = chunkBuffer;
+                int avail = stream->available();
+                if (avail <= 0) {
+                    if (!stream->connected()) break;
+                    delay(1);
                     continue;
                 }
-
-                if (!stream->available()) {
-                    if (!stream->connected()) {
-                        break;
-                    } else {
-                        delay(1);
-                        continue;
-                    }
-                }
-            }
-        } else {
-            int remaining = bufferLen - (p - chunkBuffer);
-            if (remaining < 256 && stream->available()) {
-                int p_offset = p - chunkBuffer;
-                int keep_len = bufferLen - p_offset;
-                if (keep_len > 0) {
-                    memmove(chunkBuffer, p, keep_len);
-                    bufferLen = keep_len;
-                } else {
-                    bufferLen = 0;
-                }
-                chunkBuffer[bufferLen] = '\0';
-                p = chunkBuffer;
-                continue;
+                int n = stream->read(reinterpret_cast<uint8_t*>(buf), avail < (int)sizeof(buf) ? avail : (int)sizeof(buf));
+                if (n > 0) ex.feed(buf, n);
             }
-
-            // Skip preceding numeric elements if arrayIndex > 0
-            for (int idx = 0; idx < arrayIndex; idx++) {
-                p = strpbrk(p, "0123456789.-+");
-                if (!p || p >= chunkBuffer + bufferLen) { p = NULL; break; }
-                while (p && *p && p < chunkBuffer + bufferLen &&
-                       ((*p >= '0' && *p <= '9') || *p == '.' || *p == '-' || *p == '+')) p++;
-            }
-
-            char val_buf[32];
-            const char* val_start = NULL;
-            if (p) {
-                val_start = strpbrk(p, "0123456789.-+");
-            }
-            if (val_start && val_start < chunkBuffer + bufferLen) {
-                int i = 0;
-                const char* val_p = val_start;
-                while (val_p && i < (int)sizeof(val_buf) - 1 && val_p < chunkBuffer + bufferLen) {
-                    char ch = *val_p++;
-                    if ((ch >= '0' && ch <= '9') || ch == '.' || ch == '-' || ch == '+') {
-                        val_buf[i++] = ch;
-                    } else {
-                        break;
-                    }
-                }
-                val_buf[i] = '\0';
-                extracted_value = -9999;
-                if (sscanf(val_buf, "%lf", &extracted_value) > 0) {
-                    value_extracted = true;
-                }
-            }
-            break;
         }
+        http.end();  // closes the connection, remaining body is not downloaded
     }
-
-    http.end();
-    delete[] chunkBuffer;
-    if (client_secure) delete client_secure;
-    else if (client) delete client;
+    delete client_secure;
+    return ok;
 
 #elif defined(OSPI)
     naettReq *req = naettRequest(url, naettMethod("GET"));
     naettRes *res = naettMake(req);
 
+    bool ok = false;
     unsigned long start_ms = millis();
     while (!naettComplete(res)) {
-        if (millis() - start_ms > SENSOR_READ_TIMEOUT) {
-            naettClose(res);
-            naettFree(req);
-            flags.data_ok = false;
-            return HTTP_RQT_NOT_RECEIVED;
-        }
+        if (millis() - start_ms > SENSOR_READ_TIMEOUT) break;
         usleep(50 * 1000);
     }
+    if (naettComplete(res) && naettGetStatus(res) == 200) {
+        int bodyLength = 0;
+        const char *responseBody = (const char *)naettGetBody(res, &bodyLength);
+        if (responseBody && bodyLength > 0) {
+            ex.feed(responseBody, bodyLength);
+            ok = true;
+        }
+    }
+    naettClose(res);
+    naettFree(req);
+    return ok;
+#else
+    (void)url; (void)ex;
+    return false;
+#endif
+}
 
-    if (naettGetStatus(res) != 200) {
-        naettClose(res);
-        naettFree(req);
+int RemoteJsonSensor::read(unsigned long time) {
+    if (!url || url[0] == '\0') {
         flags.data_ok = false;
         return HTTP_RQT_NOT_RECEIVED;
     }
 
-    int bodyLength = 0;
-    const char *responseBody = (char *)naettGetBody(res, &bodyLength);
-    if (responseBody && bodyLength > 0) {
-        int ok = findValue(responseBody, bodyLength, filter[0] ? filter : NULL, extracted_value);
-        if (ok) {
-            value_extracted = true;
+    double extracted_value = -9999;
+    bool value_extracted = false;
+
+    if (shared_at && time >= shared_at && time - shared_at < REMOTE_JSON_SHARE_SECS) {
+        // a sibling on the same URL fetched for us in this cycle
+        shared_at = 0;
+        value_extracted = shared_ok;
+        extracted_value = shared_value;
+    } else {
+        int now_hour = (int)((os.now_tz() % 86400L) / 3600L);  // for "[now]" indices
+        RemoteJsonSensor *group[JSON_STREAM_MAX_TARGETS];
+        JsonPath paths[JSON_STREAM_MAX_TARGETS];
+        if (!json_path_compile(filter, now_hour, &paths[0])) {
+            DEBUG_PRINTLN(F("RemoteJsonSensor: invalid filter"));
+            flags.data_ok = false;
+            return HTTP_RQT_NOT_RECEIVED;
         }
-    }
 
-    naettClose(res);
-    naettFree(req);
-#endif
+        // Collect sensors on the same URL that are due now as well, so one
+        // response serves all of them
+        JsonStreamExtractor ex;
+        uint8_t n = 0;
+        group[n] = this;
+        ex.add(&paths[n++]);
+
+        SensorIterator it = sensors_iterate_begin();
+        SensorBase *s;
+        while ((s = sensors_iterate_next(it)) != NULL && n < JSON_STREAM_MAX_TARGETS) {
+            if (s == this || s->type != SENSOR_REMOTE_JSON || !s->flags.enable) continue;
+            RemoteJsonSensor *r = static_cast<RemoteJsonSensor*>(s);
+            if (!r->url || strcmp(r->url, url) != 0) continue;
+            if (time + REMOTE_JSON_SHARE_SECS < r->last_read + r->read_interval) continue;
+            if (!json_path_compile(r->filter, now_hour, &paths[n])) continue;
+            group[n] = r;
+            ex.add(&paths[n]);
+            n++;
+        }
+
+        bool fetched = remote_json_fetch(url, ex);
+
+        for (uint8_t i = 0; i < n; i++) {
+            double v = -9999;
+            bool ok = fetched && ex.get(i, &v);
+            if (group[i] == this) {
+                value_extracted = ok;
+                extracted_value = v;
+            } else {
+                group[i]->shared_value = v;
+                group[i]->shared_ok = ok;
+                group[i]->shared_at = time;
+            }
+        }
+    }
 
     if (value_extracted && extracted_value >= -10000 && extracted_value <= 10000) {
         last_data = extracted_value;
@@ -371,4 +202,4 @@ int RemoteJsonSensor::read(unsigned long time) {
         flags.data_ok = false;
         return HTTP_RQT_NOT_RECEIVED;
     }
-}
\ No newline at end of file
+}
@@ -24,6 +24,9 @@
 #include "sensors.h"
 #include "SensorBase.hpp"
 
+// Sensors on the same URL due within this many seconds share one fetch
+#define REMOTE_JSON_SHARE_SECS 30
+
 /**
  * @brief Remote JSON sensor class for querying arbitrary REST APIs with streaming filtration
  * @note Designed to handle huge payloads with low memory buffer matching
@@ -70,6 +73,12 @@ public:
      * @param bfill BufferFiller object for output
      */
     virtual void emitJson(BufferFiller& bfill) const override;
+
+private:
+    // Value handed over by a sibling sensor that fetched the same URL
+    double shared_value = 0;
+    ulong shared_at = 0;
+    bool shared_ok = false;
 };
 
 #endif // _SENSOR_REMOTE_JSON_H
\ No newline at end of file
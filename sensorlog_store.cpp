@@ -0,0 +1,568 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Compressed block storage for the sensor log rings
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "sensorlog_store.h"
+#include "sensors.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#if defined(ESP32)
+#include <esp_heap_caps.h>
+#endif
+
+// Record encoding, one tag byte followed by its fields:
+//   0xF0            literal: varint nr, u32 time, u32 native, u64 data bits
+//   ssss ttvv       sensor slot s (0..14) of this block, relative to its previous record
+//     tt            delta-of-delta of the time: 0 none, 1 int8, 2 int16, 3 int32
+//     v bit0        data changed: byte (leading zero bytes << 4 | length), then the
+//                   meaningful bytes of the XOR with the previous value
+//     v bit1        native data changed: zigzag varint of the difference
+//   0xFF            padding up to the count byte of a sealed block
+#define SLOG_HDR_SIZE     8
+#define SLOG_DATA_END     (SLOG_BLOCK_SIZE - 1)
+#define SLOG_TAG_LITERAL  0xF0
+#define SLOG_TAG_END      0xFF
+#define SLOG_REC_MAX      24
+#define SLOG_FILES        8
+#define SLOG_READ_CHUNK   16
+#define SLOG_COPY_CHUNK   64
+#define SLOG_SIZE_UNKNOWN ((ulong)-1)
+
+static const uint8_t slog_magic[4] = {'S', 'L', 'Z', '1'};
+
+// Coding state of one sensor within a block
+struct SlogSlot {
+  uint64_t bits;  // previous value as IEEE754 bits
+  uint nr;
+  uint32_t time;
+  int32_t delta;
+  uint32_t native;
+};
+
+struct SlogState {
+  uint8_t nslots;
+  SlogSlot slot[SLOG_MAX_SLOTS];
+};
+
+// Cached block counts of one log file
+struct SlogFile {
+  char fn[28];
+  ulong size;                   // file size the counts belong to
+  std::vector<uint8_t> counts;  // records per sealed block
+  ulong total;                  // sum of counts
+  uint8_t open;                 // records in the trailing, unsealed block
+  uint16_t gen;                 // bumped when cached blocks may be outdated
+  ulong used;                   // LRU stamp
+};
+
+static SlogFile files[SLOG_FILES];
+static ulong files_clock = 0;
+
+// coding state of the block appended to last
+static SlogState wr_state;
+static SlogFile *wr_file = NULL;
+static ulong wr_size = 0;
+
+// last block read from flash
+static uint8_t *blk_buf = NULL;
+static const SlogFile *blk_file = NULL;
+static ulong blk_no = 0;
+static uint16_t blk_len = 0;
+static uint16_t blk_gen = 0;
+
+static void put_le(uint8_t *p, uint64_t v, uint8_t n) {
+  for (uint8_t i = 0; i < n; i++) {
+    p[i] = v & 0xFF;
+    v >>= 8;
+  }
+}
+
+static uint64_t get_le(const uint8_t *p, uint8_t n) {
+  uint64_t v = 0;
+  for (uint8_t i = n; i > 0; i--) v = (v << 8) | p[i - 1];
+  return v;
+}
+
+static uint8_t put_varint(uint8_t *p, uint32_t v) {
+  uint8_t n = 0;
+  while (v >= 0x80) {
+    p[n++] = (v & 0x7F) | 0x80;
+    v >>= 7;
+  }
+  p[n++] = v;
+  return n;
+}
+
+static bool get_varint(const uint8_t *b, uint16_t len, uint16_t &pos, uint32_t &v) {
+  v = 0;
+  for (uint8_t shift = 0; shift < 35; shift += 7) {
+    if (pos >= len) return false;
+    uint8_t c = b[pos++];
+    v |= (uint32_t)(c & 0x7F) << shift;
+    if (!(c & 0x80)) return true;
+  }
+  return false;
+}
+
+static int slot_find(const SlogState &st, uint nr) {
+  for (uint8_t i = 0; i < st.nslots; i++) {
+    if (st.slot[i].nr == nr) return i;
+  }
+  return -1;
+}
+
+static void slot_literal(SlogState &st, uint nr, uint32_t time, uint32_t native, uint64_t bits) {
+  int s = slot_find(st, nr);
+  if (s < 0) {
+    if (st.nslots >= SLOG_MAX_SLOTS) return;
+    s = st.nslots++;
+  }
+  SlogSlot &sl = st.slot[s];
+  sl.nr = nr;
+  sl.time = time;
+  sl.delta = 0;
+  sl.native = native;
+  sl.bits = bits;
+}
+
+static uint8_t slog_encode(SlogState &st, const SensorLog *rec, uint8_t *out) {
+  uint64_t bits;
+  memcpy(&bits, &rec->data, sizeof(bits));
+  uint32_t t = (uint32_t)rec->time;
+  int s = slot_find(st, rec->nr);
+  if (s >= 0) {
+    SlogSlot &sl = st.slot[s];
+    int64_t delta = (int64_t)t - (int64_t)sl.time;
+    int64_t dod = delta - sl.delta;
+    if (delta >= INT32_MIN && delta <= INT32_MAX && dod >= INT32_MIN && dod <= INT32_MAX) {
+      uint8_t n = 1;
+      uint8_t tag = s << 4;
+      if (dod == 0) {
+      } else if (dod >= -128 && dod <= 127) {
+        tag |= 0x04;
+        out[n++] = (uint8_t)(int8_t)dod;
+      } else if (dod >= -32768 && dod <= 32767) {
+        tag |= 0x08;
+        put_le(out + n, (uint16_t)(int16_t)dod, 2);
+        n += 2;
+      } else {
+        tag |= 0x0C;
+        put_le(out + n, (uint32_t)(int32_t)dod, 4);
+        n += 4;
+      }
+      uint64_t x = bits ^ sl.bits;
+      if (x) {
+        uint8_t lz = 0, tz = 0;
+        while (!((x >> (56 - 8 * lz)) & 0xFF)) lz++;
+        while (!((x >> (8 * tz)) & 0xFF)) tz++;
+        uint8_t len = 8 - lz - tz;
+        tag |= 0x01;
+        out[n++] = (lz << 4) | len;
+        put_le(out + n, x >> (8 * tz), len);
+        n += len;
+      }
+      if (rec->native_data != sl.native) {
+        int32_t d = (int32_t)(rec->native_data - sl.native);
+        tag |= 0x02;
+        n += put_varint(out + n, ((uint32_t)d << 1) ^ (uint32_t)(d >> 31));
+      }
+      out[0] = tag;
+      sl.time = t;
+      sl.delta = (int32_t)delta;
+      sl.native = rec->native_data;
+      sl.bits = bits;
+      return n;
+    }
+  }
+
+  uint8_t n = 0;
+  out[n++] = SLOG_TAG_LITERAL;
+  n += put_varint(out + n, rec->nr);
+  put_le(out + n, t, 4);
+  n += 4;
+  put_le(out + n, rec->native_data, 4);
+  n += 4;
+  put_le(out + n, bits, 8);
+  n += 8;
+  slot_literal(st, rec->nr, t, rec->native_data, bits);
+  return n;
+}
+
+static bool slog_decode_one(SlogState &st, const uint8_t *b, uint16_t len, uint16_t &pos, SensorLog *rec) {
+  if (pos >= len || b[pos] == SLOG_TAG_END) return false;
+  uint8_t tag = b[pos];
+  uint16_t p = pos + 1;
+  uint64_t bits;
+  if (tag == SLOG_TAG_LITERAL) {
+    uint32_t nr;
+    if (!get_varint(b, len, p, nr) || p + 16 > len) return false;
+    uint32_t t = (uint32_t)get_le(b + p, 4);
+    uint32_t native = (uint32_t)get_le(b + p + 4, 4);
+    bits = get_le(b + p + 8, 8);
+    p += 16;
+    slot_literal(st, nr, t, native, bits);
+    rec->nr = nr;
+    rec->time = t;
+    rec->native_data = native;
+  } else {
+    uint8_t s = tag >> 4;
+    if (s >= st.nslots) return false;
+    SlogSlot &sl = st.slot[s];
+    int64_t dod = 0;
+    switch ((tag >> 2) & 3) {
+      case 1:
+        if (p + 1 > len) return false;
+        dod = (int8_t)b[p];
+        p += 1;
+        break;
+      case 2:
+        if (p + 2 > len) return false;
+        dod = (int16_t)get_le(b + p, 2);
+        p += 2;
+        break;
+      case 3:
+        if (p + 4 > len) return false;
+        dod = (int32_t)get_le(b + p, 4);
+        p += 4;
+        break;
+    }
+    uint64_t x = 0;
+    if (tag & 0x01) {
+      if (p >= len) return false;
+      uint8_t lz = b[p] >> 4, n = b[p] & 0x0F;
+      p++;
+      if (!n || lz + n > 8 || p + n > len) return false;
+      x = get_le(b + p, n) << (8 * (8 - lz - n));
+      p += n;
+    }
+    uint32_t z = 0;
+    if ((tag & 0x02) && !get_varint(b, len, p, z)) return false;
+
+    sl.delta = (int32_t)(sl.delta + dod);
+    sl.time += sl.delta;
+    sl.bits ^= x;
+    sl.native += (uint32_t)((z >> 1) ^ (0u - (z & 1)));
+    rec->nr = sl.nr;
+    rec->time = sl.time;
+    rec->native_data = sl.native;
+    bits = sl.bits;
+  }
+  memcpy(&rec->data, &bits, sizeof(bits));
+  pos = p;
+  return true;
+}
+
+/**
+ * @brief Decode the records of one block
+ * @param limit number of records the block holds
+ * @param skip records to skip before storing to out
+ * @param total if set, decode the whole block and receive the number of valid records
+ * @param end if set, receives the offset after the last valid record
+ * @return number of records stored to out
+ */
+static int slog_decode(const uint8_t *b, uint16_t len, uint16_t limit, SlogState &st, ulong skip, int max,
+                       SensorLog *out, uint16_t *total, uint16_t *end) {
+  st.nslots = 0;
+  if (len > SLOG_DATA_END) len = SLOG_DATA_END;
+  uint16_t pos = SLOG_HDR_SIZE, i = 0;
+  int n = 0;
+  if (len < SLOG_HDR_SIZE || memcmp(b, slog_magic, sizeof(slog_magic)) != 0) {
+    pos = 0;
+    limit = 0;
+  }
+  SensorLog rec;
+  while (i < limit) {
+    if (!total && n >= max) break;
+    if (!slog_decode_one(st, b, len, pos, &rec)) break;
+    if (i >= skip && n < max) out[n++] = rec;
+    i++;
+  }
+  if (total) *total = i;
+  if (end) *end = pos;
+  return n;
+}
+
+static const uint8_t* slog_block(const SlogFile &f, ulong blk, uint16_t &len) {
+  ulong sealed = f.counts.size();
+  len = (blk < sealed) ? SLOG_BLOCK_SIZE : (uint16_t)(f.size % SLOG_BLOCK_SIZE);
+  if (blk > sealed || !len) return NULL;
+  if (!blk_buf) {
+#if defined(ESP32) && defined(BOARD_HAS_PSRAM)
+    blk_buf = (uint8_t *)heap_caps_malloc(SLOG_BLOCK_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#endif
+    if (!blk_buf) blk_buf = (uint8_t *)malloc(SLOG_BLOCK_SIZE);
+    if (!blk_buf) return NULL;
+  }
+  if (blk_file != &f || blk_gen != f.gen || blk_no != blk || blk_len != len) {
+    blk_file = NULL;
+    if (file_read_block(f.fn, blk_buf, blk * SLOG_BLOCK_SIZE, len) != len) return NULL;
+    blk_file = &f;
+    blk_gen = f.gen;
+    blk_no = blk;
+    blk_len = len;
+  }
+  return blk_buf;
+}
+
+static void slog_reset(SlogFile &f) {
+  f.size = SLOG_SIZE_UNKNOWN;
+  f.counts.clear();
+  f.total = 0;
+  f.open = 0;
+  f.gen++;
+  if (wr_file == &f) wr_file = NULL;
+}
+
+static SlogFile& slog_file(const char *fn) {
+  SlogFile *lru = &files[0];
+  for (uint8_t i = 0; i < SLOG_FILES; i++) {
+    if (strcmp(files[i].fn, fn) == 0) {
+      files[i].used = ++files_clock;
+      return files[i];
+    }
+    if (files[i].used < lru->used) lru = &files[i];
+  }
+  slog_reset(*lru);
+  std::vector<uint8_t>().swap(lru->counts);
+  strncpy(lru->fn, fn, sizeof(lru->fn) - 1);
+  lru->used = ++files_clock;
+  return *lru;
+}
+
+static void slog_forget(const char *fn) {
+  for (uint8_t i = 0; i < SLOG_FILES; i++) {
+    if (strcmp(files[i].fn, fn) == 0) slog_reset(files[i]);
+  }
+}
+
+// Bring the cached counts up to date with the file. Appends only add blocks,
+// a shrunk file (removed by a ring switch or trimmed) is indexed again.
+static void slog_sync(SlogFile &f) {
+  ulong size = file_size(f.fn);
+  if (size == f.size) return;
+  if (f.size == SLOG_SIZE_UNKNOWN || size < f.size) {
+    slog_reset(f);
+  }
+  ulong sealed = size / SLOG_BLOCK_SIZE;
+  while (f.counts.size() < sealed) {
+    uint8_t c = 0;
+    file_read_block(f.fn, &c, (ulong)f.counts.size() * SLOG_BLOCK_SIZE + SLOG_DATA_END, 1);
+    f.counts.push_back(c);
+    f.total += c;
+  }
+  f.size = size;
+  f.open = 0;
+  uint16_t len, total;
+  const uint8_t *b = slog_block(f, sealed, len);
+  if (b) {
+    SlogState st;
+    slog_decode(b, len, SLOG_MAX_RECORDS, st, 0, 0, NULL, &total, NULL);
+    f.open = total;
+  }
+}
+
+// Pad the open block and store its record count in the last byte
+static bool slog_seal(SlogFile &f, uint16_t used) {
+  uint16_t pad = SLOG_BLOCK_SIZE - used;
+  uint8_t *p = (uint8_t *)malloc(pad);
+  if (!p) return false;
+  memset(p, SLOG_TAG_END, pad);
+  p[pad - 1] = f.open;
+  file_append_block(f.fn, p, pad);
+  free(p);
+  f.counts.push_back(f.open);
+  f.total += f.open;
+  f.open = 0;
+  f.size += pad;
+  return true;
+}
+
+// Append to a file whose counts are in sync
+static bool slog_add(SlogFile &f, const SensorLog *rec) {
+  uint16_t used = f.size % SLOG_BLOCK_SIZE;
+  bool seal = false;
+  if (wr_file != &f || wr_size != f.size) {
+    // rebuild the coding state from the open block
+    wr_file = NULL;
+    wr_state.nslots = 0;
+    if (used) {
+      uint16_t len, total, end;
+      const uint8_t *b = slog_block(f, f.counts.size(), len);
+      if (!b) return false;
+      slog_decode(b, len, SLOG_MAX_RECORDS, wr_state, 0, 0, NULL, &total, &end);
+      if (end != used) seal = true;  // torn tail, continue in a new block
+    }
+    wr_file = &f;
+  }
+
+  uint8_t buf[SLOG_HDR_SIZE + SLOG_REC_MAX];
+  uint8_t n = 0;
+  if (used && !seal) {
+    n = slog_encode(wr_state, rec, buf);
+    if (used + n > SLOG_DATA_END || f.open >= SLOG_MAX_RECORDS) seal = true;
+  }
+  if (seal) {
+    if (!slog_seal(f, used)) return false;
+    used = 0;
+  }
+  if (!used) {
+    wr_state.nslots = 0;
+    memcpy(buf, slog_magic, sizeof(slog_magic));
+    put_le(buf + 4, (uint32_t)rec->time, 4);
+    n = SLOG_HDR_SIZE + slog_encode(wr_state, rec, buf + SLOG_HDR_SIZE);
+  }
+  file_append_block(f.fn, buf, n);
+  f.size += n;
+  f.open++;
+  wr_size = f.size;
+  return true;
+}
+
+bool slog_append(const char *fn, const SensorLog *rec) {
+  SlogFile &f = slog_file(fn);
+  slog_sync(f);
+  return slog_add(f, rec);
+}
+
+ulong slog_count(const char *fn) {
+  SlogFile &f = slog_file(fn);
+  slog_sync(f);
+  return f.total + f.open;
+}
+
+int slog_read(const char *fn, ulong idx, int count, SensorLog *out) {
+  SlogFile &f = slog_file(fn);
+  slog_sync(f);
+  ulong blk = 0, sealed = f.counts.size();
+  while (blk < sealed && idx >= f.counts[blk]) idx -= f.counts[blk++];
+
+  SlogState st;
+  int n = 0;
+  while (n < count && blk <= sealed) {
+    uint16_t len;
+    const uint8_t *b = slog_block(f, blk, len);
+    if (!b) break;
+    uint16_t limit = (blk < sealed) ? f.counts[blk] : f.open;
+    n += slog_decode(b, len, limit, st, idx, count - n, out + n, NULL, NULL);
+    idx = 0;
+    blk++;
+  }
+  return n;
+}
+
+static uint32_t slog_block_time(const SlogFile &f, ulong blk) {
+  uint8_t hdr[SLOG_HDR_SIZE];
+  if (file_read_block(f.fn, hdr, blk * SLOG_BLOCK_SIZE, SLOG_HDR_SIZE) != SLOG_HDR_SIZE) return 0;
+  return (uint32_t)get_le(hdr + 4, 4);
+}
+
+ulong slog_seek(const char *fn, ulong time) {
+  SlogFile &f = slog_file(fn);
+  slog_sync(f);
+  ulong sealed = f.counts.size();
+  ulong nblk = sealed + (f.open ? 1 : 0);
+  if (!nblk) return 0;
+
+  // binary search the block headers for the first block starting at or
+  // after time, the first match is in that block or the one before
+  ulong lo = 0, hi = nblk;
+  while (lo < hi) {
+    ulong mid = lo + (hi - lo) / 2;
+    if (slog_block_time(f, mid) < time) lo = mid + 1;
+    else hi = mid;
+  }
+  ulong blk = lo ? lo - 1 : 0;
+  ulong idx = 0;
+  for (ulong i = 0; i < blk; i++) idx += f.counts[i];
+  ulong end = idx + ((blk < sealed) ? f.counts[blk] : f.open);
+
+  SensorLog buf[SLOG_READ_CHUNK];
+  while (idx < end) {
+    int want = (end - idx < SLOG_READ_CHUNK) ? (int)(end - idx) : SLOG_READ_CHUNK;
+    int n = slog_read(fn, idx, want, buf);
+    if (n <= 0) break;
+    for (int i = 0; i < n; i++) {
+      if (buf[i].time >= time) return idx + i;
+    }
+    idx += n;
+  }
+  return idx;
+}
+
+// Copy records into a fresh file next to fn and swap it in
+static ulong slog_copy(const char *fn, bool raw, bool (*keep)(const SensorLog *rec, void *ctx), void *ctx) {
+  char tmp[sizeof(files[0].fn)];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", fn);
+  remove_file(tmp);
+  SlogFile &t = slog_file(tmp);
+  slog_sync(t);
+
+  SensorLog *buf = new SensorLog[SLOG_COPY_CHUNK];
+  ulong dropped = 0, idx = 0;
+  ulong total = raw ? file_size(fn) / sizeof(SensorLog) : slog_count(fn);
+  while (idx < total) {
+    int n;
+    if (raw) {
+      n = file_read_block(fn, buf, idx * sizeof(SensorLog), SLOG_COPY_CHUNK * sizeof(SensorLog)) / sizeof(SensorLog);
+    } else {
+      n = slog_read(fn, idx, SLOG_COPY_CHUNK, buf);
+    }
+    if (n <= 0) break;
+    for (int i = 0; i < n; i++) {
+      if (keep(&buf[i], ctx)) slog_add(t, &buf[i]);
+      else dropped++;
+    }
+    idx += n;
+  }
+  delete[] buf;
+
+  if (raw || dropped) {
+    remove_file(fn);
+    if (file_exists(tmp)) rename_file(tmp, fn);
+  }
+  remove_file(tmp);
+  slog_forget(tmp);
+  slog_forget(fn);
+  return dropped;
+}
+
+ulong slog_rewrite(const char *fn, bool (*keep)(const SensorLog *rec, void *ctx), void *ctx) {
+  if (!slog_count(fn)) return 0;
+  return slog_copy(fn, false, keep, ctx);
+}
+
+static bool keep_used(const SensorLog *rec, void *) {
+  return rec->nr != 0;  // nr 0 marks entries cleared in place by older firmware
+}
+
+void slog_migrate(const char *fn) {
+  if (!file_size(fn)) return;
+  uint8_t magic[sizeof(slog_magic)];
+  if (file_read_block(fn, magic, 0, sizeof(magic)) == sizeof(magic) &&
+      memcmp(magic, slog_magic, sizeof(magic)) == 0) return;
+  DEBUG_PRINT(F("sensorlog: converting "));
+  DEBUG_PRINTLN(fn);
+  slog_copy(fn, true, keep_used, NULL);
+}
@@ -0,0 +1,64 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Compressed block storage for the sensor log rings
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SENSORLOG_STORE_H
+#define _SENSORLOG_STORE_H
+
+#include "defines.h"
+
+struct SensorLog;
+
+// Log files are a sequence of fixed size blocks. A block starts with
+// "SLZ1" and the time of its first record, records are byte aligned and
+// only ever appended, the last byte of a sealed block holds its record count.
+#if defined(ESP8266)
+#define SLOG_BLOCK_SIZE  512
+#define SLOG_MAX_SLOTS   8    // sensors delta coded per block, others are stored literally
+#else
+#define SLOG_BLOCK_SIZE  1024
+#define SLOG_MAX_SLOTS   15
+#endif
+#define SLOG_MAX_RECORDS 255
+
+/** Append one record to a log file */
+bool slog_append(const char *fn, const SensorLog *rec);
+
+/** Number of records in a log file */
+ulong slog_count(const char *fn);
+
+/** Decode up to count records starting at idx, returns the number read */
+int slog_read(const char *fn, ulong idx, int count, SensorLog *out);
+
+/** Index of the first record at or after time, slog_count() if there is none */
+ulong slog_seek(const char *fn, ulong time);
+
+/**
+ * @brief Rewrite a log file keeping only the records keep() accepts
+ * @return number of records dropped
+ */
+ulong slog_rewrite(const char *fn, bool (*keep)(const SensorLog *rec, void *ctx), void *ctx);
+
+/** Convert a log file written with the old fixed-size records, if needed */
+void slog_migrate(const char *fn);
+
+#endif // _SENSORLOG_STORE_H
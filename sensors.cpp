@@ -23,6 +23,11 @@
 #include "sensors.h"
 #include "SensorBase.hpp"
 #include "sensors_util.h"
+#include "response_cache.h"
+#include "adc_sampler.h"
+#include "sensorlog_store.h"
+#include "config_journal.h"
+#include "event_stream.h"
 #include "main.h"
 #include "TimeLib.h"
 #include <new>
@@ -113,6 +118,7 @@
 #include "notifier.h"
 
 #include <map>
+#include <vector>
 #ifdef ADS1115
 #include "sensor_ospi_ads1115.h"
 #endif
@@ -150,6 +156,8 @@ static std::map<uint, SensorBase*>::iterator current_sensor_it;
 
 // Factory forward declaration
 SensorBase* sensor_make_obj(uint type, boolean ip_based);
+static void sensor_save_nr(uint nr);
+static void sensor_save_runtime();
 
 // Boards:
 static uint16_t asb_detected_boards = 0;  // bit 1=0x48+0x49 bit 2=0x4A+0x4B usw
@@ -162,6 +170,16 @@ static std::map<uint, ProgSensorAdjust*> progSensorAdjustsMap;
 // NOTE: std::map cannot use EXT_RAM_BSS_ATTR - has internal tree pointers
 static std::map<uint, Monitor*> monitorsMap;
 
+// The JSON config files are snapshots, edits go to their journal (see
+// config_journal.h). CRC of the JSON last persisted for each object, so a
+// save only journals the objects that actually changed.
+static std::map<uint, uint32_t> sensor_crcs;
+static std::map<uint, uint32_t> prog_adjust_crcs;
+static std::map<uint, uint32_t> monitor_crcs;
+static bool sensor_compact_due = false;
+static bool prog_adjust_compact_due = false;
+static bool monitor_compact_due = false;
+
 static const unsigned char MAX_SENSOR_UNITNAMES = 18;
 const char *sensor_unitNames[]{
   "",  "%", "°C", "°F", "V", "%", "in", "mm", "mph", "kmh", "%", "DK", "LM", "LX", "L", "gal", "L Verbrauch", "gal Verbrauch"
@@ -186,6 +204,7 @@ const char *sensor_unitNames[]{
     //  17=gal Verbrauch (relative consumption)
 };
 uint8_t logFileSwitch[3] = {0, 0, 0};  // 0=use smaller File, 1=LOG1, 2=LOG2
+static uint32_t logGeneration[3] = {0, 0, 0};  // bumped when log entries move or vanish
 
 extern volatile ulong flow_count;
 
@@ -413,6 +432,8 @@ void detect_asb_board() {
   // DEBUG_PRINTLN(asb_detected_boards);
 
   for (int log = 0; log <= 2; log++) {
+    slog_migrate(getlogfile(log));
+    slog_migrate(getlogfile2(log));
     checkLogSwitch(log);
 /*#if defined(ENABLE_DEBUG)
     // DEBUG_PRINT(F("log="));
@@ -667,10 +688,13 @@ void sensor_api_loop() {
     sensor_ble_loop();
   }
 #endif
+
+  adc_sampler_loop();
 }
 
 void sensor_save_all() {
   sensor_save();
+  sensor_save_runtime();
   prog_adjust_save();
   monitor_save();
 #if defined(OSPI)
@@ -721,6 +745,7 @@ void sensor_api_free() {
   #if defined(ESP8266) || defined(ESP32) || defined(OSPI)
   sensor_modbus_rtu_free();
   #endif
+  adc_sampler_free();
   // DEBUG_PRINTLN(F("sensor_api_free5"));
 }
 
@@ -781,6 +806,7 @@ Monitor* monitor_iterate_next(MonitorIterator& it) {
  * @param nr
  */
 int sensor_delete(uint nr, bool save_now) {
+  cache_invalidate(CACHE_DOM_SENSORS);
   auto it = sensorsMap.find(nr);
   if (it == sensorsMap.end()) return HTTP_RQT_NOT_RECEIVED;
   // Do not create a new driver object here; just remove the sensor
@@ -793,7 +819,7 @@ int sensor_delete(uint nr, bool save_now) {
   // minutes and made the /sc delete request appear to "do nothing". Stale
   // entries for this nr age out naturally as the ring log rotates; a re-created
   // sensor re-using the same nr simply sees them until then.
-  if (save_now) sensor_save();
+  if (save_now) sensor_save_nr(nr);
   return HTTP_RQT_SUCCESS;
 }
 
@@ -817,6 +843,7 @@ static inline void sensor_notify_zigbee(SensorBase *s) {
  * @param save if true, save to file after update (default: false)
  */
 int sensor_define(ArduinoJson::JsonVariantConst json, bool save) {
+  cache_invalidate(CACHE_DOM_SENSORS);
   if (!json.containsKey("nr")) {
     return HTTP_RQT_NOT_RECEIVED;
   }
@@ -840,7 +867,7 @@ int sensor_define(ArduinoJson::JsonVariantConst json, bool save) {
     SensorBase *sensor = it->second;
     sensor->fromJson(json);
     
-    if (save) sensor_save();
+    if (save) sensor_save_nr(nr);
     sensor_notify_zigbee(sensor);
     if (sensor->type != SENSOR_ZIGBEE) sensor_request_save(); // debounced persist
     
@@ -863,7 +890,7 @@ int sensor_define(ArduinoJson::JsonVariantConst json, bool save) {
       // Same type, update from JSON
       old_sensor->fromJson(json);
       
-      if (save) sensor_save();
+      if (save) sensor_save_nr(nr);
       sensor_notify_zigbee(old_sensor);
       return HTTP_RQT_SUCCESS;
     }
@@ -973,7 +1000,7 @@ int sensor_define(ArduinoJson::JsonVariantConst json, bool save) {
   }
 
   sensorsMap[nr] = new_sensor;
-  if (save) sensor_save();
+  if (save) sensor_save_nr(nr);
   sensor_notify_zigbee(new_sensor);
   return HTTP_RQT_SUCCESS;
 }
@@ -981,6 +1008,7 @@ int sensor_define(ArduinoJson::JsonVariantConst json, bool save) {
 int sensor_define_userdef(uint nr, int16_t factor, int16_t divider,
                           const char *userdef_unit, int16_t offset_mv,
                           int16_t offset2, int16_t assigned_unitid) {
+  cache_invalidate(CACHE_DOM_SENSORS);
   // Wrapper: build JSON and call sensor_define
   JsonDocument doc;
   JsonObject config = doc.to<JsonObject>();
@@ -1003,43 +1031,415 @@ int sensor_define_userdef(uint nr, int16_t factor, int16_t divider,
 #include "ArduinoJson.hpp"
 
 #if !defined(ESP8266)
-static void sensor_trend_init_from_log(SensorBase *sensor) {
-  if (!sensor) return;
+// Newest-first samples collected for one sensor during the boot scan
+struct TrendSeed {
+  uint nr;
+  SensorBase *sensor;
+  uint8_t count;
+  bool done;
+  uint32_t time[SensorBase::TREND_HISTORY_SIZE];
+  double data[SensorBase::TREND_HISTORY_SIZE];
+};
 
+/**
+ * @brief Rebuild the trend history and last values of all sensors from the log
+ * Walks the std log tail once, newest record first, and hands each record to
+ * its sensor. Stops as soon as every logging sensor has a full trend history,
+ * or at the lookback window / entry limit, so boot cost does not grow with the
+ * number of sensors.
+ */
+static void sensor_trend_init_from_log() {
   const uint32_t TREND_INIT_LOOKBACK_SEC = 24UL * 3600UL; // 24h window
   const uint16_t TREND_INIT_BLOCK = 64;
-  const uint16_t TREND_INIT_MAX_ENTRIES = 512;
+  const uint16_t TREND_INIT_MAX_ENTRIES = 4096;
+  const uint32_t min_interval = SensorBase::TREND_MIN_SPAN_SEC / SensorBase::TREND_HISTORY_SIZE;
 
   ulong total = sensorlog_size(LOG_STD);
-  if (total == 0) return;
+  if (total == 0 || sensorsMap.empty()) return;
+
+  // sensorsMap is ordered by nr, so the seeds can be searched by nr
+  std::vector<TrendSeed> seeds(sensorsMap.size());
+  size_t pending = 0, n = 0;
+  for (auto &kv : sensorsMap) {
+    TrendSeed &seed = seeds[n++];
+    seed.nr = kv.first;
+    seed.sensor = kv.second;
+    seed.count = 0;
+    seed.done = !kv.second || !kv.second->flags.log;
+    if (!seed.done) pending++;
+  }
+  if (!pending) return;
 
   ulong now = os.now_tz();
   ulong cutoff = (now > TREND_INIT_LOOKBACK_SEC) ? (now - TREND_INIT_LOOKBACK_SEC) : 0;
-  ulong start = findLogPosition(LOG_STD, cutoff);
-
-  // Clamp to last N entries to avoid long scans on large logs
-  if (total > TREND_INIT_MAX_ENTRIES && (total - start) > TREND_INIT_MAX_ENTRIES) {
-    start = total - TREND_INIT_MAX_ENTRIES;
-  }
+  ulong stop = (total > TREND_INIT_MAX_ENTRIES) ? (total - TREND_INIT_MAX_ENTRIES) : 0;
 
   SensorLog_t *buffer = new SensorLog_t[TREND_INIT_BLOCK];
-  for (ulong idx = start; idx < total; idx += TREND_INIT_BLOCK) {
-    int count = sensorlog_load2(LOG_STD, idx, TREND_INIT_BLOCK, buffer);
-    if (count <= 0) break;
-    for (int i = 0; i < count; i++) {
-      if (buffer[i].nr == sensor->nr) {
-        // Respect the creation barrier so a re-used nr does not seed the trend
-        // from the previous sensor's leftover log entries.
-        if (sensor->log_barrier && buffer[i].time && buffer[i].time < sensor->log_barrier)
-          continue;
-        sensor->trend_add_sample(buffer[i].data, buffer[i].time);
+  ulong end = total;
+  while (end > stop && pending) {
+    ulong idx = (end - stop > TREND_INIT_BLOCK) ? (end - TREND_INIT_BLOCK) : stop;
+    // a block may straddle the two log files, load2 stops at the boundary
+    int count = 0, want = end - idx;
+    while (count < want) {
+      int got = sensorlog_load2(LOG_STD, idx + count, want - count, buffer + count);
+      if (got <= 0) break;
+      count += got;
+    }
+    if (count < want) break;
+    end = idx;
+    for (int i = count - 1; i >= 0 && pending; i--) {
+      const SensorLog_t &rec = buffer[i];
+      if (rec.time < cutoff) { pending = 0; break; }
+
+      size_t lo = 0, hi = seeds.size();
+      while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (seeds[mid].nr < rec.nr) lo = mid + 1;
+        else hi = mid;
+      }
+      if (lo >= seeds.size() || seeds[lo].nr != rec.nr) continue;
+      TrendSeed &seed = seeds[lo];
+      if (seed.done) continue;
+      SensorBase *sensor = seed.sensor;
+
+      // Respect the creation barrier so a re-used nr does not seed the trend
+      // from the previous sensor's leftover log entries. Everything older is
+      // behind the barrier too.
+      if (sensor->log_barrier && rec.time && rec.time < sensor->log_barrier) {
+        seed.done = true;
+        pending--;
+        continue;
+      }
+      if (rec.time == 0 || !isfinite(rec.data)) continue;
+
+      // the newest record is the last reading before the restart
+      if (!sensor->last_read) {
+        sensor->last_read = rec.time;
+        sensor->last_data = rec.data;
+        sensor->last_native_data = rec.native_data;
+      }
+      // keep the same spacing trend_add_sample() enforces, counted from the newest
+      if (seed.count && rec.time + min_interval > seed.time[seed.count - 1]) continue;
+      seed.time[seed.count] = rec.time;
+      seed.data[seed.count] = rec.data;
+      if (++seed.count >= SensorBase::TREND_HISTORY_SIZE) {
+        seed.done = true;
+        pending--;
       }
     }
   }
   delete[] buffer;
+
+  for (TrendSeed &seed : seeds) {
+    for (uint8_t i = seed.count; i > 0; i--) {
+      seed.sensor->trend_add_sample(seed.data[i - 1], seed.time[i - 1]);
+    }
+  }
 }
 #endif // !defined(ESP8266)
 
+// Forwards JSON output to a file (if any) and keeps the CRC of all bytes
+class CrcWriter {
+public:
+  explicit CrcWriter(FileWriter *out) : crc(0), out(out) {}
+  size_t write(uint8_t c) {
+    crc = cj_crc32(crc, &c, 1);
+    return out ? out->write(c) : 1;
+  }
+  size_t write(const uint8_t *data, size_t length) {
+    crc = cj_crc32(crc, data, length);
+    return out ? out->write(data, length) : length;
+  }
+  uint32_t crc;
+private:
+  FileWriter *out;
+};
+
+/**
+ * @brief Rewrite a config snapshot, one object document at a time
+ * Writes a temp file, validates it, then swaps it in through the .bak rotation
+ * so an interrupted save never clobbers the previous good file (#263). A
+ * per-object document keeps the peak allocation tiny (#272). On success the
+ * journal is dropped and crcs describes the new file.
+ */
+template <typename T, typename ToDoc>
+static bool config_write_snapshot(const char *fn, const std::map<uint, T*> &objs,
+                                  std::map<uint, uint32_t> &crcs, ToDoc to_doc) {
+  char tmpfile[40], bakfile[40];
+  snprintf(tmpfile, sizeof(tmpfile), "%s.tmp", fn);
+  snprintf(bakfile, sizeof(bakfile), "%s.bak", fn);
+
+  std::map<uint, uint32_t> new_crcs;
+  if (file_exists(tmpfile)) remove_file(tmpfile);
+  bool ok = true;
+  {
+    FileWriter writer(tmpfile);
+    writer.write('[');
+
+    bool first = true;
+    for (auto &kv : objs) {
+      if (!kv.second) continue;
+      if (!first) writer.write(',');
+      first = false;
+
+      ArduinoJson::JsonDocument doc;
+      to_doc(kv.second, doc);
+      if (doc.overflowed()) ok = false;
+      CrcWriter out(&writer);
+      ArduinoJson::serializeJson(doc, out);
+      new_crcs[kv.first] = out.crc;
+    }
+
+    writer.write(']');
+  }  // writer flushes its buffer on destruction here
+
+  // Validate the temp file: must be non-empty, terminate with ']' (the stream
+  // completed), and no per-object build must have overflowed (OOM).
+  ulong tsize = file_size(tmpfile);
+  unsigned char lastc = 0;
+  if (tsize > 0) file_read_block(tmpfile, &lastc, tsize - 1, 1);
+  if (!ok || tsize < 2 || lastc != ']') {
+    DEBUG_PRINTF("%s: serialization failed, keeping previous file\n", fn);
+    remove_file(tmpfile);
+    return false;
+  }
+
+  if (file_exists(fn)) {
+    if (file_exists(bakfile)) remove_file(bakfile);
+    rename_file(fn, bakfile);
+  }
+  if (!rename_file(tmpfile, fn)) {
+    // Some filesystems refuse rename onto an existing target; retry after
+    // removing it.
+    if (file_exists(fn)) remove_file(fn);
+    if (!rename_file(tmpfile, fn)) {
+      // Last resort: restore from backup so we are not left without a file.
+      DEBUG_PRINTF("%s: rename failed, restoring backup\n", fn);
+      if (file_exists(bakfile)) rename_file(bakfile, fn);
+      remove_file(tmpfile);
+      return false;
+    }
+  }
+  cj_reset(fn);
+  crcs.swap(new_crcs);
+  return true;
+}
+
+/**
+ * @brief Journal one object if its JSON differs from what was persisted
+ * @return false if the record could not be appended
+ */
+static bool config_journal_object(const char *fn, std::map<uint, uint32_t> &crcs, uint nr,
+                                  ArduinoJson::JsonDocument &doc) {
+  if (doc.overflowed()) return false;
+  size_t len = ArduinoJson::measureJson(doc);
+  if (len > 0xFFFF) return false;
+  char *json = (char *)malloc(len + 1);
+  if (!json) return false;
+  ArduinoJson::serializeJson(doc, json, len + 1);
+
+  bool ok = true;
+  uint32_t crc = cj_crc32(0, json, len);
+  auto it = crcs.find(nr);
+  if (it == crcs.end() || it->second != crc) {
+    ok = cj_append(fn, CJ_UPSERT, nr, json, (uint16_t)len);
+    if (ok) crcs[nr] = crc;
+  }
+  free(json);
+  return ok;
+}
+
+/** Journal the deletion of a persisted object */
+static bool config_journal_delete(const char *fn, std::map<uint, uint32_t> &crcs, uint nr) {
+  if (!crcs.count(nr)) return true;
+  if (!cj_append(fn, CJ_DELETE, nr, NULL, 0)) return false;
+  crcs.erase(nr);
+  return true;
+}
+
+/**
+ * @brief Persist a config map
+ * Journals the objects that changed (nr >= 0: only that one) and the deleted
+ * ones. Without a snapshot, or if an append fails, the snapshot is rewritten
+ * instead. Once the journal outgrows its threshold compact_due is set and
+ * config_compact() rewrites the snapshot in the background.
+ */
+template <typename T, typename ToDoc>
+static void config_persist(const char *fn, const std::map<uint, T*> &objs, std::map<uint, uint32_t> &crcs,
+                           bool &compact_due, ToDoc to_doc, long nr = -1) {
+  bool ok = file_exists(fn);
+  if (ok && nr >= 0) {
+    auto it = objs.find((uint)nr);
+    if (it != objs.end() && it->second) {
+      ArduinoJson::JsonDocument doc;
+      to_doc(it->second, doc);
+      ok = config_journal_object(fn, crcs, (uint)nr, doc);
+    } else {
+      ok = config_journal_delete(fn, crcs, (uint)nr);
+    }
+  } else if (ok) {
+    for (auto it = objs.begin(); ok && it != objs.end(); ++it) {
+      if (!it->second) continue;
+      ArduinoJson::JsonDocument doc;
+      to_doc(it->second, doc);
+      ok = config_journal_object(fn, crcs, it->first, doc);
+    }
+    std::vector<uint> gone;
+    for (auto &kv : crcs) {
+      if (!objs.count(kv.first)) gone.push_back(kv.first);
+    }
+    for (size_t i = 0; ok && i < gone.size(); i++) {
+      ok = config_journal_delete(fn, crcs, gone[i]);
+    }
+  }
+
+  if (!ok) {
+    if (config_write_snapshot(fn, objs, crcs, to_doc)) compact_due = false;
+  } else if (cj_needs_compact(fn)) {
+    compact_due = true;
+  }
+}
+
+/** CRCs of the objects as loaded, to tell later which ones changed */
+template <typename T, typename ToDoc>
+static void config_load_crcs(const std::map<uint, T*> &objs, std::map<uint, uint32_t> &crcs, ToDoc to_doc) {
+  crcs.clear();
+  for (auto &kv : objs) {
+    if (!kv.second) continue;
+    ArduinoJson::JsonDocument doc;
+    to_doc(kv.second, doc);
+    CrcWriter out(NULL);
+    ArduinoJson::serializeJson(doc, out);
+    crcs[kv.first] = out.crc;
+  }
+}
+
+// Runtime fields of SensorBase::toJson(), not part of the persisted config
+static const char *const sensor_runtime_keys[] = {"data_ok", "last", "nativedata", "data", "trend"};
+
+// Build the persisted JSON of a sensor
+static void sensor_to_doc(SensorBase *sensor, JsonDocument &doc) {
+  JsonObject obj = doc.to<JsonObject>();
+
+  // For GenericSensors that preserve a raw JSON snapshot (unsupported type
+  // in this firmware variant), first restore ALL original fields so that
+  // variant-specific data (e.g. ZigBee device_ieee, cluster_id) is not lost.
+  // Base-class fields written below will overwrite with current values.
+  GenericSensor* gs = sensor->isGeneric() ? static_cast<GenericSensor*>(sensor) : nullptr;
+  if (gs && gs->_raw_json) {
+    JsonDocument tmp;
+    if (deserializeJson(tmp, gs->_raw_json) == DeserializationError::Ok) {
+      JsonObject tmpObj = tmp.as<JsonObject>();
+      for (auto kv_pair : tmpObj) {
+        obj[kv_pair.key()] = kv_pair.value();
+      }
+    }
+  }
+
+  // Always write current base-class values (name, enable, log, etc.).
+  sensor->toJson(obj);
+
+  // Readings change on every read; keeping them out of the config lets the
+  // CRC tell real edits apart. sensor_save_runtime() persists them instead.
+  for (const char *key : sensor_runtime_keys) obj.remove(key);
+}
+
+/**
+ * @brief Persist the last reading of every sensor
+ * Written in one go at the hourly cadence the whole sensor file used to be
+ * rewritten at, so readings survive a reboot without journaling them.
+ */
+static void sensor_save_runtime() {
+  if (!apiInit) return;
+  if (file_exists(SENSOR_FILENAME_RUNTIME)) remove_file(SENSOR_FILENAME_RUNTIME);
+  FileWriter writer(SENSOR_FILENAME_RUNTIME);
+  writer.write('[');
+  bool first = true;
+  for (auto &kv : sensorsMap) {
+    SensorBase *sensor = kv.second;
+    if (!sensor || !sensor->last) continue;
+    if (!first) writer.write(',');
+    first = false;
+
+    JsonDocument doc;
+    doc[F("nr")] = kv.first;
+    doc[F("last")] = sensor->last;
+    doc[F("nativedata")] = sensor->last_native_data;
+    doc[F("data")] = sensor->last_data;
+    serializeJson(doc, writer);
+  }
+  writer.write(']');
+}
+
+/** Restore the readings saved by sensor_save_runtime() */
+static void sensor_load_runtime() {
+  if (!file_exists(SENSOR_FILENAME_RUNTIME)) return;
+  FileReader reader(SENSOR_FILENAME_RUNTIME);
+  JsonDocument doc;
+  if (deserializeJson(doc, reader) || !doc.is<JsonArray>()) return;
+  for (JsonVariant v : doc.as<JsonArray>()) {
+    auto it = sensorsMap.find(v[F("nr")] | 0u);
+    if (it == sensorsMap.end() || !it->second) continue;
+    SensorBase *sensor = it->second;
+    sensor->last = v[F("last")] | sensor->last;
+    sensor->last_native_data = v[F("nativedata")] | sensor->last_native_data;
+    sensor->last_data = v[F("data")] | sensor->last_data;
+  }
+}
+
+// Create a sensor from its JSON config and add it to sensorsMap
+static bool sensor_parse_entry(JsonVariant v) {
+  uint sensorType = v["type"] | 0;
+  uint sensorNr = v["nr"] | 0;
+  if (sensorNr == 0 || sensorType == 0) {
+    return false; // Skip invalid sensor entries (type=0 or nr=0)
+  }
+  boolean ip_based = (v["ip"] | 0) != 0;
+
+  SensorBase *sensor = sensor_make_obj(sensorType, ip_based);
+  if (!sensor) {
+    sensor = new GenericSensor(sensorType);
+  }
+
+  sensor->fromJson(v);
+
+  // If the type is not supported in this firmware variant (e.g. a ZigBee
+  // sensor loaded on a Matter build), store the full raw JSON so all
+  // variant-specific fields (device_ieee, cluster_id, …) survive the
+  // roundtrip back to the original firmware.
+  if (!sensor_type_supported(sensorType)) {
+    DEBUG_PRINTF("sensor_load: type %u not supported in this firmware variant "
+                 "\u2014 loaded as generic sensor (all data preserved)\n", sensorType);
+    if (sensor->isGeneric()) {
+      GenericSensor* gs = static_cast<GenericSensor*>(sensor);
+      String raw;
+      serializeJson(v, raw);
+      gs->setRawJson(raw.c_str(), raw.length());
+    }
+  }
+
+  sensorsMap[sensor->nr] = sensor;
+  sensor->flags.data_ok = false;
+  return true;
+}
+
+static void monitor_to_doc(Monitor *mon, ArduinoJson::JsonDocument &doc);
+static void prog_adjust_to_doc(ProgSensorAdjust *pa, ArduinoJson::JsonDocument &doc);
+
+// Apply a journal record to sensorsMap
+static void sensor_replay(uint8_t op, uint32_t nr, const char *json, void *ctx) {
+  (void)ctx;
+  auto it = sensorsMap.find(nr);
+  if (it != sensorsMap.end()) {
+    delete it->second;
+    sensorsMap.erase(it);
+  }
+  if (op != CJ_UPSERT) return;
+  JsonDocument doc;
+  if (deserializeJson(doc, json)) return;
+  sensor_parse_entry(doc.as<JsonVariant>());
+}
+
 // Parse a sensor JSON config file into sensorsMap. Returns false if the file is
 // missing, empty or contains invalid/corrupt JSON. Does not clear the map or
 // initialize drivers — that is the caller's responsibility so it can fall back
@@ -1064,42 +1464,13 @@ static bool sensor_parse_file(const char *fn) {
   else return false;
 
   for (JsonVariant v : arr) {
-    uint sensorType = v["type"] | 0;
-    uint sensorNr = v["nr"] | 0;
-    if (sensorNr == 0 || sensorType == 0) {
-      continue; // Skip invalid sensor entries (type=0 or nr=0)
-    }
-    boolean ip_based = (v["ip"] | 0) != 0;
-
-    SensorBase *sensor = sensor_make_obj(sensorType, ip_based);
-    if (!sensor) {
-      sensor = new GenericSensor(sensorType);
-    }
-
-    sensor->fromJson(v);
-
-    // If the type is not supported in this firmware variant (e.g. a ZigBee
-    // sensor loaded on a Matter build), store the full raw JSON so all
-    // variant-specific fields (device_ieee, cluster_id, …) survive the
-    // roundtrip back to the original firmware.
-    if (!sensor_type_supported(sensorType)) {
-      DEBUG_PRINTF("sensor_load: type %u not supported in this firmware variant "
-                   "\u2014 loaded as generic sensor (all data preserved)\n", sensorType);
-      if (sensor->isGeneric()) {
-        GenericSensor* gs = static_cast<GenericSensor*>(sensor);
-        String raw;
-        serializeJson(v, raw);
-        gs->setRawJson(raw.c_str(), raw.length());
-      }
-    }
-
-    sensorsMap[sensor->nr] = sensor;
-    sensor->flags.data_ok = false;
+    sensor_parse_entry(v);
   }
   return true;
 }
 
 void sensor_load() {
+  cache_invalidate(CACHE_DOM_SENSORS);
   // DEBUG_PRINTLN(F("sensor_load"));
 
   // Clean up existing map to avoid memory / heap leaks on reload
@@ -1135,7 +1506,14 @@ void sensor_load() {
     }
   }
 
+  sensor_crcs.clear();
+  sensor_compact_due = false;
   if (loaded) {
+    // Apply the edits made since the snapshot was written. A torn record
+    // ends the journal; compact so later appends do not land behind it.
+    if (!cj_replay(SENSOR_FILENAME_JSON, sensor_replay, NULL)) sensor_compact_due = true;
+    sensor_load_runtime();
+
     // Initialize sensor drivers
     for (auto &kv : sensorsMap) {
       SensorBase *s = kv.second;
@@ -1146,17 +1524,13 @@ void sensor_load() {
     }
 
 #if !defined(ESP8266)
-    // Initialize trend history from logs (longer time window)
-    for (auto &kv : sensorsMap) {
-      SensorBase *s = kv.second;
-      if (s) {
-        sensor_trend_init_from_log(s);
-      }
-    }
+    // Initialize trend history and last values from logs (longer time window)
+    sensor_trend_init_from_log();
 #endif
 
     // If we had to fall back to the backup, re-materialize a valid primary file.
-    if (from_backup) sensor_save();
+    if (from_backup) config_write_snapshot(SENSOR_FILENAME_JSON, sensorsMap, sensor_crcs, sensor_to_doc);
+    else config_load_crcs(sensorsMap, sensor_crcs, sensor_to_doc);
   }
 
   last_save_time = os.now_tz();
@@ -1187,91 +1561,47 @@ static void sensor_flush_pending() {
 }
 
 void sensor_save() {
+  cache_invalidate(CACHE_DOM_SENSORS);
   if (!apiInit) return;
   // DEBUG_PRINTLN(F("sensor_save (json)"));
 
   ensureConfigSpace();  // config takes priority over old logs on a full FS (#293)
+  config_persist(SENSOR_FILENAME_JSON, sensorsMap, sensor_crcs, sensor_compact_due, sensor_to_doc);
 
-  const char *tmpfile = SENSOR_FILENAME_JSON ".tmp";
-  const char *bakfile = SENSOR_FILENAME_JSON ".bak";
-
-  // Stream-serialize sensors one at a time to minimize peak heap usage.
-  // Building the full array in a single JsonDocument can OOM on ESP8266.
-  // Write to a temp file first so an interrupted/partial write never clobbers
-  // the existing good configuration (same data-loss class as #263).
-  if (file_exists(tmpfile)) remove_file(tmpfile);
-  bool ok = true;
-  {
-    FileWriter writer(tmpfile);
-    writer.write('[');
-
-  bool first = true;
-  for (auto &kv : sensorsMap) {
-    SensorBase *sensor = kv.second;
-
-    if (!first) writer.write(',');
-    first = false;
-
-    // Build a temporary per-sensor JsonDocument (freed each iteration)
-    JsonDocument doc;
-    JsonObject obj = doc.to<JsonObject>();
-
-    // For GenericSensors that preserve a raw JSON snapshot (unsupported type
-    // in this firmware variant), first restore ALL original fields so that
-    // variant-specific data (e.g. ZigBee device_ieee, cluster_id) is not lost.
-    // Base-class fields written below will overwrite with current values.
-    GenericSensor* gs = sensor->isGeneric() ? static_cast<GenericSensor*>(sensor) : nullptr;
-    if (gs && gs->_raw_json) {
-      JsonDocument tmp;
-      if (deserializeJson(tmp, gs->_raw_json) == DeserializationError::Ok) {
-        JsonObject tmpObj = tmp.as<JsonObject>();
-        for (auto kv_pair : tmpObj) {
-          obj[kv_pair.key()] = kv_pair.value();
-        }
-      }
-    }
+  last_save_time = os.now_tz();
+  current_sensor = NULL;
+}
 
-    // Always write current base-class values (name, enable, log, etc.).
-    sensor->toJson(obj);
-    if (doc.overflowed()) ok = false;
-    serializeJson(doc, writer);
-  }
+/** Persist a single defined or deleted sensor with one journal append */
+static void sensor_save_nr(uint nr) {
+  cache_invalidate(CACHE_DOM_SENSORS);
+  if (!apiInit) return;
 
-    writer.write(']');
-  }  // writer flushes its buffer on destruction here
+  ensureConfigSpace();
+  config_persist(SENSOR_FILENAME_JSON, sensorsMap, sensor_crcs, sensor_compact_due, sensor_to_doc, nr);
+  current_sensor = NULL;
+}
 
-  // Validate the temp file: must be non-empty, terminate with ']' (the stream
-  // completed), and the build must not have overflowed (OOM). Otherwise keep
-  // the previous good file untouched.
-  ulong tsize = file_size(tmpfile);
-  unsigned char lastc = 0;
-  if (tsize > 0) file_read_block(tmpfile, &lastc, tsize - 1, 1);
-  if (!ok || tsize < 2 || lastc != ']') {
-    DEBUG_PRINTLN(F("sensor_save: serialization failed, keeping previous file"));
-    remove_file(tmpfile);
-    last_save_time = os.now_tz();
+/**
+ * @brief Rewrite config snapshots whose journal is due for compaction
+ * Runs from the once-a-second part of read_all_sensors(), one file per call.
+ */
+static void config_compact() {
+  if (!apiInit) return;
+  if (sensor_compact_due) {
+    sensor_compact_due = false;
+    ensureConfigSpace();
+    config_write_snapshot(SENSOR_FILENAME_JSON, sensorsMap, sensor_crcs, sensor_to_doc);
     current_sensor = NULL;
-    return;
-  }
-
-  // Rotate the current good file to a backup, then atomically swap in the new
-  // validated file.
-  if (file_exists(SENSOR_FILENAME_JSON)) {
-    if (file_exists(bakfile)) remove_file(bakfile);
-    rename_file(SENSOR_FILENAME_JSON, bakfile);
-  }
-  if (!rename_file(tmpfile, SENSOR_FILENAME_JSON)) {
-    if (file_exists(SENSOR_FILENAME_JSON)) remove_file(SENSOR_FILENAME_JSON);
-    if (!rename_file(tmpfile, SENSOR_FILENAME_JSON)) {
-      DEBUG_PRINTLN(F("sensor_save: rename failed, restoring backup"));
-      if (file_exists(bakfile)) rename_file(bakfile, SENSOR_FILENAME_JSON);
-      remove_file(tmpfile);
-    }
+  } else if (monitor_compact_due) {
+    monitor_compact_due = false;
+    ensureConfigSpace();
+    config_write_snapshot(MONITOR_FILENAME, monitorsMap, monitor_crcs, monitor_to_doc);
+  } else if (prog_adjust_compact_due) {
+    prog_adjust_compact_due = false;
+    ensureConfigSpace();
+    config_write_snapshot(PROG_SENSOR_FILENAME, progSensorAdjustsMap, prog_adjust_crcs, prog_adjust_to_doc);
   }
-
-  last_save_time = os.now_tz();
-  // DEBUG_PRINTLN(F("sensor_save2"));
-  current_sensor = NULL;
 }
 
 uint sensor_count() {
@@ -1346,16 +1676,23 @@ void checkLogSwitch(uint8_t log) {
 }
 
 void checkLogSwitchAfterWrite(uint8_t log) {
+  // Same flash budget as MAX_LOG_SIZE uncompressed entries, compression
+  // turns it into more history
   ulong size = file_size(getlogfile(log));
-  if ((size / SENSORLOG_STORE_SIZE) >= MAX_LOG_SIZE) {  // switch logs if max reached
+  if (size >= (ulong)MAX_LOG_SIZE * SENSORLOG_STORE_SIZE) {  // switch logs if max reached
     if (logFileSwitch[log] == 1)
       logFileSwitch[log] = 2;
     else
       logFileSwitch[log] = 1;
     remove_file(getlogfile(log));
+    logGeneration[log]++;
   }
 }
 
+uint32_t sensorlog_generation(uint8_t log) {
+  return log <= LOG_MONTH ? logGeneration[log] : 0;
+}
+
 bool sensorlog_add(uint8_t log, SensorLog_t *sensorlog) {
 #if defined(ESP8266) || defined(ESP32)
   static uint32_t last_error_time = 0;
@@ -1379,12 +1716,12 @@ bool sensorlog_add(uint8_t log, SensorLog_t *sensorlog) {
   // DEBUG_PRINT(F("sensorlog_add "));
   // DEBUG_PRINT(log);
   checkLogSwitch(log);
-  file_append_block(getlogfile(log), sensorlog, SENSORLOG_STORE_SIZE);
+  bool ok = slog_append(getlogfile(log), sensorlog);
   checkLogSwitchAfterWrite(log);
   // DEBUG_PRINT(F("="));
   // DEBUG_PRINTLN(sensorlog_filesize(log));
   
-  return true;
+  return ok;
 }
 
 bool sensorlog_add(uint8_t log, SensorBase *sensor, ulong time) {
@@ -1434,7 +1771,8 @@ ulong sensorlog_filesize(uint8_t log) {
 
 ulong sensorlog_size(uint8_t log) {
   // DEBUG_PRINT(F("sensorlog_size "));
-  ulong size = sensorlog_filesize(log) / SENSORLOG_STORE_SIZE;
+  checkLogSwitch(log);
+  ulong size = slog_count(getlogfile(log)) + slog_count(getlogfile2(log));
   // DEBUG_PRINTLN(size);
   return size;
 }
@@ -1450,80 +1788,52 @@ void sensorlog_clear(bool std, bool week, bool month) {
     remove_file(SENSORLOG_FILENAME1);
     remove_file(SENSORLOG_FILENAME2);
     logFileSwitch[LOG_STD] = 1;
+    logGeneration[LOG_STD]++;
   }
   if (week) {
     remove_file(SENSORLOG_FILENAME_WEEK1);
     remove_file(SENSORLOG_FILENAME_WEEK2);
     logFileSwitch[LOG_WEEK] = 1;
+    logGeneration[LOG_WEEK]++;
   }
   if (month) {
     remove_file(SENSORLOG_FILENAME_MONTH1);
     remove_file(SENSORLOG_FILENAME_MONTH2);
     logFileSwitch[LOG_MONTH] = 1;
+    logGeneration[LOG_MONTH]++;
   }
 }
 
+struct SensorlogClearFilter {
+  uint nr;
+  bool use_under;
+  double under;
+  bool use_over;
+  double over;
+  time_t before;
+  time_t after;
+};
+
+static bool sensorlog_clear_keep(const SensorLog_t *sl, void *ctx) {
+  const SensorlogClearFilter *c = (const SensorlogClearFilter *)ctx;
+  if (sl->nr == 0 || (c->nr > 0 && sl->nr != c->nr)) return true;
+  if (c->nr > 0 && !c->use_under && !c->use_over && !c->before && !c->after) return false;
+  if (c->use_under && sl->data < c->under) return false;
+  if (c->use_over && sl->data > c->over) return false;
+  if (c->before && sl->time < (ulong)c->before) return false;
+  if (c->after && sl->time > (ulong)c->after) return false;
+  return true;
+}
+
 ulong sensorlog_clear_sensor(uint sensorNr, uint8_t log, bool use_under,
                              double under, bool use_over, double over, time_t before, time_t after) {
-#define SLOG_BUFSIZE 64
-  SensorLog_t * sensorlog = new SensorLog_t[SLOG_BUFSIZE];
+  // Compressed blocks can't be patched in place, matching entries are
+  // dropped by rewriting each ring file once.
+  SensorlogClearFilter filter = {sensorNr, use_under, under, use_over, over, before, after};
   checkLogSwitch(log);
-  const char *flast = getlogfile2(log);
-  const char *fcur = getlogfile(log);
-  ulong size = file_size(flast) / SENSORLOG_STORE_SIZE;
-  ulong size2 = size + file_size(fcur) / SENSORLOG_STORE_SIZE;
-  const char *f;
-  ulong idxr = 0;
-  ulong n = 0;
-  // DEBUG_PRINTLN(F("clearlog1"));
-  // DEBUG_PRINTF("nr: %d log: %d under:%lf over: %lf before: %lld after: %lld size: %ld size2: %ld\n", sensorNr, log, under, over, before, after, size, size2);
-  while (idxr < size2) {
-    ulong idx = idxr;
-    if (idx >= size) {
-      idx -= size;
-      f = fcur;
-    } else {
-      f = flast;
-    }
-
-    ulong result = file_read_block(f, sensorlog, idx * SENSORLOG_STORE_SIZE,
-                                   SENSORLOG_STORE_SIZE*SLOG_BUFSIZE);
-    int entries = result / SENSORLOG_STORE_SIZE;
-    // Guard against a stalled read: if the block read returns nothing (EOF,
-    // read error, or a truncated log file) idxr would never advance and the
-    // outer while-loop would spin forever — hanging sensor_delete()/the /sc
-    // request. Stop clearing instead of looping endlessly.
-    if (entries <= 0) break;
-    bool block_modified = false;
-    for (int i = 0; i < entries; i++, idxr++) {
-      SensorLog_t * sl = &sensorlog[i];
-      if (sl->nr > 0 && (sl->nr == sensorNr || sensorNr == 0)) {
-        // DEBUG_PRINTF("clearlog2 idx=%ld idx2=%ld\n", idx, idxr);
-        boolean found = false;
-        if (use_under && sl->data < under) found = true;
-        if (use_over && sl->data > over) found = true;
-        if (before && sl->time < before) found = true;
-        if (after && sl->time > after) found = true;
-        if (sensorNr > 0 && sl->nr != sensorNr) found = false;
-        if (sensorNr > 0 && sl->nr == sensorNr && !use_under && !use_over && !before && !after) found = true;
-        if (found) {
-          sl->nr = 0;
-          block_modified = true;
-          n++;
-        }
-      }
-    }
-    // Write the whole modified block back in a SINGLE flash operation. The old
-    // code issued one open/seek/write/close per cleared entry, turning a log
-    // with hundreds of thousands of entries into as many flash ops on the
-    // W5500-shared SPI bus — which hung sensor_delete()/the /sc request.
-    if (block_modified) {
-      file_write_block(f, sensorlog, idx * SENSORLOG_STORE_SIZE,
-                       (ulong)entries * SENSORLOG_STORE_SIZE);
-    }
-  }
-  delete[] sensorlog;
-  // DEBUG_PRINTF("clearlog4 n=%ld\n", n);
+  ulong n = slog_rewrite(getlogfile2(log), sensorlog_clear_keep, &filter);
+  n += slog_rewrite(getlogfile(log), sensorlog_clear_keep, &filter);
+  if (n) logGeneration[log]++;
   return n;
 }
 
@@ -1534,22 +1844,8 @@ SensorLog_t *sensorlog_load(uint8_t log, ulong idx) {
 
 SensorLog_t *sensorlog_load(uint8_t log, ulong idx, SensorLog_t *sensorlog) {
   // DEBUG_PRINTLN(F("sensorlog_load"));
-
-  // Map lower idx to the other log file
-  checkLogSwitch(log);
-  const char *flast = getlogfile2(log);
-  const char *fcur = getlogfile(log);
-  ulong size = file_size(flast) / SENSORLOG_STORE_SIZE;
-  const char *f;
-  if (idx >= size) {
-    idx -= size;
-    f = fcur;
-  } else {
-    f = flast;
-  }
-
-  file_read_block(f, sensorlog, idx * SENSORLOG_STORE_SIZE,
-                  SENSORLOG_STORE_SIZE);
+  if (sensorlog_load2(log, idx, 1, sensorlog) != 1)
+    memset(sensorlog, 0, sizeof(SensorLog_t));
   return sensorlog;
 }
 
@@ -1560,41 +1856,30 @@ int sensorlog_load2(uint8_t log, ulong idx, int count, SensorLog_t *sensorlog) {
   checkLogSwitch(log);
   const char *flast = getlogfile2(log);
   const char *fcur = getlogfile(log);
-  ulong size = file_size(flast) / SENSORLOG_STORE_SIZE;
+  ulong size = slog_count(flast);
   const char *f;
   if (idx >= size) {
     idx -= size;
     f = fcur;
-    size = file_size(f) / SENSORLOG_STORE_SIZE;
   } else {
     f = flast;
   }
 
-  if (idx + count > size) count = size - idx;
   if (count <= 0) return 0;
-  file_read_block(f, sensorlog, idx * SENSORLOG_STORE_SIZE,
-                  count * SENSORLOG_STORE_SIZE);
-  return count;
+  return slog_read(f, idx, count, sensorlog);
 }
 
+/**
+ * @brief Index of the first entry at or after a time
+ * Seeks by the block headers of the older ring file, then the current one.
+ */
 ulong findLogPosition(uint8_t log, ulong after) {
-  ulong log_size = sensorlog_size(log);
-  ulong a = 0;
-  ulong b = log_size - 1;
-  ulong lastIdx = 0;
-  SensorLog_t sensorlog;
-  while (true) {
-    ulong idx = (b - a) / 2 + a;
-    sensorlog_load(log, idx, &sensorlog);
-    if (sensorlog.time < after) {
-      a = idx;
-    } else if (sensorlog.time > after) {
-      b = idx;
-    }
-    if (a >= b || idx == lastIdx) return idx;
-    lastIdx = idx;
-  }
-  return 0;
+  checkLogSwitch(log);
+  const char *flast = getlogfile2(log);
+  ulong size = slog_count(flast);
+  ulong idx = slog_seek(flast, after);
+  if (idx < size) return idx;
+  return size + slog_seek(getlogfile(log), after);
 }
 
 #if !defined(ARDUINO)
@@ -1880,7 +2165,7 @@ void push_message(SensorBase *sensor) {
                    "Content-Type: application/json\r\n\r\n$S"),
               SOPT_IFTTT_KEY, DEFAULT_IFTTT_URL, strlen(postval), postval);
 
-    os.send_http_request_async(DEFAULT_IFTTT_URL, 80, ether_buffer, sensor_remote_http_callback, false, 12000);
+    os.send_http_request_async(DEFAULT_IFTTT_URL, 80, ether_buffer, sensor_remote_http_callback, false, 12000, true, HTTP_PRIO_LOW);
     // DEBUG_PRINTLN(F("push ifttt2"));
   }
 
@@ -1952,8 +2237,11 @@ void read_all_sensors(boolean online) {
     sensor_update_groups();
     calc_sensorlogs();
     check_monitors();
-    if (time - last_save_time > 3600)  // 1h
+    if (time - last_save_time > 3600) {  // 1h: readings; config edits are journaled when made
       sensor_save();
+      sensor_save_runtime();
+    }
+    config_compact();
   }
 
   // Initialize iterator if we're starting over
@@ -2001,6 +2289,13 @@ void read_all_sensors(boolean online) {
           unsigned long push_start_ms = millis();
           push_message(current_sensor);
           DEBUG_PRINTF(F("[SENSOR] push done #%d duration=%lums\n"), current_sensor->nr, millis() - push_start_ms);
+          // %g prints nan/inf, which is not JSON
+          if (isfinite(current_sensor->last_data))
+            event_stream_post("sensor", "{\"nr\":%u,\"data\":%g,\"ok\":%d}", current_sensor->nr,
+                              current_sensor->last_data, (int)current_sensor->flags.data_ok);
+          else
+            event_stream_post("sensor", "{\"nr\":%u,\"data\":null,\"ok\":%d}", current_sensor->nr,
+                              (int)current_sensor->flags.data_ok);
         } else if (result == HTTP_RQT_TIMEOUT) {
           // delay next read on timeout:
           current_sensor->last_read = time + max((uint)60, current_sensor->read_interval);
@@ -2555,6 +2850,7 @@ double calc_sensor_watering_by_nr(uint nr) {
  * @return HTTP_RQT_SUCCESS on success, HTTP_RQT_NOT_RECEIVED on error
  */
 int prog_adjust_define(ArduinoJson::JsonVariantConst json, bool save) {
+  cache_invalidate(CACHE_DOM_SENSORS);
   if (!json.containsKey("nr")) {
     return HTTP_RQT_NOT_RECEIVED;
   }
@@ -2607,6 +2903,7 @@ int prog_adjust_define(ArduinoJson::JsonVariantConst json, bool save) {
  */
 int prog_adjust_define(uint nr, uint type, uint sensor, uint prog,
                        double factor1, double factor2, double min, double max, char * name) {
+  cache_invalidate(CACHE_DOM_SENSORS);
   // Convert to JSON and call new implementation
   ArduinoJson::JsonDocument doc;
   ArduinoJson::JsonObject obj = doc.to<ArduinoJson::JsonObject>();
@@ -2630,6 +2927,7 @@ int prog_adjust_define(uint nr, uint type, uint sensor, uint prog,
 }
 
 int prog_adjust_delete(uint nr, bool save_now) {
+  cache_invalidate(CACHE_DOM_SENSORS);
   auto it = progSensorAdjustsMap.find(nr);
   if (it != progSensorAdjustsMap.end()) {
     delete it->second;
@@ -2640,64 +2938,35 @@ int prog_adjust_delete(uint nr, bool save_now) {
   return HTTP_RQT_NOT_RECEIVED;
 }
 
+// Build the persisted JSON of a program adjustment
+static void prog_adjust_to_doc(ProgSensorAdjust *pa, ArduinoJson::JsonDocument &doc) {
+  ArduinoJson::JsonObject obj = doc.to<ArduinoJson::JsonObject>();
+  pa->toJson(obj);
+}
+
 void prog_adjust_save() {
+  cache_invalidate(CACHE_DOM_SENSORS);
   if (!apiInit) return;
 
   // DEBUG_PRINTLN(F("prog_adjust_save"));
 
   ensureConfigSpace();  // config takes priority over old logs on a full FS (#293)
+  config_persist(PROG_SENSOR_FILENAME, progSensorAdjustsMap, prog_adjust_crcs, prog_adjust_compact_due, prog_adjust_to_doc);
+}
 
-  const char *tmpfile = PROG_SENSOR_FILENAME ".tmp";
-  const char *bakfile = PROG_SENSOR_FILENAME ".bak";
-
-  // Create JSON document
-  ArduinoJson::JsonDocument doc;
-  ArduinoJson::JsonArray array = doc.to<ArduinoJson::JsonArray>();
-
-  // Serialize all prog sensor adjusts
-  size_t expected = 0;
-  for (auto &kv : progSensorAdjustsMap) {
-    ProgSensorAdjust *pa = kv.second;
-    if (pa) {
-      ArduinoJson::JsonObject obj = array.add<ArduinoJson::JsonObject>();
-      pa->toJson(obj);
-      expected++;
-    }
-  }
-
-  // Abort if the document could not be built completely (out of memory) so a
-  // truncated write never clobbers the existing good file (cf. #263).
-  if (doc.overflowed() || array.size() != expected) {
-    DEBUG_PRINTLN(F("prog_adjust_save: JSON build overflowed, keeping previous file"));
-    return;
-  }
-
-  // Write to a temp file first, validate, then atomically swap.
-  if (file_exists(tmpfile)) remove_file(tmpfile);
-  size_t written = 0;
-  {
-    FileWriter writer(tmpfile);
-    written = ArduinoJson::serializeJson(doc, writer);
-  }
+// Create a program adjustment from its JSON config and add it to the map
+static bool prog_adjust_parse_entry(ArduinoJson::JsonVariantConst v) {
+  ProgSensorAdjust *pa = new ProgSensorAdjust;
+  pa->fromJson(v);
 
-  if (written < 2 || file_size(tmpfile) != written) {
-    DEBUG_PRINTLN(F("prog_adjust_save: serialization failed, keeping previous file"));
-    remove_file(tmpfile);
-    return;
+  // Skip invalid entries
+  if (!pa->nr || !pa->type) {
+    delete pa;
+    return false;
   }
 
-  if (file_exists(PROG_SENSOR_FILENAME)) {
-    if (file_exists(bakfile)) remove_file(bakfile);
-    rename_file(PROG_SENSOR_FILENAME, bakfile);
-  }
-  if (!rename_file(tmpfile, PROG_SENSOR_FILENAME)) {
-    if (file_exists(PROG_SENSOR_FILENAME)) remove_file(PROG_SENSOR_FILENAME);
-    if (!rename_file(tmpfile, PROG_SENSOR_FILENAME)) {
-      DEBUG_PRINTLN(F("prog_adjust_save: rename failed, restoring backup"));
-      if (file_exists(bakfile)) rename_file(bakfile, PROG_SENSOR_FILENAME);
-      remove_file(tmpfile);
-    }
-  }
+  progSensorAdjustsMap[pa->nr] = pa;
+  return true;
 }
 
 // Parse a prog-adjust JSON file into progSensorAdjustsMap. Returns false if the
@@ -2722,21 +2991,27 @@ static bool prog_adjust_load_file(const char *fn) {
 
   ArduinoJson::JsonArray array = doc.as<ArduinoJson::JsonArray>();
   for (ArduinoJson::JsonVariantConst v : array) {
-    ProgSensorAdjust *pa = new ProgSensorAdjust;
-    pa->fromJson(v);
-
-    // Skip invalid entries
-    if (!pa->nr || !pa->type) {
-      delete pa;
-      continue;
-    }
-
-    progSensorAdjustsMap[pa->nr] = pa;
+    prog_adjust_parse_entry(v);
   }
   return true;
 }
 
+// Apply a journal record to progSensorAdjustsMap
+static void prog_adjust_replay(uint8_t op, uint32_t nr, const char *json, void *ctx) {
+  (void)ctx;
+  auto it = progSensorAdjustsMap.find(nr);
+  if (it != progSensorAdjustsMap.end()) {
+    delete it->second;
+    progSensorAdjustsMap.erase(it);
+  }
+  if (op != CJ_UPSERT) return;
+  ArduinoJson::JsonDocument doc;
+  if (ArduinoJson::deserializeJson(doc, json)) return;
+  prog_adjust_parse_entry(doc.as<ArduinoJson::JsonVariantConst>());
+}
+
 void prog_adjust_load() {
+  cache_invalidate(CACHE_DOM_SENSORS);
   // DEBUG_PRINTLN(F("prog_adjust_load"));
 
   // Clean up existing map
@@ -2744,8 +3019,15 @@ void prog_adjust_load() {
     delete kv.second;
   }
   progSensorAdjustsMap.clear();
+  prog_adjust_crcs.clear();
+  prog_adjust_compact_due = false;
 
-  if (prog_adjust_load_file(PROG_SENSOR_FILENAME)) return;
+  if (prog_adjust_load_file(PROG_SENSOR_FILENAME)) {
+    // Apply the edits made since the snapshot was written
+    if (!cj_replay(PROG_SENSOR_FILENAME, prog_adjust_replay, NULL)) prog_adjust_compact_due = true;
+    config_load_crcs(progSensorAdjustsMap, prog_adjust_crcs, prog_adjust_to_doc);
+    return;
+  }
 
   // Primary missing or corrupt: try to recover from the backup before giving up.
   for (auto &kv : progSensorAdjustsMap) delete kv.second;
@@ -2753,7 +3035,8 @@ void prog_adjust_load() {
 
   if (prog_adjust_load_file(PROG_SENSOR_FILENAME ".bak")) {
     DEBUG_PRINTLN(F("prog_adjust_load: recovered from backup"));
-    prog_adjust_save();
+    cj_replay(PROG_SENSOR_FILENAME, prog_adjust_replay, NULL);
+    config_write_snapshot(PROG_SENSOR_FILENAME, progSensorAdjustsMap, prog_adjust_crcs, prog_adjust_to_doc);
     return;
   }
 
@@ -2833,6 +3116,7 @@ void ensureConfigSpace() {
       DEBUG_PRINT(F("ensureConfigSpace: trimming old log "));
       DEBUG_PRINTLN(fn);
       remove_file(fn);
+      logGeneration[order[i]]++;
     }
   }
 
@@ -2852,6 +3136,7 @@ void ensureConfigSpace() {
         DEBUG_PRINT(F("ensureConfigSpace: trimming current log "));
         DEBUG_PRINTLN(fn);
         remove_file(fn);
+        logGeneration[last_order[i]]++;
       }
     }
   }
@@ -3221,6 +3506,29 @@ void Monitor::fromJson(ArduinoJson::JsonVariantConst obj) {
   }
 }
 
+// Create a monitor from its JSON config and add it to monitorsMap
+static bool monitor_parse_entry(ArduinoJson::JsonVariantConst v) {
+  Monitor_t *mon = new Monitor_t;
+  mon->fromJson(v);
+
+  // The persisted `active` must not suppress the first event after boot: a
+  // monitor whose condition is already met has to (re)fire its start/stop
+  // action once check_monitors() runs. Start inactive so the first evaluation
+  // produces a real transition. This runs only at boot (monitor_load_file and
+  // the journal replay are called solely from monitor_load()), so runtime
+  // reloads keep their state.
+  mon->active = false;
+
+  // Skip invalid entries
+  if (!mon->nr || !mon->type) {
+    delete mon;
+    return false;
+  }
+
+  monitorsMap[mon->nr] = mon;
+  return true;
+}
+
 // Parse a monitor JSON file into monitorsMap. Returns false if the file is
 // missing or contains invalid/corrupt JSON (in which case monitorsMap is left
 // unchanged so a caller can fall back to a backup file).
@@ -3244,28 +3552,27 @@ static bool monitor_load_file(const char *fn) {
 
   ArduinoJson::JsonArray array = doc.as<ArduinoJson::JsonArray>();
   for (ArduinoJson::JsonVariantConst v : array) {
-    Monitor_t *mon = new Monitor_t;
-    mon->fromJson(v);
-
-    // The persisted `active` must not suppress the first event after boot: a
-    // monitor whose condition is already met has to (re)fire its start/stop
-    // action once check_monitors() runs. Start inactive so the first evaluation
-    // produces a real transition. This runs only at boot (monitor_load_file is
-    // called solely from monitor_load()), so runtime reloads keep their state.
-    mon->active = false;
-
-    // Skip invalid entries
-    if (!mon->nr || !mon->type) {
-      delete mon;
-      continue;
-    }
-
-    monitorsMap[mon->nr] = mon;
+    monitor_parse_entry(v);
   }
   return true;
 }
 
+// Apply a journal record to monitorsMap
+static void monitor_replay(uint8_t op, uint32_t nr, const char *json, void *ctx) {
+  (void)ctx;
+  auto it = monitorsMap.find(nr);
+  if (it != monitorsMap.end()) {
+    delete it->second;
+    monitorsMap.erase(it);
+  }
+  if (op != CJ_UPSERT) return;
+  ArduinoJson::JsonDocument doc;
+  if (ArduinoJson::deserializeJson(doc, json)) return;
+  monitor_parse_entry(doc.as<ArduinoJson::JsonVariantConst>());
+}
+
 void monitor_load() {
+  cache_invalidate(CACHE_DOM_MONITORS);
   // DEBUG_PRINTLN(F("monitor_load"));
 
   // Clean up existing map
@@ -3273,9 +3580,13 @@ void monitor_load() {
     delete kv.second;
   }
   monitorsMap.clear();
+  monitor_crcs.clear();
+  monitor_compact_due = false;
 
-  // Primary file present and valid -> done.
+  // Primary file present and valid -> apply the journal and done.
   if (monitor_load_file(MONITOR_FILENAME)) {
+    if (!cj_replay(MONITOR_FILENAME, monitor_replay, NULL)) monitor_compact_due = true;
+    config_load_crcs(monitorsMap, monitor_crcs, monitor_to_doc);
     // DEBUG_PRINT(F("Loaded ")); DEBUG_PRINT(monitor_count()); DEBUG_PRINTLN(F(" monitors"));
     return;
   }
@@ -3288,7 +3599,9 @@ void monitor_load() {
 
   if (monitor_load_file(MONITOR_FILENAME ".bak")) {
     DEBUG_PRINTLN(F("monitor_load: recovered monitors from backup"));
-    monitor_save();  // re-materialize a valid primary file
+    cj_replay(MONITOR_FILENAME, monitor_replay, NULL);
+    // re-materialize a valid primary file
+    config_write_snapshot(MONITOR_FILENAME, monitorsMap, monitor_crcs, monitor_to_doc);
     return;
   }
 
@@ -3297,75 +3610,20 @@ void monitor_load() {
   }
 }
 
+// Build the persisted JSON of a monitor
+static void monitor_to_doc(Monitor *mon, ArduinoJson::JsonDocument &doc) {
+  ArduinoJson::JsonObject obj = doc.to<ArduinoJson::JsonObject>();
+  mon->toJson(obj);
+}
+
 void monitor_save() {
+  cache_invalidate(CACHE_DOM_MONITORS);
   if (!apiInit) return;
 
   // DEBUG_PRINTLN(F("monitor_save"));
 
   ensureConfigSpace();  // config takes priority over old logs on a full FS (#293)
-
-  const char *tmpfile = MONITOR_FILENAME ".tmp";
-  const char *bakfile = MONITOR_FILENAME ".bak";
-
-  // Stream-serialize monitors one at a time to minimize peak heap usage.
-  // Building the full array in a single JsonDocument can OOM on ESP8266 when
-  // many (HTTP/HTTPS) sensors already fragment the heap; the whole-list build
-  // would then silently drop monitors (#272: "adding one more HTTP sensor loses
-  // monitors"). A per-monitor document keeps the peak allocation tiny.
-  if (file_exists(tmpfile)) remove_file(tmpfile);
-  bool ok = true;
-  {
-    FileWriter writer(tmpfile);
-    writer.write('[');
-
-    bool first = true;
-    for (auto &kv : monitorsMap) {
-      Monitor_t *mon = kv.second;
-      if (!mon) continue;
-
-      if (!first) writer.write(',');
-      first = false;
-
-      ArduinoJson::JsonDocument doc;
-      ArduinoJson::JsonObject obj = doc.to<ArduinoJson::JsonObject>();
-      mon->toJson(obj);
-      if (doc.overflowed()) ok = false;
-      ArduinoJson::serializeJson(doc, writer);
-    }
-
-    writer.write(']');
-  }  // writer flushes its buffer on destruction here
-
-  // Validate the temp file: must be non-empty, terminate with ']' (the stream
-  // completed), and no per-monitor build must have overflowed (OOM). Otherwise
-  // keep the previous good file untouched (data-loss protection, #263).
-  ulong tsize = file_size(tmpfile);
-  unsigned char lastc = 0;
-  if (tsize > 0) file_read_block(tmpfile, &lastc, tsize - 1, 1);
-  if (!ok || tsize < 2 || lastc != ']') {
-    DEBUG_PRINTLN(F("monitor_save: serialization failed, keeping previous file"));
-    remove_file(tmpfile);
-    return;  // previous good file (if any) stays intact
-  }
-
-  // Rotate the current good file to a backup, then atomically swap in the new
-  // validated file.
-  if (file_exists(MONITOR_FILENAME)) {
-    if (file_exists(bakfile)) remove_file(bakfile);
-    rename_file(MONITOR_FILENAME, bakfile);
-  }
-
-  if (!rename_file(tmpfile, MONITOR_FILENAME)) {
-    // Some filesystems refuse rename onto an existing target; retry after
-    // removing it.
-    if (file_exists(MONITOR_FILENAME)) remove_file(MONITOR_FILENAME);
-    if (!rename_file(tmpfile, MONITOR_FILENAME)) {
-      // Last resort: restore from backup so we are not left without a file.
-      DEBUG_PRINTLN(F("monitor_save: rename failed, restoring backup"));
-      if (file_exists(bakfile)) rename_file(bakfile, MONITOR_FILENAME);
-      remove_file(tmpfile);
-    }
-  }
+  config_persist(MONITOR_FILENAME, monitorsMap, monitor_crcs, monitor_compact_due, monitor_to_doc);
 }
 
 int monitor_count() {
@@ -3373,6 +3631,7 @@ int monitor_count() {
 }
 
 int monitor_delete(uint nr, bool save_now) {
+  cache_invalidate(CACHE_DOM_MONITORS);
   auto it = monitorsMap.find(nr);
   if (it != monitorsMap.end()) {
     delete it->second;
@@ -3384,6 +3643,7 @@ int monitor_delete(uint nr, bool save_now) {
 }
 
 int monitor_define(uint nr, uint type, uint sensor, uint prog, uint zone, const Monitor_Union_t m, char * name, ulong maxRuntime, uint8_t prio, ulong reset_seconds, uint8_t output_mode, ulong stale_timeout, uint8_t failsafe_active, uint order, uint8_t show) {
+  cache_invalidate(CACHE_DOM_MONITORS);
   // Find or create monitor
   auto it = monitorsMap.find(nr);
   Monitor_t *p;
@@ -3921,6 +4181,9 @@ void check_monitors() {
       }
     }
 
+    if (mon && mon->active != wasActive) {
+      event_stream_post("monitor", "{\"nr\":%u,\"active\":%d}", nr, (int)mon->active);
+    }
     monidx++;
   }
 }
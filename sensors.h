@@ -61,6 +61,7 @@ extern "C" {
 // Files
 #if !defined(ESP32)
 #define SENSOR_FILENAME_JSON "sensors.json"   // sensor configuration (JSON format)
+#define SENSOR_FILENAME_RUNTIME "sensorsrt.json"  // last sensor readings (JSON format)
 #define PROG_SENSOR_FILENAME "progsensor.json"  // sensor to program assign filename (JSON format)
 #define SENSORLOG_FILENAME1 "sensorlog.dat"   // analog sensor log filename
 #define SENSORLOG_FILENAME2 "sensorlog2.dat"  // analog sensor log filename2
@@ -77,6 +78,7 @@ extern "C" {
 
 #else
 #define SENSOR_FILENAME_JSON "/sensors.json"  // sensor configuration (JSON format)
+#define SENSOR_FILENAME_RUNTIME "/sensorsrt.json"  // last sensor readings (JSON format)
 #define PROG_SENSOR_FILENAME "/progsensor.json"  // sensor to program assign filename (JSON format)
 #define SENSORLOG_FILENAME1 "/sensorlog.dat"   // analog sensor log filename
 #define SENSORLOG_FILENAME2 "/sensorlog2.dat"  // analog sensor log filename2
@@ -575,6 +577,8 @@ const char *getlogfile(uint8_t log);
 const char *getlogfile2(uint8_t log);
 void checkLogSwitch(uint8_t log);
 void checkLogSwitchAfterWrite(uint8_t log);
+/** Changes whenever entries of the log move or are removed, so indices taken before are stale */
+uint32_t sensorlog_generation(uint8_t log);
 
 //influxdb
 void add_influx_data(SensorBase *sensor);
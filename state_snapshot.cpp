@@ -0,0 +1,120 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Published controller state for readers outside the main loop
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "state_snapshot.h"
+#include "event_stream.h"
+#include <string.h>
+
+extern OpenSprinkler os;
+extern ProgramData pd;
+extern volatile ulong flow_count;
+
+static StateSnapshot snaps[STATE_SNAPSHOT_BUFFERS];
+static uint32_t snap_readers[STATE_SNAPSHOT_BUFFERS];
+static uint8_t snap_current = 0;
+static uint32_t snap_version = 0;
+static time_os_t snap_time = 0;
+static bool snap_touched = true;
+
+static void state_snapshot_fill(StateSnapshot &s) {
+	s.time = os.now_tz();
+	s.nboards = os.nboards;
+	s.nstations = os.nstations;
+	s.enabled = os.status.enabled;
+	s.rain_delayed = os.status.rain_delayed;
+	s.sensor1_active = os.status.sensor1_active;
+	s.sensor2_active = os.status.sensor2_active;
+	s.program_busy = os.status.program_busy;
+	s.pause_state = os.status.pause_state;
+	s.overcurrent_sid = os.status.overcurrent_sid;
+	s.overcurrent_ma = os.status.overcurrent_ma;
+	s.rd_stop_time = os.nvdata.rd_stop_time;
+	s.pause_timer = os.pause_timer;
+
+	s.nqueue = pd.nqueue;
+	s.current_mpid = pd.current_mpid;
+	s.lastrun = pd.lastrun;
+
+	s.flowcount_rt = os.flowcount_rt;
+	s.flow_count = flow_count;
+
+	memcpy(s.station_bits, os.station_bits, sizeof(s.station_bits));
+	for (uint8_t sid = 0; sid < os.nstations; sid++) {
+		StationSnapshot &st = s.stations[sid];
+		uint8_t qid = pd.station_qid[sid];
+		if (qid < 255) {
+			const RuntimeQueueStruct *q = pd.queue + qid;
+			st.st = (uint32_t)q->st;
+			st.dur = (uint32_t)q->dur;
+			st.pid = qpid_decode(q->pid);
+		} else {
+			st.st = st.dur = 0;
+			st.pid = 0;
+		}
+	}
+}
+
+void state_snapshot_publish() {
+	uint8_t cur = __atomic_load_n(&snap_current, __ATOMIC_SEQ_CST);
+	int b = -1;
+	for (uint8_t i = 0; i < STATE_SNAPSHOT_BUFFERS; i++) {
+		if (i == cur && STATE_SNAPSHOT_BUFFERS > 1) continue;
+		if (__atomic_load_n(&snap_readers[i], __ATOMIC_SEQ_CST) == 0) {
+			b = i;
+			break;
+		}
+	}
+	// slow readers hold every spare buffer: keep the touch for the next pass
+	if (b < 0) return;
+
+	state_snapshot_fill(snaps[b]);
+	if (snap_version && b != cur) event_stream_state(snaps[cur], snaps[b]);
+	snaps[b].version = ++snap_version;
+	__atomic_store_n(&snap_current, (uint8_t)b, __ATOMIC_SEQ_CST);
+	snap_time = snaps[b].time;
+	snap_touched = false;
+}
+
+void state_snapshot_update(time_os_t now) {
+	if (snap_touched || now != snap_time) state_snapshot_publish();
+}
+
+void state_snapshot_touch() {
+	snap_touched = true;
+}
+
+// Pin the current buffer, then check it is still current. If a publish took
+// over in between, the pinned buffer may be rewritten already: drop and retry.
+StateSnapshotRef::StateSnapshotRef() {
+	for (;;) {
+		idx = __atomic_load_n(&snap_current, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch(&snap_readers[idx], 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&snap_current, __ATOMIC_SEQ_CST) == idx) break;
+		__atomic_sub_fetch(&snap_readers[idx], 1, __ATOMIC_SEQ_CST);
+	}
+	snap = &snaps[idx];
+}
+
+StateSnapshotRef::~StateSnapshotRef() {
+	__atomic_sub_fetch(&snap_readers[idx], 1, __ATOMIC_SEQ_CST);
+}
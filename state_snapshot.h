@@ -0,0 +1,116 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Published controller state for readers outside the main loop
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _STATE_SNAPSHOT_H
+#define _STATE_SNAPSHOT_H
+
+#include "program.h"
+
+// Buffers to publish into. With three, the main loop always finds one no
+// reader holds. ESP8266 has no other tasks, one buffer updated in place will do.
+#if defined(ESP8266)
+	#define STATE_SNAPSHOT_BUFFERS  1
+#else
+	#define STATE_SNAPSHOT_BUFFERS  3
+#endif
+
+/** Queue entry of a station in the snapshot */
+struct StationSnapshot {
+	uint32_t st;   // start time
+	uint32_t dur;  // duration in seconds
+	uint8_t pid;   // decoded program id, 0: not queued
+};
+
+/**
+ * @brief Controller state as of the last publish.
+ * Filled by the main loop once per second and after station changes.
+ * Readers see all fields from the same point of the schedule.
+ */
+struct StateSnapshot {
+	uint32_t version;  // bumped on every publish
+	time_os_t time;    // local time of the publish
+
+	uint8_t nboards;
+	uint8_t nstations;
+	uint8_t enabled;
+	uint8_t rain_delayed;
+	uint8_t sensor1_active;
+	uint8_t sensor2_active;
+	uint8_t program_busy;
+	uint8_t pause_state;
+	uint8_t overcurrent_sid;
+	uint16_t overcurrent_ma;
+	uint32_t rd_stop_time;
+	ulong pause_timer;
+
+	uint8_t nqueue;
+	uint8_t current_mpid;
+	LogStruct lastrun;
+
+	ulong flowcount_rt;
+	ulong flow_count;
+
+	uint8_t station_bits[MAX_NUM_BOARDS];
+	StationSnapshot stations[MAX_NUM_STATIONS];
+
+	bool is_running(uint8_t sid) const {
+		return (station_bits[sid >> 3] >> (sid & 0x07)) & 1;
+	}
+
+	/** Seconds left for a queued station at time now (the /jc convention) */
+	ulong remaining(uint8_t sid, time_os_t now) const {
+		const StationSnapshot &s = stations[sid];
+		if (!s.pid) return 0;
+		ulong rem = (now >= s.st) ? (s.st + s.dur - now) : s.dur;
+		return (rem > 65535) ? 0 : rem;
+	}
+};
+
+/** Build and publish a new snapshot (main loop only) */
+void state_snapshot_publish();
+
+/** Publish if the second changed or the state was touched (main loop, every pass) */
+void state_snapshot_update(time_os_t now);
+
+/** Mark the state changed, the next update publishes */
+void state_snapshot_touch();
+
+/**
+ * @brief Reader handle to the latest snapshot.
+ * Lock-free: the buffer is pinned by a reader count and never rewritten
+ * while held. Keep the handle short-lived; it is safe from any thread.
+ */
+class StateSnapshotRef {
+public:
+	StateSnapshotRef();
+	~StateSnapshotRef();
+	const StateSnapshot* operator->() const { return snap; }
+	const StateSnapshot& operator*() const { return *snap; }
+private:
+	StateSnapshotRef(const StateSnapshotRef&) = delete;
+	StateSnapshotRef& operator=(const StateSnapshotRef&) = delete;
+	uint8_t idx;
+	const StateSnapshot *snap;
+};
+
+#endif // _STATE_SNAPSHOT_H
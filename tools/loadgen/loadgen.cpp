@@ -0,0 +1,1191 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Load generator and local stand-in services for performance tests
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Drives a Linux build of the firmware (OSPi built with GPIO_SIMULATION=1,
+ * or the demo build) under load and reports throughput and latency
+ * percentiles for the scheduler, the sensor pipeline, log I/O and the web
+ * server. It talks to the controller over its public interfaces only:
+ *
+ *  - starts the controller (-x) on a fresh data directory with a simulated
+ *    clock (-c/-r), or attaches to one that is already running (-H)
+ *  - serves the controller's upstreams locally: an MQTT broker, an HTTP
+ *    server for weather, InfluxDB, remote JSON and remote OpenSprinkler
+ *    sensors, and Modbus TCP gateways
+ *  - defines sensors of every type that can be fed without hardware,
+ *    programs on the simulated clock, and runs scripted web clients on
+ *    /ja, /so and /jl plus manual station runs through /cm
+ *  - follows the event stream (/events) to time station starts against
+ *    their scheduled time and sensor readings against the moment the
+ *    stand-in handed out the value
+ *
+ * Build with "make loadgen"; "OpenSprinkler-loadgen -h" lists the options.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define LG_DEFAULT_PW      "a6d82bced638de3def1e9bbb4983225c"  // md5 of "opendoor"
+#define LG_IO_TIMEOUT_MS   10000  // per request to the controller
+#define LG_SERVED_MAX_MS   60000  // older stand-in hand-outs are not matched
+#define LG_MAX_GATEWAYS    8      // Modbus gateways the controller pools
+#define LG_UNITS_PER_GW    8      // units it batches per gateway
+#define LG_MQTT_PREFIX     "loadgen/sensor/"
+
+struct Options {
+	const char *binary = NULL;         // -x controller binary to start
+	const char *host = "127.0.0.1";    // -H controller address
+	const char *local = "127.0.0.1";   // -l address the controller reaches the stand-ins at
+	const char *pw = LG_DEFAULT_PW;    // -w md5 password
+	int port = 18080;                  // -p controller HTTP port
+	int event_port = 0;                // -e event stream port, default port + 1
+	int base_port = 19000;             // -b first stand-in port
+	int duration = 60;                 // -t seconds under load
+	int rate = 60;                     // -r simulated clock speed-up (with -x)
+	long clock_start = 0;              // -c simulated clock start, default 05:59 today
+	int clients = 8;                   // -C concurrent web clients
+	int sensors = 4;                   // -s sensors per synthetic type
+	int programs = 16;                 // -P programs
+	int stations = 16;                 // -S stations
+	int interval = 30;                 // -i sensor read interval, controller seconds
+	int every = 5;                     // -m program repeat interval, controller minutes
+	bool keep = false;                 // -k keep the data directory
+};
+
+static Options opt;
+static std::atomic<bool> running(true);
+
+static double now_ms() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void sleep_ms(double ms) {
+	if (ms <= 0) return;
+	struct timespec ts;
+	ts.tv_sec = (time_t)(ms / 1000);
+	ts.tv_nsec = (long)(fmod(ms, 1000) * 1e6);
+	nanosleep(&ts, NULL);
+}
+
+// ─── Metrics ─────────────────────────────────────────────────────────────────
+
+struct Metric {
+	const char *section;
+	const char *name;
+	std::vector<float> ms;   // latency samples
+	unsigned long events;    // occurrences, with or without a sample
+	unsigned long errors;
+	unsigned long long bytes;
+};
+
+static std::mutex stat_lock;  // metrics and the stand-in bookkeeping below
+static std::vector<Metric*> metrics;
+
+static Metric *metric(const char *section, const char *name) {
+	Metric *m = new Metric();
+	m->section = section;
+	m->name = name;
+	m->events = m->errors = 0;
+	m->bytes = 0;
+	metrics.push_back(m);
+	return m;
+}
+
+static Metric *m_start_lag, *m_manual, *m_queue, *m_skipped;
+static Metric *m_read_http, *m_read_mqtt, *m_read_modbus, *m_read_weather, *m_read_local;
+static Metric *m_log, *m_influx;
+static Metric *m_web_ja, *m_web_so, *m_web_jl, *m_web_cm;
+
+static void metrics_init() {
+	m_start_lag    = metric("scheduler", "station start lag");
+	m_manual       = metric("scheduler", "manual run queued");
+	m_queue        = metric("scheduler", "queue changes");
+	m_skipped      = metric("scheduler", "skipped seconds");
+	m_read_http    = metric("sensors", "http read");
+	m_read_mqtt    = metric("sensors", "mqtt push");
+	m_read_modbus  = metric("sensors", "modbus read");
+	m_read_weather = metric("sensors", "weather read");
+	m_read_local   = metric("sensors", "internal/group");
+	m_log          = metric("log", "run records");
+	m_influx       = metric("log", "influx lines");
+	m_web_ja       = metric("web", "/ja");
+	m_web_so       = metric("web", "/so");
+	m_web_jl       = metric("web", "/jl");
+	m_web_cm       = metric("web", "/cm");
+}
+
+static void record(Metric *m, double ms) {
+	std::lock_guard<std::mutex> g(stat_lock);
+	m->events++;
+	if (ms >= 0) m->ms.push_back((float)ms);
+}
+
+static void record_error(Metric *m) {
+	std::lock_guard<std::mutex> g(stat_lock);
+	m->errors++;
+}
+
+static float percentile(std::vector<float> &v, double p) {
+	size_t k = (size_t)(p * (v.size() - 1) + 0.5);
+	std::nth_element(v.begin(), v.begin() + k, v.end());
+	return v[k];
+}
+
+static void report(double seconds) {
+	printf("\n%-10s %-19s %8s %8s %8s %8s %8s %8s %7s\n",
+		"section", "metric", "count", "per s", "p50 ms", "p90 ms", "p99 ms", "max ms", "errors");
+	std::lock_guard<std::mutex> g(stat_lock);
+	for (Metric *m : metrics) {
+		printf("%-10s %-19s %8lu %8.1f", m->section, m->name, m->events, seconds > 0 ? m->events / seconds : 0);
+		if (m->ms.empty()) {
+			printf(" %8s %8s %8s %8s", "-", "-", "-", "-");
+		} else {
+			std::vector<float> v(m->ms);
+			float mx = *std::max_element(v.begin(), v.end());
+			float p50 = percentile(v, 0.50), p90 = percentile(v, 0.90), p99 = percentile(v, 0.99);
+			printf(" %8.1f %8.1f %8.1f %8.1f", p50, p90, p99, mx);
+		}
+		printf(" %7lu", m->errors);
+		if (m->bytes) printf("  %.1f KB/s", m->bytes / 1024.0 / seconds);
+		printf("\n");
+	}
+}
+
+// ─── Simulated clock ─────────────────────────────────────────────────────────
+// Maps controller time (devt, seconds) to local monotonic time. It is synced
+// on a devt edge of /jc, so the error is about one request round trip.
+
+struct SimClock {
+	bool synced = false;
+	double sync_ms = 0;
+	long sync_t = 0;
+	int rate = 1;
+
+	double ms_of(long t) const { return sync_ms + (t - sync_t) * 1000.0 / rate; }
+	double now() const { return sync_t + (now_ms() - sync_ms) * rate / 1000.0; }
+};
+
+static SimClock sim;
+
+// Synthetic readings follow the controller's simulated day
+static double synth_value(unsigned nr, double lo, double hi) {
+	double day = fmod(sim.synced ? sim.now() : time(NULL), 86400.0) / 86400.0;
+	double s = sin(2 * M_PI * day + nr * 0.7);
+	return lo + (hi - lo) * (0.5 + 0.45 * s);
+}
+
+// ─── Sockets ─────────────────────────────────────────────────────────────────
+
+static int tcp_listen(int port) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) return -1;
+	int one = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 64) < 0) {
+		fprintf(stderr, "loadgen: cannot listen on port %d: %s\n", port, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int tcp_connect(const char *host, int port) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) return -1;
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	if (inet_pton(AF_INET, host, &addr.sin_addr) != 1 ||
+	    connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	struct timeval tv = { LG_IO_TIMEOUT_MS / 1000, 0 };
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	return fd;
+}
+
+static bool send_all(int fd, const void *data, size_t len) {
+	const char *p = (const char*)data;
+	while (len > 0) {
+		ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+static std::string url_encode(const std::string &s) {
+	static const char hex[] = "0123456789ABCDEF";
+	std::string out;
+	for (unsigned char c : s) {
+		if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+			out += (char)c;
+		} else {
+			out += '%';
+			out += hex[c >> 4];
+			out += hex[c & 15];
+		}
+	}
+	return out;
+}
+
+static std::string strf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+static std::string strf(const char *fmt, ...) {
+	char buf[1024];
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	return buf;
+}
+
+// Value of "key":<number> in a JSON text, def if missing
+static long json_long(const char *json, const char *key, long def) {
+	char pat[32];
+	snprintf(pat, sizeof(pat), "\"%s\":", key);
+	const char *s = strstr(json, pat);
+	return s ? strtol(s + strlen(pat), NULL, 10) : def;
+}
+
+// ─── Controller client ───────────────────────────────────────────────────────
+
+struct HttpResult {
+	int status = 0;        // 0: no response
+	std::string body;
+	double ms = 0;
+};
+
+/** GET path?pw=...&query from the controller; one connection per request */
+static HttpResult controller_get(const char *cmd, const std::string &query) {
+	HttpResult r;
+	double t0 = now_ms();
+	int fd = tcp_connect(opt.host, opt.port);
+	if (fd < 0) return r;
+	std::string req = strf("GET /%s?pw=%s", cmd, opt.pw);
+	if (!query.empty()) req += "&" + query;
+	req += strf(" HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n", opt.host);
+	if (send_all(fd, req.data(), req.size())) {
+		std::string resp;
+		char buf[8192];
+		ssize_t n;
+		while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) resp.append(buf, n);
+		size_t hdr = resp.find("\r\n\r\n");
+		if (resp.compare(0, 5, "HTTP/") == 0 && hdr != std::string::npos) {
+			r.status = atoi(resp.c_str() + resp.find(' ') + 1);
+			r.body = resp.substr(hdr + 4);
+		}
+	}
+	close(fd);
+	r.ms = now_ms() - t0;
+	return r;
+}
+
+/** Like controller_get, but the command must answer {"result":1} */
+static bool controller_cmd(const char *cmd, const std::string &query) {
+	HttpResult r = controller_get(cmd, query);
+	if (r.status == 200 && json_long(r.body.c_str(), "result", 0) == 1) return true;
+	fprintf(stderr, "loadgen: /%s failed (%d): %.200s\n", cmd, r.status, r.body.c_str());
+	return false;
+}
+
+// ─── Stand-in bookkeeping ────────────────────────────────────────────────────
+// Each synthetic sensor has a source key. A stand-in stamps the key when it
+// hands out a value; the sensor event that follows is timed against it.
+
+struct SensorInfo {
+	std::string source;
+	Metric *metric;
+};
+
+static std::map<unsigned, SensorInfo> sensor_info;       // by sensor nr
+static std::map<std::string, double> served;              // source key -> time handed out
+static std::map<int, unsigned> modbus_units;              // port << 8 | unit -> sensor nr
+
+static void mark_served(const std::string &key) {
+	std::lock_guard<std::mutex> g(stat_lock);
+	served[key] = now_ms();
+}
+
+static void sensor_event(unsigned nr, bool ok) {
+	double t = now_ms();
+	std::lock_guard<std::mutex> g(stat_lock);
+	auto it = sensor_info.find(nr);
+	if (it == sensor_info.end()) return;
+	Metric *m = it->second.metric;
+	if (!ok) {
+		m->errors++;
+		return;
+	}
+	m->events++;
+	auto s = served.find(it->second.source);
+	if (s != served.end() && t - s->second < LG_SERVED_MAX_MS) {
+		m->ms.push_back((float)(t - s->second));
+		// shared sources (weather) time only the first reading of a fetch
+		served.erase(s);
+	}
+}
+
+// ─── HTTP stand-in ───────────────────────────────────────────────────────────
+// Weather service, InfluxDB, remote JSON and remote OpenSprinkler sensors.
+
+static void http_reply(int fd, const char *status, const std::string &body) {
+	std::string resp = strf("HTTP/1.1 %s\r\nContent-Type: application/json\r\n"
+		"Content-Length: %u\r\nConnection: close\r\n\r\n", status, (unsigned)body.size());
+	resp += body;
+	send_all(fd, resp.data(), resp.size());
+}
+
+static void http_serve(int fd) {
+	struct timeval tv = { 5, 0 };
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	std::string req;
+	char buf[4096];
+	size_t hdr = std::string::npos;
+	while (hdr == std::string::npos) {
+		ssize_t n = recv(fd, buf, sizeof(buf), 0);
+		if (n <= 0) {
+			close(fd);
+			return;
+		}
+		req.append(buf, n);
+		hdr = req.find("\r\n\r\n");
+	}
+	// the body, if any (InfluxDB writes)
+	size_t clen = 0;
+	const char *cl = strcasestr(req.c_str(), "\r\nContent-Length:");
+	if (cl) clen = strtoul(cl + 17, NULL, 10);
+	while (req.size() < hdr + 4 + clen) {
+		ssize_t n = recv(fd, buf, sizeof(buf), 0);
+		if (n <= 0) break;
+		req.append(buf, n);
+	}
+
+	char method[8] = {0}, path[512] = {0};
+	sscanf(req.c_str(), "%7s %511s", method, path);
+
+	if (strcmp(method, "POST") == 0) {
+		std::string body = req.substr(hdr + 4);
+		unsigned long lines = 0;
+		for (size_t i = 0; i < body.size(); i++) {
+			if (body[i] == '\n') lines++;
+		}
+		if (!body.empty() && body.back() != '\n') lines++;
+		{
+			std::lock_guard<std::mutex> g(stat_lock);
+			m_influx->events += lines;
+			m_influx->bytes += body.size();
+		}
+		std::string resp = "HTTP/1.1 204 No Content\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+		send_all(fd, resp.data(), resp.size());
+	} else if (strncmp(path, "/weatherData", 12) == 0) {
+		mark_served("weather");
+		http_reply(fd, "200 OK", strf("{\"temp\":%.1f,\"humidity\":%.0f,\"precip\":%.2f,\"wind\":%.1f}",
+			synth_value(1, 50, 90), synth_value(2, 20, 90), synth_value(3, 0, 0.3), synth_value(4, 0, 15)));
+	} else if (path[0] == '/' && path[1] >= '0' && path[1] <= '9') {
+		// /<method>?loc=..: answers the controller's weather adjustment and the ETo sensors
+		mark_served("eto");
+		http_reply(fd, "200 OK", strf("&errCode=0&scale=100&sunrise=360&sunset=1080&rawData={\"eto\":%.3f,\"radiation\":%.2f}",
+			synth_value(5, 0.05, 0.3), synth_value(6, 1, 8)));
+	} else if (strncmp(path, "/json/", 6) == 0) {
+		unsigned nr = strtoul(path + 6, NULL, 10);
+		mark_served(strf("json/%u", nr));
+		http_reply(fd, "200 OK", strf("{\"value\":%.2f}", synth_value(nr, 10, 40)));
+	} else if (strncmp(path, "/sg?", 4) == 0) {
+		const char *p = strstr(path, "nr=");
+		unsigned nr = p ? strtoul(p + 3, NULL, 10) : 0;
+		mark_served(strf("sg/%u", nr));
+		double v = synth_value(nr, 10, 40);
+		http_reply(fd, "200 OK", strf("{\"datas\":[{\"nr\":%u,\"nativedata\":%u,\"data\":%.2f,\"unit\":\"%%\",\"unitid\":1,\"last\":%ld}]}",
+			nr, (unsigned)(v * 100), v, (long)sim.now()));
+	} else {
+		http_reply(fd, "404 Not Found", "{}");
+	}
+	close(fd);
+}
+
+static void http_standin(int lfd) {
+	while (running) {
+		struct pollfd p = { lfd, POLLIN, 0 };
+		if (poll(&p, 1, 200) <= 0) continue;
+		int fd = accept(lfd, NULL, NULL);
+		if (fd >= 0) std::thread(http_serve, fd).detach();
+	}
+	close(lfd);
+}
+
+// ─── Modbus TCP stand-in ─────────────────────────────────────────────────────
+// Answers "read holding registers" for Truebner SMT100/TH100 units. Requests
+// are answered in order, so the controller's pipelined batches work as well.
+
+static void modbus_serve(int fd, int port) {
+	struct timeval tv = { 1, 0 };
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	uint8_t in[512];
+	size_t len = 0;
+	while (running) {
+		ssize_t n = recv(fd, in + len, sizeof(in) - len, 0);
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) continue;
+		if (n <= 0) break;
+		len += n;
+		while (len >= 8) {
+			size_t flen = 6 + ((in[4] << 8) | in[5]);
+			if (flen < 8 || flen > sizeof(in)) {
+				len = 0;
+				break;
+			}
+			if (len < flen) break;
+			uint8_t unit = in[6], fc = in[7];
+			uint16_t reg = (in[8] << 8) | in[9], count = (in[10] << 8) | in[11];
+			uint8_t out[9 + 2 * 16];
+			memcpy(out, in, 4);  // transaction and protocol id
+			out[6] = unit;
+			size_t olen;
+			if (fc == 0x03 && count >= 1 && count <= 16) {
+				unsigned nr = 0;
+				{
+					std::lock_guard<std::mutex> g(stat_lock);
+					auto it = modbus_units.find(port << 8 | unit);
+					if (it != modbus_units.end()) nr = it->second;
+				}
+				out[7] = fc;
+				out[8] = count * 2;
+				for (uint16_t r = 0; r < count; r++) {
+					// 0: moisture (%/100), 1: temperature ((C+100)*100), 2: permittivity
+					uint16_t reg_nr = reg + r;
+					double v = reg_nr == 1 ? (synth_value(nr, 5, 30) + 100) * 100 :
+					           reg_nr == 2 ? synth_value(nr, 2, 40) * 100 : synth_value(nr, 5, 45) * 100;
+					out[9 + r*2] = ((uint16_t)v) >> 8;
+					out[10 + r*2] = ((uint16_t)v) & 0xFF;
+				}
+				olen = 9 + count * 2;
+				mark_served(strf("mb/%d/%u", port, unit));
+			} else {
+				out[7] = fc | 0x80;  // illegal function
+				out[8] = 0x01;
+				olen = 9;
+			}
+			out[4] = (olen - 6) >> 8;
+			out[5] = (olen - 6) & 0xFF;
+			if (!send_all(fd, out, olen)) {
+				len = 0;
+				break;
+			}
+			memmove(in, in + flen, len - flen);
+			len -= flen;
+		}
+	}
+	close(fd);
+}
+
+static void modbus_standin(int lfd, int port) {
+	while (running) {
+		struct pollfd p = { lfd, POLLIN, 0 };
+		if (poll(&p, 1, 200) <= 0) continue;
+		int fd = accept(lfd, NULL, NULL);
+		if (fd >= 0) std::thread(modbus_serve, fd, port).detach();
+	}
+	close(lfd);
+}
+
+// ─── MQTT stand-in ───────────────────────────────────────────────────────────
+// A minimal MQTT 3.1/3.1.1 broker: QoS 0 delivery, QoS 1 publishes are
+// acknowledged, retained messages are not kept. It also publishes a reading
+// for every MQTT sensor once per read interval.
+
+struct MqttClient {
+	int fd;
+	std::string in;
+	std::vector<std::string> subs;
+};
+
+static bool mqtt_match(const std::string &filter, const std::string &topic) {
+	size_t f = 0, t = 0;
+	while (f < filter.size()) {
+		if (filter[f] == '#') return true;
+		if (filter[f] == '+') {
+			while (t < topic.size() && topic[t] != '/') t++;
+			f++;
+			continue;
+		}
+		if (t >= topic.size() || filter[f] != topic[t]) return false;
+		f++;
+		t++;
+	}
+	return t == topic.size();
+}
+
+static std::string mqtt_packet(uint8_t type, const std::string &payload) {
+	std::string p(1, (char)type);
+	size_t len = payload.size();
+	do {
+		uint8_t b = len & 0x7F;
+		len >>= 7;
+		if (len) b |= 0x80;
+		p += (char)b;
+	} while (len);
+	return p + payload;
+}
+
+static std::string mqtt_str(const std::string &s) {
+	std::string p;
+	p += (char)(s.size() >> 8);
+	p += (char)(s.size() & 0xFF);
+	return p + s;
+}
+
+static void mqtt_route(std::vector<MqttClient> &clients, const std::string &topic, const std::string &msg) {
+	std::string pkt = mqtt_packet(0x30, mqtt_str(topic) + msg);
+	for (MqttClient &c : clients) {
+		for (const std::string &f : c.subs) {
+			if (!mqtt_match(f, topic)) continue;
+			send_all(c.fd, pkt.data(), pkt.size());
+			break;
+		}
+	}
+}
+
+/** Handle one complete packet; false closes the connection */
+static bool mqtt_handle(std::vector<MqttClient> &clients, MqttClient &c, uint8_t type, const std::string &body) {
+	std::string reply;
+	switch (type >> 4) {
+	case 1:   // CONNECT
+		reply = mqtt_packet(0x20, std::string("\0\0", 2));
+		break;
+	case 3: { // PUBLISH
+		if (body.size() < 2) return false;
+		size_t tl = ((uint8_t)body[0] << 8) | (uint8_t)body[1];
+		size_t pos = 2 + tl;
+		uint8_t qos = (type >> 1) & 3;
+		if (pos + (qos ? 2 : 0) > body.size()) return false;
+		std::string topic = body.substr(2, tl);
+		if (qos) {
+			reply = mqtt_packet(0x40, body.substr(pos, 2));
+			pos += 2;
+		}
+		mqtt_route(clients, topic, body.substr(pos));
+		break;
+	}
+	case 8: { // SUBSCRIBE
+		if (body.size() < 2) return false;
+		std::string granted;
+		size_t pos = 2;
+		while (pos + 2 <= body.size()) {
+			size_t fl = ((uint8_t)body[pos] << 8) | (uint8_t)body[pos + 1];
+			if (pos + 2 + fl + 1 > body.size()) break;
+			c.subs.push_back(body.substr(pos + 2, fl));
+			pos += 2 + fl + 1;
+			granted += '\0';
+		}
+		reply = mqtt_packet(0x90, body.substr(0, 2) + granted);
+		break;
+	}
+	case 10:  // UNSUBSCRIBE
+		if (body.size() < 2) return false;
+		reply = mqtt_packet(0xB0, body.substr(0, 2));
+		break;
+	case 12:  // PINGREQ
+		reply = mqtt_packet(0xD0, "");
+		break;
+	case 14:  // DISCONNECT
+		return false;
+	default:
+		break;
+	}
+	return reply.empty() || send_all(c.fd, reply.data(), reply.size());
+}
+
+static void mqtt_standin(int lfd, std::vector<unsigned> sensors) {
+	std::vector<MqttClient> clients;
+	double period = std::max(50.0, opt.interval * 1000.0 / sim.rate);
+	double next_pub = now_ms() + period;
+	while (running) {
+		std::vector<struct pollfd> fds;
+		fds.push_back({ lfd, POLLIN, 0 });
+		for (MqttClient &c : clients) fds.push_back({ c.fd, POLLIN, 0 });
+		int wait = (int)std::max(1.0, next_pub - now_ms());
+		poll(fds.data(), fds.size(), std::min(wait, 200));
+
+		if (fds[0].revents & POLLIN) {
+			int fd = accept(lfd, NULL, NULL);
+			if (fd >= 0) clients.push_back({ fd, std::string(), std::vector<std::string>() });
+		}
+		for (size_t i = 1; i < fds.size(); i++) {
+			if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+			MqttClient &c = clients[i - 1];
+			char buf[4096];
+			ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+			bool ok = n > 0;
+			if (ok) c.in.append(buf, n);
+			while (ok && c.in.size() >= 2) {
+				size_t len = 0, mul = 1, pos = 1;
+				bool complete = false;
+				while (pos < c.in.size() && pos < 5) {
+					uint8_t b = c.in[pos++];
+					len += (b & 0x7F) * mul;
+					mul <<= 7;
+					if (!(b & 0x80)) { complete = true; break; }
+				}
+				if (!complete || c.in.size() < pos + len) break;
+				ok = mqtt_handle(clients, c, (uint8_t)c.in[0], c.in.substr(pos, len));
+				c.in.erase(0, pos + len);
+			}
+			if (!ok) {
+				close(c.fd);
+				c.fd = -1;
+			}
+		}
+		clients.erase(std::remove_if(clients.begin(), clients.end(),
+			[](const MqttClient &c) { return c.fd < 0; }), clients.end());
+
+		if (now_ms() >= next_pub) {
+			next_pub += period;
+			for (unsigned nr : sensors) {
+				mark_served(strf("mqtt/%u", nr));
+				mqtt_route(clients, strf(LG_MQTT_PREFIX "%u", nr), strf("{\"value\":%.2f}", synth_value(nr, 10, 40)));
+			}
+		}
+	}
+	for (MqttClient &c : clients) close(c.fd);
+	close(lfd);
+}
+
+// ─── Event stream ────────────────────────────────────────────────────────────
+
+static std::mutex sched_lock;
+static std::map<int, long> queued_st;       // sid -> scheduled start of its queue entry
+static std::map<int, double> manual_sent;   // sid -> time /cm was sent
+
+static void on_event(const std::string &type, const std::string &data) {
+	const char *d = data.c_str();
+	double t = now_ms();
+	if (type == "queue") {
+		int sid = (int)json_long(d, "sid", -1);
+		long pid = json_long(d, "pid", 0);
+		record(m_queue, -1);
+		if (!pid) return;
+		std::lock_guard<std::mutex> g(sched_lock);
+		queued_st[sid] = json_long(d, "st", 0);
+		auto it = manual_sent.find(sid);
+		if (it != manual_sent.end()) {
+			record(m_manual, t - it->second);
+			manual_sent.erase(it);
+		}
+	} else if (type == "station") {
+		int sid = (int)json_long(d, "sid", -1);
+		if (!json_long(d, "on", 0) || !sim.synced) return;
+		long st = 0;
+		{
+			std::lock_guard<std::mutex> g(sched_lock);
+			auto it = queued_st.find(sid);
+			if (it == queued_st.end()) return;
+			st = it->second;
+			queued_st.erase(it);
+		}
+		// a station may not start before its second; rounding of the sync can
+		// make the difference slightly negative
+		record(m_start_lag, std::max(0.0, t - sim.ms_of(st)));
+	} else if (type == "sensor") {
+		sensor_event((unsigned)json_long(d, "nr", 0), json_long(d, "ok", 0) != 0);
+	} else if (type == "log") {
+		record(m_log, -1);
+	}
+}
+
+static void event_listener() {
+	int eport = opt.event_port ? opt.event_port : opt.port + 1;
+	while (running) {
+		int fd = tcp_connect(opt.host, eport);
+		if (fd < 0) {
+			sleep_ms(500);
+			continue;
+		}
+		struct timeval tv = { 0, 200000 };
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		std::string req = strf("GET /events?pw=%s HTTP/1.1\r\nHost: %s\r\nAccept: text/event-stream\r\n\r\n", opt.pw, opt.host);
+		send_all(fd, req.data(), req.size());
+
+		std::string in, type, data;
+		bool header = true;
+		char buf[8192];
+		while (running) {
+			ssize_t n = recv(fd, buf, sizeof(buf), 0);
+			if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) continue;
+			if (n <= 0) break;
+			in.append(buf, n);
+			size_t eol;
+			while ((eol = in.find('\n')) != std::string::npos) {
+				std::string line = in.substr(0, eol);
+				in.erase(0, eol + 1);
+				if (!line.empty() && line.back() == '\r') line.pop_back();
+				if (header) {
+					if (line.empty()) header = false;
+					continue;
+				}
+				if (line.empty()) {
+					if (!type.empty()) on_event(type, data);
+					type.clear();
+					data.clear();
+				} else if (line.compare(0, 6, "event:") == 0) {
+					type = line.substr(line[6] == ' ' ? 7 : 6);
+				} else if (line.compare(0, 5, "data:") == 0) {
+					data = line.substr(line[5] == ' ' ? 6 : 5);
+				}
+			}
+		}
+		close(fd);
+	}
+}
+
+// ─── Scripted clients ────────────────────────────────────────────────────────
+
+static void web_client(int idx, unsigned nsensors) {
+	unsigned seq = idx;
+	while (running) {
+		Metric *m;
+		HttpResult r;
+		switch (seq++ % 3) {
+		case 0:
+			m = m_web_ja;
+			r = controller_get("ja", "");
+			break;
+		case 1:
+			m = m_web_so;
+			r = controller_get("so", strf("nr=%u&lasthours=24&max=500", nsensors ? 1 + seq % nsensors : 0));
+			break;
+		default:
+			m = m_web_jl;
+			r = controller_get("jl", "hist=1");
+			break;
+		}
+		if (!running) break;
+		if (r.status != 200) {
+			record_error(m);
+			sleep_ms(100);
+			continue;
+		}
+		record(m, r.ms);
+		std::lock_guard<std::mutex> g(stat_lock);
+		m->bytes += r.body.size();
+	}
+}
+
+// One manual station run per second, timed until it shows up in the queue
+static void manual_client() {
+	unsigned seq = 0;
+	while (running) {
+		int sid = seq++ % opt.stations;
+		{
+			std::lock_guard<std::mutex> g(sched_lock);
+			manual_sent[sid] = now_ms();
+		}
+		HttpResult r = controller_get("cm", strf("sid=%d&en=1&t=%d", sid, std::max(2, sim.rate * 2)));
+		if (r.status == 200 && json_long(r.body.c_str(), "result", 0) == 1) {
+			record(m_web_cm, r.ms);
+		} else {
+			record_error(m_web_cm);
+			std::lock_guard<std::mutex> g(sched_lock);
+			manual_sent.erase(sid);
+		}
+		sleep_ms(1000);
+	}
+}
+
+// ─── Setup ───────────────────────────────────────────────────────────────────
+
+enum SourceKind { SRC_MODBUS, SRC_MQTT, SRC_JSON, SRC_REMOTE, SRC_WEATHER, SRC_ETO, SRC_LOCAL, SRC_GROUP };
+
+struct SynthType {
+	unsigned type;
+	SourceKind kind;
+	const char *name;
+};
+
+// Sensor types that can be fed without hardware
+static const SynthType synth_types[] = {
+	{ 1000, SRC_GROUP, "group min" },  { 1001, SRC_GROUP, "group max" },
+	{ 1002, SRC_GROUP, "group avg" },  { 1003, SRC_GROUP, "group sum" },
+	{ 1, SRC_MODBUS, "SMT100 moisture" }, { 2, SRC_MODBUS, "SMT100 temp" },
+	{ 3, SRC_MODBUS, "SMT100 permittivity" }, { 4, SRC_MODBUS, "TH100 humidity" },
+	{ 5, SRC_MODBUS, "TH100 temp" },
+	{ 54, SRC_LOCAL, "internal temp" },
+	{ 90, SRC_MQTT, "MQTT" },
+	{ 92, SRC_JSON, "remote JSON" },
+	{ 100, SRC_REMOTE, "remote OpenSprinkler" },
+	{ 101, SRC_WEATHER, "weather temp F" }, { 102, SRC_WEATHER, "weather temp C" },
+	{ 103, SRC_WEATHER, "weather humidity" }, { 105, SRC_WEATHER, "weather precip in" },
+	{ 106, SRC_WEATHER, "weather precip mm" }, { 107, SRC_WEATHER, "weather wind mph" },
+	{ 108, SRC_WEATHER, "weather wind kmh" },
+	{ 109, SRC_ETO, "weather ETo" }, { 110, SRC_ETO, "weather radiation" },
+	{ 10000, SRC_LOCAL, "free memory" }, { 10001, SRC_LOCAL, "free storage" },
+};
+
+static const char skipped_types[] =
+	"analog extension board (10-49), OSPi analog (50-53), FYTA/Gardena cloud (60-63), "
+	"Zigbee (95), BLE (96), flow pulse (97)";
+
+static int port_http() { return opt.base_port; }
+static int port_mqtt() { return opt.base_port + 1; }
+static int port_modbus(int gw) { return opt.base_port + 10 + gw; }
+
+// The controller keeps IPv4 addresses with the first octet in the low byte
+static uint32_t ip4_packed(const char *addr) {
+	unsigned a = 0, b = 0, c = 0, d = 0;
+	sscanf(addr, "%u.%u.%u.%u", &a, &b, &c, &d);
+	return a | (b << 8) | (c << 16) | (d << 24);
+}
+
+static bool define_sensors(std::vector<unsigned> &mqtt_sensors, unsigned *count) {
+	unsigned nr = 0, modbus_n = 0;
+	std::vector<unsigned> groups;
+	uint32_t ip = ip4_packed(opt.local);
+	for (const SynthType &st : synth_types) {
+		for (int i = 0; i < opt.sensors; i++) {
+			nr++;
+			std::string q = strf("nr=%u&type=%u&name=lg%u&ri=%d&enable=1&log=1", nr, st.type, nr, opt.interval);
+			SensorInfo info;
+			info.metric = m_read_local;
+			switch (st.kind) {
+			case SRC_GROUP:
+				groups.push_back(nr);
+				break;
+			case SRC_MODBUS: {
+				int gw = modbus_n / LG_UNITS_PER_GW, unit = 1 + modbus_n % LG_UNITS_PER_GW;
+				if (gw >= LG_MAX_GATEWAYS) {
+					nr--;
+					continue;
+				}
+				modbus_n++;
+				q += strf("&ip=%u&port=%d&id=%d", ip, port_modbus(gw), unit);
+				info.source = strf("mb/%d/%d", port_modbus(gw), unit);
+				info.metric = m_read_modbus;
+				std::lock_guard<std::mutex> g(stat_lock);
+				modbus_units[port_modbus(gw) << 8 | unit] = nr;
+				break;
+			}
+			case SRC_MQTT:
+				q += "&topic=" + url_encode(strf(LG_MQTT_PREFIX "%u", nr)) + "&filter=value";
+				info.source = strf("mqtt/%u", nr);
+				info.metric = m_read_mqtt;
+				mqtt_sensors.push_back(nr);
+				break;
+			case SRC_JSON:
+				q += "&url=" + url_encode(strf("http://%s:%d/json/%u", opt.local, port_http(), nr)) + "&filter=value";
+				info.source = strf("json/%u", nr);
+				info.metric = m_read_http;
+				break;
+			case SRC_REMOTE:
+				q += strf("&ip=%u&port=%d&id=%u", ip, port_http(), nr);
+				info.source = strf("sg/%u", nr);
+				info.metric = m_read_http;
+				break;
+			case SRC_WEATHER:
+			case SRC_ETO:
+				info.source = st.kind == SRC_WEATHER ? "weather" : "eto";
+				info.metric = m_read_weather;
+				break;
+			case SRC_LOCAL:
+				// internal and remote JSON sensors feed the groups
+				break;
+			}
+			if ((st.kind == SRC_LOCAL || st.kind == SRC_JSON) && !groups.empty()) {
+				q += strf("&group=%u", groups[nr % groups.size()]);
+			}
+			{
+				std::lock_guard<std::mutex> g(stat_lock);
+				sensor_info[nr] = info;
+			}
+			if (!controller_cmd("sc", q)) return false;
+		}
+	}
+	*count = nr;
+	return true;
+}
+
+static bool define_programs() {
+	int boards = (opt.stations + 7) / 8;
+	if (!controller_cmd("co", strf("o15=%d", boards - 1))) return false;
+	for (int p = 0; p < opt.programs; p++) {
+		// weekly, every day, repeating start staggered by one minute per program
+		int start = 6 * 60 + p % opt.every;
+		int repeats = (24 * 60 - 1 - start) / opt.every;
+		std::string v = strf("[1,127,0,[%d,%d,%d,-1],[", start, repeats, opt.every);
+		for (int s = 0; s < opt.stations; s++) {
+			bool on = s == p % opt.stations || s == (p + 1) % opt.stations;
+			v += strf("%s%d", s ? "," : "", on ? 30 + (p % 4) * 15 : 0);
+		}
+		v += "]]";
+		if (!controller_cmd("cp", strf("pid=-1&v=%s&name=lg%d", url_encode(v).c_str(), p))) return false;
+	}
+	return true;
+}
+
+static bool configure_services() {
+	std::string mqtt = strf("{\"en\":1,\"host\":\"%s\",\"port\":%d,\"user\":\"\",\"pass\":\"\",\"pubt\":\"opensprinkler\",\"subt\":\"\"}",
+		opt.local, port_mqtt());
+	std::string influx = strf("{\"en\":1,\"url\":\"%s\",\"port\":%d,\"org\":\"loadgen\",\"bucket\":\"loadgen\",\"token\":\"loadgen\"}",
+		opt.local, port_http());
+	if (!controller_cmd("co", "mqtt=" + url_encode(mqtt) + "&influxdb=" + url_encode(influx))) return false;
+	return controller_cmd("cu", "wsp=" + url_encode(strf("%s:%d", opt.local, port_http())));
+}
+
+/** Lock the simulated clock onto a devt edge */
+static bool sync_clock() {
+	HttpResult r = controller_get("jc", "");
+	long t0 = r.status == 200 ? json_long(r.body.c_str(), "devt", -1) : -1;
+	if (t0 < 0) return false;
+	double deadline = now_ms() + 3000.0;
+	while (now_ms() < deadline) {
+		r = controller_get("jc", "");
+		long t = json_long(r.body.c_str(), "devt", -1);
+		if (t > t0) {
+			sim.sync_t = t;
+			sim.sync_ms = now_ms() - r.ms / 2;
+			sim.synced = true;
+			return true;
+		}
+		t0 = t;
+	}
+	return false;
+}
+
+// ─── Controller process ──────────────────────────────────────────────────────
+
+static pid_t child = 0;
+static char data_dir[64] = {0};
+
+static bool start_controller() {
+	strcpy(data_dir, "/tmp/os-loadgen-XXXXXX");
+	if (!mkdtemp(data_dir)) {
+		perror("loadgen: mkdtemp");
+		return false;
+	}
+	child = fork();
+	if (child < 0) return false;
+	if (child == 0) {
+		std::string log = std::string(data_dir) + "/controller.log";
+		int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd >= 0) {
+			dup2(fd, 1);
+			dup2(fd, 2);
+			close(fd);
+		}
+		std::string dir = std::string(data_dir) + "/";
+		std::string port = strf("%d", opt.port), eport = strf("%d", opt.event_port ? opt.event_port : opt.port + 1);
+		std::string start = strf("%ld", opt.clock_start), rate = strf("%d", opt.rate);
+		execl(opt.binary, opt.binary, "-d", dir.c_str(), "-p", port.c_str(), "-e", eport.c_str(),
+			"-c", start.c_str(), "-r", rate.c_str(), (char*)NULL);
+		_exit(127);
+	}
+	printf("controller %s (pid %d), data in %s\n", opt.binary, (int)child, data_dir);
+	for (int i = 0; i < 300; i++) {
+		if (controller_get("jc", "").status == 200) return true;
+		if (waitpid(child, NULL, WNOHANG) == child) {
+			child = 0;
+			fprintf(stderr, "loadgen: controller exited, see %s/controller.log\n", data_dir);
+			return false;
+		}
+		sleep_ms(100);
+	}
+	fprintf(stderr, "loadgen: controller does not answer on port %d\n", opt.port);
+	return false;
+}
+
+static void stop_controller() {
+	if (child > 0) {
+		kill(child, SIGTERM);
+		for (int i = 0; i < 50 && waitpid(child, NULL, WNOHANG) != child; i++) sleep_ms(100);
+		kill(child, SIGKILL);
+		waitpid(child, NULL, 0);
+		child = 0;
+	}
+	if (data_dir[0] && !opt.keep) {
+		std::string cmd = strf("rm -rf '%s'", data_dir);
+		if (system(cmd.c_str()) != 0) fprintf(stderr, "loadgen: could not remove %s\n", data_dir);
+	}
+}
+
+// ─── Main ────────────────────────────────────────────────────────────────────
+
+static void usage() {
+	printf("usage: OpenSprinkler-loadgen [options]\n"
+		"  -x <path>   start this controller binary on a fresh data directory\n"
+		"  -H <ip>     controller address when attaching to a running one (%s)\n"
+		"  -p <port>   controller HTTP port (%d); events on port + 1 unless -e\n"
+		"  -e <port>   controller event stream port\n"
+		"  -w <md5>    controller password hash (opendoor)\n"
+		"  -l <ip>     address the controller reaches the stand-ins at (%s)\n"
+		"  -b <port>   first stand-in port (%d): HTTP, MQTT +1, Modbus +10..+17\n"
+		"  -t <s>      seconds under load (%d)\n"
+		"  -r <x>      simulated clock speed-up with -x (%d)\n"
+		"  -c <epoch>  simulated clock start with -x (default: 05:59 UTC today)\n"
+		"  -C <n>      concurrent web clients (%d)\n"
+		"  -s <n>      sensors per synthetic type (%d)\n"
+		"  -P <n>      programs (%d)\n"
+		"  -S <n>      stations (%d)\n"
+		"  -i <s>      sensor read interval in controller seconds (%d)\n"
+		"  -m <min>    program repeat interval in controller minutes (%d)\n"
+		"  -k          keep the data directory\n",
+		opt.host, opt.port, opt.local, opt.base_port, opt.duration, opt.rate,
+		opt.clients, opt.sensors, opt.programs, opt.stations, opt.interval, opt.every);
+}
+
+static void on_signal(int) {
+	running = false;
+}
+
+int main(int argc, char *argv[]) {
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	int c;
+	while ((c = getopt(argc, argv, "x:H:p:e:w:l:b:t:r:c:C:s:P:S:i:m:kh")) != -1) {
+		switch (c) {
+		case 'x': opt.binary = optarg; break;
+		case 'H': opt.host = optarg; break;
+		case 'p': opt.port = atoi(optarg); break;
+		case 'e': opt.event_port = atoi(optarg); break;
+		case 'w': opt.pw = optarg; break;
+		case 'l': opt.local = optarg; break;
+		case 'b': opt.base_port = atoi(optarg); break;
+		case 't': opt.duration = atoi(optarg); break;
+		case 'r': opt.rate = atoi(optarg); break;
+		case 'c': opt.clock_start = strtol(optarg, NULL, 0); break;
+		case 'C': opt.clients = atoi(optarg); break;
+		case 's': opt.sensors = atoi(optarg); break;
+		case 'P': opt.programs = atoi(optarg); break;
+		case 'S': opt.stations = atoi(optarg); break;
+		case 'i': opt.interval = atoi(optarg); break;
+		case 'm': opt.every = atoi(optarg); break;
+		case 'k': opt.keep = true; break;
+		default: usage(); return c == 'h' ? 0 : 2;
+		}
+	}
+	if (opt.stations < 1) opt.stations = 1;
+	if (opt.stations > 200) opt.stations = 200;
+	if (opt.every < 1) opt.every = 1;
+	if (opt.rate < 1) opt.rate = 1;
+	if (opt.rate > 1000) opt.rate = 1000;
+	if (opt.interval < 1) opt.interval = 1;
+	if (!opt.clock_start) {
+		time_t t = time(NULL);
+		opt.clock_start = t - t % 86400 + 6 * 3600 - 60;
+	}
+	// a controller we did not start runs on its own clock
+	sim.rate = opt.binary ? opt.rate : 1;
+
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	metrics_init();
+
+	// stand-ins first, the controller connects to them during setup
+	std::vector<std::thread> threads;
+	int http_fd = tcp_listen(port_http());
+	int mqtt_fd = tcp_listen(port_mqtt());
+	if (http_fd < 0 || mqtt_fd < 0) return 1;
+	threads.emplace_back(http_standin, http_fd);
+	for (int gw = 0; gw < LG_MAX_GATEWAYS && gw * LG_UNITS_PER_GW < 5 * opt.sensors; gw++) {
+		int fd = tcp_listen(port_modbus(gw));
+		if (fd < 0) return 1;
+		threads.emplace_back(modbus_standin, fd, port_modbus(gw));
+	}
+
+	int ret = 1;
+	std::vector<unsigned> mqtt_sensors;
+	unsigned nsensors = 0;
+	if (opt.binary && !start_controller()) goto done;
+	printf("setup: %d sensors per type, %d programs, %d stations\n", opt.sensors, opt.programs, opt.stations);
+	printf("setup: no stand-in for %s\n", skipped_types);
+	if (!configure_services() || !define_programs() || !define_sensors(mqtt_sensors, &nsensors)) goto done;
+	threads.emplace_back(mqtt_standin, mqtt_fd, mqtt_sensors);
+	if (!sync_clock()) fprintf(stderr, "loadgen: no clock sync, station start lag is not measured\n");
+	else printf("clock: controller time %ld, %dx\n", sim.sync_t, sim.rate);
+
+	{
+		threads.emplace_back(event_listener);
+		double t0 = now_ms();
+		// give the event stream a moment, so no early event is missed
+		sleep_ms(500);
+		threads.emplace_back(manual_client);
+		for (int i = 0; i < opt.clients; i++) threads.emplace_back(web_client, i, nsensors);
+		printf("load: %d web clients for %d s\n", opt.clients, opt.duration);
+		while (running && now_ms() - t0 < opt.duration * 1000.0) sleep_ms(200);
+		double seconds = (now_ms() - t0) / 1000.0;
+
+		HttpResult r = controller_get("db", "");
+		if (r.status == 200) {
+			long skip = json_long(r.body.c_str(), "skip", 0);
+			std::lock_guard<std::mutex> g(stat_lock);
+			m_skipped->events = skip > 0 ? skip : 0;
+		}
+		running = false;
+		for (std::thread &t : threads) t.join();
+		threads.clear();
+		printf("\n%u sensors, %d programs, %d stations, %d web clients, clock %dx, %.0f s\n",
+			nsensors, opt.programs, opt.stations, opt.clients, sim.rate, seconds);
+		report(seconds);
+		ret = 0;
+	}
+
+done:
+	running = false;
+	for (std::thread &t : threads) t.join();
+	if (ret && mqtt_fd >= 0 && threads.empty()) close(mqtt_fd);
+	stop_controller();
+	return ret;
+}
@@ -214,6 +214,33 @@ void initialiseEpoch()
 	epochMicro = (uint64_t)tv.tv_sec * (uint64_t)1000000 + (uint64_t)(tv.tv_usec) ;
 }
 
+// Simulated clock for load testing (-c/-r): controller time starts at
+// sim_start and runs sim_rate times faster. millis() and micros() stay real
+// time, they time out network I/O.
+static time_t sim_start = 0;
+static uint16_t sim_rate = 1;
+static uint64_t sim_epoch_ms = 0;
+
+void sim_clock_set(time_t start, uint16_t rate) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	sim_epoch_ms = (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+	sim_start = start ? start : tv.tv_sec;
+	sim_rate = rate ? rate : 1;
+}
+
+time_t sim_clock_now() {
+	if (!sim_epoch_ms) return time(NULL);
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	uint64_t elapsed = (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000 - sim_epoch_ms;
+	return sim_start + (time_t)(elapsed * sim_rate / 1000);
+}
+
+uint16_t sim_clock_rate() {
+	return sim_rate;
+}
+
 // millis: returns milliseconds since epoch init
 #ifndef HAVE_TINY_WEBSOCKETS
 ulong millis (void)
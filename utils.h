@@ -121,6 +121,12 @@ void str2mac(const char *_str, unsigned char mac[]);
 	ulong millis();
 	ulong micros();
 	void initialiseEpoch();
+	/** Run the controller clock from start (UTC), rate times faster than real time (load testing) */
+	void sim_clock_set(time_t start, uint16_t rate);
+	/** Current UTC time, from the simulated clock if one was set */
+	time_t sim_clock_now();
+	/** Speed-up of the simulated clock, 1 without one */
+	uint16_t sim_clock_rate();
 	#if defined(OSPI)
 	unsigned int detect_rpi_rev();
 	char* get_runtime_path();
@@ -0,0 +1,194 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Linux web server thread and main loop command queue
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "web_thread.h"
+
+#if defined(OS_HTTP_THREAD)
+
+#include "OpenSprinkler.h"
+#include "event_loop.h"
+#include "state_snapshot.h"
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+
+extern OTF::OpenThingsFramework *otf;
+
+#define WEB_THREAD_IDLE_MS     20     // otf->loop() interval without connections (cloud link)
+#define WEB_THREAD_BUSY_MS     250    // keep 1 ms passes after a connection arrives
+
+struct WebCall {
+	void (*fn)(void *arg);
+	void *arg;
+	bool done;
+	WebCall *next;
+};
+
+// Writers are preferred so a stream of readers cannot hold off the main loop
+static pthread_rwlock_t state_lock;
+static bool state_held = false;   // main loop holds the state lock exclusively
+
+static pthread_mutex_t call_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t call_done = PTHREAD_COND_INITIALIZER;
+static WebCall *call_head = NULL;
+static WebCall *call_tail = NULL;
+
+static pthread_t web_tid;
+static volatile bool web_run = false;
+static bool web_started = false;
+static OS_THREAD_LOCAL bool on_web_thread = false;
+
+static void *web_thread_main(void *arg) {
+	(void)arg;
+	on_web_thread = true;
+	// start_network() stops this thread before it replaces the server
+	struct pollfd pfd;
+	pfd.fd = event_loop_listen_fd();
+	pfd.events = POLLIN;
+	ulong busy_until = 0;
+	while (web_run) {
+		otf->loop();
+
+		// the server reads the request over several passes
+		ulong now = millis();
+		int timeout = ((long)(busy_until - now) > 0) ? 1 : WEB_THREAD_IDLE_MS;
+		pfd.revents = 0;
+		if (poll(&pfd, pfd.fd >= 0 ? 1 : 0, timeout) > 0) busy_until = millis() + WEB_THREAD_BUSY_MS;
+	}
+	on_web_thread = false;
+	return NULL;
+}
+
+void web_thread_start() {
+	if (web_started || !otf) return;
+	static bool lock_ready = false;
+	if (!lock_ready) {
+		pthread_rwlockattr_t attr;
+		pthread_rwlockattr_init(&attr);
+		pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+		pthread_rwlock_init(&state_lock, &attr);
+		pthread_rwlockattr_destroy(&attr);
+		lock_ready = true;
+	}
+	web_run = true;
+	web_started = true;
+	web_state_acquire();
+	if (pthread_create(&web_tid, NULL, web_thread_main, NULL) != 0) {
+		DEBUG_PRINTLN(F("web thread: create failed, serving from the main loop"));
+		web_run = false;
+		web_started = false;
+		web_state_release();
+		return;
+	}
+	event_loop_watch_listen(false);
+}
+
+void web_thread_stop() {
+	if (!web_started) return;
+	web_run = false;
+	// the thread may be waiting for the state or for a queued call
+	web_state_release();
+	for (;;) {
+		web_thread_process();
+		if (pthread_tryjoin_np(web_tid, NULL) != EBUSY) break;
+		delay(1);
+	}
+	web_started = false;
+	event_loop_watch_listen(true);
+}
+
+bool web_thread_running() {
+	return web_started;
+}
+
+bool web_thread_current() {
+	return on_web_thread;
+}
+
+void web_thread_call_main(void (*fn)(void *arg), void *arg) {
+	if (!on_web_thread) {
+		fn(arg);
+		return;
+	}
+	WebCall call = {fn, arg, false, NULL};
+	pthread_mutex_lock(&call_mutex);
+	if (call_tail) call_tail->next = &call; else call_head = &call;
+	call_tail = &call;
+	pthread_mutex_unlock(&call_mutex);
+	event_loop_wakeup();
+
+	pthread_mutex_lock(&call_mutex);
+	while (!call.done) pthread_cond_wait(&call_done, &call_mutex);
+	pthread_mutex_unlock(&call_mutex);
+}
+
+void web_thread_process() {
+	for (;;) {
+		pthread_mutex_lock(&call_mutex);
+		WebCall *call = call_head;
+		if (call) {
+			call_head = call->next;
+			if (!call_head) call_tail = NULL;
+		}
+		pthread_mutex_unlock(&call_mutex);
+		if (!call) return;
+
+		call->fn(call->arg);
+		state_snapshot_touch();
+
+		pthread_mutex_lock(&call_mutex);
+		call->done = true;
+		pthread_cond_broadcast(&call_done);
+		pthread_mutex_unlock(&call_mutex);
+	}
+}
+
+void web_state_release() {
+	if (!state_held) return;
+	state_held = false;
+	pthread_rwlock_unlock(&state_lock);
+}
+
+void web_state_acquire() {
+	if (state_held || !web_started) return;
+	pthread_rwlock_wrlock(&state_lock);
+	state_held = true;
+}
+
+WebStateReadLock::WebStateReadLock() {
+	pthread_rwlock_rdlock(&state_lock);
+}
+
+WebStateReadLock::~WebStateReadLock() {
+	pthread_rwlock_unlock(&state_lock);
+}
+
+WebStateReadUnlock::WebStateReadUnlock() {
+	pthread_rwlock_unlock(&state_lock);
+}
+
+WebStateReadUnlock::~WebStateReadUnlock() {
+	pthread_rwlock_rdlock(&state_lock);
+}
+
+#endif
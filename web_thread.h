@@ -0,0 +1,91 @@
+/* OpenSprinkler Unified Firmware
+ * Copyright (C) 2015 by Ray Wang (ray@opensprinkler.com)
+ *
+ * Linux web server thread and main loop command queue
+ * 2026 @ OpenSprinklerShop
+ *
+ * This file is part of the OpenSprinkler Firmware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _WEB_THREAD_H
+#define _WEB_THREAD_H
+
+#include "defines.h"
+
+#if defined(OS_HTTP_THREAD)
+
+/**
+ * On Linux the OpenThings server runs on its own thread, so slow clients
+ * and large exports no longer hold up the scheduler. The main loop owns the
+ * controller state: it holds the state lock except while it waits for
+ * work. Read-only endpoints run on the web thread under a shared hold of
+ * that lock, everything else is queued to the main loop and runs there.
+ */
+
+/** Start serving web clients from the web thread (main loop only) */
+void web_thread_start();
+
+/** Stop the web thread, e.g. before otf is replaced (main loop only) */
+void web_thread_stop();
+
+/** True while the web thread serves otf */
+bool web_thread_running();
+
+/** True when called from the web thread */
+bool web_thread_current();
+
+/**
+ * @brief Run fn(arg) on the main loop and wait until it returned.
+ * Runs it right away when called from the main loop or while the web
+ * thread is not running.
+ */
+void web_thread_call_main(void (*fn)(void *arg), void *arg);
+
+/** Main loop: run the queued calls */
+void web_thread_process();
+
+/** Main loop: let read-only requests in while waiting for work */
+void web_state_release();
+
+/** Main loop: take the state back before the next pass */
+void web_state_acquire();
+
+/** Shared hold of the state lock for the span of a read-only request */
+class WebStateReadLock {
+public:
+	WebStateReadLock();
+	~WebStateReadLock();
+};
+
+/** Let go of a WebStateReadLock for a while, e.g. to wait for a slow client */
+class WebStateReadUnlock {
+public:
+	WebStateReadUnlock();
+	~WebStateReadUnlock();
+};
+
+#else
+
+inline bool web_thread_running() { return false; }
+inline bool web_thread_current() { return false; }
+inline void web_thread_process() {}
+inline void web_state_release() {}
+inline void web_state_acquire() {}
+
+#endif
+
+#endif // _WEB_THREAD_H